@@ -375,6 +375,66 @@ typedef struct ssl_ctx_st * (*lsquic_lookup_cert_f)(
 /* 1: Cubic; 2: BBR */
 #define LSQUIC_DF_CC_ALGO 2
 
+/** By default, sharded server mode is off */
+#define LSQUIC_DF_N_SHARDS 0
+
+/** Maximum number of shards: shard ID is encoded in a single byte */
+#define LSQUIC_MAX_SHARDS 256
+
+/** Do not use UDP GSO by default */
+#define LSQUIC_DF_GSO 0
+
+/** Maximum number of datagrams passed in a single GSO buffer */
+#define LSQUIC_MAX_GSO_SEGMENTS 64
+
+/**
+ * Clock used by the engine.  See @ref es_clock.
+ */
+enum lsquic_clock
+{
+    /** Precise monotonic clock: CLOCK_MONOTONIC or platform equivalent */
+    LSQUIC_CLOCK_PRECISE,
+    /**
+     * Coarse monotonic clock: CLOCK_MONOTONIC_COARSE on Linux.  It is
+     * much cheaper to read, but its resolution is only a few milliseconds.
+     * Where this clock is not available, the precise clock is used.
+     */
+    LSQUIC_CLOCK_COARSE,
+};
+
+/** Use precise clock by default */
+#define LSQUIC_DF_CLOCK LSQUIC_CLOCK_PRECISE
+
+/** By default, connections are ticked on the calling thread only */
+#define LSQUIC_DF_TICK_THREADS 0
+
+/** Maximum number of threads used to tick connections */
+#define LSQUIC_MAX_TICK_THREADS 64
+
+/**
+ * By default, the server begins to send Retry packets when this many
+ * connections are in the handshake phase.
+ */
+#define LSQUIC_DF_RETRY_INCHOATE (10 * 1000)
+
+/** By default, the rate of new handshakes does not trigger Retry */
+#define LSQUIC_DF_RETRY_HSK_RATE 0
+
+/** By default, packet buffers are not allocated from the slab arena */
+#define LSQUIC_DF_ARENA 0
+
+/** By default, the slab arena is not bound to a NUMA node */
+#define LSQUIC_DF_ARENA_NUMA_NODE (-1)
+
+/** By default, each engine has its own object pools */
+#define LSQUIC_DF_SHARED_POOLS 0
+
+/** By default, the engine does not limit its memory use */
+#define LSQUIC_DF_MEM_BUDGET 0
+
+/** By default, idle connections do not hibernate */
+#define LSQUIC_DF_HIBERNATE_IDLE 0
+
 struct lsquic_engine_settings {
     /**
      * This is a bit mask wherein each bit corresponds to a value in
@@ -746,6 +806,198 @@ struct lsquic_engine_settings {
      * Default value is @ref LSQUIC_DF_QL_BITS
      */
     int             es_ql_bits;
+
+    /**
+     * Number of shards in sharded server mode.  When several engines
+     * (usually one per core, each with its own SO_REUSEPORT socket) serve
+     * the same address, set this to the number of engines and give each
+     * engine a distinct @ref es_shard_id.  Every Source Connection ID
+     * issued by the engine then carries the shard ID in its first byte,
+     * and @ref lsquic_packet_shard() can be used to steer incoming
+     * datagrams to the engine that owns the connection -- even after
+     * the peer's address changes.
+     *
+     * Only applicable to the IETF QUIC versions in server mode.  Values 0
+     * and 1 turn sharded mode off.  Maximum value is
+     * @ref LSQUIC_MAX_SHARDS.
+     *
+     * Default value is @ref LSQUIC_DF_N_SHARDS.
+     */
+    unsigned        es_n_shards;
+
+    /**
+     * Shard ID of this engine.  Must be smaller than @ref es_n_shards.
+     * Ignored if sharded mode is off.
+     */
+    unsigned        es_shard_id;
+
+    /**
+     * If set to true, the engine passes runs of packets destined to the
+     * same peer in a single @ref lsquic_out_spec for the application to
+     * send using UDP Generic Segmentation Offload (the UDP_SEGMENT socket
+     * option on Linux).  See @ref lsquic_out_spec.gso_size.  Up to
+     * @ref LSQUIC_MAX_GSO_SEGMENTS packets are placed in one such buffer.
+     *
+     * Default value is @ref LSQUIC_DF_GSO.
+     */
+    int             es_gso;
+
+    /**
+     * Clock used to drive timers, see @ref lsquic_clock.  Packet send and
+     * receive timestamps, which are used to calculate RTT, are always taken
+     * using the precise clock.  The engine makes sure that the two clocks
+     * do not go back in time relative to each other.
+     *
+     * This setting is ignored if @ref ea_get_time is specified.
+     *
+     * Default value is @ref LSQUIC_DF_CLOCK.
+     */
+    enum lsquic_clock
+                    es_clock;
+
+    /**
+     * If set to a value larger than one, established connections are
+     * ticked in parallel by this many threads, one of which is the thread
+     * that calls @ref lsquic_engine_process_conns().  The engine creates
+     * the other threads.  Everything else -- processing incoming packets,
+     * sending packets, creating and destroying connections -- is still
+     * done on the calling thread, after all the workers are done.
+     *
+     * When this mode is on, stream and header set callbacks of different
+     * connections may be called concurrently from different threads, as
+     * may @ref ea_get_time, the logger, and the receive buffer callbacks
+     * (@ref ea_rbi).  The callbacks of any one connection are never called
+     * concurrently.
+     *
+     * This mode pays off when a few connections are very busy; when there
+     * are many mostly idle connections, running several engines in sharded
+     * mode (see @ref es_n_shards) scales better.
+     *
+     * The maximum value is @ref LSQUIC_MAX_TICK_THREADS.  Threaded mode is
+     * not available on Windows.
+     *
+     * Default value is @ref LSQUIC_DF_TICK_THREADS.
+     */
+    unsigned        es_tick_threads;
+
+    /**
+     * When the number of IETF QUIC connections in the handshake phase
+     * reaches this value, the server stops creating connections for
+     * Initial packets that do not carry a valid token.  Instead, it
+     * replies with a Retry packet.  No state is kept for the Retry: a
+     * connection is created when the client comes back with the token,
+     * which proves that the client owns its address.
+     *
+     * Setting this value to zero turns off this check.
+     *
+     * This is only applicable in server mode.
+     *
+     * Default value is @ref LSQUIC_DF_RETRY_INCHOATE.
+     */
+    unsigned        es_retry_inchoate;
+
+    /**
+     * Like @ref es_retry_inchoate, but the threshold is the number of
+     * handshakes started during the last second.
+     *
+     * Setting this value to zero turns off this check.
+     *
+     * This is only applicable in server mode.
+     *
+     * Default value is @ref LSQUIC_DF_RETRY_HSK_RATE.
+     */
+    unsigned        es_retry_hsk_rate;
+
+    /**
+     * If set to true, buffers for incoming and outgoing packets are
+     * carved out of 2 MB slabs instead of being allocated one by one.
+     * The slabs are backed by huge pages: explicit huge pages if some are
+     * reserved, transparent huge pages otherwise.  This reduces TLB
+     * misses when many packets are in flight.  Slab memory is reused, but
+     * it is not returned to the system until the engine is destroyed.
+     *
+     * If @ref ea_pmi is not specified, buffers for encrypted packets are
+     * allocated from the same slabs.  An application that provides its
+     * own @ref ea_pmi can get these buffers from the slabs by calling
+     * @ref lsquic_engine_arena_alloc() and @ref lsquic_engine_arena_free().
+     *
+     * Default value is @ref LSQUIC_DF_ARENA.
+     */
+    int             es_arena;
+
+    /**
+     * If not negative, memory for the slab arena (see @ref es_arena) is
+     * bound to this NUMA node.  The maximum value is 63.  Binding is only
+     * supported on Linux; elsewhere, this setting is ignored.
+     *
+     * Default value is @ref LSQUIC_DF_ARENA_NUMA_NODE.
+     */
+    int             es_arena_numa_node;
+
+    /**
+     * If set to true, the engine allocates frames, packet and other small
+     * objects from pools shared by all engines in the process that have
+     * this setting on.  Each thread keeps a small cache of free objects,
+     * so that engines running on different threads -- and connections
+     * ticked on several threads, see @ref es_tick_threads -- do not
+     * contend for a lock on every allocation.
+     *
+     * This mode is not available on Windows.
+     *
+     * Default value is @ref LSQUIC_DF_SHARED_POOLS.
+     */
+    int             es_shared_pools;
+
+    /**
+     * Approximate number of bytes of memory the engine may use.  The
+     * engine counts packet buffers and pages that are in use (memory
+     * cached in the free pools is not counted) and incoming stream data
+     * that has not yet been read by the user.  When usage reaches seven
+     * eighths of the budget, the engine applies backpressure:
+     *
+     *  - flow control windows stop growing and, as data is read, are
+     *    shrunk back toward their initial sizes;
+     *  - MAX_DATA, MAX_STREAM_DATA, and WINDOW_UPDATE frames are held
+     *    back while the connection or stream still has unread data;
+     *  - IETF QUIC peers are not allowed to open more streams.
+     *
+     * Normal operation resumes once usage falls below the threshold.
+     * The budget is a soft limit: the peer may still send data it has
+     * already been credited for.
+     *
+     * If set to zero, the budget is not enforced.  Otherwise, it may not
+     * be smaller than @ref es_max_cfcw.
+     *
+     * Default value is @ref LSQUIC_DF_MEM_BUDGET.
+     */
+    size_t          es_mem_budget;
+
+    /**
+     * Number of seconds without incoming packets after which an idle
+     * connection hibernates.  A hibernated connection is reduced to a
+     * compact serialized record that keeps its keys, CIDs, and flow
+     * control state.  The full connection is recreated when the next
+     * packet for it arrives.
+     *
+     * Only connections that could be exported using
+     * @ref lsquic_conn_export() hibernate: the handshake is complete,
+     * there are no open streams, and all sent data has been acknowledged.
+     * HTTP/3 connections always have the control and QPACK streams open,
+     * so hibernation is available to servers in non-HTTP mode only.
+     * Setting this in HTTP mode is an error.
+     *
+     * To the user, hibernation looks like the connection closing and a
+     * new connection being created when it wakes up: on_conn_closed is
+     * called when the connection hibernates and on_new_conn is called
+     * when it wakes up.  The peer does not notice anything.  A connection
+     * that is not woken up within its idle timeout is discarded.
+     *
+     * If set to zero, connections do not hibernate.  Otherwise, the value
+     * must be smaller than @ref es_idle_timeout.
+     *
+     * Default value is @ref LSQUIC_DF_HIBERNATE_IDLE.
+     */
+    unsigned        es_hibernate_idle;
 };
 
 /* Initialize `settings' to default values */
@@ -782,6 +1034,12 @@ struct lsquic_out_spec
     const struct sockaddr *dest_sa;
     void                  *peer_ctx;
     int                    ecn; /* Valid values are 0 - 3.  See RFC 3168 */
+    /**
+     * If non-zero, `iov' contains several UDP datagrams back to back.
+     * Each of them is `gso_size' bytes long, except for the last one,
+     * which may be shorter.  This is only used if @ref es_gso is set.
+     */
+    unsigned               gso_size;
 };
 
 /**
@@ -866,6 +1124,26 @@ struct lsquic_packout_mem_if
                                                                 char is_ipv6);
 };
 
+/**
+ * Optional interface for zero-copy receive.  When it is specified, the
+ * application may pass refcounted receive buffers to
+ * @ref lsquic_engine_packets_in() by setting @ref lsquic_in_spec.buf_ctx.
+ * Instead of copying packet data that needs to outlive the call, the
+ * library takes a reference to the buffer.  The library also decrypts
+ * such packets in place, so the buffer must be writeable.
+ */
+struct lsquic_recv_buf_if
+{
+    /**
+     * Take a reference to receive buffer `buf_ctx'.
+     */
+    void    (*rbi_incref)  (void *rbi_ctx, void *buf_ctx);
+    /**
+     * Release reference to the receive buffer taken by rbi_incref().
+     */
+    void    (*rbi_release) (void *rbi_ctx, void *buf_ctx);
+};
+
 typedef void (*lsquic_cids_update_f)(void *ctx, void **peer_ctx,
                                 const lsquic_cid_t *cids, unsigned n_cids);
 
@@ -984,6 +1262,12 @@ typedef struct lsquic_engine_api
      */
     const struct lsquic_packout_mem_if  *ea_pmi;
     void                                *ea_pmi_ctx;
+    /**
+     * Receive buffer interface is optional.  See
+     * @ref lsquic_recv_buf_if.
+     */
+    const struct lsquic_recv_buf_if     *ea_rbi;
+    void                                *ea_rbi_ctx;
     /**
      * Optional interface to report new and old source connection IDs.
      */
@@ -1026,6 +1310,18 @@ typedef struct lsquic_engine_api
      */
     const struct lsquic_keylog_if       *ea_keylog_if;
     void                                *ea_keylog_ctx;
+
+    /**
+     * Optional clock.  If set, the engine calls this function instead of
+     * reading the system clock.  It must return monotonically increasing
+     * time in microseconds.  This is useful when the application already
+     * has the current time at hand, for example, in its event loop.
+     *
+     * This clock is used for all purposes, including packet timestamps,
+     * so its precision should be adequate for RTT measurement.
+     */
+    uint64_t                           (*ea_get_time)(void *get_time_ctx);
+    void                                *ea_get_time_ctx;
 } lsquic_engine_api_t;
 
 /**
@@ -1077,6 +1373,52 @@ lsquic_engine_packet_in (lsquic_engine_t *,
         const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
         void *peer_ctx, int ecn);
 
+/**
+ * Incoming UDP datagram passed to @ref lsquic_engine_packets_in().
+ */
+struct lsquic_in_spec
+{
+    const unsigned char   *buf;
+    size_t                 bufsz;
+    const struct sockaddr *local_sa;
+    const struct sockaddr *peer_sa;
+    void                  *peer_ctx;
+    int                    ecn; /* Valid values are 0 - 3.  See RFC 3168 */
+    /**
+     * If non-zero, `buf' contains several UDP datagrams received using
+     * Generic Receive Offload (the UDP_GRO socket option on Linux).  Each
+     * of them is `gro_size' bytes long, except for the last one, which
+     * may be shorter.  The buffer is split without copying.
+     */
+    unsigned               gro_size;
+    /**
+     * Optional receive buffer context.  If set and @ref ea_rbi is
+     * specified, `buf' is a writeable refcounted buffer.  See
+     * @ref lsquic_recv_buf_if.
+     */
+    void                  *buf_ctx;
+};
+
+/**
+ * Pass several incoming packets to the QUIC engine at once.  This is
+ * equivalent to calling @ref lsquic_engine_packet_in() for each element
+ * of `specs', but is cheaper: all packets are timestamped once and
+ * packets destined to the same connection are processed together, even
+ * if they use different destination connection IDs.  Packets belonging
+ * to the same connection are processed in the order in which they appear
+ * in `specs'; packets of different connections may be reordered.
+ *
+ * Invalid packets are dropped.
+ *
+ * Returns number of elements of `specs' consumed.  This number is smaller
+ * than `n_specs' only if the engine ran out of memory; the remaining
+ * packets have not been looked at.  (If this happens in the middle of a
+ * GRO buffer, the rest of that buffer is dropped.)
+ */
+int
+lsquic_engine_packets_in (lsquic_engine_t *,
+                const struct lsquic_in_spec *specs, unsigned n_specs);
+
 /**
  * Process tickable connections.  This function must be called often enough so
  * that packets and connections do not expire.
@@ -1084,6 +1426,27 @@ lsquic_engine_packet_in (lsquic_engine_t *,
 void
 lsquic_engine_process_conns (lsquic_engine_t *engine);
 
+/**
+ * Process tickable connections, but do only a bounded amount of work.  This
+ * is useful when the engine shares an event loop with other work that
+ * should not wait for all connections to be processed.
+ *
+ * Processing stops after `max_conns' connections have been ticked or after
+ * `max_usec' microseconds have elapsed, whichever comes first.  A zero
+ * value means no limit.  At least one connection is always ticked.
+ *
+ * Connections that were not reached remain tickable and are processed first
+ * by the next call, so that all connections make progress.
+ *
+ * Returns number of connections that remain tickable.  If it is not zero,
+ * the caller should call this function (or @ref lsquic_engine_process_conns())
+ * again soon.  @ref lsquic_engine_earliest_adv_tick() reports zero delay in
+ * this case.
+ */
+unsigned
+lsquic_engine_process_conns_budget (lsquic_engine_t *engine,
+                                    unsigned max_conns, unsigned max_usec);
+
 /**
  * Returns true if engine has some unsent packets.  This happens if
  * @ref ea_packets_out() could not send everything out.
@@ -1141,6 +1504,44 @@ lsquic_conn_going_away (lsquic_conn_t *);
 void
 lsquic_conn_close (lsquic_conn_t *);
 
+/**
+ * Serialize connection so that it can be continued by another engine,
+ * possibly in another process, using @ref lsquic_engine_import_conn().
+ *
+ * Only server IETF QUIC connections in non-HTTP mode can be exported.  The
+ * connection must be idle: the handshake is complete, there are no open
+ * streams, and all sent data has been acknowledged.  The two engines must
+ * use the same version of the library.
+ *
+ * Works like snprintf(3): the return value is the number of bytes required
+ * to hold the serialized connection.  If it is larger than `bufsz', or if
+ * `buf' is NULL, nothing is exported and the connection is not affected.
+ *
+ * On success, the connection is closed silently: no CONNECTION_CLOSE frame
+ * is sent.  on_conn_closed is called as usual.  The connection's CIDs are
+ * not reported to ea_old_scids: they now belong to the importing engine.
+ * Packets for the connection that still arrive at this engine are dropped
+ * without sending a stateless reset.
+ *
+ * This function must not be called from a callback.
+ *
+ * Returns -1 on error and sets errno to ENOTSUP if the connection can
+ * never be exported and to EAGAIN if it cannot be exported now.
+ */
+ssize_t
+lsquic_conn_export (lsquic_conn_t *, void *buf, size_t bufsz);
+
+/**
+ * Create connection from state serialized by @ref lsquic_conn_export().
+ * The engine must be a server engine.  on_new_conn is called and the
+ * connection's CIDs are reported to ea_new_scids.
+ *
+ * Returns NULL on error.
+ */
+lsquic_conn_t *
+lsquic_engine_import_conn (lsquic_engine_t *, const void *buf, size_t bufsz,
+                                                            void *peer_ctx);
+
 int lsquic_stream_wantread(lsquic_stream_t *s, int is_want);
 ssize_t lsquic_stream_read(lsquic_stream_t *s, void *buf, size_t len);
 ssize_t lsquic_stream_readv(lsquic_stream_t *s, const struct iovec *,
@@ -1204,6 +1605,30 @@ struct lsquic_reader
 ssize_t
 lsquic_stream_writef (lsquic_stream_t *, struct lsquic_reader *);
 
+/**
+ * Write data by reference.  Unlike @ref lsquic_stream_writev(), the data
+ * is not copied into the stream's buffer: it is copied directly into
+ * packets as the stream is packetized.  All of the data is accepted
+ * regardless of flow control.  Data written to the stream afterwards is
+ * sent after it.
+ *
+ * The memory pointed to by `vec' must remain valid and unchanged until
+ * `release' is called with `release_ctx' as the argument.  (The iovec
+ * array itself may be discarded when this function returns.)  The
+ * library calls `release' once it no longer needs the data: when all of
+ * it has been packetized or when the stream is reset or destroyed.  Lost
+ * packets are retransmitted from the library's own buffers, so the data
+ * may be released before it is acknowledged.  `release' is called exactly
+ * once, even if this function fails, and may be called before this
+ * function returns.  It must not call into the library.
+ *
+ * @retval Number of bytes written or -1 on error.
+ */
+ssize_t
+lsquic_stream_write_ref (lsquic_stream_t *, const struct iovec *vec,
+                int count, void (*release)(void *release_ctx),
+                void *release_ctx);
+
 /**
  * Flush any buffered data.  This triggers packetizing even a single byte
  * into a separate frame.  Flushing a closed stream is an error.
@@ -1596,6 +2021,19 @@ lsquic_is_valid_hs_packet (lsquic_engine_t *, const unsigned char *, size_t);
 int
 lsquic_cid_from_packet (const unsigned char *, size_t bufsz, lsquic_cid_t *cid);
 
+/**
+ * Return ID of the shard that should process this packet when server runs
+ * in sharded mode (see @ref es_n_shards).  The shard is derived from the
+ * packet's Destination Connection ID: server-issued CIDs map to the shard
+ * that issued them, while client-chosen CIDs (such as that in the Initial
+ * packet) map to the same shard every time.
+ *
+ * Returns -1 if connection ID cannot be extracted from the packet or if
+ * `n_shards' is invalid.
+ */
+int
+lsquic_packet_shard (const unsigned char *, size_t bufsz, unsigned n_shards);
+
 /**
  * Returns true if there are connections to be processed, false otherwise.
  * If true, `diff' is set to the difference between the earliest advisory
@@ -1612,6 +2050,75 @@ lsquic_engine_earliest_adv_tick (lsquic_engine_t *engine, int *diff);
 unsigned
 lsquic_engine_count_attq (lsquic_engine_t *engine, int from_now);
 
+/**
+ * Engine memory use by category.  All values are in bytes and are
+ * approximate.  See @ref lsquic_engine_mem_stats().
+ */
+struct lsquic_mem_stats
+{
+    /** Incoming packets and data buffered by streams until read */
+    size_t      ms_packets_in;
+    /** Outgoing packets: scheduled, unacknowledged, and lost */
+    size_t      ms_packets_out;
+    /**
+     * Memory held by the engine's object pools and free buffers.  Pools
+     * shared by several engines (see @ref es_shared_pools) are not
+     * counted.
+     */
+    size_t      ms_pools;
+    /** Connection objects, including crypto state and hash tables */
+    size_t      ms_conns;
+    /** Stream objects and data written to streams but not yet packetized */
+    size_t      ms_streams;
+    /** HPACK and QPACK dynamic tables */
+    size_t      ms_hdr_tables;
+    /** Sum of the above */
+    size_t      ms_total;
+    /** Number of connections whose memory was counted */
+    unsigned    ms_n_conns;
+};
+
+/** Memory used by a single connection */
+struct lsquic_conn_mem
+{
+    lsquic_conn_t      *cm_conn;
+    size_t              cm_bytes;
+};
+
+/**
+ * Report memory used by the engine.  If `top' is not NULL, up to `n_top'
+ * connections using the most memory are placed there, largest first.
+ * The connection pointers are valid until the next call into the engine.
+ *
+ * This function walks all connections and their streams and packet
+ * queues.  It is meant to be called periodically -- say, once a second
+ * -- and not on every packet.
+ *
+ * Returns the number of elements placed into `top'.
+ */
+unsigned
+lsquic_engine_mem_stats (lsquic_engine_t *, struct lsquic_mem_stats *,
+                         struct lsquic_conn_mem *top, unsigned n_top);
+
+/**
+ * Allocate a buffer of at least `sz' bytes from the engine's slab arena
+ * (see @ref es_arena).  This is meant to be called from the application's
+ * @ref lsquic_packout_mem_if, so that buffers for encrypted packets come
+ * from the same memory as the engine's own packet buffers.  The buffer
+ * is counted as engine memory until it is freed.
+ *
+ * Returns NULL if the engine does not use the arena or if `sz' is larger
+ * than 64 KB.
+ */
+void *
+lsquic_engine_arena_alloc (lsquic_engine_t *, size_t sz);
+
+/**
+ * Free buffer returned by @ref lsquic_engine_arena_alloc().
+ */
+void
+lsquic_engine_arena_free (lsquic_engine_t *, void *buf);
+
 enum LSQUIC_CONN_STATUS
 {
     LSCONN_ST_HSK_IN_PROGRESS,
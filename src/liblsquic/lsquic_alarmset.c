@@ -48,6 +48,7 @@ const char *const lsquic_alid2str[] =
     [AL_PATH_CHAL_0] = "PATH_CHAL_0",
     [AL_PATH_CHAL_1] = "PATH_CHAL_1",
     [AL_SESS_TICKET] = "SESS_TICKET",
+    [AL_HIBERNATE]  =  "HIBERNATE",
 };
 
 
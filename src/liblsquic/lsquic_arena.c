@@ -0,0 +1,304 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_arena.c -- Slab arena for packet buffers
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifdef WIN32
+#include <malloc.h>
+#include <vc_compat.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "lsquic_arena.h"
+
+/* Chosen to fit packet buffers of commonly used MTUs and the 4 KB and
+ * 16 KB pages handed out by lsquic_mm.
+ */
+static const unsigned arena_sizes[] = {
+    1280, 1536, 2048, 4096, 8192, 16384, 32768, ARENA_MAX_SIZE,
+};
+
+#define ARENA_N_CLASSES (sizeof(arena_sizes) / sizeof(arena_sizes[0]))
+
+/* Buffers in a slab begin after the header */
+#define ARENA_HDR_SZ 64
+
+#define SLAB_OF(buf) ((struct arena_slab *) \
+                        ((uintptr_t) (buf) & ~(uintptr_t) (ARENA_SLAB_SZ - 1)))
+
+struct arena_slab
+{
+    struct arena_slab  *as_next;
+    unsigned            as_class;
+    unsigned            as_flags;
+#define ASF_HUGE    (1 << 0)    /* Explicit huge page */
+};
+
+struct arena_buf
+{
+    SLIST_ENTRY(arena_buf)  next_ab;
+};
+
+struct arena_class
+{
+    SLIST_HEAD(, arena_buf) ac_free;
+    char                   *ac_bump,    /* Next never-used buffer */
+                           *ac_end;
+};
+
+struct arena
+{
+    struct arena_class      ar_classes[ARENA_N_CLASSES];
+    struct arena_slab      *ar_slabs;
+    int                     ar_numa_node;
+    enum {
+        AR_NO_HUGETLB   = 1 << 0,   /* Explicit huge pages are not available */
+    }                       ar_flags;
+    struct arena_stats      ar_stats;
+};
+
+
+static unsigned
+arena_class (size_t size)
+{
+    unsigned idx;
+
+    for (idx = 0; idx < ARENA_N_CLASSES; ++idx)
+        if (size <= arena_sizes[idx])
+            break;
+    return idx;
+}
+
+
+struct arena *
+lsquic_arena_new (int numa_node)
+{
+    struct arena *arena;
+    unsigned idx;
+
+    if (numa_node > ARENA_MAX_NODE)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    arena = calloc(1, sizeof(*arena));
+    if (!arena)
+        return NULL;
+
+    for (idx = 0; idx < ARENA_N_CLASSES; ++idx)
+        SLIST_INIT(&arena->ar_classes[idx].ac_free);
+    arena->ar_numa_node = numa_node;
+    return arena;
+}
+
+
+#if defined(__linux__) && defined(SYS_mbind)
+#define ARENA_MPOL_BIND 2   /* MPOL_BIND from <linux/mempolicy.h> */
+#define ARENA_LONG_BITS (sizeof(unsigned long) * 8)
+
+/* Must be called before the slab is touched */
+static int
+arena_bind (void *slab, int node)
+{
+    unsigned long mask[(ARENA_MAX_NODE + ARENA_LONG_BITS) / ARENA_LONG_BITS];
+
+    memset(mask, 0, sizeof(mask));
+    mask[node / ARENA_LONG_BITS] |= 1ul << (node % ARENA_LONG_BITS);
+    /* The kernel reads one bit fewer than `maxnode', hence the + 1 */
+    return 0 == syscall(SYS_mbind, slab, (unsigned long) ARENA_SLAB_SZ,
+                ARENA_MPOL_BIND, mask, sizeof(mask) * 8 + 1, 0) ? 0 : -1;
+}
+#else
+static int
+arena_bind (void *slab, int node)
+{
+    (void) slab; (void) node;
+    return -1;
+}
+#endif
+
+
+#ifndef WIN32
+/* Map a regular slab aligned on its size */
+static void *
+arena_map_aligned (void)
+{
+    char *p, *slab;
+
+    p = mmap(NULL, ARENA_SLAB_SZ * 2, PROT_READ|PROT_WRITE,
+                                            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    slab = (char *) (((uintptr_t) p + ARENA_SLAB_SZ - 1)
+                                        & ~(uintptr_t) (ARENA_SLAB_SZ - 1));
+    if (slab > p)
+        (void) munmap(p, slab - p);
+    if (slab + ARENA_SLAB_SZ < p + ARENA_SLAB_SZ * 2)
+        (void) munmap(slab + ARENA_SLAB_SZ,
+                                p + ARENA_SLAB_SZ * 2 - slab - ARENA_SLAB_SZ);
+#ifdef MADV_HUGEPAGE
+    (void) madvise(slab, ARENA_SLAB_SZ, MADV_HUGEPAGE);
+#endif
+    return slab;
+}
+#endif
+
+
+static struct arena_slab *
+arena_map_slab (struct arena *arena, unsigned *flags)
+{
+#ifdef WIN32
+    *flags = 0;
+    return _aligned_malloc(ARENA_SLAB_SZ, ARENA_SLAB_SZ);
+#else
+    void *p;
+
+#ifdef MAP_HUGETLB
+    if (!(arena->ar_flags & AR_NO_HUGETLB))
+    {
+        p = mmap(NULL, ARENA_SLAB_SZ, PROT_READ|PROT_WRITE,
+                            MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED && 0 == ((uintptr_t) p & (ARENA_SLAB_SZ - 1)))
+        {
+            *flags = ASF_HUGE;
+            return p;
+        }
+        /* No huge pages are reserved, the reserve is exhausted, or the
+         * default huge page size is not 2 MB.  Do not try again.
+         */
+        if (p != MAP_FAILED)
+            (void) munmap(p, ARENA_SLAB_SZ);
+        arena->ar_flags |= AR_NO_HUGETLB;
+    }
+#endif
+
+    *flags = 0;
+    return arena_map_aligned();
+#endif
+}
+
+
+static void
+arena_unmap_slab (struct arena_slab *slab)
+{
+#ifdef WIN32
+    _aligned_free(slab);
+#else
+    (void) munmap(slab, ARENA_SLAB_SZ);
+#endif
+}
+
+
+static int
+arena_add_slab (struct arena *arena, unsigned idx)
+{
+    struct arena_class *const cls = &arena->ar_classes[idx];
+    struct arena_slab *slab;
+    unsigned flags;
+
+    slab = arena_map_slab(arena, &flags);
+    if (!slab)
+        return -1;
+
+    if (arena->ar_numa_node >= 0
+                        && 0 != arena_bind(slab, arena->ar_numa_node))
+        ++arena->ar_stats.as_bind_fail;
+
+    slab->as_class = idx;
+    slab->as_flags = flags;
+    slab->as_next = arena->ar_slabs;
+    arena->ar_slabs = slab;
+    ++arena->ar_stats.as_slabs;
+    if (flags & ASF_HUGE)
+        ++arena->ar_stats.as_huge_slabs;
+
+    cls->ac_bump = (char *) slab + ARENA_HDR_SZ;
+    cls->ac_end  = (char *) slab + ARENA_SLAB_SZ;
+    return 0;
+}
+
+
+void *
+lsquic_arena_alloc (struct arena *arena, size_t size)
+{
+    struct arena_class *cls;
+    struct arena_buf *buf;
+    unsigned idx;
+
+    idx = arena_class(size);
+    if (idx >= ARENA_N_CLASSES)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    cls = &arena->ar_classes[idx];
+    buf = SLIST_FIRST(&cls->ac_free);
+    if (buf)
+        SLIST_REMOVE_HEAD(&cls->ac_free, next_ab);
+    else
+    {
+        if ((size_t) (cls->ac_end - cls->ac_bump) < arena_sizes[idx]
+                                        && 0 != arena_add_slab(arena, idx))
+            return NULL;
+        buf = (struct arena_buf *) cls->ac_bump;
+        cls->ac_bump += arena_sizes[idx];
+    }
+
+    arena->ar_stats.as_bytes_out += arena_sizes[idx];
+    return buf;
+}
+
+
+void
+lsquic_arena_free (struct arena *arena, void *mem)
+{
+    struct arena_buf *const buf = mem;
+    unsigned idx;
+
+    idx = SLAB_OF(buf)->as_class;
+    assert(idx < ARENA_N_CLASSES);
+    SLIST_INSERT_HEAD(&arena->ar_classes[idx].ac_free, buf, next_ab);
+    arena->ar_stats.as_bytes_out -= arena_sizes[idx];
+}
+
+
+size_t
+lsquic_arena_size (const void *mem)
+{
+    return arena_sizes[SLAB_OF(mem)->as_class];
+}
+
+
+void
+lsquic_arena_destroy (struct arena *arena)
+{
+    struct arena_slab *slab, *next;
+
+    for (slab = arena->ar_slabs; slab; slab = next)
+    {
+        next = slab->as_next;
+        arena_unmap_slab(slab);
+    }
+    free(arena);
+}
+
+
+void
+lsquic_arena_get_stats (const struct arena *arena, struct arena_stats *stats)
+{
+    *stats = arena->ar_stats;
+}
@@ -0,0 +1,62 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_arena.h -- Slab arena for packet buffers
+ *
+ * The arena hands out buffers of up to ARENA_MAX_SIZE bytes.  Requested
+ * sizes are rounded up to one of a few size classes.  Memory comes from
+ * slabs of ARENA_SLAB_SZ bytes.  The arena first tries to map each slab
+ * as an explicit huge page; if that fails, it maps a regular slab and
+ * asks the kernel to back it with a transparent huge page.  Packet buffers
+ * are thus packed into few TLB entries.
+ *
+ * Each slab holds buffers of one size class.  Slabs are aligned on their
+ * size and begin with a small header, so that a buffer can be freed
+ * without knowing its size.  Free buffers are kept on per-class lists;
+ * slabs are not returned to the system until the arena is destroyed.
+ *
+ * The arena does no locking of its own.
+ */
+
+#ifndef LSQUIC_ARENA_H
+#define LSQUIC_ARENA_H 1
+
+#define ARENA_SLAB_SZ   (2u * 1024 * 1024)
+#define ARENA_MAX_SIZE  0x10000u
+
+/* Largest NUMA node the arena can be bound to */
+#define ARENA_MAX_NODE  63
+
+struct arena;
+
+struct arena_stats
+{
+    unsigned    as_slabs;       /* Number of slabs */
+    unsigned    as_huge_slabs;  /* Of them, mapped as explicit huge pages */
+    unsigned    as_bind_fail;   /* Slabs that could not be bound to node */
+    size_t      as_bytes_out;   /* Size of buffers in use, incl. rounding */
+};
+
+/* If `numa_node' is not negative, slabs are bound to that node. */
+struct arena *
+lsquic_arena_new (int numa_node);
+
+void
+lsquic_arena_destroy (struct arena *);
+
+/* Returns NULL if `size' is larger than ARENA_MAX_SIZE or if a new slab
+ * cannot be mapped.
+ */
+void *
+lsquic_arena_alloc (struct arena *, size_t size);
+
+void
+lsquic_arena_free (struct arena *, void *);
+
+/* Usable size of the buffer, which is at least the size requested */
+size_t
+lsquic_arena_size (const void *);
+
+void
+lsquic_arena_get_stats (const struct arena *, struct arena_stats *);
+
+#endif
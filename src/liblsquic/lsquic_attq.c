@@ -2,13 +2,21 @@
 /*
  * lsquic_attq.c -- Advisory Tick Time Queue
  *
- * This is a collection of connections kept in a binary heap, the top
- * element having the minimum advsory time.  To speed up removal, each
- * element has an index it has in the heap array.  The index is updated
- * as elements are moved around in the array when heap is updated.
+ * There are two implementations, selected at compile time using
+ * LSQUIC_ATTQ_WHEEL (see lsquic_attq.h):
+ *
+ * 1. Hierarchical timer wheel.  Adding and removing a connection is O(1),
+ *    which matters when the server holds a lot of mostly idle connections.
+ *    See comment above struct attq below.
+ *
+ * 2. Binary heap, the top element having the minimum advsory time.  To
+ *    speed up removal, each element has an index it has in the heap array.
+ *    The index is updated as elements are moved around in the array when
+ *    heap is updated.
  */
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #ifdef WIN32
 #include <vc_compat.h>
@@ -26,6 +34,389 @@
 #include "lsquic_conn.h"
 
 
+#if LSQUIC_ATTQ_WHEEL
+
+/* The wheel has AW_N_LEVELS levels of AW_N_SLOTS slots each.  A slot at
+ * level L covers 2^(L * AW_SLOT_BITS) microseconds; level 0 has microsecond
+ * resolution and the top level covers the whole range of lsquic_time_t.
+ *
+ * The wheel keeps current time, aq_now, that is never larger than the time
+ * of any element in it.  An element is placed at the level corresponding to
+ * the highest AW_SLOT_BITS-bit group in which its time differs from aq_now,
+ * in the slot given by that group.  Elements whose advisory time is in the
+ * past are placed as if their time were aq_now.  Thus, all elements in a
+ * slot at level 0 have the same time (except the past-due ones, which come
+ * first) and each level holds elements that are later than those at the
+ * levels below it.
+ *
+ * When aq_now is advanced, the elements in the slot aq_now enters are
+ * cascaded down to lower levels.  Each element cascades at most
+ * AW_N_LEVELS - 1 times.
+ */
+
+#define AW_SLOT_BITS 6
+#define AW_N_SLOTS (1U << AW_SLOT_BITS)
+#define AW_SLOT_MASK (AW_N_SLOTS - 1)
+#define AW_N_LEVELS ((64 + AW_SLOT_BITS - 1) / AW_SLOT_BITS)
+
+TAILQ_HEAD(attq_slot, attq_elem);
+
+struct attq
+{
+    struct malo        *aq_elem_malo;
+    lsquic_time_t       aq_now;
+    unsigned            aq_nelem;
+    uint64_t            aq_occupied[AW_N_LEVELS];   /* Non-empty slots */
+    unsigned            aq_counts[AW_N_LEVELS][AW_N_SLOTS];
+    struct attq_slot    aq_slots[AW_N_LEVELS][AW_N_SLOTS];
+};
+
+
+#if __GNUC__
+#   define aw_ctz __builtin_ctzll
+#   define aw_msb(x) (63 - __builtin_clzll(x))
+#else
+static unsigned
+aw_ctz (uint64_t x)
+{
+    unsigned n = 0;
+    if (0 == (x & ((1ULL << 32) - 1))) { n += 32; x >>= 32; }
+    if (0 == (x & ((1ULL << 16) - 1))) { n += 16; x >>= 16; }
+    if (0 == (x & ((1ULL <<  8) - 1))) { n +=  8; x >>=  8; }
+    if (0 == (x & ((1ULL <<  4) - 1))) { n +=  4; x >>=  4; }
+    if (0 == (x & ((1ULL <<  2) - 1))) { n +=  2; x >>=  2; }
+    if (0 == (x & ((1ULL <<  1) - 1))) { n +=  1; x >>=  1; }
+    return n;
+}
+
+
+static unsigned
+aw_msb (uint64_t x)
+{
+    unsigned n = 0;
+    if (x >> 32) { n += 32; x >>= 32; }
+    if (x >> 16) { n += 16; x >>= 16; }
+    if (x >>  8) { n +=  8; x >>=  8; }
+    if (x >>  4) { n +=  4; x >>=  4; }
+    if (x >>  2) { n +=  2; x >>=  2; }
+    if (x >>  1) { n +=  1; }
+    return n;
+}
+#endif
+
+
+struct attq *
+attq_create (void)
+{
+    struct attq *q;
+    struct malo *malo;
+    unsigned level, slot;
+
+    malo = lsquic_malo_create(sizeof(struct attq_elem));
+    if (!malo)
+        return NULL;
+
+    q = calloc(1, sizeof(*q));
+    if (!q)
+    {
+        lsquic_malo_destroy(malo);
+        return NULL;
+    }
+
+    for (level = 0; level < AW_N_LEVELS; ++level)
+        for (slot = 0; slot < AW_N_SLOTS; ++slot)
+            TAILQ_INIT(&q->aq_slots[level][slot]);
+    q->aq_elem_malo = malo;
+    return q;
+}
+
+
+void
+attq_destroy (struct attq *q)
+{
+    lsquic_malo_destroy(q->aq_elem_malo);
+    free(q);
+}
+
+
+/* Time of the first microsecond covered by `slot' at `level' */
+static lsquic_time_t
+aw_slot_time (const struct attq *q, unsigned level, unsigned slot)
+{
+    const unsigned shift = (level + 1) * AW_SLOT_BITS;
+    lsquic_time_t high;
+
+    if (shift < 64)
+        high = q->aq_now >> shift << shift;
+    else
+        high = 0;
+    return high | ((lsquic_time_t) slot << (level * AW_SLOT_BITS));
+}
+
+
+static void
+aw_place (struct attq *q, struct attq_elem *el)
+{
+    struct attq_elem *prev;
+    struct attq_slot *head;
+    lsquic_time_t t, diff;
+    unsigned level, slot;
+
+    t = el->ae_adv_time > q->aq_now ? el->ae_adv_time : q->aq_now;
+    diff = t ^ q->aq_now;
+    if (diff)
+        level = aw_msb(diff) / AW_SLOT_BITS;
+    else
+        level = 0;
+    slot = (t >> (level * AW_SLOT_BITS)) & AW_SLOT_MASK;
+    head = &q->aq_slots[level][slot];
+
+    /* Level-0 slots are kept sorted.  Only past-due elements may have
+     * different times, so the search almost always stops right away.
+     */
+    if (level == 0)
+    {
+        for (prev = TAILQ_LAST(head, attq_slot);
+                prev && prev->ae_adv_time > el->ae_adv_time;
+                    prev = TAILQ_PREV(prev, attq_slot, ae_next))
+            ;
+        if (prev)
+            TAILQ_INSERT_AFTER(head, prev, el, ae_next);
+        else
+            TAILQ_INSERT_HEAD(head, el, ae_next);
+    }
+    else
+        TAILQ_INSERT_TAIL(head, el, ae_next);
+
+    ++q->aq_counts[level][slot];
+    q->aq_occupied[level] |= 1ULL << slot;
+    el->ae_slot = level * AW_N_SLOTS + slot;
+}
+
+
+static void
+aw_unplace (struct attq *q, struct attq_elem *el)
+{
+    const unsigned level = el->ae_slot / AW_N_SLOTS,
+                   slot  = el->ae_slot % AW_N_SLOTS;
+
+    assert(q->aq_counts[level][slot] > 0);
+    TAILQ_REMOVE(&q->aq_slots[level][slot], el, ae_next);
+    if (0 == --q->aq_counts[level][slot])
+        q->aq_occupied[level] &= ~(1ULL << slot);
+}
+
+
+/* `now' may not be larger than the placement time of any element */
+static void
+aw_advance (struct attq *q, lsquic_time_t now)
+{
+    struct attq_slot *head;
+    struct attq_elem *el;
+    unsigned level, slot;
+
+    assert(now >= q->aq_now);
+    q->aq_now = now;
+
+    /* Elements at level L in the slot that `now' falls into no longer
+     * differ from it in that bit group: move them down.
+     */
+    for (level = AW_N_LEVELS - 1; level > 0; --level)
+    {
+        slot = (now >> (level * AW_SLOT_BITS)) & AW_SLOT_MASK;
+        if (q->aq_occupied[level] & (1ULL << slot))
+        {
+            head = &q->aq_slots[level][slot];
+            while ((el = TAILQ_FIRST(head)))
+            {
+                aw_unplace(q, el);
+                aw_place(q, el);
+                assert(el->ae_slot / AW_N_SLOTS < level);
+            }
+        }
+    }
+}
+
+
+static struct attq_elem *
+aw_first (struct attq *q)
+{
+    unsigned level, slot;
+
+    if (q->aq_nelem == 0)
+        return NULL;
+
+    while (!q->aq_occupied[0])
+    {
+        for (level = 1; !q->aq_occupied[level]; ++level)
+            assert(level + 1 < AW_N_LEVELS);
+        slot = aw_ctz(q->aq_occupied[level]);
+        aw_advance(q, aw_slot_time(q, level, slot));
+    }
+
+    return TAILQ_FIRST(&q->aq_slots[0][aw_ctz(q->aq_occupied[0])]);
+}
+
+
+#if LSQUIC_EXTRA_CHECKS && !defined(NDEBUG)
+static void
+attq_verify (struct attq *q)
+{
+    const struct attq_elem *el, *prev;
+    unsigned level, slot, count, total;
+
+    total = 0;
+    for (level = 0; level < AW_N_LEVELS; ++level)
+        for (slot = 0; slot < AW_N_SLOTS; ++slot)
+        {
+            count = 0;
+            prev = NULL;
+            TAILQ_FOREACH(el, &q->aq_slots[level][slot], ae_next)
+            {
+                assert(el->ae_slot == level * AW_N_SLOTS + slot);
+                assert(level == 0 || el->ae_adv_time > q->aq_now);
+                assert(!prev || level > 0
+                                    || prev->ae_adv_time <= el->ae_adv_time);
+                prev = el;
+                ++count;
+            }
+            assert(count == q->aq_counts[level][slot]);
+            assert(!!count == !!(q->aq_occupied[level] & (1ULL << slot)));
+            total += count;
+        }
+    assert(total == q->aq_nelem);
+}
+#else
+#define attq_verify(q)
+#endif
+
+
+int
+attq_add (struct attq *q, struct lsquic_conn *conn,
+                                lsquic_time_t advisory_time, enum ae_why why)
+{
+    struct attq_elem *el;
+
+    el = lsquic_malo_get(q->aq_elem_malo);
+    if (!el)
+        return -1;
+    el->ae_adv_time = advisory_time;
+    el->ae_why = why;
+
+    /* The only place linkage between conn and attq_elem occurs: */
+    el->ae_conn = conn;
+    conn->cn_attq_elem = el;
+
+    aw_place(q, el);
+    ++q->aq_nelem;
+
+    attq_verify(q);
+
+    return 0;
+}
+
+
+void
+attq_remove (struct attq *q, struct lsquic_conn *conn)
+{
+    struct attq_elem *el;
+
+    el = conn->cn_attq_elem;
+
+    assert(q->aq_nelem > 0);
+    assert(el->ae_conn == conn);
+
+    conn->cn_attq_elem = NULL;
+
+    aw_unplace(q, el);
+    --q->aq_nelem;
+    lsquic_malo_put(el);
+    attq_verify(q);
+}
+
+
+struct lsquic_conn *
+attq_pop (struct attq *q, lsquic_time_t cutoff)
+{
+    struct lsquic_conn *conn;
+    struct attq_elem *el;
+
+    el = aw_first(q);
+    if (el && el->ae_adv_time < cutoff)
+    {
+        conn = el->ae_conn;
+        attq_remove(q, conn);
+        return conn;
+    }
+
+    /* Nothing is due before `cutoff': move the wheel forward.  This keeps
+     * new elements near the bottom of the wheel.
+     */
+    if (cutoff > q->aq_now)
+    {
+        aw_advance(q, cutoff);
+        attq_verify(q);
+    }
+    return NULL;
+}
+
+
+unsigned
+attq_count_before (struct attq *q, lsquic_time_t cutoff)
+{
+    const struct attq_elem *el;
+    lsquic_time_t slot_time, span;
+    unsigned level, slot, count;
+    uint64_t occupied;
+
+    count = 0;
+
+    /* Level-0 slots are sorted and come in order */
+    for (occupied = q->aq_occupied[0]; occupied; occupied &= occupied - 1)
+    {
+        slot = aw_ctz(occupied);
+        TAILQ_FOREACH(el, &q->aq_slots[0][slot], ae_next)
+            if (el->ae_adv_time < cutoff)
+                ++count;
+            else
+                return count;
+    }
+
+    for (level = 1; level < AW_N_LEVELS; ++level)
+    {
+        span = 1ULL << (level * AW_SLOT_BITS);
+        for (occupied = q->aq_occupied[level]; occupied;
+                                                occupied &= occupied - 1)
+        {
+            slot = aw_ctz(occupied);
+            slot_time = aw_slot_time(q, level, slot);
+            if (slot_time >= cutoff)
+                return count;
+            if (cutoff - slot_time >= span)
+                count += q->aq_counts[level][slot];
+            else
+            {
+                TAILQ_FOREACH(el, &q->aq_slots[level][slot], ae_next)
+                    count += el->ae_adv_time < cutoff;
+                return count;
+            }
+        }
+    }
+
+    return count;
+}
+
+
+const struct attq_elem *
+attq_next (struct attq *q)
+{
+    return aw_first(q);
+}
+
+
+#else
+
+
 struct attq
 {
     struct malo        *aq_elem_malo;
@@ -269,6 +660,9 @@ attq_next (struct attq *q)
 }
 
 
+#endif
+
+
 const char *
 lsquic_attq_why2str (enum ae_why why)
 {
@@ -6,6 +6,13 @@
 #ifndef LSQUIC_ATTQ_H
 #define LSQUIC_ATTQ_H
 
+/* By default, the queue is a hierarchical timer wheel.  Set this to 0 to
+ * use the binary heap instead.
+ */
+#ifndef LSQUIC_ATTQ_WHEEL
+#define LSQUIC_ATTQ_WHEEL 1
+#endif
+
 struct attq;
 struct lsquic_conn;
 
@@ -17,7 +24,13 @@ struct attq_elem
 {
     struct lsquic_conn  *ae_conn;
     lsquic_time_t        ae_adv_time;
+#if LSQUIC_ATTQ_WHEEL
+    TAILQ_ENTRY(attq_elem)
+                         ae_next;
+    unsigned             ae_slot;   /* Level * AW_N_SLOTS + slot */
+#else
     unsigned             ae_heap_idx;
+#endif
     /* The "why" describes why the connection is in the Advisory Tick Time
      * Queue.  Values past the range describe different alarm types (see
      * enum alarm_id).
@@ -34,7 +34,25 @@ lsquic_cfcw_init (struct lsquic_cfcw *fc, struct lsquic_conn_public *cpub,
     memset(fc, 0, sizeof(*fc));
     fc->cf_max_recv_win = max_recv_window;
     fc->cf_conn_pub = cpub;
-    (void) lsquic_cfcw_fc_offsets_changed(fc);
+    /* The initial window has been advertised already: it is not subject
+     * to the memory budget.
+     */
+    fc->cf_recv_off = max_recv_window;
+    fc->cf_last_updated = lsquic_enpub_tick_time(cpub->enpub);
+}
+
+
+void
+lsquic_cfcw_cleanup (struct lsquic_cfcw *fc)
+{
+    struct lsquic_engine_public *const enpub = fc->cf_conn_pub->enpub;
+
+    if (enpub->enp_mem_high)
+    {
+        lsquic_enpub_lock(enpub);
+        enpub->enp_stream_bytes -= fc->cf_max_recv_off - fc->cf_read_off;
+        lsquic_enpub_unlock(enpub);
+    }
 }
 
 
@@ -64,6 +82,44 @@ cfcw_maybe_increase_max_window (struct lsquic_cfcw *fc)
 }
 
 
+/* The engine is close to its memory budget: do not credit the peer while
+ * there is unread data and shrink the window as it is drained.
+ */
+static int
+cfcw_offsets_changed_tight (struct lsquic_cfcw *fc)
+{
+    uint64_t recv_off;
+
+    if (fc->cf_max_recv_off > fc->cf_read_off)
+    {
+        LSQ_DEBUG("memory is tight, hold off update while %"PRIu64" bytes "
+            "are unread", fc->cf_max_recv_off - fc->cf_read_off);
+        return 0;
+    }
+
+    if (fc->cf_max_recv_win / 2 >= LSQUIC_MIN_FCW)
+    {
+        LSQ_DEBUG("memory is tight, max window decrease %u -> %u",
+                                fc->cf_max_recv_win, fc->cf_max_recv_win / 2);
+        EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID,
+            "max CFCW decrease %u -> %u", fc->cf_max_recv_win,
+                                                    fc->cf_max_recv_win / 2);
+        fc->cf_max_recv_win /= 2;
+    }
+
+    /* Flow control limit can never go down */
+    recv_off = fc->cf_read_off + fc->cf_max_recv_win;
+    if (recv_off <= fc->cf_recv_off)
+        return 0;
+
+    fc->cf_last_updated = lsquic_enpub_tick_time(fc->cf_conn_pub->enpub);
+    fc->cf_recv_off = recv_off;
+    LSQ_DEBUG("recv_off changed: read_off: %"PRIu64"; recv_off: %"
+        PRIu64"", fc->cf_read_off, fc->cf_recv_off);
+    return 1;
+}
+
+
 int
 lsquic_cfcw_fc_offsets_changed (struct lsquic_cfcw *fc)
 {
@@ -72,7 +128,10 @@ lsquic_cfcw_fc_offsets_changed (struct lsquic_cfcw *fc)
     if (fc->cf_recv_off - fc->cf_read_off >= fc->cf_max_recv_win / 2)
         return 0;
 
-    now = lsquic_time_now();
+    if (lsquic_enpub_mem_tight(fc->cf_conn_pub->enpub))
+        return cfcw_offsets_changed_tight(fc);
+
+    now = lsquic_enpub_tick_time(fc->cf_conn_pub->enpub);
     since_last_update = now - fc->cf_last_updated;
     fc->cf_last_updated = now;
 
@@ -95,6 +154,12 @@ lsquic_cfcw_incr_max_recv_off (struct lsquic_cfcw *fc, uint64_t incr)
         fc->cf_max_recv_off += incr;
         LSQ_DEBUG("max_recv_off goes from %"PRIu64" to %"PRIu64"",
                     fc->cf_max_recv_off - incr, fc->cf_max_recv_off);
+        if (fc->cf_conn_pub->enpub->enp_mem_high)
+        {
+            lsquic_enpub_lock(fc->cf_conn_pub->enpub);
+            fc->cf_conn_pub->enpub->enp_stream_bytes += incr;
+            lsquic_enpub_unlock(fc->cf_conn_pub->enpub);
+        }
         return 1;
     }
     else
@@ -113,4 +178,10 @@ lsquic_cfcw_incr_read_off (struct lsquic_cfcw *fc, uint64_t incr)
     fc->cf_read_off += incr;
     LSQ_DEBUG("read_off goes from %"PRIu64" to %"PRIu64,
         fc->cf_read_off - incr, fc->cf_read_off);
+    if (fc->cf_conn_pub->enpub->enp_mem_high)
+    {
+        lsquic_enpub_lock(fc->cf_conn_pub->enpub);
+        fc->cf_conn_pub->enpub->enp_stream_bytes -= incr;
+        lsquic_enpub_unlock(fc->cf_conn_pub->enpub);
+    }
 }
@@ -0,0 +1,602 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cid_hash.c -- Open-addressing hash of connection IDs
+ *
+ * The table is an array of groups of CH_GROUP_SZ slots.  Each slot has a
+ * control byte and an element pointer; control bytes are kept in their own
+ * array so that a group's worth of them can be compared in one go.
+ *
+ * Control byte of a full slot holds the lower seven bits of the hash value
+ * (the tag).  The other bits select the first group to probe.  Groups are
+ * probed using triangular numbers, which visits every group when the
+ * number of groups is a power of two.  A lookup stops at the first group
+ * that has an empty slot.
+ *
+ * A slot that is freed becomes empty if its group already has an empty
+ * slot -- no probe could have gone past such a group -- and deleted
+ * otherwise.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifdef WIN32
+#include <vc_compat.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) \
+                                    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CH_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CH_NEON 1
+#endif
+
+#include "lsquic_hash.h"
+#include "lsquic_cid_hash.h"
+#include "lsquic_siphash.h"
+
+#define CH_GROUP_SZ 16
+
+#define CH_EMPTY    0x80
+#define CH_DELETED  0xFE
+
+#define CH_TAG(hash_val) ((hash_val) & 0x7F)
+#define CH_GROUP(hash_val) ((hash_val) >> 7)
+
+#define CH_N_SLOTS(table) (((table)->ct_group_mask + 1) * CH_GROUP_SZ)
+
+/* Control byte and element pointer */
+#define CH_SLOT_SZ (1 + sizeof(struct lsquic_hash_elem *))
+
+/* Maximum number of used -- full or deleted -- slots is 7/8 of the table.
+ * This guarantees that there is always an empty slot to stop a probe.
+ */
+#define CH_MAX_USED(table) (CH_N_SLOTS(table) - CH_N_SLOTS(table) / 8)
+
+/* Number of old table groups moved to the new table per operation.  As
+ * a table is resized when it is 7/8 full and the new table is sized for
+ * load of 1/2, moving two groups per insertion normally completes the move
+ * long before the new table fills up.  If it does fill up -- for instance,
+ * because of many insertions and deletions -- both tables are rebuilt
+ * into one.
+ */
+#define CH_MIGRATE_GROUPS 2
+
+
+/* Match masks have one bit per slot, spaced CH_MASK_STRIDE bits apart */
+typedef uint64_t ch_mask_t;
+
+#if CH_SSE2
+
+#define CH_MASK_STRIDE 1
+#define CH_MASK_ALL 0xFFFFu
+
+static ch_mask_t
+ch_match (const unsigned char *ctrl, unsigned char byte)
+{
+    const __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+    return (unsigned) _mm_movemask_epi8(
+                            _mm_cmpeq_epi8(group, _mm_set1_epi8((char) byte)));
+}
+
+
+/* Match empty and deleted slots: they have the high bit set */
+static ch_mask_t
+ch_match_free (const unsigned char *ctrl)
+{
+    const __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+    return (unsigned) _mm_movemask_epi8(group);
+}
+
+#elif CH_NEON
+
+/* NEON has no movemask: narrow each byte of the comparison result to a
+ * nibble and keep one bit of each nibble.
+ */
+#define CH_MASK_STRIDE 4
+#define CH_MASK_ALL 0x8888888888888888ull
+
+static ch_mask_t
+ch_neon_mask (uint8x16_t cmp)
+{
+    const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & CH_MASK_ALL;
+}
+
+
+static ch_mask_t
+ch_match (const unsigned char *ctrl, unsigned char byte)
+{
+    return ch_neon_mask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(byte)));
+}
+
+
+static ch_mask_t
+ch_match_free (const unsigned char *ctrl)
+{
+    return ch_neon_mask(vtstq_u8(vld1q_u8(ctrl), vdupq_n_u8(0x80)));
+}
+
+#else
+
+#define CH_MASK_STRIDE 1
+#define CH_MASK_ALL 0xFFFFu
+
+static ch_mask_t
+ch_match (const unsigned char *ctrl, unsigned char byte)
+{
+    ch_mask_t mask;
+    unsigned i;
+
+    for (i = 0, mask = 0; i < CH_GROUP_SZ; ++i)
+        mask |= (ch_mask_t) (ctrl[i] == byte) << i;
+    return mask;
+}
+
+
+static ch_mask_t
+ch_match_free (const unsigned char *ctrl)
+{
+    ch_mask_t mask;
+    unsigned i;
+
+    for (i = 0, mask = 0; i < CH_GROUP_SZ; ++i)
+        mask |= (ch_mask_t) (ctrl[i] >> 7) << i;
+    return mask;
+}
+
+#endif
+
+
+#define ch_match_full(ctrl) (ch_match_free(ctrl) ^ CH_MASK_ALL)
+
+
+/* Index of the lowest slot in a non-empty mask */
+static unsigned
+ch_first (ch_mask_t mask)
+{
+#if __GNUC__
+    return __builtin_ctzll(mask) / CH_MASK_STRIDE;
+#else
+    unsigned n;
+
+    for (n = 0; !(mask & 1); mask >>= 1)
+        ++n;
+    return n / CH_MASK_STRIDE;
+#endif
+}
+
+
+struct ch_table
+{
+    unsigned char            *ct_ctrl;
+    struct lsquic_hash_elem **ct_els;
+    unsigned                  ct_group_mask;    /* Number of groups - 1 */
+    unsigned                  ct_used;          /* Full and deleted slots */
+};
+
+
+struct cid_hash
+{
+    struct ch_table          ch_cur,
+                             ch_old;        /* Being drained if allocated */
+    unsigned                 ch_migrate_next;   /* Next group in ch_old */
+    TAILQ_HEAD(, lsquic_hash_elem)
+                             ch_all;
+    struct lsquic_hash_elem *ch_iter_next;
+    unsigned                 ch_count;
+    unsigned                 ch_key_len;
+    struct lsquic_hash_stats ch_stats;
+    unsigned char            ch_hash_key[LSQUIC_HASH_KEY_SZ];
+};
+
+
+static int
+ct_init (struct ch_table *table, unsigned n_groups)
+{
+    table->ct_ctrl = malloc(n_groups * CH_GROUP_SZ);
+    table->ct_els = malloc(n_groups * CH_GROUP_SZ * sizeof(table->ct_els[0]));
+    if (!(table->ct_ctrl && table->ct_els))
+    {
+        free(table->ct_ctrl);
+        free(table->ct_els);
+        table->ct_ctrl = NULL;
+        table->ct_els = NULL;
+        return -1;
+    }
+    memset(table->ct_ctrl, CH_EMPTY, n_groups * CH_GROUP_SZ);
+    table->ct_group_mask = n_groups - 1;
+    table->ct_used = 0;
+    return 0;
+}
+
+
+static void
+ct_cleanup (struct ch_table *table)
+{
+    free(table->ct_ctrl);
+    free(table->ct_els);
+    table->ct_ctrl = NULL;
+    table->ct_els = NULL;
+}
+
+
+/* Force inlining so that lookups with a constant key size get a constant
+ * size memcmp(), which the compiler turns into a couple of loads.
+ */
+#if __GNUC__
+__attribute__((always_inline))
+#endif
+static inline struct lsquic_hash_elem *
+ct_find (const struct ch_table *table, unsigned hash_val, const void *key,
+                                        unsigned key_sz, unsigned *n_probes)
+{
+    const unsigned char *ctrl;
+    struct lsquic_hash_elem *el;
+    unsigned group, step;
+    ch_mask_t mask;
+
+    group = CH_GROUP(hash_val) & table->ct_group_mask;
+    step = 0;
+    while (1)
+    {
+        ++*n_probes;
+        ctrl = &table->ct_ctrl[group * CH_GROUP_SZ];
+        for (mask = ch_match(ctrl, CH_TAG(hash_val)); mask; mask &= mask - 1)
+        {
+            el = table->ct_els[group * CH_GROUP_SZ + ch_first(mask)];
+            if (el->qhe_hash_val == hash_val && el->qhe_key_len == key_sz
+                                && 0 == memcmp(el->qhe_key_data, key, key_sz))
+                return el;
+        }
+        if (ch_match(ctrl, CH_EMPTY))
+            return NULL;
+        group = (group + ++step) & table->ct_group_mask;
+    }
+}
+
+
+static void
+ct_insert (struct ch_table *table, struct lsquic_hash_elem *el)
+{
+    unsigned group, step, slot;
+    ch_mask_t mask;
+
+    group = CH_GROUP(el->qhe_hash_val) & table->ct_group_mask;
+    step = 0;
+    while (!(mask = ch_match_free(&table->ct_ctrl[group * CH_GROUP_SZ])))
+        group = (group + ++step) & table->ct_group_mask;
+
+    slot = group * CH_GROUP_SZ + ch_first(mask);
+    if (table->ct_ctrl[slot] == CH_EMPTY)
+        ++table->ct_used;
+    table->ct_ctrl[slot] = CH_TAG(el->qhe_hash_val);
+    table->ct_els[slot] = el;
+}
+
+
+/* Returns true if `el' was found in the table and removed */
+static int
+ct_remove (struct ch_table *table, const struct lsquic_hash_elem *el)
+{
+    unsigned char *ctrl;
+    unsigned group, step, slot;
+    ch_mask_t mask;
+
+    group = CH_GROUP(el->qhe_hash_val) & table->ct_group_mask;
+    step = 0;
+    while (1)
+    {
+        ctrl = &table->ct_ctrl[group * CH_GROUP_SZ];
+        for (mask = ch_match(ctrl, CH_TAG(el->qhe_hash_val)); mask;
+                                                            mask &= mask - 1)
+        {
+            slot = group * CH_GROUP_SZ + ch_first(mask);
+            if (table->ct_els[slot] == el)
+            {
+                if (ch_match(ctrl, CH_EMPTY))
+                {
+                    table->ct_ctrl[slot] = CH_EMPTY;
+                    --table->ct_used;
+                }
+                else
+                    table->ct_ctrl[slot] = CH_DELETED;
+                return 1;
+            }
+        }
+        if (ch_match(ctrl, CH_EMPTY))
+            return 0;
+        group = (group + ++step) & table->ct_group_mask;
+    }
+}
+
+
+static int
+ct_full (const struct ch_table *table)
+{
+    return table->ct_used >= CH_MAX_USED(table);
+}
+
+
+struct cid_hash *
+lsquic_cidh_create (unsigned key_len, const unsigned char *hash_key)
+{
+    struct cid_hash *hash;
+
+    hash = calloc(1, sizeof(*hash));
+    if (!hash)
+        return NULL;
+
+    if (0 != ct_init(&hash->ch_cur, 1))
+    {
+        free(hash);
+        return NULL;
+    }
+
+    TAILQ_INIT(&hash->ch_all);
+    hash->ch_key_len = key_len;
+    memcpy(hash->ch_hash_key, hash_key, sizeof(hash->ch_hash_key));
+    return hash;
+}
+
+
+void
+lsquic_cidh_destroy (struct cid_hash *hash)
+{
+    ct_cleanup(&hash->ch_cur);
+    ct_cleanup(&hash->ch_old);
+    free(hash);
+}
+
+
+/* Move up to `n_groups' groups from the old table to the current one */
+static void
+ch_migrate (struct cid_hash *hash, unsigned n_groups)
+{
+    struct ch_table *const old = &hash->ch_old;
+    unsigned char *ctrl;
+    unsigned slot;
+    ch_mask_t mask;
+
+    for ( ; n_groups > 0 && hash->ch_migrate_next <= old->ct_group_mask;
+                                            --n_groups, ++hash->ch_migrate_next)
+    {
+        if (hash->ch_cur.ct_used + CH_GROUP_SZ > CH_MAX_USED(&hash->ch_cur))
+            return;
+        /* Moved slots are marked deleted, not empty, so that lookups of
+         * elements not yet moved still probe past this group.
+         */
+        ctrl = &old->ct_ctrl[hash->ch_migrate_next * CH_GROUP_SZ];
+        for (mask = ch_match_full(ctrl); mask; mask &= mask - 1)
+        {
+            slot = ch_first(mask);
+            ct_insert(&hash->ch_cur,
+                    old->ct_els[hash->ch_migrate_next * CH_GROUP_SZ + slot]);
+            ctrl[slot] = CH_DELETED;
+        }
+    }
+
+    if (hash->ch_migrate_next > old->ct_group_mask)
+        ct_cleanup(old);
+}
+
+
+/* Number of groups for load factor of at most 1/2 */
+static unsigned
+ch_n_groups (unsigned count)
+{
+    unsigned n_groups;
+
+    for (n_groups = 1; n_groups * CH_GROUP_SZ / 2 < count; n_groups <<= 1)
+        ;
+    return n_groups;
+}
+
+
+/* The old table is drained incrementally; see ch_migrate() */
+static int
+ch_start_resize (struct cid_hash *hash)
+{
+    struct ch_table table;
+
+    assert(!hash->ch_old.ct_ctrl);
+    if (0 != ct_init(&table, ch_n_groups(hash->ch_count + 1)))
+        return -1;
+
+    hash->ch_old = hash->ch_cur;
+    hash->ch_cur = table;
+    hash->ch_migrate_next = 0;
+    return 0;
+}
+
+
+/* Put all elements into a new table at once */
+static int
+ch_rebuild (struct cid_hash *hash)
+{
+    struct lsquic_hash_elem *el;
+    struct ch_table table;
+
+    if (0 != ct_init(&table, ch_n_groups(hash->ch_count + 1)))
+        return -1;
+    TAILQ_FOREACH(el, &hash->ch_all, qhe_next_all)
+        ct_insert(&table, el);
+    ct_cleanup(&hash->ch_cur);
+    ct_cleanup(&hash->ch_old);
+    hash->ch_cur = table;
+    return 0;
+}
+
+
+static int
+ch_make_room (struct cid_hash *hash)
+{
+    if (hash->ch_old.ct_ctrl)
+        ch_migrate(hash, CH_MIGRATE_GROUPS);
+    if (!ct_full(&hash->ch_cur))
+        return 0;
+    else if (hash->ch_old.ct_ctrl)
+        return ch_rebuild(hash);
+    else
+        return ch_start_resize(hash);
+}
+
+
+static unsigned
+ch_hash (const struct cid_hash *hash, const void *key, unsigned key_sz)
+{
+    return (unsigned) lsquic_siphash13(hash->ch_hash_key, key, key_sz);
+}
+
+
+struct lsquic_hash_elem *
+lsquic_cidh_insert (struct cid_hash *hash, const void *key, unsigned key_sz,
+                                    void *value, struct lsquic_hash_elem *el)
+{
+    if (el->qhe_flags & QHE_HASHED)
+        return NULL;
+
+    if (0 != ch_make_room(hash))
+        return NULL;
+
+    el->qhe_key_data = key;
+    el->qhe_key_len  = key_sz;
+    el->qhe_value    = value;
+    el->qhe_hash_val = ch_hash(hash, key, key_sz);
+    ct_insert(&hash->ch_cur, el);
+    TAILQ_INSERT_TAIL(&hash->ch_all, el, qhe_next_all);
+    el->qhe_flags |= QHE_HASHED;
+    ++hash->ch_count;
+    return el;
+}
+
+
+#if __GNUC__
+__attribute__((always_inline))
+#endif
+static inline struct lsquic_hash_elem *
+ch_find (struct cid_hash *hash, const void *key, unsigned key_sz)
+{
+    struct lsquic_hash_elem *el;
+    unsigned hash_val, n_probes;
+
+    hash_val = ch_hash(hash, key, key_sz);
+    n_probes = 0;
+    el = ct_find(&hash->ch_cur, hash_val, key, key_sz, &n_probes);
+    if (!el && hash->ch_old.ct_ctrl)
+    {
+        el = ct_find(&hash->ch_old, hash_val, key, key_sz, &n_probes);
+        ch_migrate(hash, CH_MIGRATE_GROUPS);
+    }
+
+    ++hash->ch_stats.hs_lookups;
+    hash->ch_stats.hs_probes += n_probes;
+    if (n_probes > hash->ch_stats.hs_max_probes)
+        hash->ch_stats.hs_max_probes = n_probes;
+    return el;
+}
+
+
+struct lsquic_hash_elem *
+lsquic_cidh_find (struct cid_hash *hash, const void *key, unsigned key_sz)
+{
+    /* Specialize for the common CID lengths */
+    if (key_sz == hash->ch_key_len)
+        switch (key_sz)
+        {
+        case 8:
+            return ch_find(hash, key, 8);
+        case 16:
+            return ch_find(hash, key, 16);
+        case 20:
+            return ch_find(hash, key, 20);
+        }
+
+    return ch_find(hash, key, key_sz);
+}
+
+
+void
+lsquic_cidh_prefetch (struct cid_hash *hash, const void *key,
+                                                            unsigned key_sz)
+{
+#if __GNUC__
+    unsigned group;
+
+    group = CH_GROUP(ch_hash(hash, key, key_sz)) & hash->ch_cur.ct_group_mask;
+    __builtin_prefetch(&hash->ch_cur.ct_ctrl[group * CH_GROUP_SZ]);
+    __builtin_prefetch(&hash->ch_cur.ct_els[group * CH_GROUP_SZ]);
+#else
+    (void) hash; (void) key; (void) key_sz;
+#endif
+}
+
+
+void
+lsquic_cidh_erase (struct cid_hash *hash, struct lsquic_hash_elem *el)
+{
+    int removed;
+
+    assert(el->qhe_flags & QHE_HASHED);
+    removed = ct_remove(&hash->ch_cur, el)
+           || (hash->ch_old.ct_ctrl && ct_remove(&hash->ch_old, el));
+    assert(removed);
+    (void) removed;
+    if (hash->ch_iter_next == el)
+        hash->ch_iter_next = TAILQ_NEXT(el, qhe_next_all);
+    TAILQ_REMOVE(&hash->ch_all, el, qhe_next_all);
+    el->qhe_flags &= ~QHE_HASHED;
+    --hash->ch_count;
+}
+
+
+struct lsquic_hash_elem *
+lsquic_cidh_first (struct cid_hash *hash)
+{
+    hash->ch_iter_next = TAILQ_FIRST(&hash->ch_all);
+    return lsquic_cidh_next(hash);
+}
+
+
+struct lsquic_hash_elem *
+lsquic_cidh_next (struct cid_hash *hash)
+{
+    struct lsquic_hash_elem *el;
+
+    el = hash->ch_iter_next;
+    if (el)
+        hash->ch_iter_next = TAILQ_NEXT(el, qhe_next_all);
+    return el;
+}
+
+
+unsigned
+lsquic_cidh_count (const struct cid_hash *hash)
+{
+    return hash->ch_count;
+}
+
+
+size_t
+lsquic_cidh_mem_used (const struct cid_hash *hash)
+{
+    size_t size;
+
+    size = sizeof(*hash);
+    size += CH_N_SLOTS(&hash->ch_cur) * CH_SLOT_SZ;
+    if (hash->ch_old.ct_ctrl)
+        size += CH_N_SLOTS(&hash->ch_old) * CH_SLOT_SZ;
+    return size;
+}
+
+
+void
+lsquic_cidh_get_stats (const struct cid_hash *hash,
+                                            struct lsquic_hash_stats *stats)
+{
+    *stats = hash->ch_stats;
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cid_hash.h -- Open-addressing hash of connection IDs
+ *
+ * This is the engine's connection table: it maps CIDs (or, in client
+ * mode, local ports) to connections.  Unlike the generic lsquic_hash,
+ * lookups do not chase bucket lists: each slot has a one-byte tag and a
+ * group of sixteen tags is compared at once using SSE2 or NEON.  The full
+ * key is only compared when the tag matches.
+ *
+ * The table grows incrementally: when it fills up, a new table is
+ * allocated and entries are moved over a few groups at a time as part of
+ * later operations.  Until the move is complete, lookups check both
+ * tables.
+ *
+ * Elements are struct lsquic_hash_elem, so that connection code can keep
+ * using cce_hash_el and QHE_HASHED whichever hash is used.
+ */
+
+#ifndef LSQUIC_CID_HASH_H
+#define LSQUIC_CID_HASH_H 1
+
+struct cid_hash;
+struct lsquic_hash_elem;
+struct lsquic_hash_stats;
+
+/* `key_len' is the length of the keys expected to be looked up most
+ * often; lookups with keys of this length are faster.  Keys of other
+ * lengths may still be used.  `hash_key' is the secret key for the hash
+ * function, LSQUIC_HASH_KEY_SZ bytes long.
+ */
+struct cid_hash *
+lsquic_cidh_create (unsigned key_len, const unsigned char *hash_key);
+
+void
+lsquic_cidh_destroy (struct cid_hash *);
+
+/* Returns `el' on success and NULL if `el' is already in a hash or if
+ * memory allocation fails.
+ */
+struct lsquic_hash_elem *
+lsquic_cidh_insert (struct cid_hash *, const void *key, unsigned key_sz,
+                                    void *value, struct lsquic_hash_elem *el);
+
+struct lsquic_hash_elem *
+lsquic_cidh_find (struct cid_hash *, const void *key, unsigned key_sz);
+
+/* Hint that `key' is going to be looked up soon */
+void
+lsquic_cidh_prefetch (struct cid_hash *, const void *key, unsigned key_sz);
+
+void
+lsquic_cidh_erase (struct cid_hash *, struct lsquic_hash_elem *);
+
+/* Iteration is safe with respect to erasing the current element */
+struct lsquic_hash_elem *
+lsquic_cidh_first (struct cid_hash *);
+
+struct lsquic_hash_elem *
+lsquic_cidh_next (struct cid_hash *);
+
+unsigned
+lsquic_cidh_count (const struct cid_hash *);
+
+size_t
+lsquic_cidh_mem_used (const struct cid_hash *);
+
+void
+lsquic_cidh_get_stats (const struct cid_hash *, struct lsquic_hash_stats *);
+
+#endif
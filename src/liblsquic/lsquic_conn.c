@@ -1,5 +1,6 @@
 /* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <string.h>
 #include <sys/queue.h>
@@ -66,7 +67,12 @@ int
 lsquic_conn_copy_and_release_pi_data (const lsquic_conn_t *conn,
           struct lsquic_engine_public *enpub, lsquic_packet_in_t *packet_in)
 {
-    assert(!(packet_in->pi_flags & PI_OWN_DATA));
+    assert(!(packet_in->pi_flags & (PI_OWN_DATA|PI_BUF_REF)));
+    if (packet_in->pi_buf_ctx)
+    {
+        lsquic_mm_ref_packet_in_buf(&enpub->enp_mm, packet_in);
+        return 0;
+    }
     /* The size should be guarded in lsquic_engine_packet_in(): */
     assert(packet_in->pi_data_sz <= GQUIC_MAX_PACKET_SZ);
     unsigned char *const copy = lsquic_mm_get_packet_in_buf(&enpub->enp_mm, 1370);
@@ -181,6 +187,19 @@ lsquic_conn_close (struct lsquic_conn *lconn)
 }
 
 
+ssize_t
+lsquic_conn_export (struct lsquic_conn *lconn, void *buf, size_t bufsz)
+{
+    if (lconn->cn_if->ci_export)
+        return lconn->cn_if->ci_export(lconn, buf, bufsz);
+    else
+    {
+        errno = ENOTSUP;
+        return -1;
+    }
+}
+
+
 int
 lsquic_conn_is_push_enabled (lsquic_conn_t *lconn)
 {
@@ -245,6 +264,25 @@ lsquic_generate_cid (lsquic_cid_t *cid, size_t len)
 }
 
 
+/* In sharded mode, the first byte of the CID is a random number that is
+ * congruent to the shard ID modulo the number of shards.  This way, the
+ * first byte still looks random, while lsquic_packet_shard() is able to
+ * recover the shard ID.
+ */
+void
+lsquic_generate_scid (lsquic_cid_t *cid,
+                            const struct lsquic_engine_settings *settings)
+{
+    unsigned n_shards;
+
+    lsquic_generate_cid(cid, settings->es_scid_len);
+    n_shards = settings->es_n_shards;
+    if (n_shards > 1 && cid->len > 0)
+        cid->idbuf[0] = cid->idbuf[0] % (LSQUIC_MAX_SHARDS / n_shards)
+                                    * n_shards + settings->es_shard_id;
+}
+
+
 void
 lsquic_generate_cid_gquic (lsquic_cid_t *cid)
 {
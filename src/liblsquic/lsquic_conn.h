@@ -21,8 +21,10 @@
 
 struct lsquic_conn;
 struct lsquic_engine_public;
+struct lsquic_engine_settings;
 struct lsquic_packet_out;
 struct lsquic_packet_in;
+struct lsquic_mem_stats;
 struct sockaddr;
 struct parse_funcs;
 struct attq_elem;
@@ -36,7 +38,7 @@ enum lsquic_conn_flags {
     LSCONN_HASHED         = (1 << 2),
     LSCONN_MINI           = (1 << 3),   /* This is a mini connection */
     LSCONN_IMMED_CLOSE    = (1 << 4),
-    LSCONN_UNUSED_5       = (1 << 5),
+    LSCONN_HIBERNATED     = (1 << 5),   /* This is a hibernated connection */
     LSCONN_HANDSHAKE_DONE = (1 << 6),
     LSCONN_CLOSING        = (1 << 7),
     LSCONN_PEER_GOING_AWAY= (1 << 8),
@@ -49,7 +51,7 @@ enum lsquic_conn_flags {
     LSCONN_SEND_BLOCKED   = (1 <<15),   /* Send connection blocked frame */
     LSCONN_PROMOTED       = (1 <<16),   /* Promoted.  Only set if LSCONN_MINI is set */
     LSCONN_NEVER_TICKABLE = (1 <<17),   /* Do not put onto the Tickable Queue */
-    LSCONN_UNUSED_18      = (1 <<18),
+    LSCONN_EXPORTED       = (1 <<18),   /* CIDs moved to another engine */
     LSCONN_ATTQ           = (1 <<19),
     LSCONN_SKIP_ON_PROC   = (1 <<20),
 #if LSQUIC_ENABLE_HANDSHAKE_DISABLE
@@ -66,6 +68,8 @@ enum tick_st {
     TICK_SEND    = (1 << 0),
     TICK_CLOSE   = (1 << 1),
     TICK_PROMOTE = (1 << 2), /* Promote mini connection to full connection */
+    TICK_HIBERNATE
+                 = (1 << 3), /* Replace connection with hibernated record */
 };
 
 #define TICK_QUIET 0
@@ -244,8 +248,23 @@ struct conn_iface
     /* Optional method.  Only used by the IETF client code. */
     void
     (*ci_drop_crypto_streams) (struct lsquic_conn *);
+
+    /* Optional method.  See lsquic_conn_export(). */
+    ssize_t
+    (*ci_export) (struct lsquic_conn *, void *buf, size_t bufsz);
+
+    /* Optional method.  Add memory used by the connection to `stats'.
+     * Only the categories are updated; ms_total and ms_n_conns are left
+     * to the caller.
+     */
+    void
+    (*ci_mem_stats) (struct lsquic_conn *, struct lsquic_mem_stats *);
 };
 
+#define lsquic_mem_stats_sum(stats_) ((stats_)->ms_packets_in             \
+    + (stats_)->ms_packets_out + (stats_)->ms_pools + (stats_)->ms_conns  \
+    + (stats_)->ms_streams + (stats_)->ms_hdr_tables)
+
 #define LSCONN_CCE_BITS 3
 #define LSCONN_MAX_CCES (1 << LSCONN_CCE_BITS)
 
@@ -339,6 +358,12 @@ lsquic_conn_copy_and_release_pi_data (const lsquic_conn_t *conn,
 void
 lsquic_generate_cid (lsquic_cid_t *cid, size_t len);
 
+/* Generate server-issued SCID of es_scid_len bytes.  If sharded mode is
+ * on, the shard ID is encoded in it.
+ */
+void
+lsquic_generate_scid (lsquic_cid_t *cid, const struct lsquic_engine_settings *);
+
 void
 lsquic_generate_cid_gquic (lsquic_cid_t *cid);
 
@@ -42,6 +42,10 @@ void
 lsquic_cfcw_init (lsquic_cfcw_t *, struct lsquic_conn_public *,
                                         unsigned initial_max_recv_window);
 
+/* Removes data that has not been read from the engine's memory accounting */
+void
+lsquic_cfcw_cleanup (lsquic_cfcw_t *);
+
 /* If update is to be sent, updates max_recv_off and returns true.  Note
  * that if you call this function twice, the second call will return false.
  */
@@ -10,6 +10,8 @@
 #ifndef LSQUIC_CONN_PUBLIC_H
 #define LSQUIC_CONN_PUBLIC_H 1
 
+#include "lsquic_stream_tab.h"
+
 struct lsquic_conn;
 struct lsquic_engine_public;
 struct lsquic_mm;
@@ -29,6 +31,7 @@ struct lsquic_conn_public {
                                     write_streams,      /* Send STREAM frames */
                                     service_streams;
     struct lsquic_hash             *all_streams;
+    struct stream_tab               stream_tab;     /* Index into all_streams */
     struct lsquic_cfcw              cfcw;
     struct lsquic_conn_cap          conn_cap;
     struct lsquic_rtt_stats         rtt_stats;
@@ -13,6 +13,7 @@
 #include <vc_compat.h>
 #endif
 
+#include "lsquic.h"
 #include "lsquic_int_types.h"
 #include "lsquic_types.h"
 #include "lsquic_hash.h"
@@ -25,6 +26,8 @@
 #include "lsquic_stream.h"
 #include "lsquic_rtt.h"
 #include "lsquic_conn_public.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
 #include "lsquic_packet_common.h"
 #include "lsquic_packet_out.h"
 #include "lsquic_cubic.h"
@@ -122,6 +125,7 @@ lsquic_cubic_init (void *cong_ctl, const struct lsquic_conn_public *conn_pub,
     cubic_reset(cubic);
     cubic->cu_ssthresh = 10000 * TCP_MSS; /* Emulate "unbounded" slow start */
     cubic->cu_conn  = conn_pub->lconn;
+    cubic->cu_enpub = conn_pub->enpub;
     cubic->cu_rtt_stats = &conn_pub->rtt_stats;
     cubic->cu_flags = DEFAULT_CUBIC_FLAGS;
 #ifndef NDEBUG
@@ -137,9 +141,9 @@ lsquic_cubic_init (void *cong_ctl, const struct lsquic_conn_public *conn_pub,
 }
 
 
-#define LOG_CWND(c) do {                                                    \
+#define LOG_CWND(c, now_time) do {                                          \
     if (LSQ_LOG_ENABLED(LSQ_LOG_INFO)) {                                    \
-        lsquic_time_t now = lsquic_time_now();                              \
+        lsquic_time_t now = (now_time);                                     \
         now -= now % (c)->cu_sampling_rate;                                 \
         if (now > (c)->cu_last_logged) {                                    \
             LSQ_INFO("CWND: %lu", (c)->cu_cwnd);                            \
@@ -185,7 +189,7 @@ lsquic_cubic_ack (void *cong_ctl, struct lsquic_packet_out *packet_out,
         LSQ_DEBUG("ACK: cwnd: %lu", cubic->cu_cwnd);
     }
 
-    LOG_CWND(cubic);
+    LOG_CWND(cubic, now_time);
 }
 
 
@@ -204,7 +208,7 @@ lsquic_cubic_loss (void *cong_ctl)
     cubic->cu_ssthresh = cubic->cu_cwnd;
     LSQ_INFO("loss detected, last_max_cwnd: %lu, cwnd: %lu",
         cubic->cu_last_max_cwnd, cubic->cu_cwnd);
-    LOG_CWND(cubic);
+    LOG_CWND(cubic, lsquic_enpub_tick_time(cubic->cu_enpub));
 }
 
 
@@ -221,7 +225,7 @@ lsquic_cubic_timeout (void *cong_ctl)
     cubic->cu_tcp_cwnd = 2 * TCP_MSS;
     cubic->cu_cwnd = 2 * TCP_MSS;
     LSQ_INFO("timeout, cwnd: %lu", cubic->cu_cwnd);
-    LOG_CWND(cubic);
+    LOG_CWND(cubic, lsquic_enpub_tick_time(cubic->cu_enpub));
 }
 
 
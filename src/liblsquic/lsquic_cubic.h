@@ -19,6 +19,8 @@ struct lsquic_cubic {
     unsigned long   cu_ssthresh;
     const struct lsquic_conn
                    *cu_conn;            /* Used for logging */
+    const struct lsquic_engine_public
+                   *cu_enpub;
     const struct lsquic_rtt_stats
                    *cu_rtt_stats;
     enum cubic_flags {
@@ -15,6 +15,8 @@ struct ssl_stream_method_st;
 struct ssl_st;
 struct sockaddr;
 struct conn_cid_elem;
+struct export_writer;
+struct export_reader;
 
 #define DNONC_LENGTH 32
 #define SRST_LENGTH 16
@@ -299,6 +301,16 @@ struct enc_session_funcs_iquic
 
     void
     (*esfi_1rtt_acked)(enc_session_t *);
+
+    /* Serialize keys and peer transport parameters for connection export.
+     * Returns -1 if the session cannot be exported.
+     */
+    int
+    (*esfi_export) (enc_session_t *, struct export_writer *);
+
+    enc_session_t *
+    (*esfi_import) (struct lsquic_engine_public *, struct lsquic_conn *,
+                                                    struct export_reader *);
 };
 
 extern
@@ -45,6 +45,7 @@
 #include "lsquic_tokgen.h"
 #include "lsquic_ietf.h"
 #include "lsquic_alarmset.h"
+#include "lsquic_export.h"
 
 #if __GNUC__
 #   define UNLIKELY(cond) __builtin_expect(cond, 0)
@@ -263,6 +264,7 @@ struct enc_sess_iquic
     struct {
         const char *cipher_name;
         int         alg_bits;
+        uint32_t    cipher_id;      /* Used by connection export */
     }                    esi_cached_info;
     /* Secrets are kept for key rotation */
     unsigned char        esi_traffic_secrets[2][EVP_MAX_KEY_LENGTH];
@@ -499,8 +501,8 @@ gen_trans_params (struct enc_sess_iquic *enc_sess, unsigned char *buf,
             }
             cce->cce_seqno = seqno + 1;
             cce->cce_flags = CCE_SEQNO;
-            lsquic_generate_cid(&cce->cce_cid,
-                            enc_sess->esi_enpub->enp_settings.es_scid_len);
+            lsquic_generate_scid(&cce->cce_cid,
+                                        &enc_sess->esi_enpub->enp_settings);
             /* Don't add to hash: migration must not start until *after*
              * handshake is complete.
              */
@@ -1359,17 +1361,10 @@ struct crypto_params
 
 
 static int
-get_crypto_params (const struct enc_sess_iquic *enc_sess,
+get_crypto_params_by_id (const struct enc_sess_iquic *enc_sess, uint32_t id,
                                                 struct crypto_params *params)
 {
-    const SSL_CIPHER *cipher;
     unsigned key_sz, iv_sz;
-    uint32_t id;
-
-    cipher = SSL_get_current_cipher(enc_sess->esi_ssl);
-    id = SSL_CIPHER_get_id(cipher);
-
-    LSQ_DEBUG("Negotiated cipher ID is 0x%"PRIX32, id);
 
     /* RFC 8446, Appendix B.4 */
     switch (id)
@@ -1426,6 +1421,22 @@ get_crypto_params (const struct enc_sess_iquic *enc_sess,
 }
 
 
+static int
+get_crypto_params (const struct enc_sess_iquic *enc_sess,
+                                                struct crypto_params *params)
+{
+    const SSL_CIPHER *cipher;
+    uint32_t id;
+
+    cipher = SSL_get_current_cipher(enc_sess->esi_ssl);
+    id = SSL_CIPHER_get_id(cipher);
+
+    LSQ_DEBUG("Negotiated cipher ID is 0x%"PRIX32, id);
+
+    return get_crypto_params_by_id(enc_sess, id, params);
+}
+
+
 static int
 get_peer_transport_params (struct enc_sess_iquic *enc_sess)
 {
@@ -1545,7 +1556,8 @@ iquic_esfi_handshake (struct enc_sess_iquic *enc_sess)
 
     hsk_status = LSQ_HSK_OK;
     LSQ_DEBUG("handshake reported complete");
-    EV_LOG_HSK_COMPLETED(LSQUIC_LOG_CONN_ID);
+    EV_LOG_HSK_COMPLETED(LSQUIC_LOG_CONN_ID,
+                                lsquic_enpub_tick_time(enc_sess->esi_enpub));
     /* The ESI_USE_SSL_TICKET flag indicates if the client attempted 0-RTT.
      * If the handshake is complete, and the client attempted 0-RTT, it
      * must have succeeded.
@@ -1553,7 +1565,8 @@ iquic_esfi_handshake (struct enc_sess_iquic *enc_sess)
     if (enc_sess->esi_flags & ESI_USE_SSL_TICKET)
     {
         hsk_status = LSQ_HSK_0RTT_OK;
-        EV_LOG_ZERO_RTT(LSQUIC_LOG_CONN_ID);
+        EV_LOG_ZERO_RTT(LSQUIC_LOG_CONN_ID,
+                                lsquic_enpub_tick_time(enc_sess->esi_enpub));
     }
 
     if (0 != maybe_get_peer_transport_params(enc_sess))
@@ -1831,7 +1844,7 @@ iquic_esf_decrypt_packet (enc_session_t *enc_session_p,
         struct lsquic_packet_in *packet_in)
 {
     struct enc_sess_iquic *const enc_sess = enc_session_p;
-    unsigned char *dst;
+    unsigned char *dst = NULL;
     struct crypto_ctx_pair *pair;
     const struct header_prot *hp;
     struct crypto_ctx *crypto_ctx = NULL;
@@ -1843,21 +1856,13 @@ iquic_esf_decrypt_packet (enc_session_t *enc_session_p,
     lsquic_packno_t packno;
     size_t out_sz;
     enum dec_packin dec_packin;
-    int s;
-    const size_t dst_sz = packet_in->pi_data_sz;
+    int s, in_place = 0;
+    size_t dst_sz = 0;
     unsigned char new_secret[EVP_MAX_KEY_LENGTH];
     struct crypto_ctx crypto_ctx_buf;
     char secret_str[EVP_MAX_KEY_LENGTH * 2 + 1];
     char errbuf[ERR_ERROR_STRING_BUF_LEN];
 
-    dst = lsquic_mm_get_packet_in_buf(&enpub->enp_mm, dst_sz);
-    if (!dst)
-    {
-        LSQ_WARN("cannot allocate memory to copy incoming packet data");
-        dec_packin = DECPI_NOMEM;
-        goto err;
-    }
-
     enc_level = hety2el[packet_in->pi_header_type];
     if (enc_level == ENC_LEV_FORW)
         hp = &enc_sess->esi_hp;
@@ -1885,8 +1890,31 @@ iquic_esf_decrypt_packet (enc_session_t *enc_session_p,
         dec_packin = DECPI_TOO_SHORT;
         goto err;
     }
+
+    /* The buffer only needs to fit the decrypted packet.  Sizing it this
+     * way makes the memory manager see the same size when the buffer is
+     * returned (see lsquic_mm_put_packet_in()).
+     */
+    dst_sz = packet_in->pi_data_sz - IQUIC_TAG_LEN;
+
+    /* Application's refcounted receive buffers are decrypted in place */
+    in_place = packet_in->pi_buf_ctx && !(packet_in->pi_flags & PI_OWN_DATA);
+    if (in_place)
+        dst = packet_in->pi_data;
+    else
+    {
+        dst = lsquic_mm_get_packet_in_buf(&enpub->enp_mm, dst_sz);
+        if (!dst)
+        {
+            LSQ_WARN("cannot allocate memory to copy incoming packet data");
+            dec_packin = DECPI_NOMEM;
+            goto err;
+        }
+    }
+
     cliser = !(enc_sess->esi_flags & ESI_SERVER);
-    memcpy(dst, packet_in->pi_data, sample_off);
+    if (!in_place)
+        memcpy(dst, packet_in->pi_data, sample_off);
     packet_in->pi_packno =
     packno = strip_hp(enc_sess, hp, cliser,
         packet_in->pi_data + sample_off,
@@ -2038,12 +2066,22 @@ iquic_esf_decrypt_packet (enc_session_t *enc_session_p,
     }
 
     packet_in->pi_data_sz = packet_in->pi_header_sz + out_sz;
-    if (packet_in->pi_flags & PI_OWN_DATA)
-        lsquic_mm_put_packet_in_buf(&enpub->enp_mm, packet_in->pi_data,
+    if (in_place)
+    {
+        if (!(packet_in->pi_flags & PI_BUF_REF))
+            lsquic_mm_ref_packet_in_buf(&enpub->enp_mm, packet_in);
+        packet_in->pi_flags |= PI_DECRYPTED
+                            | (enc_level << PIBIT_ENC_LEV_SHIFT);
+    }
+    else
+    {
+        if (packet_in->pi_flags & PI_OWN_DATA)
+            lsquic_mm_put_packet_in_buf(&enpub->enp_mm, packet_in->pi_data,
                                                         packet_in->pi_data_sz);
-    packet_in->pi_data = dst;
-    packet_in->pi_flags |= PI_OWN_DATA | PI_DECRYPTED
-                        | (enc_level << PIBIT_ENC_LEV_SHIFT);
+        packet_in->pi_data = dst;
+        packet_in->pi_flags |= PI_OWN_DATA | PI_DECRYPTED
+                            | (enc_level << PIBIT_ENC_LEV_SHIFT);
+    }
     EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "decrypted packet %"PRIu64,
                                                     packet_in->pi_packno);
     pns = lsquic_enclev2pns[enc_level];
@@ -2057,7 +2095,7 @@ iquic_esf_decrypt_packet (enc_session_t *enc_session_p,
   err:
     if (crypto_ctx == &crypto_ctx_buf)
         cleanup_crypto_ctx(crypto_ctx);
-    if (dst)
+    if (dst && !in_place)
         lsquic_mm_put_packet_in_buf(&enpub->enp_mm, dst, dst_sz);
     EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "could not decrypt packet (type %s, "
         "number %"PRIu64")", lsquic_hety2str[packet_in->pi_header_type],
@@ -2224,6 +2262,191 @@ static void iquic_esfi_shake_stream (enc_session_t *sess,
                             struct lsquic_stream *stream, const char *what);
 
 
+/* Flags that are carried over to the importing engine */
+#define ESI_EXPORT_FLAGS (ESI_QL_BITS)
+
+/* Only the 1-RTT keys and the peer's transport parameters are exported:
+ * the session must be past the point where it drops the SSL object, as
+ * TLS state cannot be carried over.
+ */
+static int
+iquic_esfi_export (enc_session_t *enc_session_p, struct export_writer *ew)
+{
+    struct enc_sess_iquic *const enc_sess = enc_session_p;
+    const struct crypto_ctx_pair *pair;
+    const struct crypto_ctx *ctx;
+    int trapa_len;
+    unsigned char trapa_buf[sizeof(struct transport_params)];
+    const unsigned need = ESI_SERVER|ESI_HANDSHAKE_OK|ESI_HAVE_PEER_TP
+                                                            |ESI_CACHED_INFO;
+
+    if (enc_sess->esi_ssl || (enc_sess->esi_flags & need) != need)
+    {
+        LSQ_DEBUG("cannot export: SSL object is still in use");
+        return -1;
+    }
+
+    trapa_len = lsquic_tp_encode(&enc_sess->esi_peer_tp, trapa_buf,
+                                                        sizeof(trapa_buf));
+    if (trapa_len < 0)
+    {
+        LSQ_WARN("cannot export: failed to encode transport parameters");
+        return -1;
+    }
+
+    lsquic_ew_u64(ew, enc_sess->esi_flags & ESI_EXPORT_FLAGS);
+    lsquic_ew_u64(ew, enc_sess->esi_cached_info.cipher_id);
+    lsquic_ew_u64(ew, enc_sess->esi_key_phase);
+    lsquic_ew_u64(ew, enc_sess->esi_max_packno[PNS_APP]);
+    lsquic_ew_u64(ew, enc_sess->esi_max_streams_uni);
+    lsquic_ew_bytes(ew, enc_sess->esi_traffic_secrets[0],
+                                                    enc_sess->esi_trasec_sz);
+    lsquic_ew_bytes(ew, enc_sess->esi_traffic_secrets[1],
+                                                    enc_sess->esi_trasec_sz);
+    lsquic_ew_bytes(ew, enc_sess->esi_hp.hp_buf[0], enc_sess->esi_hp.hp_sz);
+    lsquic_ew_bytes(ew, enc_sess->esi_hp.hp_buf[1], enc_sess->esi_hp.hp_sz);
+    for (pair = enc_sess->esi_pairs; pair < enc_sess->esi_pairs + 2; ++pair)
+    {
+        lsquic_ew_u64(ew, pair->ykp_thresh);
+        for (ctx = pair->ykp_ctx; ctx < pair->ykp_ctx + 2; ++ctx)
+        {
+            lsquic_ew_bytes(ew, ctx->yk_key_buf,
+                            ctx->yk_flags & YK_INITED ? ctx->yk_key_sz : 0);
+            lsquic_ew_bytes(ew, ctx->yk_iv_buf,
+                            ctx->yk_flags & YK_INITED ? ctx->yk_iv_sz : 0);
+        }
+    }
+    lsquic_ew_bytes(ew, trapa_buf, (size_t) trapa_len);
+
+    LSQ_DEBUG("exported enc session");
+    return 0;
+}
+
+
+static enc_session_t *
+iquic_esfi_import (struct lsquic_engine_public *enpub,
+                        struct lsquic_conn *lconn, struct export_reader *er)
+{
+    struct enc_sess_iquic *enc_sess;
+    const struct alpn_map *am;
+    const SSL_CIPHER *cipher;
+    struct crypto_ctx_pair *pair;
+    struct crypto_ctx *ctx;
+    struct crypto_params crypa;
+    uint64_t flags, cipher_id;
+    size_t sz, trapa_sz;
+    unsigned char trapa_buf[sizeof(struct transport_params)];
+
+    enc_sess = calloc(1, sizeof(*enc_sess));
+    if (!enc_sess)
+        return NULL;
+
+    enc_sess->esi_flags = ESI_SERVER|ESI_INITIALIZED|ESI_HANDSHAKE_OK
+                        |ESI_HAVE_PEER_TP|ESI_ALPN_CHECKED|ESI_CACHED_INFO
+                        |ESI_1RTT_ACKED;
+    enc_sess->esi_enpub = enpub;
+    enc_sess->esi_conn = lconn;
+    enc_sess->esi_dir[0] = evp_aead_open;
+    enc_sess->esi_dir[1] = evp_aead_seal;
+    init_frals(enc_sess);
+
+    for (am = s_alpns; am < s_alpns + sizeof(s_alpns)
+                                                / sizeof(s_alpns[0]); ++am)
+        if (am->version == lconn->cn_version)
+            break;
+    if (am >= s_alpns + sizeof(s_alpns) / sizeof(s_alpns[0]))
+    {
+        LSQ_INFO("cannot import: version %s has no matching ALPN",
+                                            lsquic_ver2str[lconn->cn_version]);
+        goto err;
+    }
+    enc_sess->esi_alpn = am->alpn;
+
+    flags = lsquic_er_u64(er);
+    enc_sess->esi_flags |= flags & ESI_EXPORT_FLAGS;
+    cipher_id = lsquic_er_u64(er);
+    enc_sess->esi_key_phase = lsquic_er_u64(er) & 1;
+    enc_sess->esi_max_packno[PNS_APP] = lsquic_er_u64(er);
+    enc_sess->esi_max_streams_uni = lsquic_er_u64(er);
+    if (er->er_error)
+        goto err;
+
+    cipher = SSL_get_cipher_by_value(cipher_id & 0xFFFF);
+    if (!cipher || 0 != get_crypto_params_by_id(enc_sess, cipher_id, &crypa))
+    {
+        LSQ_INFO("cannot import: unsupported cipher 0x%"PRIX64, cipher_id);
+        goto err;
+    }
+    enc_sess->esi_md = crypa.md;
+    enc_sess->esi_aead = crypa.aead;
+    enc_sess->esi_cached_info.cipher_name = SSL_CIPHER_get_name(cipher);
+    SSL_CIPHER_get_bits(cipher, &enc_sess->esi_cached_info.alg_bits);
+    enc_sess->esi_cached_info.cipher_id = cipher_id;
+
+    sz = lsquic_er_bytes(er, enc_sess->esi_traffic_secrets[0],
+                                    sizeof(enc_sess->esi_traffic_secrets[0]));
+    if (sz != lsquic_er_bytes(er, enc_sess->esi_traffic_secrets[1],
+                                    sizeof(enc_sess->esi_traffic_secrets[1])))
+        goto err;
+    enc_sess->esi_trasec_sz = sz;
+
+    sz = lsquic_er_bytes(er, enc_sess->esi_hp.hp_buf[0],
+                                            sizeof(enc_sess->esi_hp.hp_buf[0]));
+    if (sz != EVP_AEAD_key_length(crypa.aead)
+            || sz != lsquic_er_bytes(er, enc_sess->esi_hp.hp_buf[1],
+                                        sizeof(enc_sess->esi_hp.hp_buf[1])))
+        goto err;
+    enc_sess->esi_hp.hp_sz       = sz;
+    enc_sess->esi_hp.hp_enc_level = ENC_LEV_FORW;
+    enc_sess->esi_hp.hp_cipher   = crypa.hp;
+    enc_sess->esi_hp.hp_gen_mask = crypa.gen_hp_mask;
+
+    for (pair = enc_sess->esi_pairs; pair < enc_sess->esi_pairs + 2; ++pair)
+    {
+        pair->ykp_thresh = lsquic_er_u64(er);
+        for (ctx = pair->ykp_ctx; ctx < pair->ykp_ctx + 2; ++ctx)
+        {
+            ctx->yk_key_sz = lsquic_er_bytes(er, ctx->yk_key_buf,
+                                                    sizeof(ctx->yk_key_buf));
+            ctx->yk_iv_sz = lsquic_er_bytes(er, ctx->yk_iv_buf,
+                                                    sizeof(ctx->yk_iv_buf));
+            if (ctx->yk_key_sz == 0 && ctx->yk_iv_sz == 0)
+                continue;
+            if (ctx->yk_key_sz != EVP_AEAD_key_length(crypa.aead)
+                || ctx->yk_iv_sz != EVP_AEAD_nonce_length(crypa.aead)
+                || !EVP_AEAD_CTX_init_with_direction(&ctx->yk_aead_ctx,
+                        crypa.aead, ctx->yk_key_buf, ctx->yk_key_sz,
+                        IQUIC_TAG_LEN, enc_sess->esi_dir[ctx - pair->ykp_ctx]))
+                goto err;
+            ctx->yk_flags |= YK_INITED;
+        }
+    }
+    pair = &enc_sess->esi_pairs[ enc_sess->esi_key_phase ];
+    if (!((pair->ykp_ctx[0].yk_flags & pair->ykp_ctx[1].yk_flags) & YK_INITED))
+        goto err;
+
+    trapa_sz = lsquic_er_bytes(er, trapa_buf, sizeof(trapa_buf));
+    if (er->er_error
+            || 0 > lsquic_tp_decode(trapa_buf, trapa_sz, 0,
+                                                    &enc_sess->esi_peer_tp))
+        goto err;
+
+    LSQ_DEBUG("imported enc session; cipher: %s; key phase: %u",
+        enc_sess->esi_cached_info.cipher_name, enc_sess->esi_key_phase);
+    return enc_sess;
+
+  err:
+    LSQ_INFO("cannot import enc session: bad input");
+    for (pair = enc_sess->esi_pairs; pair < enc_sess->esi_pairs + 2; ++pair)
+    {
+        cleanup_crypto_ctx(&pair->ykp_ctx[0]);
+        cleanup_crypto_ctx(&pair->ykp_ctx[1]);
+    }
+    iquic_esfi_destroy(enc_sess);
+    return NULL;
+}
+
+
 const struct enc_session_funcs_iquic lsquic_enc_session_iquic_ietf_v1 =
 {
     .esfi_create_client  = iquic_esfi_create_client,
@@ -2237,6 +2460,8 @@ const struct enc_session_funcs_iquic lsquic_enc_session_iquic_ietf_v1 =
     .esfi_create_server  = iquic_esfi_create_server,
     .esfi_shake_stream   = iquic_esfi_shake_stream,
     .esfi_1rtt_acked     = iquic_esfi_1rtt_acked,
+    .esfi_export         = iquic_esfi_export,
+    .esfi_import         = iquic_esfi_import,
 };
 
 
@@ -2264,6 +2489,7 @@ cache_info (struct enc_sess_iquic *enc_sess)
     cipher = SSL_get_current_cipher(enc_sess->esi_ssl);
     enc_sess->esi_cached_info.cipher_name = SSL_CIPHER_get_name(cipher);
     SSL_CIPHER_get_bits(cipher, &enc_sess->esi_cached_info.alg_bits);
+    enc_sess->esi_cached_info.cipher_id = SSL_CIPHER_get_id(cipher);
     enc_sess->esi_flags |= ESI_CACHED_INFO;
 }
 
@@ -2305,7 +2531,7 @@ maybe_drop_SSL (struct enc_sess_iquic *enc_sess)
             LSQ_DEBUG("no session ticket: delay dropping SSL object");
             lsquic_alarmset_set(enc_sess->esi_alset, AL_SESS_TICKET,
                 /* Wait up to two seconds for session tickets */
-                                                lsquic_time_now() + 2000000);
+                        lsquic_enpub_now(enc_sess->esi_enpub) + 2000000);
         }
     }
 }
@@ -34,6 +34,7 @@
 #endif
 
 #include <openssl/aead.h>
+#include <openssl/rand.h>
 
 #include "lsquic.h"
 #include "lsquic_types.h"
@@ -55,11 +56,15 @@
 #include "lsquic_conn_flow.h"
 #include "lsquic_sfcw.h"
 #include "lsquic_hash.h"
+#include "lsquic_cid_hash.h"
 #include "lsquic_conn.h"
 #include "lsquic_full_conn.h"
+#include "lsquic_hib_conn.h"
 #include "lsquic_util.h"
 #include "lsquic_qtags.h"
 #include "lsquic_enc_sess.h"
+#include "lsquic_arena.h"
+#include "lsquic_malo.h"
 #include "lsquic_mm.h"
 #include "lsquic_engine_public.h"
 #include "lsquic_eng_hist.h"
@@ -76,6 +81,7 @@
 #include "lsquic_http1x_if.h"
 #include "lsquic_parse_common.h"
 #include "lsquic_handshake.h"
+#include "lsquic_tick_pool.h"
 
 #define LSQUIC_LOGGER_MODULE LSQLM_ENGINE
 #include "lsquic_logger.h"
@@ -104,7 +110,8 @@ typedef struct lsquic_conn * (*conn_iter_f)(struct lsquic_engine *);
 
 static void
 process_connections (struct lsquic_engine *engine, conn_iter_f iter,
-                     lsquic_time_t now);
+                     lsquic_time_t now, unsigned max_conns,
+                     lsquic_time_t deadline);
 
 static void
 engine_incref_conn (lsquic_conn_t *conn, enum lsquic_conn_flags flag);
@@ -116,6 +123,9 @@ engine_decref_conn (lsquic_engine_t *engine, lsquic_conn_t *conn,
 static void
 force_close_conn (lsquic_engine_t *engine, lsquic_conn_t *conn);
 
+static void
+remove_conn_from_hash (lsquic_engine_t *engine, lsquic_conn_t *conn);
+
 #if LSQUIC_COUNT_ENGINE_CALLS
 #define ENGINE_CALLS_INCR(e) do { ++(e)->n_engine_calls; } while (0)
 #else
@@ -197,6 +207,7 @@ struct lsquic_engine
                                          */
         ENG_CONNS_BY_ADDR
                         = (1 <<  9),    /* Connections are hashed by address */
+        ENG_RETRY       = (1 << 10),    /* Send Retry to clients without token */
 #ifndef NDEBUG
         ENG_COALESCE    = (1 << 24),    /* Packet coalescing is enabled */
         ENG_LOSE_PACKETS= (1 << 25),    /* Lose *some* outgoing packets */
@@ -209,7 +220,7 @@ struct lsquic_engine
     lsquic_cids_update_f               report_live_scids;
     lsquic_cids_update_f               report_old_scids;
     void                              *scids_ctx;
-    struct lsquic_hash                *conns_hash;
+    struct cid_hash                   *conns_hash;
     struct min_heap                    conns_tickable;
     struct min_heap                    conns_out;
     /* Use a union because only one iterator is being used at any one time */
@@ -235,6 +246,11 @@ struct lsquic_engine
     lsquic_time_t                      deadline;
     lsquic_time_t                      resume_sending_at;
     unsigned                           mini_conns_count;
+    /* Mini connections created since hsk_rate_start; compared against
+     * es_retry_hsk_rate.
+     */
+    unsigned                           hsk_rate_count;
+    lsquic_time_t                      hsk_rate_start;
     struct lsquic_purga               *purga;
 #if LSQUIC_CONN_STATS
     struct {
@@ -245,6 +261,16 @@ struct lsquic_engine
 #endif
     struct cid_update_batch            new_scids;
     struct out_batch                   out_batch;
+#if LSQUIC_TICK_THREADS
+    /* Used when es_tick_threads is larger than one */
+    struct tick_pool                  *tick_pool;
+    pthread_mutex_t                    mt_lock;
+    struct mt_tick {
+        struct lsquic_conn     *conn;
+        enum tick_st            tick_st;
+    }                                 *mt_ticks;
+    unsigned                           mt_ticks_sz;
+#endif
 #if LSQUIC_COUNT_ENGINE_CALLS
     unsigned long                      n_engine_calls;
 #endif
@@ -324,6 +350,17 @@ lsquic_engine_init_settings (struct lsquic_engine_settings *settings,
     settings->es_qpack_enc_max_blocked = LSQUIC_DF_QPACK_ENC_MAX_BLOCKED;
     settings->es_allow_migration = LSQUIC_DF_ALLOW_MIGRATION;
     settings->es_ql_bits         = LSQUIC_DF_QL_BITS;
+    settings->es_n_shards        = LSQUIC_DF_N_SHARDS;
+    settings->es_gso             = LSQUIC_DF_GSO;
+    settings->es_clock           = LSQUIC_DF_CLOCK;
+    settings->es_tick_threads    = LSQUIC_DF_TICK_THREADS;
+    settings->es_retry_inchoate  = LSQUIC_DF_RETRY_INCHOATE;
+    settings->es_retry_hsk_rate  = LSQUIC_DF_RETRY_HSK_RATE;
+    settings->es_arena           = LSQUIC_DF_ARENA;
+    settings->es_arena_numa_node = LSQUIC_DF_ARENA_NUMA_NODE;
+    settings->es_shared_pools    = LSQUIC_DF_SHARED_POOLS;
+    settings->es_mem_budget      = LSQUIC_DF_MEM_BUDGET;
+    settings->es_hibernate_idle  = LSQUIC_DF_HIBERNATE_IDLE;
 }
 
 
@@ -391,6 +428,110 @@ lsquic_engine_check_settings (const struct lsquic_engine_settings *settings,
                 "algorithm value %u", settings->es_cc_algo);
         return -1;
     }
+
+    if (settings->es_n_shards > 1)
+    {
+        if (!(flags & ENG_SERVER))
+        {
+            if (err_buf)
+                snprintf(err_buf, err_buf_sz, "%s",
+                            "sharded mode is only supported by the server");
+            return -1;
+        }
+        if (settings->es_n_shards > LSQUIC_MAX_SHARDS)
+        {
+            if (err_buf)
+                snprintf(err_buf, err_buf_sz, "number of shards cannot "
+                    "exceed %u", LSQUIC_MAX_SHARDS);
+            return -1;
+        }
+        if (settings->es_shard_id >= settings->es_n_shards)
+        {
+            if (err_buf)
+                snprintf(err_buf, err_buf_sz, "shard ID %u is out of range: "
+                    "there are %u shards", settings->es_shard_id,
+                    settings->es_n_shards);
+            return -1;
+        }
+    }
+
+    if (!(settings->es_clock == LSQUIC_CLOCK_PRECISE
+                                || settings->es_clock == LSQUIC_CLOCK_COARSE))
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "Invalid clock value %u",
+                                                (unsigned) settings->es_clock);
+        return -1;
+    }
+
+    if (settings->es_tick_threads > 1)
+    {
+#if LSQUIC_TICK_THREADS
+        if (settings->es_tick_threads > LSQUIC_MAX_TICK_THREADS)
+        {
+            if (err_buf)
+                snprintf(err_buf, err_buf_sz, "number of tick threads cannot "
+                    "exceed %u", LSQUIC_MAX_TICK_THREADS);
+            return -1;
+        }
+#else
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "%s", "ticking connections on "
+                "several threads is not supported on this platform");
+        return -1;
+#endif
+    }
+
+    if (settings->es_arena_numa_node < -1
+                        || settings->es_arena_numa_node > ARENA_MAX_NODE)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "invalid arena NUMA node %d",
+                                                settings->es_arena_numa_node);
+        return -1;
+    }
+
+#if !LSQUIC_MALO_MT
+    if (settings->es_shared_pools)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "%s", "shared object pools are "
+                "not supported on this platform");
+        return -1;
+    }
+#endif
+
+    if (settings->es_mem_budget
+                        && settings->es_mem_budget < settings->es_max_cfcw)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "memory budget of %zu bytes is "
+                "smaller than the maximum connection flow control window "
+                "(%u bytes)", settings->es_mem_budget, settings->es_max_cfcw);
+        return -1;
+    }
+
+    if (settings->es_hibernate_idle)
+    {
+        /* Same restriction as lsquic_conn_export() */
+        if ((flags & (ENG_SERVER|ENG_HTTP)) != ENG_SERVER)
+        {
+            if (err_buf)
+                snprintf(err_buf, err_buf_sz, "%s", "hibernation is only "
+                    "available to servers in non-HTTP mode");
+            return -1;
+        }
+        if (settings->es_hibernate_idle >= settings->es_idle_timeout)
+        {
+            if (err_buf)
+                snprintf(err_buf, err_buf_sz, "hibernation idle time (%u "
+                    "seconds) must be smaller than the idle timeout (%u "
+                    "seconds)", settings->es_hibernate_idle,
+                    settings->es_idle_timeout);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -409,6 +550,73 @@ malloc_buf (void *ctx, void *conn_ctx, unsigned short size, char is_ipv6)
 }
 
 
+static lsquic_time_t
+engine_clock_precise (void *ctx)
+{
+    struct lsquic_engine_public *const enpub = ctx;
+    lsquic_time_t now;
+
+    now = lsquic_time_now();
+#if LSQUIC_TICK_THREADS
+    /* Worker threads do not update shared state */
+    if (!enpub->enp_mt_lock)
+#endif
+        enpub->enp_last_precise = now;
+    return now;
+}
+
+
+static lsquic_time_t
+engine_clock_coarse (void *ctx)
+{
+    const struct lsquic_engine_public *const enpub = ctx;
+    lsquic_time_t now;
+
+    /* Coarse clock lags behind the precise clock.  Do not let it go back
+     * in time relative to the packet timestamps.
+     */
+    now = lsquic_time_now_coarse();
+    if (now < enpub->enp_last_precise)
+        now = enpub->enp_last_precise;
+    return now;
+}
+
+
+#if LSQUIC_TICK_THREADS
+/* Number of connections per thread ticked in one go */
+#define MT_TICKS_PER_THREAD 32
+
+static int
+init_tick_pool (struct lsquic_engine *engine)
+{
+    pthread_mutexattr_t attr;
+    unsigned n_threads;
+
+    n_threads = engine->pub.enp_settings.es_tick_threads;
+    engine->mt_ticks_sz = n_threads * MT_TICKS_PER_THREAD;
+    engine->mt_ticks = malloc(engine->mt_ticks_sz
+                                            * sizeof(engine->mt_ticks[0]));
+    if (!engine->mt_ticks)
+        return -1;
+
+    engine->tick_pool = lsquic_tp_new(n_threads);
+    if (!engine->tick_pool)
+    {
+        LSQ_ERROR("cannot create pool of %u tick threads", n_threads);
+        free(engine->mt_ticks);
+        engine->mt_ticks = NULL;
+        return -1;
+    }
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&engine->mt_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return 0;
+}
+#endif
+
+
 static const struct lsquic_packout_mem_if stock_pmi =
 {
     malloc_buf, free_packet, free_packet,
@@ -464,6 +672,26 @@ lsquic_engine_new (unsigned flags,
         engine->pub.enp_settings        = *api->ea_settings;
     else
         lsquic_engine_init_settings(&engine->pub.enp_settings, flags);
+    /* Leave some headroom: the peer may send data it already has credit for */
+    engine->pub.enp_mem_high = engine->pub.enp_settings.es_mem_budget
+                            - engine->pub.enp_settings.es_mem_budget / 8;
+    if (engine->pub.enp_settings.es_arena
+        && 0 != lsquic_mm_use_arena(&engine->pub.enp_mm,
+                                engine->pub.enp_settings.es_arena_numa_node))
+    {
+        LSQ_ERROR("cannot create slab arena");
+        lsquic_mm_cleanup(&engine->pub.enp_mm);
+        free(engine);
+        return NULL;
+    }
+    if (engine->pub.enp_settings.es_shared_pools
+        && 0 != lsquic_mm_use_shared_pools(&engine->pub.enp_mm))
+    {
+        LSQ_ERROR("cannot set up shared object pools");
+        lsquic_mm_cleanup(&engine->pub.enp_mm);
+        free(engine);
+        return NULL;
+    }
     int tag_buf_len;
     tag_buf_len = lsquic_gen_ver_tags(engine->pub.enp_ver_tags_buf,
                                     sizeof(engine->pub.enp_ver_tags_buf),
@@ -523,19 +751,45 @@ lsquic_engine_new (unsigned flags,
         engine->pub.enp_pmi      = api->ea_pmi;
         engine->pub.enp_pmi_ctx  = api->ea_pmi_ctx;
     }
+    else if (engine->pub.enp_mm.arena)
+    {
+        engine->pub.enp_pmi      = &lsquic_mm_arena_pmi;
+        engine->pub.enp_pmi_ctx  = &engine->pub.enp_mm;
+    }
     else
     {
         engine->pub.enp_pmi      = &stock_pmi;
         engine->pub.enp_pmi_ctx  = NULL;
     }
+    engine->pub.enp_mm.rbi       = api->ea_rbi;
+    engine->pub.enp_mm.rbi_ctx   = api->ea_rbi_ctx;
     engine->pub.enp_verify_cert  = api->ea_verify_cert;
     engine->pub.enp_verify_ctx   = api->ea_verify_ctx;
     engine->pub.enp_kli          = api->ea_keylog_if;
     engine->pub.enp_kli_ctx      = api->ea_keylog_ctx;
+    if (api->ea_get_time)
+    {
+        engine->pub.enp_clock         = api->ea_get_time;
+        engine->pub.enp_precise_clock = api->ea_get_time;
+        engine->pub.enp_clock_ctx     = api->ea_get_time_ctx;
+    }
+    else
+    {
+        if (engine->pub.enp_settings.es_clock == LSQUIC_CLOCK_COARSE)
+            engine->pub.enp_clock     = engine_clock_coarse;
+        else
+            engine->pub.enp_clock     = engine_clock_precise;
+        engine->pub.enp_precise_clock = engine_clock_precise;
+        engine->pub.enp_clock_ctx     = &engine->pub;
+    }
     engine->pub.enp_engine = engine;
     if (hash_conns_by_addr(engine))
         engine->flags |= ENG_CONNS_BY_ADDR;
-    engine->conns_hash = lsquic_hash_create();
+    RAND_bytes(engine->pub.enp_hash_key, sizeof(engine->pub.enp_hash_key));
+    engine->conns_hash = lsquic_cidh_create(
+            engine->pub.enp_settings.es_scid_len, engine->pub.enp_hash_key);
+    if (!engine->conns_hash)
+        return NULL;
     engine->pub.enp_tokgen = lsquic_tg_new(&engine->pub);
     if (!engine->pub.enp_tokgen)
         return NULL;
@@ -563,13 +817,22 @@ lsquic_engine_new (unsigned flags,
     engine->batch_size = INITIAL_OUT_BATCH_SIZE;
     if (engine->pub.enp_settings.es_honor_prst)
     {
-        engine->pub.enp_srst_hash = lsquic_hash_create();
+        engine->pub.enp_srst_hash = lsquic_hash_create_keyed(
+                                                engine->pub.enp_hash_key);
         if (!engine->pub.enp_srst_hash)
         {
             lsquic_engine_destroy(engine);
             return NULL;
         }
     }
+#if LSQUIC_TICK_THREADS
+    if (engine->pub.enp_settings.es_tick_threads > 1
+                                            && 0 != init_tick_pool(engine))
+    {
+        lsquic_engine_destroy(engine);
+        return NULL;
+    }
+#endif
 
 #ifndef NDEBUG
     {
@@ -715,7 +978,19 @@ destroy_conn (struct lsquic_engine *engine, struct lsquic_conn *conn,
             && (conn->cn_flags & (LSCONN_MINI|LSCONN_PROMOTED))
                                         != (LSCONN_MINI|LSCONN_PROMOTED))
     {
-        if (!(conn->cn_flags & LSCONN_IMMED_CLOSE)
+        if (conn->cn_flags & LSCONN_EXPORTED)
+        {
+            /* The connection lives on in another engine.  Packets that
+             * still arrive here are dropped: a stateless reset would kill
+             * the connection.
+             */
+            for (cce = cce_iter_first(&citer, conn); cce;
+                                                cce = cce_iter_next(&citer))
+                (void) lsquic_purga_add(engine->purga, &cce->cce_cid,
+                                    lsquic_conn_get_peer_ctx(conn, NULL),
+                                    PUTY_CID_MOVED, now);
+        }
+        else if (!(conn->cn_flags & LSCONN_IMMED_CLOSE)
             && conn->cn_if->ci_drain_time &&
             (drain_time = conn->cn_if->ci_drain_time(conn), drain_time))
         {
@@ -790,7 +1065,7 @@ maybe_grow_conn_heaps (struct lsquic_engine *engine)
 
 
 static void
-remove_cces_from_hash (struct lsquic_hash *hash, struct lsquic_conn *conn,
+remove_cces_from_hash (struct cid_hash *hash, struct lsquic_conn *conn,
                                                                 unsigned todo)
 {
     unsigned n;
@@ -798,12 +1073,12 @@ remove_cces_from_hash (struct lsquic_hash *hash, struct lsquic_conn *conn,
     for (n = 0; todo; todo &= ~(1 << n++))
         if ((todo & (1 << n)) &&
                         (conn->cn_cces[n].cce_hash_el.qhe_flags & QHE_HASHED))
-            lsquic_hash_erase(hash, &conn->cn_cces[n].cce_hash_el);
+            lsquic_cidh_erase(hash, &conn->cn_cces[n].cce_hash_el);
 }
 
 
 static void
-remove_all_cces_from_hash (struct lsquic_hash *hash, struct lsquic_conn *conn)
+remove_all_cces_from_hash (struct cid_hash *hash, struct lsquic_conn *conn)
 {
     remove_cces_from_hash(hash, conn, conn->cn_cces_mask);
 }
@@ -825,7 +1100,7 @@ insert_conn_into_hash (struct lsquic_engine *engine, struct lsquic_conn *conn,
         {
             cce = &conn->cn_cces[n];
             assert(!(cce->cce_hash_el.qhe_flags & QHE_HASHED));
-            if (lsquic_hash_insert(engine->conns_hash, cce->cce_cid.idbuf,
+            if (lsquic_cidh_insert(engine->conns_hash, cce->cce_cid.idbuf,
                                     cce->cce_cid.len, conn, &cce->cce_hash_el))
                 done |= 1 << n;
             else
@@ -964,12 +1239,12 @@ sa2port (const struct sockaddr *sa)
 
 
 static struct lsquic_hash_elem *
-find_conn_by_addr (struct lsquic_hash *hash, const struct sockaddr *sa)
+find_conn_by_addr (struct cid_hash *hash, const struct sockaddr *sa)
 {
     unsigned short port;
 
     port = sa2port(sa);
-    return lsquic_hash_find(hash, &port, sizeof(port));
+    return lsquic_cidh_find(hash, &port, sizeof(port));
 }
 
 
@@ -983,7 +1258,7 @@ find_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
     if (engine->flags & ENG_CONNS_BY_ADDR)
         el = find_conn_by_addr(engine->conns_hash, sa_local);
     else if (packet_in->pi_flags & PI_CONN_ID)
-        el = lsquic_hash_find(engine->conns_hash,
+        el = lsquic_cidh_find(engine->conns_hash,
                     packet_in->pi_conn_id.idbuf, packet_in->pi_conn_id.len);
     else
     {
@@ -1009,6 +1284,39 @@ find_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
 }
 
 
+/* Returns true if clients must prove their address using a Retry token
+ * before we create mini connections for them.
+ */
+static int
+retry_mode (struct lsquic_engine *engine, lsquic_time_t now)
+{
+    const struct lsquic_engine_settings *const settings
+                                                = &engine->pub.enp_settings;
+    int on;
+
+    if (now >= engine->hsk_rate_start + 1000000)
+    {
+        engine->hsk_rate_start = now;
+        engine->hsk_rate_count = 0;
+    }
+
+    on = (settings->es_retry_inchoate
+                && engine->mini_conns_count >= settings->es_retry_inchoate)
+      || (settings->es_retry_hsk_rate
+                && engine->hsk_rate_count >= settings->es_retry_hsk_rate);
+
+    if (on != !!(engine->flags & ENG_RETRY))
+    {
+        engine->flags ^= ENG_RETRY;
+        LSQ_INFO("%s retry mode: %u mini connections, %u new ones in the "
+            "last second", on ? "enter" : "leave", engine->mini_conns_count,
+            engine->hsk_rate_count);
+    }
+
+    return on;
+}
+
+
 static lsquic_conn_t *
 find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
          struct packin_parse_state *ppstate, const struct sockaddr *sa_local,
@@ -1017,13 +1325,15 @@ find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
     struct lsquic_hash_elem *el;
     struct purga_el *puel;
     lsquic_conn_t *conn;
+    const lsquic_cid_t *odcid;
+    lsquic_cid_t odcid_buf;
 
     if (!(packet_in->pi_flags & PI_CONN_ID))
     {
         LSQ_DEBUG("packet header does not have connection ID: discarding");
         return NULL;
     }
-    el = lsquic_hash_find(engine->conns_hash,
+    el = lsquic_cidh_find(engine->conns_hash,
                     packet_in->pi_conn_id.idbuf, packet_in->pi_conn_id.len);
 
     if (el)
@@ -1057,6 +1367,10 @@ find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
             LSQ_DEBUGC("CID %"CID_FMT" was retired, ignore packet",
                                             CID_BITS(&packet_in->pi_conn_id));
             return NULL;
+        case PUTY_CID_MOVED:
+            LSQ_DEBUGC("connection with CID %"CID_FMT" was moved to another "
+                "engine, ignore packet", CID_BITS(&packet_in->pi_conn_id));
+            return NULL;
         case PUTY_CONN_DRAIN:
             LSQ_DEBUG("drain till: %"PRIu64"; now: %"PRIu64,
                 puel->puel_time, packet_in->pi_received);
@@ -1123,8 +1437,30 @@ find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
 
     if ((1 << version) & LSQUIC_IETF_VERSIONS)
     {
+        odcid = NULL;
+        if (packet_in->pi_token_size)
+        {
+            if (0 == lsquic_tg_validate_retry(engine->pub.enp_tokgen,
+                        packet_in->pi_data + packet_in->pi_token,
+                        packet_in->pi_token_size, sa_peer, &odcid_buf,
+                        packet_in->pi_received))
+                odcid = &odcid_buf;
+            else if (retry_mode(engine, packet_in->pi_received))
+            {
+                LSQ_DEBUGC("invalid token in packet for CID %"CID_FMT
+                    ": drop it", CID_BITS(&packet_in->pi_conn_id));
+                return NULL;
+            }
+        }
+        if (!odcid && HETY_INITIAL == packet_in->pi_header_type
+                                && retry_mode(engine, packet_in->pi_received))
+        {
+            schedule_req_packet(engine, PACKET_REQ_RETRY, packet_in,
+                                                sa_local, sa_peer, peer_ctx);
+            return NULL;
+        }
         conn = lsquic_mini_conn_ietf_new(&engine->pub, packet_in, version,
-                    sa_peer->sa_family == AF_INET, NULL);
+                    sa_peer->sa_family == AF_INET, odcid);
     }
     else
     {
@@ -1133,6 +1469,7 @@ find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
     if (!conn)
         return NULL;
     ++engine->mini_conns_count;
+    ++engine->hsk_rate_count;
     ++engine->n_conns;
     if (0 != insert_conn_into_hash(engine, conn, peer_ctx))
     {
@@ -1156,10 +1493,12 @@ lsquic_engine_find_conn (const struct lsquic_engine_public *engine,
 {
     struct lsquic_hash_elem *el;
     lsquic_conn_t *conn = NULL;
-    el = lsquic_hash_find(engine->enp_engine->conns_hash, cid->idbuf, cid->len);
 
+    lsquic_enpub_lock(engine);
+    el = lsquic_cidh_find(engine->enp_engine->conns_hash, cid->idbuf, cid->len);
     if (el)
         conn = lsquic_hashelem_getdata(el);
+    lsquic_enpub_unlock(engine);
     return conn;
 }
 
@@ -1186,6 +1525,8 @@ lsquic_engine_add_conn_to_attq (struct lsquic_engine_public *enpub,
                     lsquic_conn_t *conn, lsquic_time_t tick_time, unsigned why)
 {
     lsquic_engine_t *const engine = (lsquic_engine_t *) enpub;
+
+    lsquic_enpub_lock(enpub);
     if (conn->cn_flags & LSCONN_TICKABLE)
     {
         /* Optimization: no need to add the connection to the Advisory Tick
@@ -1204,6 +1545,7 @@ lsquic_engine_add_conn_to_attq (struct lsquic_engine_public *enpub,
     }
     else if (0 == attq_add(engine->attq, conn, tick_time, why))
         engine_incref_conn(conn, LSCONN_ATTQ);
+    lsquic_enpub_unlock(enpub);
 }
 
 
@@ -1229,6 +1571,50 @@ find_conn_by_srst (struct lsquic_engine *engine,
 }
 
 
+/* Replace hibernated connection with the full connection recreated from
+ * it.  If this fails, the hibernated connection is dropped.
+ */
+static struct lsquic_conn *
+wake_conn (struct lsquic_engine *engine, struct lsquic_conn *hib_conn,
+                                                                void *peer_ctx)
+{
+    struct lsquic_conn *conn;
+
+    if (0 != maybe_grow_conn_heaps(engine))
+        return NULL;
+
+    conn = lsquic_hib_conn_wake(&engine->pub, hib_conn,
+                            engine->flags & (ENG_SERVER|ENG_HTTP), peer_ctx);
+    if (conn)
+        ++engine->n_conns;
+
+    /* Engine reference flags may keep the hibernated connection around a
+     * little longer: it no longer owns its CIDs.
+     */
+    remove_conn_from_hash(engine, hib_conn);
+    if (conn)
+        hib_conn->cn_cces_mask = 0;
+    if (hib_conn->cn_flags & LSCONN_ATTQ)
+    {
+        attq_remove(engine->attq, hib_conn);
+        (void) engine_decref_conn(engine, hib_conn, LSCONN_ATTQ);
+    }
+
+    if (!conn)
+        return NULL;
+
+    if (0 != insert_conn_into_hash(engine, conn, peer_ctx))
+    {
+        LSQ_WARNC("cannot add woken up connection %"CID_FMT" to hash - "
+                            "destroy", CID_BITS(lsquic_conn_log_cid(conn)));
+        destroy_conn(engine, conn, lsquic_enpub_tick_time(&engine->pub));
+        return NULL;
+    }
+    conn->cn_flags |= LSCONN_HASHED;
+    return conn;
+}
+
+
 /* Return 0 if packet is being processed by a real connection (mini or full),
  * otherwise return 1.
  */
@@ -1282,6 +1668,13 @@ process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
         return 1;
     }
 
+    if ((conn->cn_flags & LSCONN_HIBERNATED)
+                            && !(conn = wake_conn(engine, conn, peer_ctx)))
+    {
+        lsquic_mm_put_packet_in(&engine->pub.enp_mm, packet_in);
+        return 1;
+    }
+
     if (0 == (conn->cn_flags & LSCONN_TICKABLE))
     {
         lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
@@ -1319,6 +1712,32 @@ process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
 }
 
 
+/* Long lookups mean that the hash is being flooded */
+static void
+log_hash_stats (const struct lsquic_engine *engine)
+{
+    struct lsquic_hash_stats stats;
+
+    if (!LSQ_LOG_ENABLED(LSQ_LOG_INFO))
+        return;
+
+    lsquic_cidh_get_stats(engine->conns_hash, &stats);
+    LSQ_INFO("connections hash: %lu lookups, %.2f probes per lookup, "
+        "longest lookup: %u probes", stats.hs_lookups, stats.hs_lookups ?
+        (double) stats.hs_probes / (double) stats.hs_lookups : 0.,
+        stats.hs_max_probes);
+    if (engine->pub.enp_srst_hash)
+    {
+        lsquic_hash_get_stats(engine->pub.enp_srst_hash, &stats);
+        LSQ_INFO("stateless reset hash: %lu lookups, %.2f probes per "
+            "lookup, longest lookup: %u probes", stats.hs_lookups,
+            stats.hs_lookups ?
+            (double) stats.hs_probes / (double) stats.hs_lookups : 0.,
+            stats.hs_max_probes);
+    }
+}
+
+
 void
 lsquic_engine_destroy (lsquic_engine_t *engine)
 {
@@ -1329,6 +1748,14 @@ lsquic_engine_destroy (lsquic_engine_t *engine)
 #ifndef NDEBUG
     engine->flags |= ENG_DTOR;
 #endif
+#if LSQUIC_TICK_THREADS
+    if (engine->tick_pool)
+    {
+        lsquic_tp_destroy(engine->tick_pool);
+        pthread_mutex_destroy(&engine->mt_lock);
+        free(engine->mt_ticks);
+    }
+#endif
 
     while ((conn = lsquic_mh_pop(&engine->conns_out)))
     {
@@ -1342,13 +1769,14 @@ lsquic_engine_destroy (lsquic_engine_t *engine)
         (void) engine_decref_conn(engine, conn, LSCONN_TICKABLE);
     }
 
-    for (el = lsquic_hash_first(engine->conns_hash); el;
-                                el = lsquic_hash_next(engine->conns_hash))
+    for (el = lsquic_cidh_first(engine->conns_hash); el;
+                                el = lsquic_cidh_next(engine->conns_hash))
     {
         conn = lsquic_hashelem_getdata(el);
         force_close_conn(engine, conn);
     }
-    lsquic_hash_destroy(engine->conns_hash);
+    log_hash_stats(engine);
+    lsquic_cidh_destroy(engine->conns_hash);
 
     assert(0 == engine->n_conns);
     assert(0 == engine->mini_conns_count);
@@ -1448,7 +1876,7 @@ add_conn_to_hash (struct lsquic_engine *engine, struct lsquic_conn *conn,
         }
         cce->cce_port = sa2port(local_sa);
         cce->cce_flags = CCE_PORT;
-        if (lsquic_hash_insert(engine->conns_hash, &cce->cce_port,
+        if (lsquic_cidh_insert(engine->conns_hash, &cce->cce_port,
                                 sizeof(cce->cce_port), conn, &cce->cce_hash_el))
         {
             conn->cn_cces_mask |= 1 << (cce - conn->cn_cces);
@@ -1523,8 +1951,10 @@ lsquic_engine_connect (lsquic_engine_t *engine, enum lsquic_version version,
                             zero_rtt, zero_rtt_len);
     if (!conn)
         goto err;
-    EV_LOG_CREATE_CONN(lsquic_conn_log_cid(conn), local_sa, peer_sa);
-    EV_LOG_VER_NEG(lsquic_conn_log_cid(conn), "proposed",
+    EV_LOG_CREATE_CONN(lsquic_conn_log_cid(conn),
+                        lsquic_enpub_tick_time(&engine->pub), local_sa, peer_sa);
+    EV_LOG_VER_NEG(lsquic_conn_log_cid(conn),
+                        lsquic_enpub_tick_time(&engine->pub), "proposed",
                                             lsquic_ver2str[conn->cn_version]);
     ++engine->n_conns;
     lsquic_conn_record_sockaddr(conn, peer_ctx, local_sa, peer_sa);
@@ -1533,7 +1963,7 @@ lsquic_engine_connect (lsquic_engine_t *engine, enum lsquic_version version,
         const lsquic_cid_t *cid = lsquic_conn_log_cid(conn);
         LSQ_WARNC("cannot add connection %"CID_FMT" to hash - destroy",
             CID_BITS(cid));
-        destroy_conn(engine, conn, lsquic_time_now());
+        destroy_conn(engine, conn, lsquic_enpub_tick_time(&engine->pub));
         goto err;
     }
     assert(!(conn->cn_flags &
@@ -1555,6 +1985,58 @@ lsquic_engine_connect (lsquic_engine_t *engine, enum lsquic_version version,
 }
 
 
+lsquic_conn_t *
+lsquic_engine_import_conn (lsquic_engine_t *engine, const void *buf,
+                                                size_t bufsz, void *peer_ctx)
+{
+    lsquic_conn_t *conn;
+
+    ENGINE_IN(engine);
+
+    if (!(engine->flags & ENG_SERVER))
+    {
+        LSQ_ERROR("`%s' must only be called in server mode", __func__);
+        goto err;
+    }
+
+    if (0 != maybe_grow_conn_heaps(engine))
+        goto err;
+    conn = lsquic_ietf_full_conn_import(&engine->pub,
+                    engine->flags & (ENG_SERVER|ENG_HTTP), buf, bufsz, peer_ctx);
+    if (!conn)
+    {
+        LSQ_INFO("could not import connection: %s", strerror(errno));
+        goto err;
+    }
+    ++engine->n_conns;
+    if (0 != insert_conn_into_hash(engine, conn, peer_ctx))
+    {
+        const lsquic_cid_t *cid = lsquic_conn_log_cid(conn);
+        LSQ_WARNC("cannot add connection %"CID_FMT" to hash - destroy",
+            CID_BITS(cid));
+        destroy_conn(engine, conn, lsquic_enpub_tick_time(&engine->pub));
+        goto err;
+    }
+    assert(!(conn->cn_flags &
+        (CONN_REF_FLAGS
+         & ~LSCONN_TICKABLE /* This flag may be set as effect of user
+                                 callbacks */
+                             )));
+    conn->cn_flags |= LSCONN_HASHED;
+    if (!(conn->cn_flags & LSCONN_TICKABLE))
+    {
+        lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
+        engine_incref_conn(conn, LSCONN_TICKABLE);
+    }
+  end:
+    ENGINE_OUT(engine);
+    return conn;
+  err:
+    conn = NULL;
+    goto end;
+}
+
+
 static void
 remove_conn_from_hash (lsquic_engine_t *engine, lsquic_conn_t *conn)
 {
@@ -1609,7 +2091,7 @@ engine_decref_conn (lsquic_engine_t *engine, lsquic_conn_t *conn,
                     (refflags2str(conn->cn_flags, str[1]), str[1]));
     if (0 == (conn->cn_flags & CONN_REF_FLAGS))
     {
-        now = lsquic_time_now();
+        now = lsquic_enpub_tick_time(&engine->pub);
         if (conn->cn_flags & LSCONN_MINI)
             eng_hist_inc(&engine->history, now, sl_del_mini_conns);
         else
@@ -1730,8 +2212,8 @@ drop_all_mini_conns (lsquic_engine_t *engine)
 
     cub_init(&cub, engine->report_old_scids, engine->scids_ctx);
 
-    for (el = lsquic_hash_first(engine->conns_hash); el;
-                                el = lsquic_hash_next(engine->conns_hash))
+    for (el = lsquic_cidh_first(engine->conns_hash); el;
+                                el = lsquic_cidh_next(engine->conns_hash))
     {
         conn = lsquic_hashelem_getdata(el);
         if (conn->cn_flags & LSCONN_MINI)
@@ -1748,15 +2230,13 @@ drop_all_mini_conns (lsquic_engine_t *engine)
 }
 
 
-void
-lsquic_engine_process_conns (lsquic_engine_t *engine)
+static lsquic_time_t
+move_due_conns_to_tickable (struct lsquic_engine *engine)
 {
     lsquic_conn_t *conn;
     lsquic_time_t now;
 
-    ENGINE_IN(engine);
-
-    now = lsquic_time_now();
+    now = lsquic_enpub_now(&engine->pub);
     while ((conn = attq_pop(engine->attq, now)))
     {
         conn = engine_decref_conn(engine, conn, LSCONN_ATTQ);
@@ -1767,25 +2247,65 @@ lsquic_engine_process_conns (lsquic_engine_t *engine)
         }
     }
 
-    process_connections(engine, conn_iter_next_tickable, now);
-    ENGINE_OUT(engine);
+    return now;
 }
 
 
-static void
-release_or_return_enc_data (struct lsquic_engine *engine,
-                void (*pmi_rel_or_ret) (void *, void *, void *, char),
-                struct lsquic_conn *conn, struct lsquic_packet_out *packet_out)
+void
+lsquic_engine_process_conns (lsquic_engine_t *engine)
 {
-    pmi_rel_or_ret(engine->pub.enp_pmi_ctx, packet_out->po_path->np_peer_ctx,
-                packet_out->po_enc_data, lsquic_packet_out_ipv6(packet_out));
-    packet_out->po_flags &= ~PO_ENCRYPTED;
-    packet_out->po_enc_data = NULL;
+    lsquic_time_t now;
+
+    ENGINE_IN(engine);
+
+    now = move_due_conns_to_tickable(engine);
+    process_connections(engine, conn_iter_next_tickable, now, 0, 0);
+    ENGINE_OUT(engine);
 }
 
 
-static void
-release_enc_data (struct lsquic_engine *engine, struct lsquic_conn *conn,
+unsigned
+lsquic_engine_process_conns_budget (lsquic_engine_t *engine,
+                                    unsigned max_conns, unsigned max_usec)
+{
+    lsquic_time_t now, deadline;
+    unsigned count;
+
+    ENGINE_IN(engine);
+
+    now = move_due_conns_to_tickable(engine);
+    if (max_usec)
+        deadline = lsquic_enpub_precise_now(&engine->pub) + max_usec;
+    else
+        deadline = 0;
+    process_connections(engine, conn_iter_next_tickable, now, max_conns,
+                                                                    deadline);
+    /* Connections that were not reached remain in the Tickable Queue.  They
+     * have not been ticked for longer than any connection that was ticked
+     * during this call and thus come out of the min-heap first next time.
+     */
+    count = lsquic_mh_count(&engine->conns_tickable);
+    LSQ_DEBUG("%u connection%.*s left to tick", count, count != 1, "s");
+
+    ENGINE_OUT(engine);
+    return count;
+}
+
+
+static void
+release_or_return_enc_data (struct lsquic_engine *engine,
+                void (*pmi_rel_or_ret) (void *, void *, void *, char),
+                struct lsquic_conn *conn, struct lsquic_packet_out *packet_out)
+{
+    pmi_rel_or_ret(engine->pub.enp_pmi_ctx, packet_out->po_path->np_peer_ctx,
+                packet_out->po_enc_data, lsquic_packet_out_ipv6(packet_out));
+    packet_out->po_flags &= ~PO_ENCRYPTED;
+    packet_out->po_enc_data = NULL;
+}
+
+
+static void
+release_enc_data (struct lsquic_engine *engine, struct lsquic_conn *conn,
                                         struct lsquic_packet_out *packet_out)
 {
     release_or_return_enc_data(engine, engine->pub.enp_pmi->pmi_release,
@@ -1946,10 +2466,11 @@ coi_reheap (struct conns_out_iter *iter, lsquic_engine_t *engine)
         conn->cn_flags &= ~LSCONN_COI_ACTIVE;
         if ((conn->cn_flags & CONN_REF_FLAGS) != LSCONN_HAS_OUTGOING
                                 && !(conn->cn_flags & LSCONN_IMMED_CLOSE))
-            lsquic_mh_insert(iter->coi_heap, conn, conn->cn_last_sent);
+            lsquic_mh_append(iter->coi_heap, conn, conn->cn_last_sent);
         else    /* Closed connection gets one shot at sending packets */
             (void) engine_decref_conn(engine, conn, LSCONN_HAS_OUTGOING);
     }
+    lsquic_mh_build(iter->coi_heap);
     while ((conn = TAILQ_FIRST(&iter->coi_inactive_list)))
     {
         TAILQ_REMOVE(&iter->coi_inactive_list, conn, cn_next_out);
@@ -2095,7 +2616,7 @@ send_batch (lsquic_engine_t *engine, const struct send_batch_ctx *sb_ctx,
         lose_matching_packets(engine, batch, n_to_send);
 #endif
     /* Set sent time before the write to avoid underestimating RTT */
-    now = lsquic_time_now();
+    now = lsquic_enpub_precise_now(&engine->pub);
     for (i = 0; i < (int) n_to_send; ++i)
     {
         off = batch->pack_off[i];
@@ -2200,7 +2721,7 @@ static int
 check_deadline (lsquic_engine_t *engine)
 {
     if (engine->pub.enp_settings.es_proc_time_thresh &&
-                                lsquic_time_now() > engine->deadline)
+                        lsquic_enpub_now(&engine->pub) > engine->deadline)
     {
         LSQ_INFO("went past threshold of %u usec, stop sending",
                             engine->pub.enp_settings.es_proc_time_thresh);
@@ -2228,6 +2749,99 @@ iov_size (const struct iovec *iov, const struct iovec *const end)
 }
 
 
+/* GSO buffer cannot exceed maximum IP packet size */
+#define MAX_GSO_SIZE 0xFFFF
+
+
+/* Append packets from the same connection to the out spec `n' for as long
+ * as they can be sent as a single GSO buffer: same path and ECN marking,
+ * and sizes not exceeding that of the first packet.  Packets that do not
+ * fit are returned to the connection.
+ */
+static void
+add_gso_segments (struct lsquic_engine *engine, struct lsquic_conn *conn,
+                  struct out_batch *batch, unsigned n, struct iovec **iovp,
+                  struct lsquic_packet_out ***packetp)
+{
+    struct lsquic_out_spec *const spec = &batch->outs[n];
+    const struct lsquic_packet_out *const first
+                                    = batch->packets[ batch->pack_off[n] ];
+    struct iovec *const iov_end
+                    = batch->iov + sizeof(batch->iov) / sizeof(batch->iov[0]);
+    struct iovec *iov = *iovp;
+    struct lsquic_packet_out **packet = *packetp;
+    struct lsquic_packet_out **batched;
+    lsquic_packet_out_t *packet_out;
+    size_t segsz, total;
+
+    assert(spec->iovlen == 1);
+    segsz = spec->iov[0].iov_len;
+    total = segsz;
+
+    while (spec->iovlen < LSQUIC_MAX_GSO_SEGMENTS
+            && iov < iov_end
+            && iov[-1].iov_len == segsz
+            && total + segsz <= MAX_GSO_SIZE)
+    {
+        packet_out = conn->cn_if->ci_next_packet_to_send(conn, 0);
+        if (!packet_out)
+            break;
+        /* A packet is handed out again until it is reported as sent or not
+         * sent.  It is already accounted for: do not call ci_packet_not_sent.
+         */
+        for (batched = &batch->packets[ batch->pack_off[n] ];
+                                batched < packet; ++batched)
+            if (*batched == packet_out)
+                goto end;
+        if (packet_out->po_path != first->po_path
+            || lsquic_packet_out_ecn(packet_out) != spec->ecn
+            || ((packet_out->po_flags & PO_NOENCRYPT)
+                                        && engine->pub.enp_pmi != &stock_pmi))
+        {
+            conn->cn_if->ci_packet_not_sent(conn, packet_out);
+            break;
+        }
+        if (!(packet_out->po_flags & (PO_ENCRYPTED|PO_NOENCRYPT))
+            && ENCPA_OK != conn->cn_esf_c->esf_encrypt_packet(
+                        conn->cn_enc_session, &engine->pub, conn, packet_out))
+        {
+            /* Errors are handled when the packet comes up again */
+            conn->cn_if->ci_packet_not_sent(conn, packet_out);
+            break;
+        }
+        if (packet_out->po_flags & PO_ENCRYPTED)
+        {
+            iov->iov_base          = packet_out->po_enc_data;
+            iov->iov_len           = packet_out->po_enc_data_sz;
+        }
+        else
+        {
+            iov->iov_base          = packet_out->po_data;
+            iov->iov_len           = packet_out->po_data_sz;
+        }
+        if (iov->iov_len > segsz)
+        {
+            conn->cn_if->ci_packet_not_sent(conn, packet_out);
+            break;
+        }
+        LSQ_DEBUGC("batched packet %"PRIu64" for connection %"CID_FMT
+            " (GSO segment #%zu)", packet_out->po_packno,
+            CID_BITS(lsquic_conn_log_cid(conn)), spec->iovlen);
+        total += iov->iov_len;
+        *packet = packet_out;
+        ++packet;
+        ++iov;
+        ++spec->iovlen;
+    }
+
+  end:
+    if (spec->iovlen > 1)
+        spec->gso_size = segsz;
+    *iovp = iov;
+    *packetp = packet;
+}
+
+
 /* XXX A lot of extra setup -- two extra arguments to this function, two extra
  * connection ref flags and queues -- is just to handle the ENCPA_BADCRYPT case,
  * which never really happens.
@@ -2327,6 +2941,7 @@ send_packets_out (struct lsquic_engine *engine,
             batch->outs   [n].peer_ctx = packet_out->po_path->np_peer_ctx;
             batch->outs   [n].local_sa = NP_LOCAL_SA(packet_out->po_path);
             batch->outs   [n].dest_sa  = NP_PEER_SA(packet_out->po_path);
+            batch->outs   [n].gso_size = 0;
             batch->conns  [n]          = conn;
         }
         *packet = packet_out;
@@ -2346,6 +2961,10 @@ send_packets_out (struct lsquic_engine *engine,
                 goto next_coa;
         }
         batch->outs   [n].iovlen = iov - packet_iov;
+        /* Evanescent connections have a single packet to send */
+        if (engine->pub.enp_settings.es_gso && batch->outs[n].iovlen == 1
+                                && !(conn->cn_flags & LSCONN_EVANESCENT))
+            add_gso_segments(engine, conn, batch, n, &iov, &packet);
         ++n;
         if (n == engine->batch_size
             || iov >= batch->iov + sizeof(batch->iov) / sizeof(batch->iov[0]))
@@ -2420,7 +3039,7 @@ lsquic_engine_send_unsent_packets (lsquic_engine_t *engine)
     ENGINE_IN(engine);
     cub_init(&cub, engine->report_old_scids, engine->scids_ctx);
     STAILQ_INIT(&closed_conns);
-    reset_deadline(engine, lsquic_time_now());
+    reset_deadline(engine, lsquic_enpub_now(&engine->pub));
     if (!(engine->pub.enp_flags & ENPUB_CAN_SEND))
     {
         LSQ_DEBUG("can send again");
@@ -2454,9 +3073,189 @@ next_new_full_conn (struct conns_stailq *new_full_conns)
 }
 
 
+/* The hibernated connection takes the place of the full connection `conn',
+ * which has just been removed from the hash and is about to be destroyed.
+ */
+static void
+insert_hib_conn (struct lsquic_engine *engine, struct lsquic_conn *conn,
+                        struct lsquic_conn *hib_conn, lsquic_time_t now)
+{
+    lsquic_time_t expiry;
+    unsigned why;
+
+    conn->cn_cces_mask = 0;     /* Do not purge CIDs when it is destroyed */
+    ++engine->n_conns;
+    if (0 != insert_conn_into_hash(engine, hib_conn, NULL))
+    {
+        LSQ_WARNC("cannot add hibernated connection %"CID_FMT" to hash - "
+                        "destroy", CID_BITS(lsquic_conn_log_cid(hib_conn)));
+        destroy_conn(engine, hib_conn, now);
+        return;
+    }
+    hib_conn->cn_flags |= LSCONN_HASHED;
+
+    expiry = hib_conn->cn_if->ci_next_tick_time(hib_conn, &why);
+    if (0 == attq_add(engine->attq, hib_conn, expiry, why))
+        engine_incref_conn(hib_conn, LSCONN_ATTQ);
+    else
+        /* It would never expire */
+        remove_conn_from_hash(engine, hib_conn);
+}
+
+
+/* Place connection that has just been ticked onto the appropriate lists */
+static void
+after_tick (struct lsquic_engine *engine, struct lsquic_conn *conn,
+            enum tick_st tick_st, lsquic_time_t now,
+            struct conns_stailq *new_full_conns,
+            struct conns_stailq *closed_conns,
+            struct conns_tailq *ticked_conns,
+            struct cid_update_batch *cub_live)
+{
+    struct lsquic_conn *hib_conn;
+
+    hib_conn = NULL;
+    if ((tick_st & TICK_HIBERNATE) && 0 == maybe_grow_conn_heaps(engine)
+                                && (hib_conn = lsquic_hib_conn_new(conn)))
+        tick_st |= TICK_CLOSE;
+    if (tick_st & TICK_PROMOTE)
+    {
+        lsquic_conn_t *new_conn;
+        EV_LOG_CONN_EVENT(lsquic_conn_log_cid(conn),
+                                            "scheduled for promotion");
+        assert(conn->cn_flags & LSCONN_MINI);
+        new_conn = new_full_conn_server(engine, conn, now);
+        if (new_conn)
+        {
+            STAILQ_INSERT_TAIL(new_full_conns, new_conn, cn_next_new_full);
+            new_conn->cn_last_sent = engine->last_sent;
+            eng_hist_inc(&engine->history, now, sl_new_full_conns);
+        }
+        tick_st |= TICK_CLOSE;  /* Destroy mini connection */
+        conn->cn_flags |= LSCONN_PROMOTED;
+    }
+    if (tick_st & TICK_SEND)
+    {
+        if (!(conn->cn_flags & LSCONN_HAS_OUTGOING))
+        {
+            lsquic_mh_insert(&engine->conns_out, conn, conn->cn_last_sent);
+            engine_incref_conn(conn, LSCONN_HAS_OUTGOING);
+        }
+    }
+    if (tick_st & TICK_CLOSE)
+    {
+        STAILQ_INSERT_TAIL(closed_conns, conn, cn_next_closed_conn);
+        engine_incref_conn(conn, LSCONN_CLOSING);
+        if (conn->cn_flags & LSCONN_HASHED)
+            remove_conn_from_hash(engine, conn);
+        if (hib_conn)
+            insert_hib_conn(engine, conn, hib_conn, now);
+    }
+    else
+    {
+        TAILQ_INSERT_TAIL(ticked_conns, conn, cn_next_ticked);
+        engine_incref_conn(conn, LSCONN_TICKED);
+        if ((engine->flags & ENG_SERVER) && conn->cn_if->ci_report_live
+                                && conn->cn_if->ci_report_live(conn, now))
+            cub_add_cids_from_cces(cub_live, conn);
+    }
+}
+
+
+#if LSQUIC_TICK_THREADS
+struct mt_tick_ctx
+{
+    struct lsquic_engine   *engine;
+    lsquic_time_t           now;
+};
+
+
+static void
+mt_tick_job (void *ctx, unsigned idx)
+{
+    struct mt_tick_ctx *const mtc = ctx;
+    struct mt_tick *const mt = &mtc->engine->mt_ticks[idx];
+
+    mt->tick_st = mt->conn->cn_if->ci_tick(mt->conn, mtc->now);
+}
+
+
+/* Only established full connections are ticked by the worker threads.
+ * Mini connections, promotion, and the handshake use state that is shared
+ * by all connections (for example, the gQUIC server certificate caches)
+ * and are ticked on the calling thread.
+ *
+ * Connections are taken from `next_conn' in batches.  The budget limits
+ * are checked between batches.  Returns number of connections ticked.
+ */
+static unsigned
+tick_in_parallel (struct lsquic_engine *engine, conn_iter_f next_conn,
+            lsquic_time_t now, unsigned max_conns, lsquic_time_t deadline,
+            struct conns_stailq *new_full_conns,
+            struct conns_stailq *closed_conns,
+            struct conns_tailq *ticked_conns,
+            struct cid_update_batch *cub_live)
+{
+    struct mt_tick_ctx mtc = { engine, now, };
+    struct lsquic_conn *conn;
+    enum tick_st tick_st;
+    unsigned i, n, n_ticked;
+
+    n_ticked = 0;
+    do
+    {
+        n = 0;
+        while (n < engine->mt_ticks_sz
+                    && (!max_conns || n_ticked + n < max_conns)
+                    && (conn = next_conn(engine)))
+            if ((conn->cn_flags & (LSCONN_MINI|LSCONN_HANDSHAKE_DONE))
+                                                    == LSCONN_HANDSHAKE_DONE)
+                engine->mt_ticks[n++].conn = conn;
+            else
+            {
+                tick_st = conn->cn_if->ci_tick(conn, now);
+                conn->cn_last_ticked = now + n_ticked++;
+                after_tick(engine, conn, tick_st, now, new_full_conns,
+                                        closed_conns, ticked_conns, cub_live);
+            }
+
+        if (n > 1)
+        {
+            engine->pub.enp_mt_lock = &engine->mt_lock;
+            lsquic_mm_set_lock(&engine->pub.enp_mm, &engine->mt_lock);
+            lsquic_tp_run(engine->tick_pool, mt_tick_job, &mtc, n);
+            lsquic_mm_set_lock(&engine->pub.enp_mm, NULL);
+            engine->pub.enp_mt_lock = NULL;
+        }
+        else if (n == 1)
+            mt_tick_job(&mtc, 0);
+
+        for (i = 0; i < n; ++i)
+        {
+            conn = engine->mt_ticks[i].conn;
+            conn->cn_last_ticked = now + n_ticked++;
+            after_tick(engine, conn, engine->mt_ticks[i].tick_st, now,
+                        new_full_conns, closed_conns, ticked_conns, cub_live);
+        }
+    }
+    while (n == engine->mt_ticks_sz
+                && (!max_conns || n_ticked < max_conns)
+                && (!deadline
+                        || lsquic_enpub_precise_now(&engine->pub) < deadline));
+
+    return n_ticked;
+}
+#endif
+
+
+/* If `max_conns' or `deadline' is not zero, stop taking connections from
+ * `next_conn' once that many connections have been ticked or once the
+ * deadline has passed.  New full connections are always ticked.
+ */
 static void
 process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
-                     lsquic_time_t now)
+                     lsquic_time_t now, unsigned max_conns,
+                     lsquic_time_t deadline)
 {
     lsquic_conn_t *conn;
     enum tick_st tick_st;
@@ -2471,6 +3270,10 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
 
     eng_hist_tick(&engine->history, now);
 
+    /* Code called during the pass uses this instead of reading the clock */
+    engine->pub.enp_tick_time = now;
+    engine->pub.enp_flags |= ENPUB_TICK;
+
     STAILQ_INIT(&closed_conns);
     TAILQ_INIT(&ticked_conns);
     reset_deadline(engine, now);
@@ -2486,50 +3289,21 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
     }
 
     i = 0;
-    while ((conn = next_conn(engine))
+#if LSQUIC_TICK_THREADS
+    if (engine->tick_pool)
+        i = tick_in_parallel(engine, next_conn, now, max_conns, deadline,
+                        &new_full_conns, &closed_conns, &ticked_conns, &cub_live);
+#endif
+    while (((!max_conns || i < max_conns)
+                && (!deadline || i == 0
+                        || lsquic_enpub_precise_now(&engine->pub) < deadline)
+                && (conn = next_conn(engine)))
                             || (conn = next_new_full_conn(&new_full_conns)))
     {
         tick_st = conn->cn_if->ci_tick(conn, now);
         conn->cn_last_ticked = now + i /* Maintain relative order */ ++;
-        if (tick_st & TICK_PROMOTE)
-        {
-            lsquic_conn_t *new_conn;
-            EV_LOG_CONN_EVENT(lsquic_conn_log_cid(conn),
-                                                "scheduled for promotion");
-            assert(conn->cn_flags & LSCONN_MINI);
-            new_conn = new_full_conn_server(engine, conn, now);
-            if (new_conn)
-            {
-                STAILQ_INSERT_TAIL(&new_full_conns, new_conn, cn_next_new_full);
-                new_conn->cn_last_sent = engine->last_sent;
-                eng_hist_inc(&engine->history, now, sl_new_full_conns);
-            }
-            tick_st |= TICK_CLOSE;  /* Destroy mini connection */
-            conn->cn_flags |= LSCONN_PROMOTED;
-        }
-        if (tick_st & TICK_SEND)
-        {
-            if (!(conn->cn_flags & LSCONN_HAS_OUTGOING))
-            {
-                lsquic_mh_insert(&engine->conns_out, conn, conn->cn_last_sent);
-                engine_incref_conn(conn, LSCONN_HAS_OUTGOING);
-            }
-        }
-        if (tick_st & TICK_CLOSE)
-        {
-            STAILQ_INSERT_TAIL(&closed_conns, conn, cn_next_closed_conn);
-            engine_incref_conn(conn, LSCONN_CLOSING);
-            if (conn->cn_flags & LSCONN_HASHED)
-                remove_conn_from_hash(engine, conn);
-        }
-        else
-        {
-            TAILQ_INSERT_TAIL(&ticked_conns, conn, cn_next_ticked);
-            engine_incref_conn(conn, LSCONN_TICKED);
-            if ((engine->flags & ENG_SERVER) && conn->cn_if->ci_report_live
-                                    && conn->cn_if->ci_report_live(conn, now))
-                cub_add_cids_from_cces(&cub_live, conn);
-        }
+        after_tick(engine, conn, tick_st, now, &new_full_conns, &closed_conns,
+                                                    &ticked_conns, &cub_live);
     }
 
     if ((engine->pub.enp_flags & ENPUB_CAN_SEND)
@@ -2543,8 +3317,8 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
         (void) engine_decref_conn(engine, conn, LSCONN_CLOSING);
     }
 
-    /* TODO Heapification can be optimized by switching to the Floyd method:
-     * https://en.wikipedia.org/wiki/Binary_heap#Building_a_heap
+    /* Many connections may re-enter the tickable heap at once: append them
+     * and build the heap after the loop.
      */
     while ((conn = TAILQ_FIRST(&ticked_conns)))
     {
@@ -2553,7 +3327,7 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
         if (!(conn->cn_flags & LSCONN_TICKABLE)
             && conn->cn_if->ci_is_tickable(conn))
         {
-            lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
+            lsquic_mh_append(&engine->conns_tickable, conn, conn->cn_last_ticked);
             engine_incref_conn(conn, LSCONN_TICKABLE);
         }
         else if (!(conn->cn_flags & LSCONN_ATTQ))
@@ -2568,6 +3342,9 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
                 assert(0);
         }
     }
+    lsquic_mh_build(&engine->conns_tickable);
+
+    engine->pub.enp_flags &= ~ENPUB_TICK;
 
     cub_flush(&engine->new_scids);
     cub_flush(&cub_live);
@@ -2578,24 +3355,18 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
 /* Return 0 if packet is being processed by a real connection, 1 if the
  * packet was processed, but not by a connection, and -1 on error.
  */
-int
-lsquic_engine_packet_in (lsquic_engine_t *engine,
-    const unsigned char *packet_in_data, size_t packet_in_size,
-    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
-    void *peer_ctx, int ecn)
-{
-    const unsigned char *const packet_end = packet_in_data + packet_in_size;
-    struct packin_parse_state ppstate;
-    lsquic_packet_in_t *packet_in;
-    int (*parse_packet_in_begin) (struct lsquic_packet_in *, size_t length,
-                int is_server, unsigned cid_len, struct packin_parse_state *);
-    unsigned n_zeroes;
-    int s;
+typedef int (*parse_packet_in_begin_f) (struct lsquic_packet_in *,
+                size_t length, int is_server, unsigned cid_len,
+                struct packin_parse_state *);
 
-    ENGINE_CALLS_INCR(engine);
 
+/* Return NULL if the packet cannot be processed. */
+static parse_packet_in_begin_f
+select_parse_packet_in_begin (lsquic_engine_t *engine,
+                                            const struct sockaddr *sa_local)
+{
     if (engine->flags & ENG_SERVER)
-        parse_packet_in_begin = lsquic_parse_packet_in_server_begin;
+        return lsquic_parse_packet_in_server_begin;
     else
     if (engine->flags & ENG_CONNS_BY_ADDR)
     {
@@ -2603,12 +3374,12 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
         const struct lsquic_conn *conn;
         el = find_conn_by_addr(engine->conns_hash, sa_local);
         if (!el)
-            return -1;
+            return NULL;
         conn = lsquic_hashelem_getdata(el);
         if ((1 << conn->cn_version) & LSQUIC_GQUIC_HEADER_VERSIONS)
-            parse_packet_in_begin = lsquic_gquic_parse_packet_in_begin;
+            return lsquic_gquic_parse_packet_in_begin;
         else if ((1 << conn->cn_version) & LSQUIC_IETF_VERSIONS)
-            parse_packet_in_begin = lsquic_ietf_v1_parse_packet_in_begin;
+            return lsquic_ietf_v1_parse_packet_in_begin;
         else
         {
             assert(conn->cn_version == LSQVER_046
@@ -2617,47 +3388,288 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
 #endif
 
                                                     );
-            parse_packet_in_begin = lsquic_Q046_parse_packet_in_begin;
+            return lsquic_Q046_parse_packet_in_begin;
         }
     }
     else
-        parse_packet_in_begin = lsquic_parse_packet_in_begin;
+        return lsquic_parse_packet_in_begin;
+}
 
-    n_zeroes = 0;
-    do
+
+/* Allocate packet_in and parse the header of the packet at the beginning
+ * of `packet_in_data'.  Returns NULL on failure, in which case errno is
+ * set.
+ */
+static struct lsquic_packet_in *
+parse_packet_in (lsquic_engine_t *engine,
+        parse_packet_in_begin_f parse_packet_in_begin,
+        const unsigned char *packet_in_data, size_t packet_in_size,
+        struct packin_parse_state *ppstate)
+{
+    lsquic_packet_in_t *packet_in;
+
+    packet_in = lsquic_mm_get_packet_in(&engine->pub.enp_mm);
+    if (!packet_in)
     {
-        packet_in = lsquic_mm_get_packet_in(&engine->pub.enp_mm);
-        if (!packet_in)
-            return -1;
-        /* Library does not modify packet_in_data, it is not referenced after
-         * this function returns and subsequent release of pi_data is guarded
-         * by PI_OWN_DATA flag.
-         */
-        packet_in->pi_data = (unsigned char *) packet_in_data;
-        if (0 != parse_packet_in_begin(packet_in, packet_end - packet_in_data,
-                                engine->flags & ENG_SERVER,
-                                engine->pub.enp_settings.es_scid_len, &ppstate))
-        {
-            LSQ_DEBUG("Cannot parse incoming packet's header");
-            lsquic_mm_put_packet_in(&engine->pub.enp_mm, packet_in);
-            errno = EINVAL;
-            return -1;
-        }
+        errno = ENOMEM;
+        return NULL;
+    }
+    /* Library does not modify packet_in_data, it is not referenced after
+     * the packet-in function returns and subsequent release of pi_data is
+     * guarded by PI_OWN_DATA flag.
+     */
+    packet_in->pi_data = (unsigned char *) packet_in_data;
+    if (0 != parse_packet_in_begin(packet_in, packet_in_size,
+                            engine->flags & ENG_SERVER,
+                            engine->pub.enp_settings.es_scid_len, ppstate))
+    {
+        LSQ_DEBUG("Cannot parse incoming packet's header");
+        lsquic_mm_put_packet_in(&engine->pub.enp_mm, packet_in);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return packet_in;
+}
+
+
+/* Process UDP datagram whose first packet has already been parsed.  Any
+ * coalesced packets that follow it are parsed and processed in turn.
+ */
+static int
+process_datagram (lsquic_engine_t *engine,
+        parse_packet_in_begin_f parse_packet_in_begin,
+        lsquic_packet_in_t *packet_in, struct packin_parse_state *ppstate,
+        const unsigned char *packet_in_data, size_t packet_in_size,
+        const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+        void *peer_ctx, int ecn, void *buf_ctx, lsquic_time_t now)
+{
+    const unsigned char *const packet_end = packet_in_data + packet_in_size;
+    unsigned n_zeroes;
+    int s;
 
+    n_zeroes = 0;
+    while (1)
+    {
         packet_in_data += packet_in->pi_data_sz;
-        packet_in->pi_received = lsquic_time_now();
+        packet_in->pi_received = now;
         packet_in->pi_flags |= (3 & ecn) << PIBIT_ECN_SHIFT;
+        packet_in->pi_buf_ctx = buf_ctx;
         eng_hist_inc(&engine->history, packet_in->pi_received, sl_packets_in);
-        s = process_packet_in(engine, packet_in, &ppstate, sa_local, sa_peer,
+        s = process_packet_in(engine, packet_in, ppstate, sa_local, sa_peer,
                             peer_ctx, packet_in->pi_data_sz == packet_in_size);
         n_zeroes += s == 0;
+        if (!(0 == s && packet_in_data < packet_end))
+            break;
+        packet_in = parse_packet_in(engine, parse_packet_in_begin,
+                    packet_in_data, packet_end - packet_in_data, ppstate);
+        if (!packet_in)
+            return -1;
     }
-    while (0 == s && packet_in_data < packet_end);
 
     return n_zeroes > 0 ? 0 : s;
 }
 
 
+int
+lsquic_engine_packet_in (lsquic_engine_t *engine,
+    const unsigned char *packet_in_data, size_t packet_in_size,
+    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+    void *peer_ctx, int ecn)
+{
+    struct packin_parse_state ppstate;
+    lsquic_packet_in_t *packet_in;
+    parse_packet_in_begin_f parse_packet_in_begin;
+
+    ENGINE_CALLS_INCR(engine);
+
+    parse_packet_in_begin = select_parse_packet_in_begin(engine, sa_local);
+    if (!parse_packet_in_begin)
+        return -1;
+
+    packet_in = parse_packet_in(engine, parse_packet_in_begin,
+                            packet_in_data, packet_in_size, &ppstate);
+    if (!packet_in)
+        return -1;
+
+    return process_datagram(engine, parse_packet_in_begin, packet_in,
+                &ppstate, packet_in_data, packet_in_size, sa_local, sa_peer,
+                peer_ctx, ecn, NULL, lsquic_enpub_precise_now(&engine->pub));
+}
+
+
+/* Datagrams are processed in chunks of this size.  This bounds the amount
+ * of stack space used by lsquic_engine_packets_in().
+ */
+#define PACKETS_IN_BATCH 32
+
+struct datagram_in
+{
+    const struct lsquic_in_spec *spec;
+    const unsigned char         *buf;
+    size_t                       bufsz;
+    struct lsquic_packet_in     *packet_in;
+    parse_packet_in_begin_f      parse_packet_in_begin;
+    struct packin_parse_state    ppstate;
+    /* Connection found by packet's CID; only valid if `conn_found' is set */
+    const struct lsquic_conn    *conn;
+    int                          conn_found;
+};
+
+
+/* Connections can be addressed by several CIDs.  Look up the connection a
+ * not-yet-processed datagram is headed to once and remember it: the CID
+ * hash does not gain entries for existing connections while packets are
+ * being processed, only when they are ticked.
+ */
+static const struct lsquic_conn *
+datagram_in_conn (lsquic_engine_t *engine, struct datagram_in *dg)
+{
+    struct lsquic_hash_elem *el;
+
+    if (!dg->conn_found)
+    {
+        el = lsquic_cidh_find(engine->conns_hash,
+                dg->packet_in->pi_conn_id.idbuf, dg->packet_in->pi_conn_id.len);
+        dg->conn = el ? lsquic_hashelem_getdata(el) : NULL;
+        dg->conn_found = 1;
+    }
+    return dg->conn;
+}
+
+
+static int
+process_datagram_in (lsquic_engine_t *engine, struct datagram_in *dg,
+                                                            lsquic_time_t now)
+{
+    struct lsquic_packet_in *const packet_in = dg->packet_in;
+
+    dg->packet_in = NULL;
+    return process_datagram(engine, dg->parse_packet_in_begin, packet_in,
+            &dg->ppstate, dg->buf, dg->bufsz, dg->spec->local_sa,
+            dg->spec->peer_sa, dg->spec->peer_ctx, dg->spec->ecn,
+            engine->pub.enp_mm.rbi ? dg->spec->buf_ctx : NULL, now);
+}
+
+
+int
+lsquic_engine_packets_in (lsquic_engine_t *engine,
+                const struct lsquic_in_spec *specs, unsigned n_specs)
+{
+    const struct lsquic_in_spec *spec;
+    struct datagram_in dgrams[PACKETS_IN_BATCH], *dg;
+    parse_packet_in_begin_f parse_packet_in_begin;
+    struct lsquic_hash_elem *el;
+    const struct lsquic_conn *conn;
+    lsquic_cid_t cid;
+    lsquic_time_t now;
+    size_t off;
+    unsigned n_dgrams, n_consumed, i, j;
+    int group;
+
+    ENGINE_CALLS_INCR(engine);
+
+    /* Header parsing is done for the whole chunk first: this is when
+     * connection hash buckets are prefetched.  Then the datagrams are
+     * processed, grouped by connection, so that the connection's state is
+     * still in cache when its next packet comes up.  Within a group, the
+     * order of the datagrams is kept.
+     */
+    now = lsquic_enpub_precise_now(&engine->pub);
+    if (engine->flags & ENG_CONNS_BY_ADDR)
+        parse_packet_in_begin = NULL;
+    else
+        parse_packet_in_begin = select_parse_packet_in_begin(engine, NULL);
+
+    n_consumed = 0;
+    off = 0;    /* Offset into GRO buffer */
+    while (n_consumed < n_specs)
+    {
+        for (n_dgrams = 0; n_dgrams < PACKETS_IN_BATCH && n_consumed < n_specs;
+                                                                ++n_dgrams)
+        {
+            spec = &specs[n_consumed];
+            dg = &dgrams[n_dgrams];
+            dg->spec = spec;
+            dg->buf = spec->buf + off;
+            dg->conn_found = 0;
+            if (spec->gro_size && spec->bufsz - off > spec->gro_size)
+            {
+                dg->bufsz = spec->gro_size;
+                off += spec->gro_size;
+            }
+            else
+            {
+                dg->bufsz = spec->bufsz - off;
+                off = 0;
+                ++n_consumed;
+            }
+            if (parse_packet_in_begin)
+                dg->parse_packet_in_begin = parse_packet_in_begin;
+            else
+            {
+                dg->parse_packet_in_begin = select_parse_packet_in_begin(
+                                                        engine, spec->local_sa);
+                if (!dg->parse_packet_in_begin)
+                {
+                    dg->packet_in = NULL;
+                    continue;
+                }
+            }
+            dg->packet_in = parse_packet_in(engine, dg->parse_packet_in_begin,
+                                            dg->buf, dg->bufsz, &dg->ppstate);
+            if (dg->packet_in)
+            {
+                if (dg->packet_in->pi_flags & PI_CONN_ID)
+                    lsquic_cidh_prefetch(engine->conns_hash,
+                                        dg->packet_in->pi_conn_id.idbuf,
+                                        dg->packet_in->pi_conn_id.len);
+            }
+            else if (errno == ENOMEM)
+            {
+                /* Stop here: the caller can try again with the rest.  If
+                 * we are in the middle of a GRO buffer, the rest of it is
+                 * dropped.
+                 */
+                if (dg->buf == spec->buf)
+                    n_consumed = spec - specs;
+                else
+                    n_consumed = spec - specs + 1;
+                n_specs = n_consumed;
+                break;
+            }
+        }
+
+        for (i = 0; i < n_dgrams; ++i)
+        {
+            if (!dgrams[i].packet_in)
+                continue;
+            group = parse_packet_in_begin
+                            && (dgrams[i].packet_in->pi_flags & PI_CONN_ID);
+            if (group)
+                cid = dgrams[i].packet_in->pi_conn_id;
+            (void) process_datagram_in(engine, &dgrams[i], now);
+            if (!group)
+                continue;
+            /* Look up after processing: the first packet may have created
+             * the connection.
+             */
+            el = lsquic_cidh_find(engine->conns_hash, cid.idbuf, cid.len);
+            conn = el ? lsquic_hashelem_getdata(el) : NULL;
+            for (j = i + 1; j < n_dgrams; ++j)
+                if (dgrams[j].packet_in
+                    && (dgrams[j].packet_in->pi_flags & PI_CONN_ID)
+                    && (LSQUIC_CIDS_EQ(&dgrams[j].packet_in->pi_conn_id, &cid)
+                        || (conn && conn == datagram_in_conn(engine,
+                                                            &dgrams[j]))))
+                    (void) process_datagram_in(engine, &dgrams[j], now);
+        }
+    }
+
+    return (int) n_consumed;
+}
+
+
 #if __GNUC__ && !defined(NDEBUG)
 __attribute__((weak))
 #endif
@@ -2683,8 +3695,8 @@ lsquic_engine_cooldown (lsquic_engine_t *engine)
     LSQ_INFO("entering cooldown mode");
     if (engine->flags & ENG_SERVER)
         drop_all_mini_conns(engine);
-    for (el = lsquic_hash_first(engine->conns_hash); el;
-                                el = lsquic_hash_next(engine->conns_hash))
+    for (el = lsquic_cidh_first(engine->conns_hash); el;
+                                el = lsquic_cidh_next(engine->conns_hash))
     {
         conn = lsquic_hashelem_getdata(el);
         lsquic_conn_going_away(conn);
@@ -2765,7 +3777,7 @@ lsquic_engine_earliest_adv_tick (lsquic_engine_t *engine, int *diff)
             next_time = engine->resume_sending_at;
     }
 
-    now = lsquic_time_now();
+    now = lsquic_enpub_now(&engine->pub);
     *diff = (int) ((int64_t) next_time - (int64_t) now);
 #if LSQUIC_DEBUG_NEXT_ADV_TICK
     if (next_attq)
@@ -2784,7 +3796,7 @@ lsquic_engine_count_attq (lsquic_engine_t *engine, int from_now)
 {
     lsquic_time_t now;
     ENGINE_CALLS_INCR(engine);
-    now = lsquic_time_now();
+    now = lsquic_enpub_now(&engine->pub);
     if (from_now < 0)
         now -= from_now;
     else
@@ -2793,6 +3805,98 @@ lsquic_engine_count_attq (lsquic_engine_t *engine, int from_now)
 }
 
 
+/* A connection is in the hash once for each of its CIDs.  Return true if
+ * `el' is the first of them.
+ */
+static int
+is_first_hash_el (const struct lsquic_conn *conn,
+                                        const struct lsquic_hash_elem *el)
+{
+    const struct conn_cid_elem *cce;
+
+    for (cce = conn->cn_cces; cce < END_OF_CCES(conn); ++cce)
+        if ((conn->cn_cces_mask & (1 << (cce - conn->cn_cces)))
+                            && (cce->cce_hash_el.qhe_flags & QHE_HASHED))
+            return el == &cce->cce_hash_el;
+    return 0;
+}
+
+
+unsigned
+lsquic_engine_mem_stats (lsquic_engine_t *engine,
+        struct lsquic_mem_stats *stats, struct lsquic_conn_mem *top,
+        unsigned n_top)
+{
+    struct lsquic_mem_stats conn_stats;
+    struct lsquic_hash_elem *el;
+    lsquic_conn_t *conn;
+    unsigned n, i;
+    size_t bytes;
+
+    ENGINE_CALLS_INCR(engine);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->ms_pools = lsquic_mm_mem_used(&engine->pub.enp_mm);
+    stats->ms_conns = sizeof(*engine) + lsquic_cidh_mem_used(engine->conns_hash);
+    if (engine->pub.enp_srst_hash)
+        stats->ms_conns += lsquic_hash_mem_used(engine->pub.enp_srst_hash);
+
+    n = 0;
+    for (el = lsquic_cidh_first(engine->conns_hash); el;
+                                el = lsquic_cidh_next(engine->conns_hash))
+    {
+        conn = lsquic_hashelem_getdata(el);
+        /* Mini connections come from the pools */
+        if (!conn->cn_if->ci_mem_stats || !is_first_hash_el(conn, el))
+            continue;
+        memset(&conn_stats, 0, sizeof(conn_stats));
+        conn->cn_if->ci_mem_stats(conn, &conn_stats);
+        stats->ms_packets_in  += conn_stats.ms_packets_in;
+        stats->ms_packets_out += conn_stats.ms_packets_out;
+        stats->ms_pools       += conn_stats.ms_pools;
+        stats->ms_conns       += conn_stats.ms_conns;
+        stats->ms_streams     += conn_stats.ms_streams;
+        stats->ms_hdr_tables  += conn_stats.ms_hdr_tables;
+        ++stats->ms_n_conns;
+
+        /* Insertion sort: `n_top' is expected to be small.  Hibernated
+         * connections are not known to the user.
+         */
+        bytes = lsquic_mem_stats_sum(&conn_stats);
+        if (top && !(conn->cn_flags & LSCONN_HIBERNATED)
+                && (n < n_top || (n > 0 && bytes > top[n - 1].cm_bytes)))
+        {
+            if (n < n_top)
+                ++n;
+            for (i = n - 1; i > 0 && top[i - 1].cm_bytes < bytes; --i)
+                top[i] = top[i - 1];
+            top[i].cm_conn  = conn;
+            top[i].cm_bytes = bytes;
+        }
+    }
+
+    stats->ms_total = lsquic_mem_stats_sum(stats);
+    return n;
+}
+
+
+/* These are called from the user's packet out memory interface, that is,
+ * from inside the engine: do not use ENGINE_IN().
+ */
+void *
+lsquic_engine_arena_alloc (lsquic_engine_t *engine, size_t sz)
+{
+    return lsquic_mm_arena_alloc(&engine->pub.enp_mm, sz);
+}
+
+
+void
+lsquic_engine_arena_free (lsquic_engine_t *engine, void *buf)
+{
+    lsquic_mm_arena_free(&engine->pub.enp_mm, buf);
+}
+
+
 int
 lsquic_engine_add_cid (struct lsquic_engine_public *enpub,
                               struct lsquic_conn *conn, unsigned cce_idx)
@@ -2800,12 +3904,14 @@ lsquic_engine_add_cid (struct lsquic_engine_public *enpub,
     struct lsquic_engine *const engine = (struct lsquic_engine *) enpub;
     struct conn_cid_elem *const cce = &conn->cn_cces[cce_idx];
     void *peer_ctx;
+    int s;
 
     assert(cce_idx < conn->cn_n_cces);
     assert(conn->cn_cces_mask & (1 << cce_idx));
     assert(!(cce->cce_hash_el.qhe_flags & QHE_HASHED));
 
-    if (lsquic_hash_insert(engine->conns_hash, cce->cce_cid.idbuf,
+    lsquic_enpub_lock(enpub);
+    if (lsquic_cidh_insert(engine->conns_hash, cce->cce_cid.idbuf,
                                     cce->cce_cid.len, conn, &cce->cce_hash_el))
     {
         LSQ_DEBUGC("add %"CID_FMT" to the list of SCIDs",
@@ -2813,14 +3919,16 @@ lsquic_engine_add_cid (struct lsquic_engine_public *enpub,
         peer_ctx = lsquic_conn_get_peer_ctx(conn, NULL);
         cce->cce_flags |= CCE_REG;
         cub_add(&engine->new_scids, &cce->cce_cid, peer_ctx);
-        return 0;
+        s = 0;
     }
     else
     {
         LSQ_WARNC("could not add new cid %"CID_FMT" to the SCID hash",
                                                     CID_BITS(&cce->cce_cid));
-        return -1;
+        s = -1;
     }
+    lsquic_enpub_unlock(enpub);
+    return s;
 }
 
 
@@ -2834,8 +3942,9 @@ lsquic_engine_retire_cid (struct lsquic_engine_public *enpub,
 
     assert(cce_idx < conn->cn_n_cces);
 
+    lsquic_enpub_lock(enpub);
     if (cce->cce_hash_el.qhe_flags & QHE_HASHED)
-        lsquic_hash_erase(engine->conns_hash, &cce->cce_hash_el);
+        lsquic_cidh_erase(engine->conns_hash, &cce->cce_hash_el);
 
     if (engine->purga)
     {
@@ -2843,6 +3952,7 @@ lsquic_engine_retire_cid (struct lsquic_engine_public *enpub,
         lsquic_purga_add(engine->purga, &cce->cce_cid, peer_ctx,
                                                     PUTY_CID_RETIRED, now);
     }
+    lsquic_enpub_unlock(enpub);
     conn->cn_cces_mask &= ~(1u << cce_idx);
     LSQ_DEBUGC("retire CID %"CID_FMT, CID_BITS(&cce->cce_cid));
 }
@@ -10,6 +10,8 @@
 #ifndef LSQUIC_ENGINE_PUBLIC_H
 #define LSQUIC_ENGINE_PUBLIC_H 1
 
+#include "lsquic_hash.h"
+
 struct lsquic_conn;
 struct lsquic_engine;
 struct stack_st_X509;
@@ -51,16 +53,78 @@ struct lsquic_engine_public {
     void                           *enp_kli_ctx;
     struct lsquic_engine           *enp_engine;
     struct lsquic_hash             *enp_srst_hash;
+    /* Random key for hash tables keyed by values chosen by peers */
+    unsigned char                   enp_hash_key[LSQUIC_HASH_KEY_SZ];
     enum {
         ENPUB_PROC  = (1 << 0), /* Being processed by one of the user-facing
                                  * functions.
                                  */
         ENPUB_CAN_SEND = (1 << 1),
+        ENPUB_TICK  = (1 << 2), /* Connections are being processed:
+                                 * enp_tick_time is valid.
+                                 */
     }                               enp_flags;
+    /* The engine clock.  enp_clock may be coarse and is used for timers;
+     * enp_precise_clock is used to timestamp packets.  Use the macros
+     * below instead of calling these directly.
+     */
+    lsquic_time_t                 (*enp_clock)(void *clock_ctx);
+    lsquic_time_t                 (*enp_precise_clock)(void *clock_ctx);
+    void                           *enp_clock_ctx;
+    /* Latest precise clock reading.  Coarse clock readings are never
+     * smaller than this value.
+     */
+    lsquic_time_t                   enp_last_precise;
+    /* Time captured at the beginning of current connection processing
+     * pass.
+     */
+    lsquic_time_t                   enp_tick_time;
+#if LSQUIC_TICK_THREADS
+    /* Set while connections are being ticked on several threads.  Engine
+     * state shared by connections -- the connection and stateless reset
+     * hashes, the Advisory Tick Time Queue, the purgatory, and enp_mm -- is
+     * only accessed under this lock during that time.
+     */
+    pthread_mutex_t                *enp_mt_lock;
+#endif
+    /* Memory budget accounting, see es_mem_budget.  enp_mem_high is zero
+     * if the budget is not enforced.  enp_stream_bytes is the amount of
+     * incoming stream data that has been received but not yet read by the
+     * user; it is updated under the engine lock.  Together with buffers
+     * that enp_mm has handed out, it is compared against enp_mem_high.
+     */
+    size_t                          enp_mem_high;
+    size_t                          enp_stream_bytes;
     unsigned char                   enp_ver_tags_buf[ sizeof(lsquic_ver_tag_t) * N_LSQVER ];
     unsigned                        enp_ver_tags_len;
 };
 
+/* If the clock is not set (as is the case in some unit tests),
+ * lsquic_time_now() is used.
+ */
+#define lsquic_enpub_now(enpub) ((enpub)->enp_clock ?                   \
+    (enpub)->enp_clock((enpub)->enp_clock_ctx) : lsquic_time_now())
+
+/* Use this for packet timestamps, from which RTT is calculated */
+#define lsquic_enpub_precise_now(enpub) ((enpub)->enp_precise_clock ?   \
+    (enpub)->enp_precise_clock((enpub)->enp_clock_ctx) : lsquic_time_now())
+
+/* While connections are being processed, return time captured at the
+ * beginning of the pass instead of reading the clock again.
+ */
+#define lsquic_enpub_tick_time(enpub) ((enpub)->enp_flags & ENPUB_TICK ?  \
+    (enpub)->enp_tick_time : lsquic_enpub_now(enpub))
+
+#define lsquic_enpub_lock(enpub) LSQ_MT_LOCK((enpub)->enp_mt_lock)
+#define lsquic_enpub_unlock(enpub) LSQ_MT_UNLOCK((enpub)->enp_mt_lock)
+
+/* True if the engine is close to its memory budget and connections should
+ * stop admitting more data.
+ */
+#define lsquic_enpub_mem_tight(enpub) ((enpub)->enp_mem_high &&          \
+    lsquic_mm_mem_out(&(enpub)->enp_mm) + (enpub)->enp_stream_bytes     \
+                                            >= (enpub)->enp_mem_high)
+
 /* Put connection onto the Tickable Queue if it is not already on it.  If
  * connection is being destroyed, this is a no-op.
  */
@@ -292,52 +292,53 @@ void
 lsquic_ev_log_create_connection (const lsquic_cid_t *, const struct sockaddr *,
                                                     const struct sockaddr *);
 
-#define EV_LOG_CREATE_CONN(...) do {                                        \
+/* `now' is only evaluated if qlog is enabled */
+#define EV_LOG_CREATE_CONN(cid, now, local_sa, peer_sa) do {                \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_EVENT))                    \
-        lsquic_ev_log_create_connection(__VA_ARGS__);                       \
+        lsquic_ev_log_create_connection(cid, local_sa, peer_sa);            \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_QLOG))                     \
-        lsquic_qlog_create_connection(__VA_ARGS__);                         \
+        lsquic_qlog_create_connection(cid, now, local_sa, peer_sa);         \
 } while (0)
 
 void
 lsquic_ev_log_hsk_completed (const lsquic_cid_t *);
 
-#define EV_LOG_HSK_COMPLETED(...) do {                                      \
+#define EV_LOG_HSK_COMPLETED(cid, now) do {                                 \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_EVENT))                    \
-        lsquic_ev_log_hsk_completed(__VA_ARGS__);                           \
+        lsquic_ev_log_hsk_completed(cid);                                   \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_QLOG))                     \
-        lsquic_qlog_hsk_completed(__VA_ARGS__);                             \
+        lsquic_qlog_hsk_completed(cid, now);                                \
 } while (0)
 
 
 void
 lsquic_ev_log_zero_rtt (const lsquic_cid_t *);
 
-#define EV_LOG_ZERO_RTT(...) do {                                           \
+#define EV_LOG_ZERO_RTT(cid, now) do {                                      \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_EVENT))                    \
-        lsquic_ev_log_zero_rtt(__VA_ARGS__);                                \
+        lsquic_ev_log_zero_rtt(cid);                                        \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_QLOG))                     \
-        lsquic_qlog_zero_rtt(__VA_ARGS__);                                  \
+        lsquic_qlog_zero_rtt(cid, now);                                     \
 } while (0)
 
 void
 lsquic_ev_log_check_certs (const lsquic_cid_t *, const lsquic_str_t **, size_t);
 
-#define EV_LOG_CHECK_CERTS(...) do {                                        \
+#define EV_LOG_CHECK_CERTS(cid, now, certs, count) do {                     \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_EVENT))                    \
-        lsquic_ev_log_check_certs(__VA_ARGS__);                             \
+        lsquic_ev_log_check_certs(cid, certs, count);                       \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_QLOG))                     \
-        lsquic_qlog_check_certs(__VA_ARGS__);                               \
+        lsquic_qlog_check_certs(cid, now, certs, count);                    \
 } while (0)
 
 void
 lsquic_ev_log_version_negotiation (const lsquic_cid_t *, const char *, const char *);
 
-#define EV_LOG_VER_NEG(...) do {                                            \
+#define EV_LOG_VER_NEG(cid, now, action, ver) do {                          \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_EVENT))                    \
-        lsquic_ev_log_version_negotiation(__VA_ARGS__);                     \
+        lsquic_ev_log_version_negotiation(cid, action, ver);                \
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_QLOG))                     \
-        lsquic_qlog_version_negotiation(__VA_ARGS__);                       \
+        lsquic_qlog_version_negotiation(cid, now, action, ver);             \
 } while (0)
 
 #endif
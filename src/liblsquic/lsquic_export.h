@@ -0,0 +1,126 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_export.h -- Helpers to serialize connection state
+ *
+ * Exported connection state is a flat sequence of 64-bit big-endian
+ * integers and length-prefixed byte strings.  The format is private to
+ * lsquic: it is versioned and the same library version is expected on
+ * both sides.
+ *
+ * The writer keeps counting when the buffer is too small, so that the
+ * caller can find out how much space is needed.  The reader sets an error
+ * flag when it runs out of input or a string is too long; the caller
+ * checks it once at the end.
+ */
+
+#ifndef LSQUIC_EXPORT_H
+#define LSQUIC_EXPORT_H 1
+
+#include "lsquic_byteswap.h"
+
+struct export_writer
+{
+    unsigned char      *ew_buf;
+    size_t              ew_bufsz;
+    size_t              ew_off;     /* Bytes written or that would be */
+};
+
+struct export_reader
+{
+    const unsigned char
+                       *er_p,
+                       *er_end;
+    int                 er_error;
+};
+
+
+static inline void
+lsquic_ew_init (struct export_writer *ew, void *buf, size_t bufsz)
+{
+    ew->ew_buf = buf;
+    ew->ew_bufsz = buf ? bufsz : 0;
+    ew->ew_off = 0;
+}
+
+
+static inline void
+lsquic_ew_raw (struct export_writer *ew, const void *data, size_t len)
+{
+    if (ew->ew_off + len <= ew->ew_bufsz)
+        memcpy(ew->ew_buf + ew->ew_off, data, len);
+    ew->ew_off += len;
+}
+
+
+static inline void
+lsquic_ew_u64 (struct export_writer *ew, uint64_t val)
+{
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    val = bswap_64(val);
+#endif
+    lsquic_ew_raw(ew, &val, sizeof(val));
+}
+
+
+static inline void
+lsquic_ew_bytes (struct export_writer *ew, const void *data, size_t len)
+{
+    lsquic_ew_u64(ew, len);
+    lsquic_ew_raw(ew, data, len);
+}
+
+
+/* True if everything fit */
+#define lsquic_ew_ok(ew_) ((ew_)->ew_off <= (ew_)->ew_bufsz)
+
+
+static inline void
+lsquic_er_init (struct export_reader *er, const void *buf, size_t bufsz)
+{
+    er->er_p = buf;
+    er->er_end = er->er_p + bufsz;
+    er->er_error = 0;
+}
+
+
+static inline uint64_t
+lsquic_er_u64 (struct export_reader *er)
+{
+    uint64_t val;
+
+    if ((size_t) (er->er_end - er->er_p) >= sizeof(val))
+    {
+        READ_UINT(val, 64, er->er_p, sizeof(val));
+        er->er_p += sizeof(val);
+        return val;
+    }
+    else
+    {
+        er->er_error = 1;
+        return 0;
+    }
+}
+
+
+/* Returns length of the string copied into `buf' */
+static inline size_t
+lsquic_er_bytes (struct export_reader *er, void *buf, size_t bufsz)
+{
+    uint64_t len;
+
+    len = lsquic_er_u64(er);
+    if (len <= bufsz && len <= (uint64_t) (er->er_end - er->er_p))
+    {
+        memcpy(buf, er->er_p, len);
+        er->er_p += len;
+        return len;
+    }
+    else
+    {
+        er->er_error = 1;
+        return 0;
+    }
+}
+
+
+#endif
@@ -355,30 +355,50 @@ highest_bit_set (unsigned sz)
 }
 
 
-static size_t
-calc_mem_used (const struct full_conn *conn)
+static void
+full_conn_ci_mem_stats (struct lsquic_conn *lconn,
+                                            struct lsquic_mem_stats *stats)
 {
+    struct full_conn *conn = (struct full_conn *) lconn;
     const lsquic_stream_t *stream;
     const struct lsquic_hash_elem *el;
-    size_t size;
+    size_t hpack, data_in;
 
-    size = sizeof(*conn);
-    size -= sizeof(conn->fc_send_ctl);
-    size += lsquic_send_ctl_mem_used(&conn->fc_send_ctl);
-    size += lsquic_hash_mem_used(conn->fc_pub.all_streams);
-    size += lsquic_malo_mem_used(conn->fc_pub.packet_out_malo);
+    stats->ms_conns += sizeof(*conn);
+    stats->ms_conns += lsquic_hash_mem_used(conn->fc_pub.all_streams);
+    stats->ms_conns += lsquic_stab_mem_used(&conn->fc_pub.stream_tab);
+    stats->ms_conns += conn->fc_conn.cn_esf.g->esf_mem_used(
+                                                conn->fc_conn.cn_enc_session);
+    stats->ms_packets_out += lsquic_send_ctl_mem_used(&conn->fc_send_ctl)
+                                                - sizeof(conn->fc_send_ctl);
+    stats->ms_packets_out += lsquic_malo_mem_used(conn->fc_pub.packet_out_malo);
     if (conn->fc_pub.u.gquic.hs)
-        size += lsquic_headers_stream_mem_used(conn->fc_pub.u.gquic.hs);
+    {
+        hpack = lsquic_headers_stream_hpack_mem_used(conn->fc_pub.u.gquic.hs);
+        stats->ms_hdr_tables += hpack;
+        stats->ms_streams += lsquic_headers_stream_mem_used(
+                                            conn->fc_pub.u.gquic.hs) - hpack;
+    }
 
     for (el = lsquic_hash_first(conn->fc_pub.all_streams); el;
                                  el = lsquic_hash_next(conn->fc_pub.all_streams))
     {
         stream = lsquic_hashelem_getdata(el);
-        size += lsquic_stream_mem_used(stream);
+        data_in = lsquic_stream_data_in_mem_used(stream);
+        stats->ms_packets_in += data_in;
+        stats->ms_streams += lsquic_stream_mem_used(stream) - data_in;
     }
-    size += conn->fc_conn.cn_esf.g->esf_mem_used(conn->fc_conn.cn_enc_session);
+}
 
-    return size;
+
+static size_t
+calc_mem_used (const struct full_conn *conn)
+{
+    struct lsquic_mem_stats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    full_conn_ci_mem_stats((struct lsquic_conn *) &conn->fc_conn, &stats);
+    return lsquic_mem_stats_sum(&stats);
 }
 
 
@@ -618,7 +638,8 @@ new_conn_common (lsquic_cid_t cid, struct lsquic_engine_public *enpub,
                      flags & FC_SERVER ? &server_ver_neg : &conn->fc_ver_neg,
                      &conn->fc_pub, 0);
 
-    conn->fc_pub.all_streams = lsquic_hash_create();
+    conn->fc_pub.all_streams = lsquic_hash_create_keyed(
+                                                conn->fc_enpub->enp_hash_key);
     if (!conn->fc_pub.all_streams)
         goto cleanup_on_error;
     lsquic_rechist_init(&conn->fc_rechist, &conn->fc_conn, 0);
@@ -655,6 +676,7 @@ new_conn_common (lsquic_cid_t cid, struct lsquic_engine_public *enpub,
 
     if (conn->fc_pub.all_streams)
         lsquic_hash_destroy(conn->fc_pub.all_streams);
+    lsquic_stab_cleanup(&conn->fc_pub.stream_tab);
     lsquic_rechist_cleanup(&conn->fc_rechist);
     if (conn->fc_flags & FC_HTTP)
     {
@@ -731,7 +753,7 @@ lsquic_gquic_full_conn_client_new (struct lsquic_engine_public *enpub,
     init_ver_neg(conn, versions, &version);
     if (conn->fc_settings->es_handshake_to)
         lsquic_alarmset_set(&conn->fc_alset, AL_HANDSHAKE,
-                    lsquic_time_now() + conn->fc_settings->es_handshake_to);
+                    lsquic_enpub_tick_time(conn->fc_enpub) + conn->fc_settings->es_handshake_to);
     if (!new_stream(conn, LSQUIC_GQUIC_STREAM_HANDSHAKE, SCF_CALL_ON_NEW))
     {
         LSQ_WARN("could not create handshake stream: %s", strerror(errno));
@@ -933,7 +955,7 @@ lsquic_gquic_full_conn_server_new (struct lsquic_engine_public *enpub,
         if (have_outgoing_ack)
             reset_ack_state(conn);
         lsquic_alarmset_set(&conn->fc_alset, AL_IDLE,
-                    lsquic_time_now() + conn->fc_settings->es_idle_conn_to);
+                    lsquic_enpub_tick_time(conn->fc_enpub) + conn->fc_settings->es_idle_conn_to);
         EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "created full connection");
         LSQ_INFO("Created new server connection");
         return &conn->fc_conn;
@@ -1038,6 +1060,8 @@ full_conn_ci_destroy (lsquic_conn_t *lconn)
         lsquic_stream_destroy(stream);
     }
     lsquic_hash_destroy(conn->fc_pub.all_streams);
+    lsquic_stab_cleanup(&conn->fc_pub.stream_tab);
+    lsquic_cfcw_cleanup(&conn->fc_pub.cfcw);
     if (conn->fc_flags & FC_CREATED_OK)
         conn->fc_stream_ifs[STREAM_IF_STD].stream_if
                     ->on_conn_closed(&conn->fc_conn);
@@ -1161,7 +1185,7 @@ verify_ack_frame (struct full_conn *conn, const unsigned char *buf, int bufsz)
     unsigned buf_off = 0;
     int nw;
 
-    ack_info = conn->fc_pub.mm->acki;
+    ack_info = lsquic_mm_acki(conn->fc_pub.mm);
     parsed_len = parse_ack_frame(buf, bufsz, ack_info);
     assert(parsed_len == bufsz);
 
@@ -1193,7 +1217,7 @@ full_conn_ci_write_ack (struct lsquic_conn *lconn,
     lsquic_time_t now;
     int has_missing, w;
 
-    now = lsquic_time_now();
+    now = lsquic_enpub_precise_now(conn->fc_enpub);
     w = conn->fc_conn.cn_pf->pf_gen_ack_frame(
             packet_out->po_data + packet_out->po_data_sz,
             lsquic_packet_out_avail(packet_out),
@@ -1245,9 +1269,9 @@ new_stream_ext (struct full_conn *conn, lsquic_stream_id_t stream_id, int if_idx
         stream_id == LSQUIC_GQUIC_STREAM_HANDSHAKE
                                 ? 16 * 1024 : conn->fc_cfg.max_stream_send,
         stream_ctor_flags);
-    if (stream)
-        lsquic_hash_insert(conn->fc_pub.all_streams, &stream->id,
-                            sizeof(stream->id), stream, &stream->sm_hash_el);
+    if (stream && lsquic_hash_insert(conn->fc_pub.all_streams, &stream->id,
+                            sizeof(stream->id), stream, &stream->sm_hash_el))
+        lsquic_stab_insert(&conn->fc_pub.stream_tab, stream->id, stream);
     return stream;
 }
 
@@ -1365,6 +1389,11 @@ static lsquic_stream_t *
 find_stream_by_id (struct full_conn *conn, lsquic_stream_id_t stream_id)
 {
     struct lsquic_hash_elem *el;
+    struct lsquic_stream *stream;
+
+    if (lsquic_stab_find(&conn->fc_pub.stream_tab, stream_id, &stream))
+        return stream;
+
     el = lsquic_hash_find(conn->fc_pub.all_streams, &stream_id, sizeof(stream_id));
     if (el)
         return lsquic_hashelem_getdata(el);
@@ -1592,6 +1621,14 @@ process_stream_frame (struct full_conn *conn, lsquic_packet_in_t *packet_in,
                 lsquic_malo_put(stream_frame);
                 return parsed_len;
             }
+            if (lsquic_enpub_mem_tight(conn->fc_enpub))
+            {
+                LSQ_DEBUG("memory is tight: reset new incoming stream %"
+                                            PRIu64, stream_frame->stream_id);
+                maybe_schedule_reset_for_stream(conn, stream_frame->stream_id);
+                lsquic_malo_put(stream_frame);
+                return parsed_len;
+            }
         }
         else
         {
@@ -1785,7 +1822,7 @@ static int
 process_saved_ack (struct full_conn *conn, int restore_parsed_ack,
                                                         lsquic_time_t now)
 {
-    struct ack_info *const acki = conn->fc_pub.mm->acki;
+    struct ack_info *const acki = lsquic_mm_acki(conn->fc_pub.mm);
     struct lsquic_packno_range range;
     unsigned n_ranges, n_timestamps;
     lsquic_time_t lack_delta;
@@ -1882,7 +1919,7 @@ static unsigned
 process_ack_frame (struct full_conn *conn, lsquic_packet_in_t *packet_in,
                                             const unsigned char *p, size_t len)
 {
-    struct ack_info *const new_acki = conn->fc_pub.mm->acki;
+    struct ack_info *const new_acki = lsquic_mm_acki(conn->fc_pub.mm);
     int parsed_len;
     lsquic_time_t warn_time;
 
@@ -1984,7 +2021,7 @@ process_ack_frame (struct full_conn *conn, lsquic_packet_in_t *packet_in,
     return parsed_len;
 
   err:
-    warn_time = lsquic_time_now();
+    warn_time = lsquic_enpub_now(conn->fc_enpub);
     if (0 == conn->fc_enpub->enp_last_warning[WT_ACKPARSE_FULL]
         || conn->fc_enpub->enp_last_warning[WT_ACKPARSE_FULL]
                 + WARNING_INTERVAL < warn_time)
@@ -2263,6 +2300,7 @@ process_ver_neg_packet (struct full_conn *conn, lsquic_packet_in_t *packet_in)
             versions |= 1 << version;
             LSQ_DEBUG("server supports version %s", lsquic_ver2str[version]);
             EV_LOG_VER_NEG(LSQUIC_LOG_CONN_ID,
+                                lsquic_enpub_tick_time(conn->fc_enpub),
                                         "supports", lsquic_ver2str[version]);
         }
     }
@@ -2479,6 +2517,7 @@ process_incoming_packet (struct full_conn *conn, lsquic_packet_in_t *packet_in)
                                     lsquic_ver2str[conn->fc_ver_neg.vn_ver]);
             lsquic_send_ctl_verneg_done(&conn->fc_send_ctl);
             EV_LOG_VER_NEG(LSQUIC_LOG_CONN_ID,
+                            lsquic_enpub_tick_time(conn->fc_enpub),
                             "agreed", lsquic_ver2str[conn->fc_ver_neg.vn_ver]);
         }
         return process_regular_packet(conn, packet_in);
@@ -2981,7 +3020,10 @@ service_streams (struct full_conn *conn)
             TAILQ_REMOVE(&conn->fc_pub.service_streams, stream, next_service_stream);
             el = lsquic_hash_find(conn->fc_pub.all_streams, &stream->id, sizeof(stream->id));
             if (el)
+            {
                 lsquic_hash_erase(conn->fc_pub.all_streams, el);
+                lsquic_stab_remove(&conn->fc_pub.stream_tab, stream->id);
+            }
             SAVE_STREAM_HISTORY(conn, stream);
             lsquic_stream_destroy(stream);
         }
@@ -3779,6 +3821,13 @@ find_stream_on_non_stream_frame (struct full_conn *conn,
         LSQ_DEBUG("going away: reset new incoming stream %"PRIu64, stream_id);
         return NULL;
     }
+    if (lsquic_enpub_mem_tight(conn->fc_enpub))
+    {
+        maybe_schedule_reset_for_stream(conn, stream_id);
+        LSQ_DEBUG("memory is tight: reset new incoming stream %"PRIu64,
+                                                                    stream_id);
+        return NULL;
+    }
 
     stream = new_stream(conn, stream_id, stream_ctor_flags);
     if (!stream)
@@ -4308,7 +4357,7 @@ full_conn_ci_next_tick_time (lsquic_conn_t *lconn, unsigned *why)
 
     if (pacer_time && LSQ_LOG_ENABLED(LSQ_LOG_DEBUG))
     {
-        now = lsquic_time_now();
+        now = lsquic_enpub_tick_time(conn->fc_enpub);
         if (pacer_time < now)
             LSQ_DEBUG("%s: pacer is %"PRIu64" usec in the past", __func__,
                                                             now - pacer_time);
@@ -4458,6 +4507,7 @@ static const struct conn_iface full_conn_iface = {
     .ci_is_push_enabled      =  full_conn_ci_is_push_enabled,
     .ci_is_tickable          =  full_conn_ci_is_tickable,
     .ci_make_stream          =  full_conn_ci_make_stream,
+    .ci_mem_stats            =  full_conn_ci_mem_stats,
     .ci_n_avail_streams      =  full_conn_ci_n_avail_streams,
     .ci_n_pending_streams    =  full_conn_ci_n_pending_streams,
     .ci_next_packet_to_send  =  full_conn_ci_next_packet_to_send,
@@ -36,6 +36,21 @@ lsquic_ietf_full_conn_server_new (struct lsquic_engine_public *,
                unsigned flags /* Only FC_SERVER and FC_HTTP */,
                struct lsquic_conn *mini_conn);
 
+/* Create server connection from state produced by lsquic_conn_export() */
+struct lsquic_conn *
+lsquic_ietf_full_conn_import (struct lsquic_engine_public *,
+               unsigned flags /* Only FC_SERVER and FC_HTTP */,
+               const void *buf, size_t bufsz, void *peer_ctx);
+
+/* Serialize connection whose tick returned TICK_HIBERNATE.  Works like
+ * lsquic_conn_export(); once the state is written out, the connection is
+ * closed silently and `idle_expiry' is set to the time the connection
+ * would have timed out.
+ */
+ssize_t
+lsquic_ietf_full_conn_hibernate (struct lsquic_conn *, void *buf,
+                                size_t bufsz, lsquic_time_t *idle_expiry);
+
 struct dcid_elem
 {
     /* This is never both in the hash and on the retirement list */
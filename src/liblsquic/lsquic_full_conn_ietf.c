@@ -66,6 +66,7 @@
 #include "lsquic_ietf.h"
 #include "lsquic_push_promise.h"
 #include "lsquic_headers.h"
+#include "lsquic_export.h"
 
 #define LSQUIC_LOGGER_MODULE LSQLM_CONN
 #define LSQUIC_LOG_CONN_ID ietf_full_conn_ci_get_log_cid(&conn->ifc_conn)
@@ -125,6 +126,10 @@ enum ifull_conn_flags
     IFC_FIRST_TICK    = 1 << 24,
     IFC_IGNORE_HSK    = 1 << 25,
     IFC_PROC_CRYPTO   = 1 << 26,
+    IFC_EXPORTED      = 1 << 27,  /* Moved to another engine */
+    IFC_MAX_STREAMS_DEFER
+                      = 1 << 28,  /* MAX_STREAMS held back: memory is tight */
+    IFC_HIBERNATE     = 1 << 29,  /* Hibernation alarm rang */
 };
 
 
@@ -182,7 +187,8 @@ enum send_flags
             (((SF_SEND_PATH_CHAL << N_PATHS) - 1) & ~(SF_SEND_PATH_CHAL - 1))
 
 #define IFC_IMMEDIATE_CLOSE_FLAGS \
-            (IFC_TIMED_OUT|IFC_ERROR|IFC_ABORTED|IFC_HSK_FAILED|IFC_GOT_PRST)
+            (IFC_TIMED_OUT|IFC_ERROR|IFC_ABORTED|IFC_HSK_FAILED|IFC_GOT_PRST\
+                                                                |IFC_EXPORTED)
 
 #define MAX_ERRMSG 256
 
@@ -599,6 +605,16 @@ ping_alarm_expired (enum alarm_id al_id, void *ctx, lsquic_time_t expiry,
 }
 
 
+static void
+hibernate_alarm_expired (enum alarm_id al_id, void *ctx,
+                                    lsquic_time_t expiry, lsquic_time_t now)
+{
+    struct ietf_full_conn *const conn = (struct ietf_full_conn *) ctx;
+    LSQ_DEBUG("hibernation alarm rang");
+    conn->ifc_flags |= IFC_HIBERNATE;
+}
+
+
 static void
 retire_cid (struct ietf_full_conn *, struct conn_cid_elem *, lsquic_time_t);
 
@@ -739,6 +755,7 @@ create_uni_stream_out (struct ietf_full_conn *conn, int priority,
         lsquic_stream_destroy(stream);
         return -1;
     }
+    lsquic_stab_insert(&conn->ifc_pub.stream_tab, stream->id, stream);
     if (priority >= 0)
         lsquic_stream_set_priority_internal(stream, priority);
     lsquic_stream_call_on_new(stream);
@@ -791,6 +808,7 @@ create_bidi_stream_out (struct ietf_full_conn *conn)
         lsquic_stream_destroy(stream);
         return -1;
     }
+    lsquic_stab_insert(&conn->ifc_pub.stream_tab, stream->id, stream);
     lsquic_stream_call_on_new(stream);
     return 0;
 }
@@ -818,6 +836,7 @@ create_push_stream (struct ietf_full_conn *conn)
         lsquic_stream_destroy(stream);
         return NULL;
     }
+    lsquic_stab_insert(&conn->ifc_pub.stream_tab, stream->id, stream);
     return stream;
 }
 
@@ -861,7 +880,7 @@ ietf_full_conn_add_scid (struct ietf_full_conn *conn,
     }
 
     if (enpub->enp_settings.es_scid_len)
-        lsquic_generate_cid(&cce->cce_cid, enpub->enp_settings.es_scid_len);
+        lsquic_generate_scid(&cce->cce_cid, &enpub->enp_settings);
     cce->cce_seqno = conn->ifc_scid_seqno++;
     cce->cce_flags |= CCE_SEQNO | flags;
     lconn->cn_cces_mask |= 1 << (cce - lconn->cn_cces);
@@ -913,6 +932,8 @@ ietf_full_conn_init (struct ietf_full_conn *conn,
     lsquic_alarmset_init_alarm(&conn->ifc_alset, AL_CID_THROT, cid_throt_alarm_expired, conn);
     lsquic_alarmset_init_alarm(&conn->ifc_alset, AL_PATH_CHAL_0, path_chal_0_alarm_expired, conn);
     lsquic_alarmset_init_alarm(&conn->ifc_alset, AL_PATH_CHAL_1, path_chal_1_alarm_expired, conn);
+    if (enpub->enp_settings.es_hibernate_idle)
+        lsquic_alarmset_init_alarm(&conn->ifc_alset, AL_HIBERNATE, hibernate_alarm_expired, conn);
     lsquic_rechist_init(&conn->ifc_rechist[PNS_INIT], &conn->ifc_conn, 1);
     lsquic_rechist_init(&conn->ifc_rechist[PNS_HSK], &conn->ifc_conn, 1);
     lsquic_rechist_init(&conn->ifc_rechist[PNS_APP], &conn->ifc_conn, 1);
@@ -921,7 +942,8 @@ ietf_full_conn_init (struct ietf_full_conn *conn,
         &conn->ifc_pub, SC_IETF|SC_NSTP|(ecn ? SC_ECN : 0));
     lsquic_cfcw_init(&conn->ifc_pub.cfcw, &conn->ifc_pub,
                                                 conn->ifc_settings->es_cfcw);
-    conn->ifc_pub.all_streams = lsquic_hash_create();
+    conn->ifc_pub.all_streams = lsquic_hash_create_keyed(
+                                                    enpub->enp_hash_key);
     if (!conn->ifc_pub.all_streams)
         return -1;
     conn->ifc_pub.u.ietf.qeh = &conn->ifc_qeh;
@@ -960,7 +982,7 @@ lsquic_ietf_full_conn_client_new (struct lsquic_engine_public *enpub,
     conn = calloc(1, sizeof(*conn));
     if (!conn)
         return NULL;
-    now = lsquic_time_now();
+    now = lsquic_enpub_tick_time(enpub);
     /* Set the flags early so that correct CID is used for logging */
     conn->ifc_conn.cn_flags |= LSCONN_IETF;
     conn->ifc_conn.cn_cces = conn->ifc_cces;
@@ -1032,7 +1054,7 @@ lsquic_ietf_full_conn_client_new (struct lsquic_engine_public *enpub,
     assert(ver == conn->ifc_u.cli.ifcli_ver_neg.vn_ver);
     if (conn->ifc_settings->es_handshake_to)
         lsquic_alarmset_set(&conn->ifc_alset, AL_HANDSHAKE,
-                    lsquic_time_now() + conn->ifc_settings->es_handshake_to);
+                    lsquic_enpub_tick_time(conn->ifc_enpub) + conn->ifc_settings->es_handshake_to);
     lsquic_alarmset_set(&conn->ifc_alset, AL_IDLE, now + conn->ifc_idle_to);
     if (enpub->enp_settings.es_support_push && CLIENT_PUSH_SUPPORT)
     {
@@ -1117,7 +1139,7 @@ lsquic_ietf_full_conn_server_new (struct lsquic_engine_public *enpub,
     conn = calloc(1, sizeof(*conn));
     if (!conn)
         return NULL;
-    now = lsquic_time_now();
+    now = lsquic_enpub_tick_time(enpub);
     conn->ifc_conn.cn_cces = conn->ifc_cces;
     conn->ifc_conn.cn_n_cces = sizeof(conn->ifc_cces)
                                                 / sizeof(conn->ifc_cces[0]);
@@ -1195,7 +1217,8 @@ lsquic_ietf_full_conn_server_new (struct lsquic_engine_public *enpub,
         conn->ifc_u.ser.ifser_flags |= IFSER_PUSH_ENABLED;
     if (flags & IFC_HTTP)
     {
-        conn->ifc_pub.u.ietf.promises = lsquic_hash_create();
+        conn->ifc_pub.u.ietf.promises = lsquic_hash_create_keyed(
+                                                    enpub->enp_hash_key);
         if (!conn->ifc_pub.u.ietf.promises)
         {
             /* XXX: deinit conn? */
@@ -1278,7 +1301,7 @@ lsquic_ietf_full_conn_server_new (struct lsquic_engine_public *enpub,
 
     if (conn->ifc_original_cids)
     {
-        lsquic_time_t now = lsquic_time_now();
+        lsquic_time_t now = lsquic_enpub_tick_time(conn->ifc_enpub);
         lsquic_alarmset_init_alarm(&conn->ifc_alset, AL_RET_CIDS,
                                                 ret_cids_alarm_expired, conn);
         lsquic_alarmset_set(&conn->ifc_alset, AL_RET_CIDS,
@@ -1722,6 +1745,16 @@ generate_max_streams_frame (struct ietf_full_conn *conn, enum stream_dir sd)
     size_t need;
     int w;
 
+    /* Peer cannot open new streams until memory use goes down */
+    if (lsquic_enpub_mem_tight(conn->ifc_enpub))
+    {
+        LSQ_DEBUG("memory is tight, defer MAX_STREAMS frame (uni: %d)",
+                                                            sd == SD_UNI);
+        conn->ifc_send_flags &= ~(SF_SEND_MAX_STREAMS << sd);
+        conn->ifc_flags |= IFC_MAX_STREAMS_DEFER;
+        return;
+    }
+
     limit = conn->ifc_closed_peer_streams[sd] + conn->ifc_max_streams_in[sd];
     need = conn->ifc_conn.cn_pf->pf_max_streams_frame_size(limit);
     packet_out = get_writeable_packet(conn, need);
@@ -1751,6 +1784,32 @@ generate_max_streams_frame (struct ietf_full_conn *conn, enum stream_dir sd)
 }
 
 
+/* Reschedule MAX_STREAMS frames deferred by generate_max_streams_frame() */
+static void
+maybe_resume_max_streams (struct ietf_full_conn *conn)
+{
+    enum stream_id_type sit;
+    enum stream_dir sd;
+
+    if (lsquic_enpub_mem_tight(conn->ifc_enpub))
+        return;
+
+    conn->ifc_flags &= ~IFC_MAX_STREAMS_DEFER;
+    for (sd = 0; sd < N_SDS; ++sd)
+    {
+        sit = gen_sit(!(conn->ifc_flags & IFC_SERVER), sd);
+        if (conn->ifc_closed_peer_streams[sd]
+                                    + conn->ifc_max_streams_in[sd] / 2
+                        >= conn->ifc_max_allowed_stream_id[sit] >> SIT_SHIFT)
+        {
+            LSQ_DEBUG("memory use is down, resume %sdirectional MAX_STREAMS",
+                                                sd == SD_UNI ? "uni" : "bi");
+            conn->ifc_send_flags |= SF_SEND_MAX_STREAMS << sd;
+        }
+    }
+}
+
+
 static void
 generate_max_streams_uni_frame (struct ietf_full_conn *conn, lsquic_time_t now)
 {
@@ -2158,7 +2217,10 @@ service_streams (struct ietf_full_conn *conn)
                 el = lsquic_hash_find(conn->ifc_pub.all_streams,
                                             &stream->id, sizeof(stream->id));
                 if (el)
+                {
                     lsquic_hash_erase(conn->ifc_pub.all_streams, el);
+                    lsquic_stab_remove(&conn->ifc_pub.stream_tab, stream->id);
+                }
                 conn_mark_stream_closed(conn, stream->id);
             }
             else
@@ -2224,7 +2286,8 @@ ietf_full_conn_ci_write_ack (struct lsquic_conn *lconn,
                                         struct lsquic_packet_out *packet_out)
 {
     struct ietf_full_conn *conn = (struct ietf_full_conn *) lconn;
-    generate_ack_frame_for_pns(conn, packet_out, PNS_APP, lsquic_time_now());
+    generate_ack_frame_for_pns(conn, packet_out, PNS_APP,
+                                lsquic_enpub_precise_now(conn->ifc_enpub));
 }
 
 
@@ -2275,7 +2338,11 @@ static void
 retire_dcid (struct ietf_full_conn *conn, struct dcid_elem **dce)
 {
     if ((*dce)->de_hash_el.qhe_flags & QHE_HASHED)
+    {
+        lsquic_enpub_lock(conn->ifc_enpub);
         lsquic_hash_erase(conn->ifc_enpub->enp_srst_hash, &(*dce)->de_hash_el);
+        lsquic_enpub_unlock(conn->ifc_enpub);
+    }
     TAILQ_INSERT_TAIL(&conn->ifc_to_retire, *dce, de_next_to_ret);
     LSQ_DEBUG("prepare to retire DCID seqno %"PRIu32"", (*dce)->de_seqno);
     *dce = NULL;
@@ -2387,6 +2454,7 @@ ietf_full_conn_ci_destroy (struct lsquic_conn *lconn)
         lsquic_hash_erase(conn->ifc_pub.all_streams, el);
         lsquic_stream_destroy(stream);
     }
+    lsquic_cfcw_cleanup(&conn->ifc_pub.cfcw);
     if (conn->ifc_flags & IFC_HTTP)
     {
         lsquic_qdh_cleanup(&conn->ifc_qdh);
@@ -2426,6 +2494,9 @@ ietf_full_conn_ci_destroy (struct lsquic_conn *lconn)
             lsquic_hash_destroy(conn->ifc_pub.u.ietf.promises);
     }
     lsquic_hash_destroy(conn->ifc_pub.all_streams);
+    lsquic_stab_cleanup(&conn->ifc_pub.stream_tab);
+    for (i = 0; i < N_SITS; ++i)
+        lsquic_set64_cleanup(&conn->ifc_closed_stream_ids[i]);
     EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "full connection destroyed");
     free(conn->ifc_errmsg);
     free(conn);
@@ -2438,8 +2509,11 @@ ietf_full_conn_ci_drain_time (const struct lsquic_conn *lconn)
     struct ietf_full_conn *conn = (struct ietf_full_conn *) lconn;
     lsquic_time_t drain_time, pto, srtt, var;
 
-    /* Only applicable to a server whose connection was not timed out */
-    if ((conn->ifc_flags & (IFC_SERVER|IFC_TIMED_OUT)) != IFC_SERVER)
+    /* Only applicable to a server whose connection was not timed out or
+     * exported.
+     */
+    if ((conn->ifc_flags & (IFC_SERVER|IFC_TIMED_OUT|IFC_EXPORTED))
+                                                                != IFC_SERVER)
     {
         LSQ_DEBUG("drain time is zero (don't drain)");
         return 0;
@@ -2563,6 +2637,7 @@ begin_migra_or_retire_cid (struct ietf_full_conn *conn,
 {
     struct conn_path *copath;
     struct dcid_elem *dce;
+    struct lsquic_hash_elem *el;
     int is_ipv6;
     union {
         struct sockaddr_in  v4;
@@ -2619,9 +2694,12 @@ begin_migra_or_retire_cid (struct ietf_full_conn *conn,
                                                     sizeof(dce->de_srst));
     if (conn->ifc_enpub->enp_srst_hash)
     {
-        if (!lsquic_hash_insert(conn->ifc_enpub->enp_srst_hash,
+        lsquic_enpub_lock(conn->ifc_enpub);
+        el = lsquic_hash_insert(conn->ifc_enpub->enp_srst_hash,
                 dce->de_srst, sizeof(dce->de_srst), &conn->ifc_conn,
-                &dce->de_hash_el))
+                &dce->de_hash_el);
+        lsquic_enpub_unlock(conn->ifc_enpub);
+        if (!el)
         {
             lsquic_malo_put(dce);
             ABORT_WARN("cannot insert DCE");
@@ -2778,9 +2856,12 @@ handshake_ok (struct lsquic_conn *lconn)
         dce->de_flags = DE_SRST | DE_ASSIGNED;
         if (conn->ifc_enpub->enp_srst_hash)
         {
-            if (!lsquic_hash_insert(conn->ifc_enpub->enp_srst_hash,
+            lsquic_enpub_lock(conn->ifc_enpub);
+            el = lsquic_hash_insert(conn->ifc_enpub->enp_srst_hash,
                     dce->de_srst, sizeof(dce->de_srst), &conn->ifc_conn,
-                    &dce->de_hash_el))
+                    &dce->de_hash_el);
+            lsquic_enpub_unlock(conn->ifc_enpub);
+            if (!el)
             {
                 ABORT_WARN("cannot insert DCE");
                 return -1;
@@ -2946,6 +3027,7 @@ undo_stream_creation (struct ietf_full_conn *conn,
 
     LSQ_DEBUG("undo creation of stream %"PRIu64, stream->id);
     lsquic_hash_erase(conn->ifc_pub.all_streams, &stream->sm_hash_el);
+    lsquic_stab_remove(&conn->ifc_pub.stream_tab, stream->id);
     sd = (stream->id >> SD_SHIFT) & 1;
     --conn->ifc_n_created_streams[sd];
     lsquic_stream_destroy(stream);
@@ -3308,7 +3390,7 @@ immediate_close (struct ietf_full_conn *conn)
     struct conn_err conn_err;
     int sz;
 
-    if (conn->ifc_flags & (IFC_TICK_CLOSE|IFC_GOT_PRST))
+    if (conn->ifc_flags & (IFC_TICK_CLOSE|IFC_GOT_PRST|IFC_EXPORTED))
         return TICK_CLOSE;
 
     if (!(conn->ifc_flags & IFC_SERVER)
@@ -3731,7 +3813,7 @@ ietf_full_conn_ci_next_tick_time (struct lsquic_conn *lconn, unsigned *why)
 
     if (pacer_time && LSQ_LOG_ENABLED(LSQ_LOG_DEBUG))
     {
-        now = lsquic_time_now();
+        now = lsquic_enpub_tick_time(conn->ifc_enpub);
         if (pacer_time < now)
             LSQ_DEBUG("%s: pacer is %"PRIu64" usec in the past", __func__,
                                                             now - pacer_time);
@@ -3825,7 +3907,7 @@ static int
 process_saved_ack (struct ietf_full_conn *conn, int restore_parsed_ack,
                                                         lsquic_time_t now)
 {
-    struct ack_info *const acki = conn->ifc_pub.mm->acki;
+    struct ack_info *const acki = lsquic_mm_acki(conn->ifc_pub.mm);
     struct lsquic_packno_range range;
     unsigned n_ranges, n_timestamps;
     lsquic_time_t lack_delta;
@@ -4076,6 +4158,11 @@ static lsquic_stream_t *
 find_stream_by_id (struct ietf_full_conn *conn, lsquic_stream_id_t stream_id)
 {
     struct lsquic_hash_elem *el;
+    struct lsquic_stream *stream;
+
+    if (lsquic_stab_find(&conn->ifc_pub.stream_tab, stream_id, &stream))
+        return stream;
+
     el = lsquic_hash_find(conn->ifc_pub.all_streams, &stream_id,
                                                             sizeof(stream_id));
     if (el)
@@ -4163,6 +4250,7 @@ new_stream (struct ietf_full_conn *conn, lsquic_stream_id_t stream_id,
         if (lsquic_hash_insert(conn->ifc_pub.all_streams, &stream->id,
                             sizeof(stream->id), stream, &stream->sm_hash_el))
         {
+            lsquic_stab_insert(&conn->ifc_pub.stream_tab, stream->id, stream);
             if (call_on_new)
                 lsquic_stream_call_on_new(stream);
         }
@@ -4571,7 +4659,7 @@ static unsigned
 process_ack_frame (struct ietf_full_conn *conn,
     struct lsquic_packet_in *packet_in, const unsigned char *p, size_t len)
 {
-    struct ack_info *const new_acki = conn->ifc_pub.mm->acki;
+    struct ack_info *const new_acki = lsquic_mm_acki(conn->ifc_pub.mm);
     enum packnum_space pns;
     int parsed_len;
     lsquic_time_t warn_time;
@@ -4673,7 +4761,7 @@ process_ack_frame (struct ietf_full_conn *conn,
     return parsed_len;
 
   err:
-    warn_time = lsquic_time_now();
+    warn_time = lsquic_enpub_now(conn->ifc_enpub);
     if (0 == conn->ifc_enpub->enp_last_warning[WT_ACKPARSE_FULL]
         || conn->ifc_enpub->enp_last_warning[WT_ACKPARSE_FULL]
                 + WARNING_INTERVAL < warn_time)
@@ -5915,6 +6003,7 @@ process_incoming_packet_verneg (struct ietf_full_conn *conn,
                 versions |= 1 << version;
                 LSQ_DEBUG("server supports version %s", lsquic_ver2str[version]);
                 EV_LOG_VER_NEG(LSQUIC_LOG_CONN_ID,
+                                    lsquic_enpub_tick_time(conn->ifc_enpub),
                                             "supports", lsquic_ver2str[version]);
             }
         }
@@ -5948,7 +6037,7 @@ process_incoming_packet_verneg (struct ietf_full_conn *conn,
     conn->ifc_conn.cn_flags |= LSCONN_VER_SET;
     LSQ_DEBUG("end of version negotiation: agreed upon %s",
                     lsquic_ver2str[conn->ifc_u.cli.ifcli_ver_neg.vn_ver]);
-    EV_LOG_VER_NEG(LSQUIC_LOG_CONN_ID,
+    EV_LOG_VER_NEG(LSQUIC_LOG_CONN_ID, lsquic_enpub_tick_time(conn->ifc_enpub),
             "agreed", lsquic_ver2str[conn->ifc_u.cli.ifcli_ver_neg.vn_ver]);
     conn->ifc_process_incoming_packet = process_incoming_packet_fast;
 
@@ -5973,6 +6062,10 @@ ietf_full_conn_ci_packet_in (struct lsquic_conn *lconn,
 
     lsquic_alarmset_set(&conn->ifc_alset, AL_IDLE,
                 packet_in->pi_received + conn->ifc_idle_to);
+    if (conn->ifc_settings->es_hibernate_idle)
+        lsquic_alarmset_set(&conn->ifc_alset, AL_HIBERNATE,
+                packet_in->pi_received
+                    + conn->ifc_settings->es_hibernate_idle * 1000000ull);
     if (0 == (conn->ifc_flags & IFC_IMMEDIATE_CLOSE_FLAGS))
         if (0 != conn->ifc_process_incoming_packet(conn, packet_in))
             conn->ifc_flags |= IFC_ERROR;
@@ -6070,6 +6163,10 @@ static void (*const send_funcs[N_SEND])(
     |SF_SEND_PATH_RESP_PATH_0|SF_SEND_PATH_RESP_PATH_1\
     |SF_SEND_STOP_SENDING)
 
+static enum tick_st
+maybe_hibernate (struct ietf_full_conn *, lsquic_time_t now);
+
+
 static enum tick_st
 ietf_full_conn_ci_tick (struct lsquic_conn *lconn, lsquic_time_t now)
 {
@@ -6187,6 +6284,9 @@ ietf_full_conn_ci_tick (struct lsquic_conn *lconn, lsquic_time_t now)
         CLOSE_IF_NECESSARY();
     }
 
+    if (conn->ifc_flags & IFC_MAX_STREAMS_DEFER)
+        maybe_resume_max_streams(conn);
+
     if (conn->ifc_send_flags & SEND_WITH_FUNCS)
     {
         enum send send;
@@ -6321,6 +6421,8 @@ ietf_full_conn_ci_tick (struct lsquic_conn *lconn, lsquic_time_t now)
   end:
     service_streams(conn);
     CLOSE_IF_NECESSARY();
+    if ((conn->ifc_flags & IFC_HIBERNATE) && tick == TICK_QUIET)
+        tick |= maybe_hibernate(conn, now);
 
   close_end:
     lsquic_send_ctl_set_buffer_stream_packets(&conn->ifc_send_ctl, 1);
@@ -6642,6 +6744,619 @@ ietf_full_conn_ci_drop_crypto_streams (struct lsquic_conn *lconn)
 }
 
 
+/* Version of the format produced by ietf_full_conn_ci_export().  Bump it
+ * whenever the list of exported fields changes.
+ */
+#define IFC_EXPORT_VERSION 1
+
+/* Returns true if the connection is quiescent enough to be exported: the
+ * handshake is over, there are no streams, and there is nothing to send or
+ * to wait for.  Anything else would require serializing stream and packet
+ * state, which is not worth it.
+ */
+static int
+can_export (struct ietf_full_conn *conn)
+{
+    if (!(conn->ifc_conn.cn_flags & LSCONN_HANDSHAKE_DONE)
+                                    || !(conn->ifc_flags & IFC_IGNORE_HSK))
+    {
+        LSQ_DEBUG("cannot export: handshake is not complete");
+        return 0;
+    }
+
+    if (lsquic_hash_count(conn->ifc_pub.all_streams) > 0
+            || conn->ifc_n_delayed_streams > 0
+            || !STAILQ_EMPTY(&conn->ifc_stream_ids_to_ss))
+    {
+        LSQ_DEBUG("cannot export: there are streams");
+        return 0;
+    }
+
+    if (!lsquic_send_ctl_is_empty(&conn->ifc_send_ctl)
+            || conn->ifc_send_flags
+            || (conn->ifc_flags & (IFC_ACK_QUEUED|IFC_HAVE_SAVED_ACK))
+            || conn->ifc_n_slack_akbl[PNS_APP] > 0
+            || !TAILQ_EMPTY(&conn->ifc_to_retire))
+    {
+        LSQ_DEBUG("cannot export: there is something to send or to wait for");
+        return 0;
+    }
+
+    if (conn->ifc_used_paths != 1 << conn->ifc_cur_path_id)
+    {
+        LSQ_DEBUG("cannot export: more than one path is in use");
+        return 0;
+    }
+
+    return 1;
+}
+
+
+static void
+export_closed_stream_ids (const struct lsquic_set64 *set,
+                                                    struct export_writer *ew)
+{
+    uint64_t low, high;
+    int i, n;
+
+    n = lsquic_set64_n_ranges(set);
+    lsquic_ew_u64(ew, set->lowset);
+    lsquic_ew_u64(ew, n);
+    for (i = 0; i < n; ++i)
+    {
+        lsquic_set64_get_range(set, i, &low, &high);
+        lsquic_ew_u64(ew, low);
+        lsquic_ew_u64(ew, high);
+    }
+}
+
+
+static int
+import_closed_stream_ids (struct lsquic_set64 *set, struct export_reader *er)
+{
+    uint64_t n, low, high;
+
+    set->lowset = lsquic_er_u64(er);
+    for (n = lsquic_er_u64(er); n > 0 && !er->er_error; --n)
+    {
+        low = lsquic_er_u64(er);
+        high = lsquic_er_u64(er);
+        if (er->er_error || 0 != lsquic_set64_append_range(set, low, high))
+            return -1;
+    }
+
+    return -er->er_error;
+}
+
+
+static int
+write_export (struct ietf_full_conn *conn, struct export_writer *ew)
+{
+    const struct conn_path *const cpath = CUR_CPATH(conn);
+    const struct lsquic_send_ctl *const ctl = &conn->ifc_send_ctl;
+    const struct lsquic_packno_range *range;
+    const struct conn_cid_elem *cce;
+    struct dcid_elem **dcep;
+    lsquic_packno_t cutoff;
+    unsigned i, n;
+
+    lsquic_ew_u64(ew, IFC_EXPORT_VERSION);
+    lsquic_ew_u64(ew, conn->ifc_conn.cn_version);
+    lsquic_ew_u64(ew, ctl->sc_ecn != ECN_NOT_ECT);
+
+    lsquic_ew_u64(ew, conn->ifc_conn.cn_cces_mask);
+    for (i = 0; i < conn->ifc_conn.cn_n_cces; ++i)
+        if (conn->ifc_conn.cn_cces_mask & (1 << i))
+        {
+            cce = &conn->ifc_conn.cn_cces[i];
+            lsquic_ew_bytes(ew, cce->cce_cid.idbuf, cce->cce_cid.len);
+            lsquic_ew_u64(ew, cce->cce_seqno);
+            lsquic_ew_u64(ew, cce->cce_flags & (CCE_USED|CCE_SEQNO));
+            lsquic_ew_u64(ew, (conn->ifc_original_cids >> i) & 1);
+        }
+    lsquic_ew_u64(ew, conn->ifc_conn.cn_cur_cce_idx);
+    lsquic_ew_u64(ew, conn->ifc_scid_seqno);
+    lsquic_ew_u64(ew, conn->ifc_active_cids_limit);
+    lsquic_ew_u64(ew, conn->ifc_active_cids_count);
+    lsquic_ew_u64(ew, conn->ifc_first_active_cid_seqno);
+
+    for (dcep = conn->ifc_dces, n = 0; dcep < DCES_END(conn); ++dcep)
+        n += *dcep != NULL;
+    lsquic_ew_u64(ew, n);
+    for (dcep = conn->ifc_dces; dcep < DCES_END(conn); ++dcep)
+        if (*dcep)
+        {
+            lsquic_ew_bytes(ew, (*dcep)->de_cid.idbuf, (*dcep)->de_cid.len);
+            lsquic_ew_u64(ew, (*dcep)->de_seqno);
+            lsquic_ew_u64(ew, (*dcep)->de_flags);
+            lsquic_ew_raw(ew, (*dcep)->de_srst, sizeof((*dcep)->de_srst));
+        }
+    lsquic_ew_u64(ew, conn->ifc_last_retire_prior_to);
+
+    lsquic_ew_raw(ew, cpath->cop_path.np_local_addr,
+                                    sizeof(cpath->cop_path.np_local_addr));
+    lsquic_ew_raw(ew, cpath->cop_path.np_peer_addr,
+                                    sizeof(cpath->cop_path.np_peer_addr));
+    lsquic_ew_bytes(ew, cpath->cop_path.np_dcid.idbuf,
+                                            cpath->cop_path.np_dcid.len);
+    lsquic_ew_u64(ew, cpath->cop_path.np_pack_size);
+    lsquic_ew_u64(ew, cpath->cop_cce_idx);
+
+    lsquic_ew_u64(ew, ctl->sc_cur_packno);
+    lsquic_ew_u64(ew, ctl->sc_largest_acked_packno);
+    lsquic_ew_u64(ew, ctl->sc_largest_ack2ed[PNS_APP]);
+    lsquic_ew_u64(ew, ctl->sc_largest_acked);
+    lsquic_ew_u64(ew, ctl->sc_ecn_total_acked[PNS_APP]);
+    lsquic_ew_u64(ew, ctl->sc_ecn_ce_cnt[PNS_APP]);
+    lsquic_ew_u64(ew, !!(ctl->sc_flags & SC_1RTT_ACKED));
+
+    /* The receive history is not exported.  Everything we have seen so far
+     * has been acknowledged, so a cutoff is enough.
+     */
+    range = lsquic_rechist_first(&conn->ifc_rechist[PNS_APP]);
+    if (range)
+        cutoff = lsquic_rechist_largest_packno(&conn->ifc_rechist[PNS_APP]) + 1;
+    else
+        cutoff = lsquic_rechist_cutoff(&conn->ifc_rechist[PNS_APP]);
+    lsquic_ew_u64(ew, cutoff);
+    lsquic_ew_u64(ew, conn->ifc_max_ack_packno[PNS_APP]);
+    lsquic_ew_u64(ew, conn->ifc_max_non_probing);
+    lsquic_ew_u64(ew, conn->ifc_spin_bit);
+    lsquic_ew_u64(ew, conn->ifc_incoming_ecn);
+    for (i = 0; i < 4; ++i)
+    {
+        lsquic_ew_u64(ew, conn->ifc_ecn_counts_in[PNS_APP][i]);
+        lsquic_ew_u64(ew, conn->ifc_ecn_counts_out[PNS_APP][i]);
+    }
+
+    lsquic_ew_u64(ew, conn->ifc_pub.cfcw.cf_max_recv_off);
+    lsquic_ew_u64(ew, conn->ifc_pub.cfcw.cf_recv_off);
+    lsquic_ew_u64(ew, conn->ifc_pub.cfcw.cf_read_off);
+    lsquic_ew_u64(ew, conn->ifc_pub.cfcw.cf_max_recv_win);
+    lsquic_ew_u64(ew, conn->ifc_pub.conn_cap.cc_sent);
+    lsquic_ew_u64(ew, conn->ifc_pub.conn_cap.cc_max);
+    lsquic_ew_u64(ew, conn->ifc_pub.conn_cap.cc_blocked);
+
+    for (i = 0; i < N_SDS; ++i)
+    {
+        lsquic_ew_u64(ew, conn->ifc_n_created_streams[i]);
+        lsquic_ew_u64(ew, conn->ifc_closed_peer_streams[i]);
+        lsquic_ew_u64(ew, conn->ifc_max_streams_in[i]);
+        lsquic_ew_u64(ew, conn->ifc_send.streams_blocked[i]);
+    }
+    for (i = 0; i < N_SITS; ++i)
+    {
+        lsquic_ew_u64(ew, conn->ifc_max_allowed_stream_id[i]);
+        export_closed_stream_ids(&conn->ifc_closed_stream_ids[i], ew);
+    }
+
+    lsquic_ew_u64(ew, conn->ifc_pub.rtt_stats.srtt);
+    lsquic_ew_u64(ew, conn->ifc_pub.rtt_stats.rttvar);
+    lsquic_ew_u64(ew, conn->ifc_pub.rtt_stats.min_rtt);
+
+    return conn->ifc_conn.cn_esf.i->esfi_export(conn->ifc_conn.cn_enc_session,
+                                                                        ew);
+}
+
+
+#define IFC_NO_EXPORT_FLAGS (IFC_IMMEDIATE_CLOSE_FLAGS|IFC_CLOSING \
+                                |IFC_GOING_AWAY|IFC_RECV_CLOSE|IFC_TICK_CLOSE)
+
+
+/* Called at the end of a quiet tick after the hibernation alarm rang.  The
+ * alarm is rearmed in case the connection is busy or the engine cannot
+ * hibernate it.
+ */
+static enum tick_st
+maybe_hibernate (struct ietf_full_conn *conn, lsquic_time_t now)
+{
+    conn->ifc_flags &= ~IFC_HIBERNATE;
+    lsquic_alarmset_set(&conn->ifc_alset, AL_HIBERNATE,
+                now + conn->ifc_settings->es_hibernate_idle * 1000000ull);
+    if (!(conn->ifc_flags & IFC_NO_EXPORT_FLAGS) && can_export(conn))
+    {
+        LSQ_DEBUG("ready to hibernate");
+        return TICK_HIBERNATE;
+    }
+    else
+        return 0;
+}
+
+
+/* On success, the connection is marked as exported and will close
+ * silently the next time it is ticked.
+ */
+static ssize_t
+export_conn (struct ietf_full_conn *conn, void *buf, size_t bufsz)
+{
+    struct export_writer ew;
+
+    lsquic_ew_init(&ew, buf, bufsz);
+    if (0 != write_export(conn, &ew))
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (!buf || !lsquic_ew_ok(&ew))
+    {
+        LSQ_DEBUG("export needs %zu bytes, buffer is %zu bytes", ew.ew_off,
+                                                                        bufsz);
+        return ew.ew_off;
+    }
+
+    conn->ifc_flags |= IFC_EXPORTED;
+    return ew.ew_off;
+}
+
+
+static ssize_t
+ietf_full_conn_ci_export (struct lsquic_conn *lconn, void *buf, size_t bufsz)
+{
+    struct ietf_full_conn *conn = (struct ietf_full_conn *) lconn;
+    struct conn_cid_elem *cce;
+    ssize_t len;
+
+    if ((conn->ifc_flags & (IFC_SERVER|IFC_HTTP)) != IFC_SERVER
+                                || (conn->ifc_flags & IFC_NO_EXPORT_FLAGS))
+    {
+        LSQ_DEBUG("connection cannot be exported");
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if ((conn->ifc_enpub->enp_flags & ENPUB_PROC) || !can_export(conn))
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    len = export_conn(conn, buf, bufsz);
+    if (!(conn->ifc_flags & IFC_EXPORTED))
+        return len;
+
+    /* The connection is closed silently.  Its CIDs now belong to the
+     * importing engine: they must not be reported as old or live by this
+     * one.
+     */
+    LSQ_INFO("exported connection (%zd bytes)", len);
+    EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "connection exported");
+    for (cce = lconn->cn_cces; cce < END_OF_CCES(lconn); ++cce)
+        cce->cce_flags &= ~CCE_REG;
+    lconn->cn_flags |= LSCONN_EXPORTED;
+    lsquic_engine_add_conn_to_tickable(conn->ifc_enpub, lconn);
+    return len;
+}
+
+
+ssize_t
+lsquic_ietf_full_conn_hibernate (struct lsquic_conn *lconn, void *buf,
+                                size_t bufsz, lsquic_time_t *idle_expiry)
+{
+    struct ietf_full_conn *conn = (struct ietf_full_conn *) lconn;
+    ssize_t len;
+
+    assert(!(conn->ifc_flags & IFC_NO_EXPORT_FLAGS));
+    len = export_conn(conn, buf, bufsz);
+    if (!(conn->ifc_flags & IFC_EXPORTED))
+        return len;
+
+    LSQ_INFO("hibernated connection (%zd bytes)", len);
+    EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "connection hibernated");
+    *idle_expiry = conn->ifc_alset.as_expiry[AL_IDLE];
+    return len;
+}
+
+
+struct lsquic_conn *
+lsquic_ietf_full_conn_import (struct lsquic_engine_public *enpub,
+                unsigned flags, const void *buf, size_t bufsz, void *peer_ctx)
+{
+    struct ietf_full_conn *conn;
+    struct conn_cid_elem *cce;
+    struct conn_path *cpath;
+    struct lsquic_send_ctl *ctl;
+    struct dcid_elem **dcep;
+    const struct transport_params *params;
+    struct lsquic_hash_elem *el;
+    struct export_reader er;
+    uint64_t ver, ecn, mask, n;
+    uint64_t max_recv_off, recv_off, read_off;
+    lsquic_packno_t cutoff;
+    lsquic_time_t now;
+    unsigned i;
+
+    if ((flags & (IFC_SERVER|IFC_HTTP)) != IFC_SERVER)
+    {
+        errno = ENOTSUP;
+        return NULL;
+    }
+
+    lsquic_er_init(&er, buf, bufsz);
+    ver = IFC_EXPORT_VERSION == lsquic_er_u64(&er) ? lsquic_er_u64(&er)
+                                                                : N_LSQVER;
+    ecn = lsquic_er_u64(&er);
+    mask = lsquic_er_u64(&er);
+    if (er.er_error || ver >= N_LSQVER
+            || !((1 << ver) & LSQUIC_IETF_VERSIONS
+                                        & enpub->enp_settings.es_versions)
+            || mask == 0 || mask >= 1u << MAX_SCID)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    conn = calloc(1, sizeof(*conn));
+    if (!conn)
+        return NULL;
+    now = lsquic_enpub_tick_time(enpub);
+    conn->ifc_conn.cn_cces = conn->ifc_cces;
+    conn->ifc_conn.cn_n_cces = sizeof(conn->ifc_cces)
+                                                / sizeof(conn->ifc_cces[0]);
+    conn->ifc_conn.cn_cces_mask = mask;
+    for (i = 0; i < conn->ifc_conn.cn_n_cces; ++i)
+        if (mask & (1 << i))
+        {
+            cce = &conn->ifc_cces[i];
+            cce->cce_cid.len = lsquic_er_bytes(&er, cce->cce_cid.idbuf,
+                                                                MAX_CID_LEN);
+            cce->cce_seqno = lsquic_er_u64(&er);
+            cce->cce_flags = lsquic_er_u64(&er) & (CCE_USED|CCE_SEQNO);
+            if (lsquic_er_u64(&er))
+                conn->ifc_original_cids |= 1 << i;
+            conn->ifc_scid_timestamp[i] = now;
+        }
+    n = lsquic_er_u64(&er);
+    if (er.er_error || n >= conn->ifc_conn.cn_n_cces || !(mask & (1 << n)))
+    {
+        free(conn);
+        errno = EINVAL;
+        return NULL;
+    }
+    conn->ifc_conn.cn_cur_cce_idx = n;
+
+    /* Set the flags early so that correct CID is used for logging */
+    conn->ifc_conn.cn_flags |= LSCONN_IETF | LSCONN_SERVER;
+
+    if (0 != ietf_full_conn_init(conn, enpub, flags, ecn != 0))
+    {
+        free(conn);
+        return NULL;
+    }
+    conn->ifc_pub.packet_out_malo =
+                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    if (!conn->ifc_pub.packet_out_malo)
+    {
+        /* XXX: deinit conn? */
+        free(conn);
+        return NULL;
+    }
+    /* Do not call on_conn_closed() if import fails */
+    conn->ifc_flags &= ~IFC_CREATED_OK;
+
+    conn->ifc_conn.cn_version     = ver;
+    conn->ifc_conn.cn_flags      |= LSCONN_VER_SET | LSCONN_HANDSHAKE_DONE;
+    conn->ifc_conn.cn_pf          = select_pf_by_ver(ver);
+    conn->ifc_conn.cn_esf_c       = select_esf_common_by_ver(ver);
+    conn->ifc_conn.cn_esf.i       = select_esf_iquic_by_ver(ver);
+
+    conn->ifc_scid_seqno = lsquic_er_u64(&er);
+    conn->ifc_active_cids_limit = lsquic_er_u64(&er);
+    conn->ifc_active_cids_count = lsquic_er_u64(&er);
+    conn->ifc_first_active_cid_seqno = lsquic_er_u64(&er);
+
+    n = lsquic_er_u64(&er);
+    if (n > MAX_IETF_CONN_DCIDS)
+        goto err;
+    for (dcep = conn->ifc_dces; dcep < conn->ifc_dces + n; ++dcep)
+    {
+        *dcep = lsquic_malo_get(conn->ifc_pub.mm->malo.dcid_elem);
+        if (!*dcep)
+            goto err;
+        memset(*dcep, 0, sizeof(**dcep));
+        (*dcep)->de_cid.len = lsquic_er_bytes(&er, (*dcep)->de_cid.idbuf,
+                                                                MAX_CID_LEN);
+        (*dcep)->de_seqno = lsquic_er_u64(&er);
+        (*dcep)->de_flags = lsquic_er_u64(&er) & (DE_SRST|DE_ASSIGNED);
+        if ((size_t) (er.er_end - er.er_p) < sizeof((*dcep)->de_srst))
+            goto err;
+        memcpy((*dcep)->de_srst, er.er_p, sizeof((*dcep)->de_srst));
+        er.er_p += sizeof((*dcep)->de_srst);
+    }
+    conn->ifc_last_retire_prior_to = lsquic_er_u64(&er);
+
+    cpath = CUR_CPATH(conn);
+    if ((size_t) (er.er_end - er.er_p) < sizeof(cpath->cop_path.np_local_addr)
+                                    + sizeof(cpath->cop_path.np_peer_addr))
+        goto err;
+    memcpy(cpath->cop_path.np_local_addr, er.er_p,
+                                    sizeof(cpath->cop_path.np_local_addr));
+    er.er_p += sizeof(cpath->cop_path.np_local_addr);
+    memcpy(cpath->cop_path.np_peer_addr, er.er_p,
+                                    sizeof(cpath->cop_path.np_peer_addr));
+    er.er_p += sizeof(cpath->cop_path.np_peer_addr);
+    cpath->cop_path.np_peer_ctx = peer_ctx;
+    cpath->cop_path.np_dcid.len = lsquic_er_bytes(&er,
+                                cpath->cop_path.np_dcid.idbuf, MAX_CID_LEN);
+    n = lsquic_er_u64(&er);
+    if (n < IQUIC_MAX_IPv6_PACKET_SZ || n > TP_DEF_MAX_PACKET_SIZE)
+        goto err;
+    cpath->cop_path.np_pack_size = n;
+    n = lsquic_er_u64(&er);
+    if (n >= conn->ifc_conn.cn_n_cces || !(mask & (1 << n)))
+        goto err;
+    cpath->cop_cce_idx = n;
+    cpath->cop_flags = COP_VALIDATED;
+    conn->ifc_used_paths = 1 << conn->ifc_cur_path_id;
+
+    ctl = &conn->ifc_send_ctl;
+    ctl->sc_cur_packno = lsquic_er_u64(&er);
+    ctl->sc_senhist.sh_last_sent = ctl->sc_cur_packno;
+    ctl->sc_largest_acked_packno = lsquic_er_u64(&er);
+    ctl->sc_largest_ack2ed[PNS_APP] = lsquic_er_u64(&er);
+    ctl->sc_largest_acked = lsquic_er_u64(&er);
+    ctl->sc_ecn_total_acked[PNS_APP] = lsquic_er_u64(&er);
+    ctl->sc_ecn_ce_cnt[PNS_APP] = lsquic_er_u64(&er);
+    if (lsquic_er_u64(&er))
+        ctl->sc_flags |= SC_1RTT_ACKED;
+
+    cutoff = lsquic_er_u64(&er);
+    if (cutoff)
+        lsquic_rechist_stop_wait(&conn->ifc_rechist[PNS_APP], cutoff);
+    conn->ifc_max_ack_packno[PNS_APP] = lsquic_er_u64(&er);
+    conn->ifc_max_non_probing = lsquic_er_u64(&er);
+    conn->ifc_spin_bit = lsquic_er_u64(&er) & 1;
+    conn->ifc_incoming_ecn = lsquic_er_u64(&er);
+    for (i = 0; i < 4; ++i)
+    {
+        conn->ifc_ecn_counts_in[PNS_APP][i] = lsquic_er_u64(&er);
+        conn->ifc_ecn_counts_out[PNS_APP][i] = lsquic_er_u64(&er);
+    }
+
+    /* Offsets are checked before they are set: the destructor uncounts
+     * unread data from the memory budget.
+     */
+    max_recv_off = lsquic_er_u64(&er);
+    recv_off = lsquic_er_u64(&er);
+    read_off = lsquic_er_u64(&er);
+    if (!(read_off <= max_recv_off && max_recv_off <= recv_off))
+        goto err;
+    conn->ifc_pub.cfcw.cf_max_recv_off = max_recv_off;
+    conn->ifc_pub.cfcw.cf_recv_off = recv_off;
+    conn->ifc_pub.cfcw.cf_read_off = read_off;
+    conn->ifc_pub.cfcw.cf_max_recv_win = lsquic_er_u64(&er);
+    /* Unread data came along with the connection */
+    if (conn->ifc_enpub->enp_mem_high)
+        conn->ifc_enpub->enp_stream_bytes +=
+            conn->ifc_pub.cfcw.cf_max_recv_off - conn->ifc_pub.cfcw.cf_read_off;
+    conn->ifc_pub.conn_cap.cc_sent = lsquic_er_u64(&er);
+    conn->ifc_pub.conn_cap.cc_max = lsquic_er_u64(&er);
+    conn->ifc_pub.conn_cap.cc_blocked = lsquic_er_u64(&er);
+
+    for (i = 0; i < N_SDS; ++i)
+    {
+        conn->ifc_n_created_streams[i] = lsquic_er_u64(&er);
+        conn->ifc_closed_peer_streams[i] = lsquic_er_u64(&er);
+        conn->ifc_max_streams_in[i] = lsquic_er_u64(&er);
+        conn->ifc_send.streams_blocked[i] = lsquic_er_u64(&er);
+    }
+    for (i = 0; i < N_SITS; ++i)
+    {
+        conn->ifc_max_allowed_stream_id[i] = lsquic_er_u64(&er);
+        if (0 != import_closed_stream_ids(&conn->ifc_closed_stream_ids[i],
+                                                                        &er))
+            goto err;
+    }
+
+    conn->ifc_pub.rtt_stats.srtt = lsquic_er_u64(&er);
+    conn->ifc_pub.rtt_stats.rttvar = lsquic_er_u64(&er);
+    conn->ifc_pub.rtt_stats.min_rtt = lsquic_er_u64(&er);
+    if (er.er_error)
+        goto err;
+
+    conn->ifc_conn.cn_enc_session = conn->ifc_conn.cn_esf.i->esfi_import(
+                                                enpub, &conn->ifc_conn, &er);
+    if (!conn->ifc_conn.cn_enc_session)
+        goto err;
+    if (er.er_p != er.er_end)
+    {
+        LSQ_INFO("cannot import: %zu bytes of trailing data",
+                                            (size_t) (er.er_end - er.er_p));
+        goto err;
+    }
+
+    /* Values derived from peer transport parameters, as in handshake_ok() */
+    params = conn->ifc_conn.cn_esf.i->esfi_get_peer_transport_params(
+                                                conn->ifc_conn.cn_enc_session);
+    if (!params)
+        goto err;
+    conn->ifc_max_stream_data_uni = params->tp_init_max_stream_data_uni;
+    conn->ifc_cfg.max_stream_send = params->tp_init_max_stream_data_bidi_local;
+    conn->ifc_cfg.ack_exp = params->tp_ack_delay_exponent;
+    if ((params->tp_flags & TRAPA_QL_BITS) && conn->ifc_settings->es_ql_bits)
+        lsquic_send_ctl_do_ql_bits(&conn->ifc_send_ctl);
+
+    for (dcep = conn->ifc_dces; dcep < DCES_END(conn); ++dcep)
+        if (*dcep && ((*dcep)->de_flags & DE_SRST) && enpub->enp_srst_hash)
+        {
+            lsquic_enpub_lock(enpub);
+            el = lsquic_hash_insert(enpub->enp_srst_hash,
+                    (*dcep)->de_srst, sizeof((*dcep)->de_srst),
+                    &conn->ifc_conn, &(*dcep)->de_hash_el);
+            lsquic_enpub_unlock(enpub);
+            if (!el)
+                goto err;
+        }
+
+    ignore_init(conn);
+    ignore_hsk(conn);
+    conn->ifc_process_incoming_packet = process_incoming_packet_fast;
+    if (conn->ifc_original_cids)
+    {
+        lsquic_alarmset_init_alarm(&conn->ifc_alset, AL_RET_CIDS,
+                                                ret_cids_alarm_expired, conn);
+        lsquic_alarmset_set(&conn->ifc_alset, AL_RET_CIDS,
+                                                now + RET_CID_TIMEOUT);
+    }
+    lsquic_alarmset_set(&conn->ifc_alset, AL_IDLE, now + conn->ifc_idle_to);
+    conn->ifc_last_live_update = now;
+    conn->ifc_flags |= IFC_CREATED_OK;
+
+    LSQ_INFO("imported connection");
+    EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "connection imported");
+    LSQ_DEBUG("Calling on_new_conn callback");
+    conn->ifc_conn_ctx = conn->ifc_enpub->enp_stream_if->on_new_conn(
+                        conn->ifc_enpub->enp_stream_if_ctx, &conn->ifc_conn);
+    return &conn->ifc_conn;
+
+  err:
+    LSQ_INFO("cannot import connection: bad input");
+    ietf_full_conn_ci_destroy(&conn->ifc_conn);
+    errno = EINVAL;
+    return NULL;
+}
+
+
+static void
+ietf_full_conn_ci_mem_stats (struct lsquic_conn *lconn,
+                                            struct lsquic_mem_stats *stats)
+{
+    struct ietf_full_conn *conn = (struct ietf_full_conn *) lconn;
+    struct lsquic_stream **streamp;
+    const struct lsquic_stream *stream;
+    struct lsquic_hash_elem *el;
+    size_t data_in;
+
+    stats->ms_conns += sizeof(*conn);
+    stats->ms_conns += lsquic_hash_mem_used(conn->ifc_pub.all_streams);
+    stats->ms_conns += lsquic_stab_mem_used(&conn->ifc_pub.stream_tab);
+    stats->ms_packets_out += lsquic_send_ctl_mem_used(&conn->ifc_send_ctl)
+                                                - sizeof(conn->ifc_send_ctl);
+    stats->ms_packets_out += lsquic_malo_mem_used(conn->ifc_pub.packet_out_malo);
+    if (conn->ifc_flags & IFC_HTTP)
+        stats->ms_hdr_tables += lsquic_qeh_mem_used(&conn->ifc_qeh)
+                              + lsquic_qdh_mem_used(&conn->ifc_qdh);
+
+    if (!(conn->ifc_flags & IFC_SERVER))
+    {
+        for (streamp = conn->ifc_u.cli.crypto_streams; streamp <
+                conn->ifc_u.cli.crypto_streams
+                    + sizeof(conn->ifc_u.cli.crypto_streams)
+                        / sizeof(conn->ifc_u.cli.crypto_streams[0]); ++streamp)
+            if (*streamp)
+                stats->ms_streams += lsquic_stream_mem_used(*streamp);
+    }
+    for (el = lsquic_hash_first(conn->ifc_pub.all_streams); el;
+                             el = lsquic_hash_next(conn->ifc_pub.all_streams))
+    {
+        stream = lsquic_hashelem_getdata(el);
+        data_in = lsquic_stream_data_in_mem_used(stream);
+        stats->ms_packets_in += data_in;
+        stats->ms_streams += lsquic_stream_mem_used(stream) - data_in;
+    }
+}
+
+
 #define IETF_FULL_CONN_FUNCS \
     .ci_abort                =  ietf_full_conn_ci_abort, \
     .ci_abort_error          =  ietf_full_conn_ci_abort_error, \
@@ -6653,6 +7368,7 @@ ietf_full_conn_ci_drop_crypto_streams (struct lsquic_conn *lconn)
     .ci_destroy              =  ietf_full_conn_ci_destroy, \
     .ci_drain_time           =  ietf_full_conn_ci_drain_time, \
     .ci_drop_crypto_streams  =  ietf_full_conn_ci_drop_crypto_streams, \
+    .ci_export               =  ietf_full_conn_ci_export, \
     .ci_get_ctx              =  ietf_full_conn_ci_get_ctx, \
     .ci_get_engine           =  ietf_full_conn_ci_get_engine, \
     .ci_get_log_cid          =  ietf_full_conn_ci_get_log_cid, \
@@ -6664,6 +7380,7 @@ ietf_full_conn_ci_drop_crypto_streams (struct lsquic_conn *lconn)
     .ci_is_push_enabled      =  ietf_full_conn_ci_is_push_enabled, \
     .ci_is_tickable          =  ietf_full_conn_ci_is_tickable, \
     .ci_make_stream          =  ietf_full_conn_ci_make_stream, \
+    .ci_mem_stats            =  ietf_full_conn_ci_mem_stats, \
     .ci_n_avail_streams      =  ietf_full_conn_ci_n_avail_streams, \
     .ci_n_pending_streams    =  ietf_full_conn_ci_n_pending_streams, \
     .ci_next_tick_time       =  ietf_full_conn_ci_next_tick_time, \
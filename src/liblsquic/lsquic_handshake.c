@@ -2217,7 +2217,9 @@ static int handle_chlo_reply_verify_prof(struct lsquic_enc_session *enc_session,
         LSQ_INFO("server certificate verification %ssuccessful",
                                                     ret == 0 ? "" : "not ");
     }
-    EV_LOG_CHECK_CERTS(&enc_session->cid, (const lsquic_str_t **)out_certs, *out_certs_count);
+    EV_LOG_CHECK_CERTS(&enc_session->cid,
+                        lsquic_enpub_tick_time(enc_session->enpub),
+                        (const lsquic_str_t **)out_certs, *out_certs_count);
 
   cleanup:
     if (chain)
@@ -2499,9 +2501,11 @@ lsquic_enc_session_handle_chlo_reply (enc_session_t *enc_session_p,
         break;
     case QTAG_SHLO:
         enc_session->hsk_state = HSK_COMPLETED;
-        EV_LOG_HSK_COMPLETED(&enc_session->cid);
+        EV_LOG_HSK_COMPLETED(&enc_session->cid,
+                                lsquic_enpub_tick_time(enc_session->enpub));
         if (!(enc_session->es_flags & ES_RECV_REJ))
-            EV_LOG_ZERO_RTT(&enc_session->cid);
+            EV_LOG_ZERO_RTT(&enc_session->cid,
+                                lsquic_enpub_tick_time(enc_session->enpub));
         break;
     default:
         ret = 1;    /* XXX Why 1? */
@@ -2912,6 +2916,8 @@ gquic_decrypt_packet (enc_session_t *enc_session_p,
     assert(header_len + out_len <= 1370);
     if (packet_in->pi_flags & PI_OWN_DATA)
         lsquic_mm_put_packet_in_buf(&enpub->enp_mm, packet_in->pi_data, 1370);
+    else if (packet_in->pi_flags & PI_BUF_REF)
+        lsquic_mm_unref_packet_in_buf(&enpub->enp_mm, packet_in);
     packet_in->pi_data = copy;
     packet_in->pi_flags |= PI_OWN_DATA | PI_DECRYPTED
                         | (enc_level << PIBIT_ENC_LEV_SHIFT);
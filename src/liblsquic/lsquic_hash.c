@@ -12,8 +12,10 @@
 #include <vc_compat.h>
 #endif
 
+#include <openssl/rand.h>
+
 #include "lsquic_hash.h"
-#include "lsquic_xxhash.h"
+#include "lsquic_siphash.h"
 
 TAILQ_HEAD(hels_head, lsquic_hash_elem);
 
@@ -26,15 +28,24 @@ struct lsquic_hash
                              qh_all;
     struct lsquic_hash_elem *qh_iter_next;
     int                    (*qh_cmp)(const void *, const void *, size_t);
-    unsigned               (*qh_hash)(const void *, size_t, unsigned seed);
+    lsquic_hash_func_f       qh_hash;
     unsigned                 qh_count;
     unsigned                 qh_nbits;
+    struct lsquic_hash_stats qh_stats;
+    unsigned char            qh_key[LSQUIC_HASH_KEY_SZ];
 };
 
 
+unsigned
+lsquic_hash_keyed (const void *data, size_t len, const unsigned char *key)
+{
+    return (unsigned) lsquic_siphash13(key, data, len);
+}
+
+
 struct lsquic_hash *
 lsquic_hash_create_ext (int (*cmp)(const void *, const void *, size_t),
-                    unsigned (*hashf)(const void *, size_t, unsigned seed))
+                        lsquic_hash_func_f hashf, const unsigned char *key)
 {
     struct hels_head *buckets;
     struct lsquic_hash *hash;
@@ -45,7 +56,7 @@ lsquic_hash_create_ext (int (*cmp)(const void *, const void *, size_t),
     if (!buckets)
         return NULL;
 
-    hash = malloc(sizeof(*hash));
+    hash = calloc(1, sizeof(*hash));
     if (!hash)
     {
         free(buckets);
@@ -62,14 +73,25 @@ lsquic_hash_create_ext (int (*cmp)(const void *, const void *, size_t),
     hash->qh_nbits     = nbits;
     hash->qh_iter_next = NULL;
     hash->qh_count     = 0;
+    memcpy(hash->qh_key, key, sizeof(hash->qh_key));
     return hash;
 }
 
 
+struct lsquic_hash *
+lsquic_hash_create_keyed (const unsigned char *key)
+{
+    return lsquic_hash_create_ext(memcmp, lsquic_hash_keyed, key);
+}
+
+
 struct lsquic_hash *
 lsquic_hash_create (void)
 {
-    return lsquic_hash_create_ext(memcmp, XXH32);
+    unsigned char key[LSQUIC_HASH_KEY_SZ];
+
+    RAND_bytes(key, sizeof(key));
+    return lsquic_hash_create_keyed(key);
 }
 
 
@@ -128,7 +150,7 @@ lsquic_hash_insert (struct lsquic_hash *hash, const void *key,
                                             0 != lsquic_hash_grow(hash))
         return NULL;
 
-    hash_val = hash->qh_hash(key, key_sz, (uintptr_t) hash);
+    hash_val = hash->qh_hash(key, key_sz, hash->qh_key);
     buckno = BUCKNO(hash->qh_nbits, hash_val);
     TAILQ_INSERT_TAIL(&hash->qh_all, el, qhe_next_all);
     TAILQ_INSERT_TAIL(&hash->qh_buckets[buckno], el, qhe_next_bucket);
@@ -145,20 +167,44 @@ lsquic_hash_insert (struct lsquic_hash *hash, const void *key,
 struct lsquic_hash_elem *
 lsquic_hash_find (struct lsquic_hash *hash, const void *key, unsigned key_sz)
 {
-    unsigned buckno, hash_val;
+    unsigned buckno, hash_val, n_probes;
     struct lsquic_hash_elem *el;
 
-    hash_val = hash->qh_hash(key, key_sz, (uintptr_t) hash);
+    hash_val = hash->qh_hash(key, key_sz, hash->qh_key);
     buckno = BUCKNO(hash->qh_nbits, hash_val);
+    n_probes = 0;
     TAILQ_FOREACH(el, &hash->qh_buckets[buckno], qhe_next_bucket)
+    {
+        ++n_probes;
         if (hash_val == el->qhe_hash_val &&
             key_sz   == el->qhe_key_len &&
             0 == hash->qh_cmp(key, el->qhe_key_data, key_sz))
         {
-            return el;
+            break;
         }
+    }
 
-    return NULL;
+    ++hash->qh_stats.hs_lookups;
+    hash->qh_stats.hs_probes += n_probes;
+    if (n_probes > hash->qh_stats.hs_max_probes)
+        hash->qh_stats.hs_max_probes = n_probes;
+    return el;
+}
+
+
+void
+lsquic_hash_prefetch (struct lsquic_hash *hash, const void *key,
+                                                            unsigned key_sz)
+{
+#if __GNUC__
+    unsigned buckno, hash_val;
+
+    hash_val = hash->qh_hash(key, key_sz, hash->qh_key);
+    buckno = BUCKNO(hash->qh_nbits, hash_val);
+    __builtin_prefetch(TAILQ_FIRST(&hash->qh_buckets[buckno]));
+#else
+    (void) hash; (void) key; (void) key_sz;
+#endif
 }
 
 
@@ -217,3 +263,11 @@ lsquic_hash_mem_used (const struct lsquic_hash *hash)
     return sizeof(*hash)
          + N_BUCKETS(hash->qh_nbits) * sizeof(hash->qh_buckets[0]);
 }
+
+
+void
+lsquic_hash_get_stats (const struct lsquic_hash *hash,
+                                            struct lsquic_hash_stats *stats)
+{
+    *stats = hash->qh_stats;
+}
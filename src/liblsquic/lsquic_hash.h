@@ -22,12 +22,31 @@ struct lsquic_hash_elem
     }               qhe_flags;
 };
 
+/* Hash functions are keyed with a secret, so that peers cannot make keys
+ * collide.  The key is LSQUIC_HASH_KEY_SZ bytes.
+ */
+#define LSQUIC_HASH_KEY_SZ 16
+
+typedef unsigned (*lsquic_hash_func_f)(const void *, size_t,
+                                                    const unsigned char *key);
+
+/* The default hash function: SipHash-1-3 truncated to 32 bits */
+unsigned
+lsquic_hash_keyed (const void *, size_t, const unsigned char *key);
+
+/* Use a random key */
 struct lsquic_hash *
 lsquic_hash_create (void);
 
+/* The key is copied.  Use this to key a hash using the engine key, which
+ * is cheaper than generating a new key.
+ */
+struct lsquic_hash *
+lsquic_hash_create_keyed (const unsigned char *key);
+
 struct lsquic_hash *
 lsquic_hash_create_ext (int (*cmp)(const void *, const void *, size_t),
-                    unsigned (*hash)(const void *, size_t, unsigned seed));
+                        lsquic_hash_func_f, const unsigned char *key);
 
 void
 lsquic_hash_destroy (struct lsquic_hash *);
@@ -39,6 +58,10 @@ lsquic_hash_insert (struct lsquic_hash *, const void *key, unsigned key_sz,
 struct lsquic_hash_elem *
 lsquic_hash_find (struct lsquic_hash *, const void *key, unsigned key_sz);
 
+/* Hint that `key' is going to be looked up soon */
+void
+lsquic_hash_prefetch (struct lsquic_hash *, const void *key, unsigned key_sz);
+
 #define lsquic_hashelem_getdata(el) ((el)->qhe_value)
 
 void
@@ -58,4 +81,18 @@ lsquic_hash_count (struct lsquic_hash *);
 
 size_t
 lsquic_hash_mem_used (const struct lsquic_hash *);
+
+/* Lookup statistics, used to check that peers cannot create long chains.
+ * lsquic_cid_hash uses the same structure; there, a probe is a group of
+ * slots rather than an element.
+ */
+struct lsquic_hash_stats
+{
+    unsigned long   hs_lookups;
+    unsigned long   hs_probes;      /* Elements compared by lookups */
+    unsigned        hs_max_probes;  /* Longest chain walked by a lookup */
+};
+
+void
+lsquic_hash_get_stats (const struct lsquic_hash *, struct lsquic_hash_stats *);
 #endif
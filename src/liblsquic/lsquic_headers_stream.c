@@ -414,12 +414,24 @@ lsquic_headers_stream_mem_used (const struct headers_stream *hs)
     size = sizeof(*hs);
     size += lsquic_frame_reader_mem_used(hs->hs_fr);
     size += lsquic_frame_writer_mem_used(hs->hs_fw);
-    /* XXX: get rid of this mem_used business as we no longer use it? */
+    size += lsquic_headers_stream_hpack_mem_used(hs);
 
     return size;
 }
 
 
+size_t
+lsquic_headers_stream_hpack_mem_used (const struct headers_stream *hs)
+{
+    /* HPACK counts 32 bytes of overhead per entry, which is close enough */
+    return hs->hs_henc.hpe_cur_capacity
+         + hs->hs_henc.hpe_hist_size * sizeof(hs->hs_henc.hpe_hist_buf[0])
+         + hs->hs_hdec.hpd_cur_capacity
+         + hs->hs_hdec.hpd_dyn_table.nalloc
+                            * sizeof(hs->hs_hdec.hpd_dyn_table.els[0]);
+}
+
+
 struct lsquic_stream *
 lsquic_headers_stream_get_stream (const struct headers_stream *hs)
 {
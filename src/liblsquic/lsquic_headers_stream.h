@@ -78,6 +78,10 @@ lsquic_headers_stream_get_stream (const struct headers_stream *);
 size_t
 lsquic_headers_stream_mem_used (const struct headers_stream *);
 
+/* Part of the above used by HPACK encoder and decoder */
+size_t
+lsquic_headers_stream_hpack_mem_used (const struct headers_stream *);
+
 extern const struct lsquic_stream_if *const lsquic_headers_stream_if;
 
 #endif
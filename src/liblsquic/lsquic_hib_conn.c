@@ -0,0 +1,217 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_hib_conn.c -- Hibernated connection
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <sys/socket.h>
+#include <sys/types.h>
+#else
+#include <vc_compat.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_sizes.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_alarmset.h"
+#include "lsquic_attq.h"
+#include "lsquic_full_conn.h"
+#include "lsquic_hib_conn.h"
+#include "lsquic_ev_log.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_CONN
+#define LSQUIC_LOG_CONN_ID lsquic_conn_log_cid(&hc->hc_conn)
+#include "lsquic_logger.h"
+
+
+struct hib_conn
+{
+    struct lsquic_conn          hc_conn;
+    /* The path is kept for the peer context */
+    struct network_path         hc_path;
+    lsquic_time_t               hc_expiry;
+    size_t                      hc_state_sz;
+    /* The CCEs and the serialized state follow the struct */
+    unsigned char              *hc_state;
+};
+
+
+static const struct conn_iface hib_conn_iface;
+
+
+struct lsquic_conn *
+lsquic_hib_conn_new (struct lsquic_conn *full_conn)
+{
+    struct hib_conn *hc;
+    lsquic_time_t expiry;
+    ssize_t len;
+    unsigned i, n_cces;
+
+    len = lsquic_ietf_full_conn_hibernate(full_conn, NULL, 0, &expiry);
+    if (len <= 0)
+        return NULL;
+
+    /* CCEs must stay at the same index: keep all up to the last one in use */
+    n_cces = 0;
+    for (i = 0; i < full_conn->cn_n_cces; ++i)
+        if (full_conn->cn_cces_mask & (1 << i))
+            n_cces = i + 1;
+
+    hc = malloc(sizeof(*hc) + n_cces * sizeof(full_conn->cn_cces[0]) + len);
+    if (!hc)
+        return NULL;
+
+    memset(hc, 0, sizeof(*hc));
+    hc->hc_conn.cn_cces = (struct conn_cid_elem *) (hc + 1);
+    hc->hc_state = (unsigned char *) (hc->hc_conn.cn_cces + n_cces);
+    hc->hc_state_sz = len;
+    if (len != lsquic_ietf_full_conn_hibernate(full_conn, hc->hc_state, len,
+                                                                    &expiry))
+    {
+        free(hc);
+        return NULL;
+    }
+
+    for (i = 0; i < n_cces; ++i)
+    {
+        hc->hc_conn.cn_cces[i] = full_conn->cn_cces[i];
+        memset(&hc->hc_conn.cn_cces[i].cce_hash_el, 0,
+                                sizeof(hc->hc_conn.cn_cces[i].cce_hash_el));
+    }
+    hc->hc_conn.cn_cces_mask = full_conn->cn_cces_mask;
+    hc->hc_conn.cn_n_cces = n_cces;
+    hc->hc_conn.cn_cur_cce_idx = full_conn->cn_cur_cce_idx;
+    hc->hc_conn.cn_if = &hib_conn_iface;
+    hc->hc_conn.cn_pf = full_conn->cn_pf;
+    hc->hc_conn.cn_version = full_conn->cn_version;
+    hc->hc_conn.cn_flags = LSCONN_HIBERNATED | (full_conn->cn_flags
+                                & (LSCONN_IETF|LSCONN_SERVER|LSCONN_VER_SET));
+    hc->hc_conn.cn_last_sent = full_conn->cn_last_sent;
+    hc->hc_conn.cn_last_ticked = full_conn->cn_last_ticked;
+    hc->hc_path = *full_conn->cn_if->ci_get_path(full_conn, NULL);
+    hc->hc_expiry = expiry;
+
+    LSQ_DEBUG("created hibernated connection (%zu bytes), expires at "
+        "%"PRIu64, sizeof(*hc) + n_cces * sizeof(hc->hc_conn.cn_cces[0])
+        + hc->hc_state_sz, hc->hc_expiry);
+    return &hc->hc_conn;
+}
+
+
+struct lsquic_conn *
+lsquic_hib_conn_wake (struct lsquic_engine_public *enpub,
+                struct lsquic_conn *lconn, unsigned flags, void *peer_ctx)
+{
+    struct hib_conn *const hc = (struct hib_conn *) lconn;
+    struct lsquic_conn *conn;
+    unsigned i;
+
+    conn = lsquic_ietf_full_conn_import(enpub, flags, hc->hc_state,
+                                                hc->hc_state_sz, peer_ctx);
+    if (!conn)
+    {
+        LSQ_INFO("cannot wake up connection: %s", strerror(errno));
+        return NULL;
+    }
+
+    /* The CIDs have already been reported to the user */
+    for (i = 0; i < lconn->cn_n_cces; ++i)
+        if (lconn->cn_cces_mask & (1 << i))
+            conn->cn_cces[i].cce_flags |=
+                                    lconn->cn_cces[i].cce_flags & CCE_REG;
+
+    LSQ_DEBUG("woke up connection");
+    EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "connection woke up");
+    return conn;
+}
+
+
+/* The hibernated connection is only ticked when its idle timeout expires */
+static enum tick_st
+hib_conn_ci_tick (struct lsquic_conn *lconn, lsquic_time_t now)
+{
+    struct hib_conn *const hc = (struct hib_conn *) lconn;
+
+    LSQ_DEBUG("hibernated connection timed out");
+    EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "hibernated connection timed out");
+    return TICK_CLOSE;
+}
+
+
+static void
+hib_conn_ci_destroy (struct lsquic_conn *lconn)
+{
+    struct hib_conn *const hc = (struct hib_conn *) lconn;
+
+    LSQ_DEBUG("destroy hibernated connection");
+    free(hc);
+}
+
+
+static int
+hib_conn_ci_is_tickable (struct lsquic_conn *lconn)
+{
+    return 0;
+}
+
+
+static lsquic_time_t
+hib_conn_ci_next_tick_time (struct lsquic_conn *lconn, unsigned *why)
+{
+    struct hib_conn *const hc = (struct hib_conn *) lconn;
+
+    *why = N_AEWS + AL_IDLE;
+    return hc->hc_expiry;
+}
+
+
+/* The user does not know about hibernated connections: there is nothing
+ * to do here.
+ */
+static void
+hib_conn_ci_going_away (struct lsquic_conn *lconn)
+{
+}
+
+
+static struct network_path *
+hib_conn_ci_get_path (struct lsquic_conn *lconn, const struct sockaddr *sa)
+{
+    struct hib_conn *const hc = (struct hib_conn *) lconn;
+
+    return &hc->hc_path;
+}
+
+
+static void
+hib_conn_ci_mem_stats (struct lsquic_conn *lconn,
+                                            struct lsquic_mem_stats *stats)
+{
+    struct hib_conn *const hc = (struct hib_conn *) lconn;
+
+    stats->ms_conns += sizeof(*hc)
+                    + lconn->cn_n_cces * sizeof(lconn->cn_cces[0])
+                    + hc->hc_state_sz;
+}
+
+
+static const struct conn_iface hib_conn_iface = {
+    .ci_destroy              =  hib_conn_ci_destroy,
+    .ci_get_path             =  hib_conn_ci_get_path,
+    .ci_going_away           =  hib_conn_ci_going_away,
+    .ci_is_tickable          =  hib_conn_ci_is_tickable,
+    .ci_mem_stats            =  hib_conn_ci_mem_stats,
+    .ci_next_tick_time       =  hib_conn_ci_next_tick_time,
+    .ci_tick                 =  hib_conn_ci_tick,
+};
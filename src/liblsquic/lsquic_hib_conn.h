@@ -0,0 +1,39 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_hib_conn.h -- Hibernated connection
+ *
+ * An idle IETF full connection can be replaced by a hibernated connection:
+ * a compact record that holds the connection's serialized state (see
+ * lsquic_export.h) and copies of its CIDs.  The record takes the full
+ * connection's place in the engine's connection hash.  It is never ticked
+ * unless its idle timeout expires, in which case it is closed.
+ *
+ * When a packet for a hibernated connection arrives, the engine wakes it
+ * up: the full connection is recreated from the serialized state and the
+ * record is destroyed.
+ *
+ * Only non-HTTP server connections hibernate: the serialized state does
+ * not cover the HTTP/3 control and QPACK streams or QPACK tables.
+ */
+
+#ifndef LSQUIC_HIB_CONN_H
+#define LSQUIC_HIB_CONN_H 1
+
+struct lsquic_conn;
+struct lsquic_engine_public;
+
+/* Serialize full connection whose tick returned TICK_HIBERNATE.  On
+ * success, the full connection is closed silently.  Returns NULL on
+ * failure, in which case the full connection is not affected.
+ */
+struct lsquic_conn *
+lsquic_hib_conn_new (struct lsquic_conn *full_conn);
+
+/* Recreate full connection.  The hibernated connection is not destroyed:
+ * this is up to the caller.  Returns NULL on failure.
+ */
+struct lsquic_conn *
+lsquic_hib_conn_wake (struct lsquic_engine_public *,
+                struct lsquic_conn *hib_conn, unsigned flags, void *peer_ctx);
+
+#endif
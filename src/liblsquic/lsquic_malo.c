@@ -38,6 +38,25 @@
  *  2. 4 KB pages are not freed until the malo allocator is destroyed.
  *     This is something to keep in mind.
  *
+ * Thread-caching mode
+ * --------------------
+ *
+ * A malo created using lsquic_malo_create_mt() can be shared by several
+ * engines and threads.  Each thread keeps a cache of free objects per such
+ * malo.  Gets and puts use the cache without locking.  When the cache is
+ * empty, a whole magazine -- a chain of MALO_MAG_SZ free objects -- is
+ * taken from the shared depot; when it holds two magazines' worth, one
+ * magazine is moved to the depot.  The depot is protected by a mutex.
+ * Because the page of an object points to its malo, objects put by a
+ * different thread still go back to the pool they came from.
+ *
+ * Caches live in thread-local storage, in an array indexed by the malo's
+ * registry slot.  There are MALO_MAX_MT slots; malos created when all
+ * slots are taken work without caches.  Cached objects of a destroyed
+ * malo are dropped the next time the thread uses the slot: the malo's
+ * generation number no longer matches.  When a thread exits, its cached
+ * objects are returned to their pages.
+ *
  * P.S. In Russian, "malo" (мало) means "little" or "few".  Thus, the
  *      malo allocator aims to perform its job in as few CPU cycles as
  *      possible.
@@ -47,6 +66,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/queue.h>
 #ifdef WIN32
 #include <vc_compat.h>
@@ -56,6 +76,10 @@
 #include "fiu-local.h"
 #include "lsquic_malo.h"
 
+#if LSQUIC_MALO_MT
+#include <pthread.h>
+#endif
+
 #ifndef LSQUIC_USE_POOLS
 #define LSQUIC_USE_POOLS 1
 #endif
@@ -114,8 +138,61 @@ struct malo {
     size_t                      obj_size;
     struct nopool_elem         *next_iter_elem;
 #endif
+#if LSQUIC_TICK_THREADS
+    pthread_mutex_t            *lock;
+#endif
+#if LSQUIC_MALO_MT
+    struct malo_mt             *mt;     /* NULL unless thread-caching */
+#endif
+};
+
+
+#if LSQUIC_MALO_MT
+#define MALO_MAX_MT 16
+#define MALO_MAG_SZ 32
+
+/* Free object in thread-caching mode.  The smallest object is 64 bytes,
+ * so this always fits.
+ */
+struct malo_obj
+{
+    struct malo_obj        *next_obj;
+    struct malo_obj        *next_mag;   /* Used by first object in depot */
+};
+
+struct malo_mt
+{
+    pthread_mutex_t         depot_lock;
+    struct malo_obj        *depot;      /* List of full magazines */
+    unsigned                n_depot_mags;
+    unsigned                idx;        /* Registry slot */
+    unsigned                gen;
+    struct malo_stats       stats;
+};
+
+struct malo_tcache
+{
+    struct malo_obj        *tc_head;
+    unsigned                tc_count;
+    unsigned                tc_gen;     /* Zero if cache is unused */
+    unsigned long           tc_hits;    /* Not yet added to malo stats */
 };
 
+static __thread struct malo_tcache malo_tcaches[MALO_MAX_MT];
+
+/* Registry of thread-caching malos, protected by malo_reg_lock */
+static pthread_mutex_t malo_reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct malo *malo_reg[MALO_MAX_MT];
+static unsigned malo_last_gen;
+
+static pthread_once_t malo_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t malo_tcache_key;
+static int malo_key_ok;
+
+static void malo_tcache_flush (void *);
+static void malo_put_to_page (void *);
+#endif
+
 struct malo *
 lsquic_malo_create (size_t obj_size)
 {
@@ -144,6 +221,12 @@ lsquic_malo_create (size_t obj_size)
     LIST_INIT(&malo->free_pages);
     malo->iter.cur_page = &malo->page_header;
     malo->iter.next_slot = 0;
+#if LSQUIC_TICK_THREADS
+    malo->lock = NULL;
+#endif
+#if LSQUIC_MALO_MT
+    malo->mt = NULL;
+#endif
 
     if (pow)
         n_slots =   sizeof(*malo) / (1 << nbits)
@@ -182,6 +265,9 @@ lsquic_malo_create (size_t obj_size)
     {
         TAILQ_INIT(&malo->elems);
         malo->obj_size = obj_size;
+#if LSQUIC_TICK_THREADS
+        malo->lock = NULL;
+#endif
         return malo;
     }
     else
@@ -190,6 +276,54 @@ lsquic_malo_create (size_t obj_size)
 }
 
 
+#if LSQUIC_MALO_MT
+static void
+malo_key_init (void)
+{
+    malo_key_ok = 0 == pthread_key_create(&malo_tcache_key, malo_tcache_flush);
+}
+
+
+struct malo *
+lsquic_malo_create_mt (size_t obj_size)
+{
+    struct malo *malo;
+    struct malo_mt *mt;
+    unsigned idx;
+
+    (void) pthread_once(&malo_key_once, malo_key_init);
+
+    mt = calloc(1, sizeof(*mt));
+    if (!mt)
+        return NULL;
+    malo = lsquic_malo_create(obj_size);
+    if (!malo)
+    {
+        free(mt);
+        return NULL;
+    }
+
+    pthread_mutex_init(&mt->depot_lock, NULL);
+    pthread_mutex_lock(&malo_reg_lock);
+    for (idx = 0; idx < MALO_MAX_MT; ++idx)
+        if (!malo_reg[idx])
+            break;
+    if (idx < MALO_MAX_MT && malo_key_ok)
+        malo_reg[idx] = malo;
+    else
+        idx = MALO_MAX_MT;  /* No caching */
+    mt->idx = idx;
+    mt->gen = ++malo_last_gen;
+    if (0 == mt->gen)
+        mt->gen = ++malo_last_gen;
+    pthread_mutex_unlock(&malo_reg_lock);
+
+    malo->mt = mt;
+    return malo;
+}
+#endif
+
+
 #if LSQUIC_USE_POOLS
 static struct malo_page *
 allocate_page (struct malo *malo)
@@ -212,12 +346,10 @@ allocate_page (struct malo *malo)
 
 #define FAIL_NOMEM do { errno = ENOMEM; return NULL; } while (0)
 
-/* Get a new object. */
-void *
-lsquic_malo_get (struct malo *malo)
+static void *
+malo_get (struct malo *malo)
 {
 #if LSQUIC_USE_POOLS
-    fiu_do_on("malo/get", FAIL_NOMEM);
     struct malo_page *page = LIST_FIRST(&malo->free_pages);
     if (!page)
     {
@@ -248,37 +380,256 @@ lsquic_malo_get (struct malo *malo)
 }
 
 
-/* Return obj to the pool */
-void
-lsquic_malo_put (void *obj)
+#if LSQUIC_MALO_MT
+static struct malo_tcache *
+malo_tcache (struct malo_mt *mt)
+{
+    struct malo_tcache *const tc = &malo_tcaches[mt->idx];
+
+    if (tc->tc_gen != mt->gen)
+    {
+        /* Objects left over from a destroyed malo went away with it */
+        if (!tc->tc_gen)
+            (void) pthread_setspecific(malo_tcache_key, malo_tcaches);
+        tc->tc_head = NULL;
+        tc->tc_count = 0;
+        tc->tc_hits = 0;
+        tc->tc_gen = mt->gen;
+    }
+    return tc;
+}
+
+
+static void *
+malo_mt_get (struct malo *malo)
+{
+    struct malo_mt *const mt = malo->mt;
+    struct malo_tcache *tc;
+    struct malo_obj *obj, *extra;
+    unsigned n;
+
+    if (mt->idx >= MALO_MAX_MT)
+    {
+        pthread_mutex_lock(&mt->depot_lock);
+        ++mt->stats.ms_misses;
+        obj = malo_get(malo);
+        pthread_mutex_unlock(&mt->depot_lock);
+        return obj;
+    }
+
+    tc = malo_tcache(mt);
+    if (tc->tc_head)
+    {
+        obj = tc->tc_head;
+        tc->tc_head = obj->next_obj;
+        --tc->tc_count;
+        ++tc->tc_hits;
+        return obj;
+    }
+
+    pthread_mutex_lock(&mt->depot_lock);
+    mt->stats.ms_hits += tc->tc_hits;
+    tc->tc_hits = 0;
+    ++mt->stats.ms_misses;
+    obj = mt->depot;
+    if (obj)
+    {
+        mt->depot = obj->next_mag;
+        --mt->n_depot_mags;
+        tc->tc_head = obj->next_obj;
+        tc->tc_count = MALO_MAG_SZ - 1;
+    }
+    else
+    {
+        /* Depot is empty: fill the cache straight from the pages */
+        obj = malo_get(malo);
+        for (n = 1; obj && n < MALO_MAG_SZ; ++n)
+        {
+            extra = malo_get(malo);
+            if (!extra)
+                break;
+            extra->next_obj = tc->tc_head;
+            tc->tc_head = extra;
+            ++tc->tc_count;
+        }
+    }
+    pthread_mutex_unlock(&mt->depot_lock);
+    return obj;
+}
+
+
+static void
+malo_mt_put (struct malo *malo, struct malo_obj *obj)
+{
+    struct malo_mt *const mt = malo->mt;
+    struct malo_tcache *tc;
+    struct malo_obj *mag, *last;
+    unsigned n;
+
+    if (mt->idx >= MALO_MAX_MT)
+    {
+        pthread_mutex_lock(&mt->depot_lock);
+        malo_put_to_page(obj);
+        pthread_mutex_unlock(&mt->depot_lock);
+        return;
+    }
+
+    tc = malo_tcache(mt);
+    obj->next_obj = tc->tc_head;
+    tc->tc_head = obj;
+    if (++tc->tc_count < MALO_MAG_SZ * 2)
+        return;
+
+    /* Move one magazine to the depot, keeping the most recently put
+     * objects, which are likely to still be in the CPU cache.
+     */
+    for (last = tc->tc_head, n = 1; n < MALO_MAG_SZ; ++n)
+        last = last->next_obj;
+    mag = last->next_obj;
+    last->next_obj = NULL;
+    tc->tc_count -= MALO_MAG_SZ;
+
+    pthread_mutex_lock(&mt->depot_lock);
+    mag->next_mag = mt->depot;
+    mt->depot = mag;
+    ++mt->n_depot_mags;
+    mt->stats.ms_hits += tc->tc_hits;
+    tc->tc_hits = 0;
+    pthread_mutex_unlock(&mt->depot_lock);
+}
+
+
+/* Called when a thread exits: return cached objects to their pages */
+static void
+malo_tcache_flush (void *arg)
 {
+    struct malo_tcache *const tcaches = arg;
+    struct malo_tcache *tc;
+    struct malo_obj *obj, *next;
+    struct malo_mt *mt;
+    unsigned idx;
+
+    pthread_mutex_lock(&malo_reg_lock);
+    for (idx = 0; idx < MALO_MAX_MT; ++idx)
+    {
+        tc = &tcaches[idx];
+        if (!(tc->tc_gen && malo_reg[idx]
+                                && malo_reg[idx]->mt->gen == tc->tc_gen))
+            continue;
+        mt = malo_reg[idx]->mt;
+        pthread_mutex_lock(&mt->depot_lock);
+        for (obj = tc->tc_head; obj; obj = next)
+        {
+            next = obj->next_obj;
+            malo_put_to_page(obj);
+        }
+        mt->stats.ms_hits += tc->tc_hits;
+        pthread_mutex_unlock(&mt->depot_lock);
+        memset(tc, 0, sizeof(*tc));
+    }
+    pthread_mutex_unlock(&malo_reg_lock);
+}
+#endif
+
+
+/* Get a new object. */
+void *
+lsquic_malo_get (struct malo *malo)
+{
+    void *obj;
+
+    fiu_do_on("malo/get", FAIL_NOMEM);
+#if LSQUIC_MALO_MT
+    if (malo->mt)
+        return malo_mt_get(malo);
+#endif
+    LSQ_MT_LOCK(malo->lock);
+    obj = malo_get(malo);
+    LSQ_MT_UNLOCK(malo->lock);
+    return obj;
+}
+
+
 #if LSQUIC_USE_POOLS
-    uintptr_t page_addr = (uintptr_t) obj & ~((1 << 12) - 1);
-    struct malo_page *page = (void *) page_addr;
+#define PAGE_OF(obj) \
+            ((struct malo_page *) ((uintptr_t) (obj) & ~(uintptr_t) 0xFFF))
+
+static void
+malo_put_to_page (void *obj)
+{
+    struct malo_page *const page = PAGE_OF(obj);
     unsigned slot;
+
     if (page->pow)
-        slot = ((uintptr_t) obj - page_addr) >> page->nbits;
+        slot = ((uintptr_t) obj - (uintptr_t) page) >> page->nbits;
     else
-        slot = ((uintptr_t) obj - page_addr) / page->nbits;
+        slot = ((uintptr_t) obj - (uintptr_t) page) / page->nbits;
     if (page->full_slot_mask == page->slots)
         LIST_INSERT_HEAD(&page->malo->free_pages, page, next_free_page);
     page->slots &= ~(1ULL << slot);
+}
+#endif
+
+
+/* Return obj to the pool */
+void
+lsquic_malo_put (void *obj)
+{
+#if LSQUIC_USE_POOLS
+#if LSQUIC_MALO_MT
+    if (PAGE_OF(obj)->malo->mt)
+    {
+        malo_mt_put(PAGE_OF(obj)->malo, obj);
+        return;
+    }
+#endif
+    LSQ_MT_LOCK(PAGE_OF(obj)->malo->lock);
+    malo_put_to_page(obj);
+    LSQ_MT_UNLOCK(PAGE_OF(obj)->malo->lock);
 #else
     struct nopool_elem *el;
+    struct malo *malo;
     el = (struct nopool_elem *) ((char *) obj - sizeof(*el));
-    if (el == el->malo->next_iter_elem)
-        el->malo->next_iter_elem = TAILQ_NEXT(el->malo->next_iter_elem, next);
-    TAILQ_REMOVE(&el->malo->elems, el, next);
+    malo = el->malo;
+    LSQ_MT_LOCK(malo->lock);
+    if (el == malo->next_iter_elem)
+        malo->next_iter_elem = TAILQ_NEXT(malo->next_iter_elem, next);
+    TAILQ_REMOVE(&malo->elems, el, next);
+    LSQ_MT_UNLOCK(malo->lock);
     free(el);
 #endif
 }
 
 
+#if LSQUIC_TICK_THREADS
+void
+lsquic_malo_set_lock (struct malo *malo, pthread_mutex_t *lock)
+{
+#if LSQUIC_MALO_MT
+    if (malo->mt)
+        return;
+#endif
+    malo->lock = lock;
+}
+#endif
+
+
 void
 lsquic_malo_destroy (struct malo *malo)
 {
 #if LSQUIC_USE_POOLS
     struct malo_page *page, *next;
+#if LSQUIC_MALO_MT
+    if (malo->mt)
+    {
+        pthread_mutex_lock(&malo_reg_lock);
+        if (malo->mt->idx < MALO_MAX_MT)
+            malo_reg[malo->mt->idx] = NULL;
+        pthread_mutex_unlock(&malo_reg_lock);
+        pthread_mutex_destroy(&malo->mt->depot_lock);
+        free(malo->mt);
+    }
+#endif
     page = SLIST_FIRST(&malo->all_pages);
     while (page != &malo->page_header)
     {
@@ -453,3 +804,19 @@ lsquic_malo_mem_used (const struct malo *malo)
     return 0;
 #endif
 }
+
+
+void
+lsquic_malo_get_stats (const struct malo *malo, struct malo_stats *stats)
+{
+#if LSQUIC_MALO_MT
+    if (malo->mt)
+    {
+        pthread_mutex_lock(&malo->mt->depot_lock);
+        *stats = malo->mt->stats;
+        pthread_mutex_unlock(&malo->mt->depot_lock);
+        return;
+    }
+#endif
+    memset(stats, 0, sizeof(*stats));
+}
@@ -6,16 +6,44 @@
 #ifndef LSQUIC_MALO_H
 #define LSQUIC_MALO_H 1
 
+#include "lsquic_mt.h"
+
 #ifndef LSQUIC_USE_POOLS
 #define LSQUIC_USE_POOLS 1
 #endif
 
+/* The thread-caching mode requires pools and threads */
+#if LSQUIC_USE_POOLS && LSQUIC_TICK_THREADS
+#define LSQUIC_MALO_MT 1
+#else
+#define LSQUIC_MALO_MT 0
+#endif
+
 struct malo;
 
+struct malo_stats
+{
+    unsigned long   ms_hits;    /* Gets served from thread's cache */
+    unsigned long   ms_misses;  /* Gets that went to the shared depot */
+};
+
 /* Create a malo allocator for objects of size `obj_size'. */
 struct malo *
 lsquic_malo_create (size_t obj_size);
 
+#if LSQUIC_MALO_MT
+/* Create a malo allocator that can be used by several threads at once.
+ * Each thread keeps a small cache of free objects for each such allocator;
+ * objects move between the caches and the shared depot in batches.  An
+ * object may be put by a thread other than the one that got it.
+ *
+ * The lock set by lsquic_malo_set_lock() is not used and the iterator
+ * is not supported.
+ */
+struct malo *
+lsquic_malo_create_mt (size_t obj_size);
+#endif
+
 /* Get a new object. */
 void *
 lsquic_malo_get (struct malo *);
@@ -46,4 +74,16 @@ lsquic_malo_next (struct malo *);
 size_t
 lsquic_malo_mem_used (const struct malo *);
 
+/* Statistics are only kept in the thread-caching mode.  Hits are added
+ * to the totals in batches, so the numbers lag a little.
+ */
+void
+lsquic_malo_get_stats (const struct malo *, struct malo_stats *);
+
+#if LSQUIC_TICK_THREADS
+/* When lock is set, get and put operations are performed under it. */
+void
+lsquic_malo_set_lock (struct malo *, pthread_mutex_t *);
+#endif
+
 #endif
@@ -1,6 +1,10 @@
 /* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
 /*
  * lsquic_min_heap.c
+ *
+ * This is a 4-ary heap: it is shallower than a binary heap and the children
+ * of a node are next to each other in memory, which makes sifting down
+ * cheaper in terms of cache misses.
  */
 
 #include <assert.h>
@@ -11,65 +15,111 @@
 #include "lsquic_types.h"
 #include "lsquic_logger.h"
 
-#define MHE_PARENT(i) ((i - 1) / 2)
-#define MHE_LCHILD(i) (2 * i + 1)
-#define MHE_RCHILD(i) (2 * i + 2)
+#define MHE_ARITY 4
+#define MHE_PARENT(i) (((i) - 1) / MHE_ARITY)
+#define MHE_FCHILD(i) (MHE_ARITY * (i) + 1)
 
 
 static void
-heapify_min_heap (struct min_heap *heap, unsigned i)
+sift_down (struct min_heap *heap, unsigned i)
 {
     struct min_heap_elem el;
-    unsigned smallest;
+    unsigned child, smallest, last;
 
     assert(i < heap->mh_nelem);
 
-    if (MHE_LCHILD(i) < heap->mh_nelem)
+    el = heap->mh_elems[i];
+    while ((child = MHE_FCHILD(i)) < heap->mh_nelem)
     {
-        if (heap->mh_elems[ MHE_LCHILD(i) ].mhe_val <
-                                    heap->mh_elems[ i ].mhe_val)
-            smallest = MHE_LCHILD(i);
-        else
-            smallest = i;
-        if (MHE_RCHILD(i) < heap->mh_nelem &&
-            heap->mh_elems[ MHE_RCHILD(i) ].mhe_val <
+        last = child + MHE_ARITY;
+        if (last > heap->mh_nelem)
+            last = heap->mh_nelem;
+        smallest = child;
+        for (++child; child < last; ++child)
+            if (heap->mh_elems[ child ].mhe_val <
                                     heap->mh_elems[ smallest ].mhe_val)
-            smallest = MHE_RCHILD(i);
+                smallest = child;
+        if (heap->mh_elems[ smallest ].mhe_val >= el.mhe_val)
+            break;
+        heap->mh_elems[ i ] = heap->mh_elems[ smallest ];
+        i = smallest;
     }
-    else
-        smallest = i;
+    heap->mh_elems[ i ] = el;
+}
+
+
+static void
+sift_up (struct min_heap *heap, unsigned i)
+{
+    struct min_heap_elem el;
 
-    if (smallest != i)
+    el = heap->mh_elems[i];
+    while (i > 0 && heap->mh_elems[ MHE_PARENT(i) ].mhe_val > el.mhe_val)
     {
-        el = heap->mh_elems[ smallest ];
-        heap->mh_elems[ smallest ] = heap->mh_elems[ i ];
-        heap->mh_elems[ i ] = el;
-        heapify_min_heap(heap, smallest);
+        heap->mh_elems[ i ] = heap->mh_elems[ MHE_PARENT(i) ];
+        i = MHE_PARENT(i);
     }
+    heap->mh_elems[ i ] = el;
 }
 
 
 void
 lsquic_mh_insert (struct min_heap *heap, struct lsquic_conn *conn, uint64_t val)
 {
-    struct min_heap_elem el;
-    unsigned i;
+    assert(heap->mh_nelem < heap->mh_nalloc);
+    assert(heap->mh_nheaped == heap->mh_nelem);
+
+    heap->mh_elems[ heap->mh_nelem ].mhe_conn = conn;
+    heap->mh_elems[ heap->mh_nelem ].mhe_val  = val;
+    ++heap->mh_nelem;
+    heap->mh_nheaped = heap->mh_nelem;
+
+    sift_up(heap, heap->mh_nelem - 1);
+}
 
+
+void
+lsquic_mh_append (struct min_heap *heap, struct lsquic_conn *conn,
+                                                                uint64_t val)
+{
     assert(heap->mh_nelem < heap->mh_nalloc);
 
     heap->mh_elems[ heap->mh_nelem ].mhe_conn = conn;
     heap->mh_elems[ heap->mh_nelem ].mhe_val  = val;
     ++heap->mh_nelem;
+}
+
+
+void
+lsquic_mh_build (struct min_heap *heap)
+{
+    unsigned i, n_appended;
+
+    n_appended = heap->mh_nelem - heap->mh_nheaped;
+    if (n_appended == 0)
+        return;
 
-    i = heap->mh_nelem - 1;
-    while (i > 0 && heap->mh_elems[ MHE_PARENT(i) ].mhe_val >
-                                    heap->mh_elems[ i ].mhe_val)
+    /* If only a few elements were appended to a large heap, inserting them
+     * one by one is cheaper than rebuilding the whole heap using Floyd's
+     * method, which is O(n).
+     */
+    if (n_appended < heap->mh_nheaped)
     {
-        el = heap->mh_elems[ MHE_PARENT(i) ];
-        heap->mh_elems[ MHE_PARENT(i) ] = heap->mh_elems[ i ];
-        heap->mh_elems[ i ] = el;
-        i = MHE_PARENT(i);
+        LSQ_DEBUG("sift up %u appended element%.*s", n_appended,
+                                                    n_appended != 1, "s");
+        for (i = heap->mh_nheaped; i < heap->mh_nelem; ++i)
+            sift_up(heap, i);
     }
+    else if (heap->mh_nelem > 1)
+    {
+        LSQ_DEBUG("rebuild heap of %u elements", heap->mh_nelem);
+        i = MHE_PARENT(heap->mh_nelem - 1) + 1;
+        do
+            sift_down(heap, --i);
+        while (i > 0);
+    }
+
+    heap->mh_nheaped = heap->mh_nelem;
 }
 
 
@@ -78,15 +128,18 @@ lsquic_mh_pop (struct min_heap *heap)
 {
     struct lsquic_conn *conn;
 
+    assert(heap->mh_nheaped == heap->mh_nelem);
+
     if (heap->mh_nelem == 0)
         return NULL;
 
     conn = heap->mh_elems[0].mhe_conn;
     --heap->mh_nelem;
+    heap->mh_nheaped = heap->mh_nelem;
     if (heap->mh_nelem > 0)
     {
         heap->mh_elems[0] = heap->mh_elems[ heap->mh_nelem ];
-        heapify_min_heap(heap, 0);
+        sift_down(heap, 0);
     }
 
     return conn;
@@ -19,13 +19,24 @@ struct min_heap
 {
     struct min_heap_elem    *mh_elems;
     unsigned                 mh_nalloc,
-                             mh_nelem;
+                             mh_nelem,
+                             mh_nheaped;    /* Elements in heap order */
 };
 
 
 void
 lsquic_mh_insert (struct min_heap *, struct lsquic_conn *conn, uint64_t val);
 
+/* Add element to the end of the array without restoring heap property.
+ * This is used when many connections are added at once.  Call
+ * lsquic_mh_build() before the heap is used again.
+ */
+void
+lsquic_mh_append (struct min_heap *, struct lsquic_conn *conn, uint64_t val);
+
+void
+lsquic_mh_build (struct min_heap *);
+
 struct lsquic_conn *
 lsquic_mh_pop (struct min_heap *);
 
@@ -263,7 +263,7 @@ process_ack_frame (struct mini_conn *mc, lsquic_packet_in_t *packet_in,
     lsquic_time_t warn_time;
     char buf[200];
 
-    acki = mc->mc_enpub->enp_mm.acki;
+    acki = lsquic_mm_acki(&mc->mc_enpub->enp_mm);
     parsed_len = mc->mc_conn.cn_pf->pf_parse_ack_frame(p, len, acki, 0);
     if (parsed_len < 0)
         return 0;
@@ -285,7 +285,7 @@ process_ack_frame (struct mini_conn *mc, lsquic_packet_in_t *packet_in,
             if (packno > MINICONN_MAX_PACKETS ||
                 0 == (MCONN_PACKET_MASK(packno) & mc->mc_sent_packnos))
                 {
-                    warn_time = lsquic_time_now();
+                    warn_time = lsquic_enpub_now(mc->mc_enpub);
                     if (0 == mc->mc_enpub->enp_last_warning[WT_ACKPARSE_MINI]
                         || mc->mc_enpub->enp_last_warning[WT_ACKPARSE_MINI]
                                 + WARNING_INTERVAL < warn_time)
@@ -651,11 +651,11 @@ process_regular_packet (struct mini_conn *mc, lsquic_packet_in_t *packet_in)
             MCHIST_APPEND(mc, MCHE_UNDECR_DROP);
             return PRP_DROP;
         }
-        else if ((packet_in->pi_flags & PI_OWN_DATA) ||
+        else if ((packet_in->pi_flags & (PI_OWN_DATA|PI_BUF_REF)) ||
                 0 == lsquic_conn_copy_and_release_pi_data(&mc->mc_conn,
                                                     mc->mc_enpub, packet_in))
         {
-            assert(packet_in->pi_flags & PI_OWN_DATA);
+            assert(packet_in->pi_flags & (PI_OWN_DATA|PI_BUF_REF));
             LSQ_INFO("could not decrypt packet: defer");
             mc->mc_deferred_packnos |= MCONN_PACKET_MASK(packet_in->pi_packno);
             MCHIST_APPEND(mc, MCHE_UNDECR_DEFER);
@@ -1472,7 +1472,7 @@ process_packet (struct mini_conn *mc, struct lsquic_packet_in *packet_in)
     switch (process_regular_packet(mc, packet_in))
     {
     case PRP_KEEP:
-        assert(packet_in->pi_flags & PI_OWN_DATA);
+        assert(packet_in->pi_flags & (PI_OWN_DATA|PI_BUF_REF));
         lsquic_packet_in_upref(packet_in);
         TAILQ_INSERT_TAIL(&mc->mc_packets_in, packet_in, pi_next);
         if (mc->mc_flags & MC_HAVE_NEW_HSK)
@@ -1483,7 +1483,7 @@ process_packet (struct mini_conn *mc, struct lsquic_packet_in *packet_in)
         }
         break;
     case PRP_DEFER:
-        assert(packet_in->pi_flags & PI_OWN_DATA);
+        assert(packet_in->pi_flags & (PI_OWN_DATA|PI_BUF_REF));
         lsquic_packet_in_upref(packet_in);
         TAILQ_INSERT_TAIL(&mc->mc_deferred, packet_in, pi_next);
         break;
@@ -1772,7 +1772,7 @@ mini_conn_ci_destroy (struct lsquic_conn *lconn)
             mc->mc_deferred_packnos, still_deferred,
             mc->mc_dropped_packnos, in_flight, mc->mc_acked_packnos,
             mc->mc_error_code, mc->mc_n_ticks, mc->mc_conn.cn_pack_size,
-            lsquic_time_now() - mc->mc_created,
+            lsquic_enpub_now(mc->mc_enpub) - mc->mc_created,
             lsquic_ver2str[mc->mc_conn.cn_version],
             (int) hist_idx, mc->mc_hist_buf);
     else
@@ -1796,7 +1796,7 @@ mini_conn_ci_destroy (struct lsquic_conn *lconn)
             mc->mc_deferred_packnos, still_deferred,
             mc->mc_dropped_packnos, in_flight, mc->mc_acked_packnos,
             mc->mc_error_code, mc->mc_n_ticks, mc->mc_conn.cn_pack_size,
-            lsquic_time_now() - mc->mc_created,
+            lsquic_enpub_now(mc->mc_enpub) - mc->mc_created,
             lsquic_ver2str[mc->mc_conn.cn_version],
             (int) (sizeof(mc->mc_hist_buf) - hist_idx),
             mc->mc_hist_buf + hist_idx, (int) hist_idx, mc->mc_hist_buf);
@@ -1821,7 +1821,7 @@ mini_conn_ci_destroy (struct lsquic_conn *lconn)
         mc->mc_deferred_packnos, still_deferred,
         mc->mc_dropped_packnos, in_flight, mc->mc_acked_packnos,
         mc->mc_error_code, mc->mc_n_ticks, mc->mc_path.np_pack_size,
-        lsquic_time_now() - mc->mc_created);
+        lsquic_enpub_now(mc->mc_enpub) - mc->mc_created);
 #endif
     EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID, "mini connection destroyed");
     lsquic_malo_put(mc);
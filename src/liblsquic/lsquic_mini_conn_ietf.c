@@ -218,6 +218,19 @@ imico_stream_flush (void *stream)
 }
 
 
+static void
+imico_release_stash (struct ietf_mini_conn *conn)
+{
+    if (conn->imc_stash_buf)
+    {
+        lsquic_mm_put_4k(&conn->imc_enpub->enp_mm, conn->imc_stash_buf);
+        --conn->imc_enpub->enp_mm.n_mini_conn_pages;
+        conn->imc_stash_buf = NULL;
+        conn->imc_stash_off = 0;
+    }
+}
+
+
 static struct stream_frame *
 imico_find_stream_frame (const struct ietf_mini_conn *conn,
                                 enum enc_level enc_level, unsigned read_off)
@@ -323,9 +336,12 @@ imico_stream_readf (void *stream,
                 TAILQ_REMOVE(&conn->imc_crypto_frames, frame, next_frame);
                 --conn->imc_n_crypto_frames;
                 conn->imc_crypto_frames_sz -= DF_SIZE(frame);
-                lsquic_packet_in_put(&conn->imc_enpub->enp_mm,
+                if (frame->packet_in)
+                    lsquic_packet_in_put(&conn->imc_enpub->enp_mm,
                                                             frame->packet_in);
                 lsquic_malo_put(frame);
+                if (conn->imc_n_crypto_frames == 0)
+                    imico_release_stash(conn);
             }
         }
         if (nread < avail)
@@ -433,8 +449,8 @@ lsquic_mini_conn_ietf_new (struct lsquic_engine_public *enpub,
     /* Generate new SCID. Since is not the original SCID, it is given
      * a sequence number (0) and therefore can be retired by the client.
      */
-    lsquic_generate_cid(&conn->imc_conn.cn_cces[1].cce_cid,
-                                        enpub->enp_settings.es_scid_len);
+    lsquic_generate_scid(&conn->imc_conn.cn_cces[1].cce_cid,
+                                                    &enpub->enp_settings);
     LSQ_DEBUGC("generated SCID %"CID_FMT" at index %u, switching to it",
                 CID_BITS(&conn->imc_conn.cn_cces[1].cce_cid), 1);
     conn->imc_conn.cn_cces[1].cce_flags = CCE_SEQNO | CCE_USED;
@@ -512,9 +528,11 @@ ietf_mini_conn_ci_destroy (struct lsquic_conn *lconn)
     while ((frame = TAILQ_FIRST(&conn->imc_crypto_frames)))
     {
         TAILQ_REMOVE(&conn->imc_crypto_frames, frame, next_frame);
-        lsquic_packet_in_put(&conn->imc_enpub->enp_mm, frame->packet_in);
+        if (frame->packet_in)
+            lsquic_packet_in_put(&conn->imc_enpub->enp_mm, frame->packet_in);
         lsquic_malo_put(frame);
     }
+    imico_release_stash(conn);
     if (lconn->cn_enc_session)
         lconn->cn_esf.i->esfi_destroy(lconn->cn_enc_session);
     LSQ_DEBUG("ietf_mini_conn_ci_destroyed");
@@ -710,12 +728,38 @@ imico_process_stream_frame (IMICO_PROC_FRAME_ARGS)
 }
 
 
+/* Returns pointer to the copy or NULL if data does not fit */
+static const unsigned char *
+imico_stash_data (struct ietf_mini_conn *conn, const unsigned char *data,
+                                                                unsigned size)
+{
+    unsigned char *copy;
+
+    if (conn->imc_stash_off + size > IMICO_STASH_BUF_SZ)
+        return NULL;
+
+    if (!conn->imc_stash_buf)
+    {
+        conn->imc_stash_buf = lsquic_mm_get_4k(&conn->imc_enpub->enp_mm);
+        if (!conn->imc_stash_buf)
+            return NULL;
+        ++conn->imc_enpub->enp_mm.n_mini_conn_pages;
+    }
+
+    copy = conn->imc_stash_buf + conn->imc_stash_off;
+    memcpy(copy, data, size);
+    conn->imc_stash_off += size;
+    return copy;
+}
+
+
 static int
 imico_stash_stream_frame (struct ietf_mini_conn *conn,
         enum enc_level enc_level, struct lsquic_packet_in *packet_in,
         const struct stream_frame *frame)
 {
     struct stream_frame *copy;
+    const unsigned char *data;
 
     if (conn->imc_n_crypto_frames >= IMICO_MAX_STASHED_FRAMES)
     {
@@ -739,7 +783,14 @@ imico_stash_stream_frame (struct ietf_mini_conn *conn,
     }
 
     *copy = *frame;
-    copy->packet_in = lsquic_packet_in_get(packet_in);
+    data = imico_stash_data(conn, frame->data_frame.df_data, DF_SIZE(frame));
+    if (data)
+    {
+        copy->data_frame.df_data = data;
+        copy->packet_in = NULL;
+    }
+    else
+        copy->packet_in = lsquic_packet_in_get(packet_in);
     copy->stream_id = enc_level;
     TAILQ_INSERT_TAIL(&conn->imc_crypto_frames, copy, next_frame);
     ++conn->imc_n_crypto_frames;
@@ -898,7 +949,7 @@ imico_process_ack_frame (IMICO_PROC_FRAME_ARGS)
         ack_exp = conn->imc_ack_exp;
     else
         ack_exp = TP_DEF_ACK_DELAY_EXP; /* Odd: no transport params yet? */
-    acki = conn->imc_enpub->enp_mm.acki;
+    acki = lsquic_mm_acki(&conn->imc_enpub->enp_mm);
     parsed_len = conn->imc_conn.cn_pf->pf_parse_ack_frame(p, len, acki,
                                                                     ack_exp);
     if (parsed_len < 0)
@@ -955,7 +1006,7 @@ imico_process_ack_frame (IMICO_PROC_FRAME_ARGS)
     return parsed_len;
 
   err_never_sent:
-    warn_time = lsquic_time_now();
+    warn_time = lsquic_enpub_now(conn->imc_enpub);
     if (0 == conn->imc_enpub->enp_last_warning[WT_ACKPARSE_MINI]
         || conn->imc_enpub->enp_last_warning[WT_ACKPARSE_MINI]
                 + WARNING_INTERVAL < warn_time)
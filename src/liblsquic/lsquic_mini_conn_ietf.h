@@ -65,6 +65,11 @@ struct ietf_mini_conn
     TAILQ_HEAD(, lsquic_packet_in)  imc_app_packets;
     TAILQ_HEAD(, lsquic_packet_out) imc_packets_out;
     TAILQ_HEAD(, stream_frame)      imc_crypto_frames;
+    /* Data of stashed CRYPTO frames is copied into this 4K page, so that
+     * the packets can be released right away.  The page is returned to
+     * the memory manager when all stashed frames have been read.
+     */
+    unsigned char                  *imc_stash_buf;
     packno_set_t                    imc_sent_packnos;
     packno_set_t                    imc_recvd_packnos[N_PNS];
     packno_set_t                    imc_acked_packnos[N_PNS];
@@ -74,6 +79,7 @@ struct ietf_mini_conn
     unsigned                        imc_bytes_in;
     unsigned                        imc_bytes_out;
     unsigned short                  imc_crypto_frames_sz;
+    unsigned short                  imc_stash_off;  /* Used in imc_stash_buf */
     /* We need to read in the length of ClientHello to check when we have fed
      * it to the crypto layer.
      */
@@ -107,6 +113,11 @@ struct ietf_mini_conn
  */
 #define IMICO_MAX_BUFFERED_CRYPTO (6u * 1024u)
 
+/* Size of imc_stash_buf.  Frames that do not fit keep a reference to
+ * their packet instead.
+ */
+#define IMICO_STASH_BUF_SZ 0x1000u
+
 struct lsquic_conn *
 lsquic_mini_conn_ietf_new (struct lsquic_engine_public *,
                const struct lsquic_packet_in *,
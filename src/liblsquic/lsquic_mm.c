@@ -15,6 +15,7 @@
 #include "lsquic.h"
 #include "lsquic_int_types.h"
 #include "lsquic_sizes.h"
+#include "lsquic_arena.h"
 #include "lsquic_malo.h"
 #include "lsquic_hash.h"
 #include "lsquic_conn.h"
@@ -49,6 +50,10 @@
 
 #define FAIL_NOMEM do { errno = ENOMEM; return NULL; } while (0)
 
+#if LSQUIC_TICK_THREADS
+__thread struct ack_info *lsquic_mm_thread_acki;
+#endif
+
 
 struct packet_in_buf
 {
@@ -71,6 +76,56 @@ struct sixteen_k_page
 };
 
 
+#if LSQUIC_MALO_MT
+/* Pools shared by memory managers in shared mode, protected by the lock */
+static pthread_mutex_t mm_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mm_malo mm_shared_malo;
+static unsigned mm_shared_refcnt;
+#endif
+
+
+static void
+mm_malo_create (struct mm_malo *malo, struct malo *(*create)(size_t))
+{
+    malo->stream_frame = create(sizeof(struct stream_frame));
+    malo->stream_rec_arr = create(sizeof(struct stream_rec_arr));
+    malo->mini_conn = create(sizeof(struct mini_conn));
+    malo->mini_conn_ietf = create(sizeof(struct ietf_mini_conn));
+    malo->packet_in = create(sizeof(struct lsquic_packet_in));
+    malo->packet_out = create(sizeof(struct lsquic_packet_out));
+    malo->dcid_elem = create(sizeof(struct dcid_elem));
+    malo->stream_hq_frame = create(sizeof(struct stream_hq_frame));
+}
+
+
+static int
+mm_malo_ok (const struct mm_malo *malo)
+{
+    return malo->stream_frame && malo->stream_rec_arr && malo->mini_conn
+        && malo->mini_conn_ietf && malo->packet_in && malo->packet_out
+        && malo->dcid_elem && malo->stream_hq_frame;
+}
+
+
+static void
+mm_malo_destroy (struct mm_malo *malo)
+{
+    struct malo **const pools[] = {
+        &malo->stream_frame, &malo->stream_rec_arr, &malo->mini_conn,
+        &malo->mini_conn_ietf, &malo->packet_in, &malo->packet_out,
+        &malo->dcid_elem, &malo->stream_hq_frame,
+    };
+    unsigned i;
+
+    for (i = 0; i < sizeof(pools) / sizeof(pools[0]); ++i)
+        if (*pools[i])
+        {
+            lsquic_malo_destroy(*pools[i]);
+            *pools[i] = NULL;
+        }
+}
+
+
 int
 lsquic_mm_init (struct lsquic_mm *mm)
 {
@@ -79,15 +134,14 @@ lsquic_mm_init (struct lsquic_mm *mm)
 #endif
 
     mm->acki = malloc(sizeof(*mm->acki));
-    mm->malo.stream_frame = lsquic_malo_create(sizeof(struct stream_frame));
-    mm->malo.stream_rec_arr = lsquic_malo_create(sizeof(struct stream_rec_arr));
-    mm->malo.mini_conn = lsquic_malo_create(sizeof(struct mini_conn));
-    mm->malo.mini_conn_ietf = lsquic_malo_create(sizeof(struct ietf_mini_conn));
-    mm->malo.packet_in = lsquic_malo_create(sizeof(struct lsquic_packet_in));
-    mm->malo.packet_out = lsquic_malo_create(sizeof(struct lsquic_packet_out));
-    mm->malo.dcid_elem = lsquic_malo_create(sizeof(struct dcid_elem));
-    mm->malo.stream_hq_frame
-                        = lsquic_malo_create(sizeof(struct stream_hq_frame));
+    mm->n_mini_conn_pages = 0;
+    mm->mem_out = 0;
+    mm->arena = NULL;
+    mm->shared_malo = 0;
+#if LSQUIC_TICK_THREADS
+    mm->lock = NULL;
+#endif
+    mm_malo_create(&mm->malo, lsquic_malo_create);
 #if LSQUIC_USE_POOLS
     TAILQ_INIT(&mm->free_packets_in);
     for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
@@ -97,17 +151,76 @@ lsquic_mm_init (struct lsquic_mm *mm)
     SLIST_INIT(&mm->four_k_pages);
     SLIST_INIT(&mm->sixteen_k_pages);
 #endif
-    if (mm->acki && mm->malo.stream_frame && mm->malo.stream_rec_arr
-        && mm->malo.mini_conn && mm->malo.mini_conn_ietf && mm->malo.packet_in
-        && mm->malo.stream_hq_frame)
-    {
+    if (mm->acki && mm_malo_ok(&mm->malo))
         return 0;
-    }
     else
         return -1;
 }
 
 
+int
+lsquic_mm_use_shared_pools (struct lsquic_mm *mm)
+{
+#if LSQUIC_MALO_MT
+    assert(!mm->shared_malo);
+    pthread_mutex_lock(&mm_shared_lock);
+    if (0 == mm_shared_refcnt)
+    {
+        mm_malo_create(&mm_shared_malo, lsquic_malo_create_mt);
+        if (!mm_malo_ok(&mm_shared_malo))
+        {
+            mm_malo_destroy(&mm_shared_malo);
+            pthread_mutex_unlock(&mm_shared_lock);
+            return -1;
+        }
+    }
+    ++mm_shared_refcnt;
+    pthread_mutex_unlock(&mm_shared_lock);
+
+    mm_malo_destroy(&mm->malo);
+    mm->malo = mm_shared_malo;
+    mm->shared_malo = 1;
+    return 0;
+#else
+    (void) mm;
+    return -1;
+#endif
+}
+
+
+#if LSQUIC_TICK_THREADS
+int
+lsquic_mm_thread_init (void)
+{
+    lsquic_mm_thread_acki = malloc(sizeof(*lsquic_mm_thread_acki));
+    return lsquic_mm_thread_acki ? 0 : -1;
+}
+
+
+void
+lsquic_mm_thread_cleanup (void)
+{
+    free(lsquic_mm_thread_acki);
+    lsquic_mm_thread_acki = NULL;
+}
+
+
+void
+lsquic_mm_set_lock (struct lsquic_mm *mm, pthread_mutex_t *lock)
+{
+    mm->lock = lock;
+    lsquic_malo_set_lock(mm->malo.stream_frame, lock);
+    lsquic_malo_set_lock(mm->malo.stream_rec_arr, lock);
+    lsquic_malo_set_lock(mm->malo.mini_conn, lock);
+    lsquic_malo_set_lock(mm->malo.mini_conn_ietf, lock);
+    lsquic_malo_set_lock(mm->malo.packet_in, lock);
+    lsquic_malo_set_lock(mm->malo.packet_out, lock);
+    lsquic_malo_set_lock(mm->malo.dcid_elem, lock);
+    lsquic_malo_set_lock(mm->malo.stream_hq_frame, lock);
+}
+#endif
+
+
 void
 lsquic_mm_cleanup (struct lsquic_mm *mm)
 {
@@ -120,14 +233,17 @@ lsquic_mm_cleanup (struct lsquic_mm *mm)
 #endif
 
     free(mm->acki);
-    lsquic_malo_destroy(mm->malo.stream_hq_frame);
-    lsquic_malo_destroy(mm->malo.dcid_elem);
-    lsquic_malo_destroy(mm->malo.packet_in);
-    lsquic_malo_destroy(mm->malo.packet_out);
-    lsquic_malo_destroy(mm->malo.stream_frame);
-    lsquic_malo_destroy(mm->malo.stream_rec_arr);
-    lsquic_malo_destroy(mm->malo.mini_conn);
-    lsquic_malo_destroy(mm->malo.mini_conn_ietf);
+    if (mm->shared_malo)
+    {
+#if LSQUIC_MALO_MT
+        pthread_mutex_lock(&mm_shared_lock);
+        if (0 == --mm_shared_refcnt)
+            mm_malo_destroy(&mm_shared_malo);
+        pthread_mutex_unlock(&mm_shared_lock);
+#endif
+    }
+    else
+        mm_malo_destroy(&mm->malo);
 
 #if LSQUIC_USE_POOLS
     for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
@@ -156,10 +272,76 @@ lsquic_mm_cleanup (struct lsquic_mm *mm)
         free(skp);
     }
 #endif
+
+    if (mm->arena)
+        lsquic_arena_destroy(mm->arena);
 }
 
 
+int
+lsquic_mm_use_arena (struct lsquic_mm *mm, int numa_node)
+{
 #if LSQUIC_USE_POOLS
+    assert(!mm->arena);
+    mm->arena = lsquic_arena_new(numa_node);
+    return mm->arena ? 0 : -1;
+#else
+    /* Without pools, all buffers come from malloc() */
+    (void) mm; (void) numa_node;
+    return 0;
+#endif
+}
+
+
+void *
+lsquic_mm_arena_alloc (struct lsquic_mm *mm, size_t size)
+{
+    void *buf;
+
+    if (!mm->arena)
+        return NULL;
+
+    LSQ_MT_LOCK(mm->lock);
+    buf = lsquic_arena_alloc(mm->arena, size);
+    if (buf)
+        mm->mem_out += lsquic_arena_size(buf);
+    LSQ_MT_UNLOCK(mm->lock);
+    return buf;
+}
+
+
+void
+lsquic_mm_arena_free (struct lsquic_mm *mm, void *buf)
+{
+    assert(mm->arena);
+    LSQ_MT_LOCK(mm->lock);
+    mm->mem_out -= lsquic_arena_size(buf);
+    lsquic_arena_free(mm->arena, buf);
+    LSQ_MT_UNLOCK(mm->lock);
+}
+
+
+static void *
+arena_pmi_allocate (void *ctx, void *conn_ctx, unsigned short sz,
+                                                                char is_ipv6)
+{
+    return lsquic_mm_arena_alloc(ctx, sz);
+}
+
+
+static void
+arena_pmi_free (void *ctx, void *conn_ctx, void *buf, char is_ipv6)
+{
+    lsquic_mm_arena_free(ctx, buf);
+}
+
+
+const struct lsquic_packout_mem_if lsquic_mm_arena_pmi =
+{
+    arena_pmi_allocate, arena_pmi_free, arena_pmi_free,
+};
+
+
 enum {
     PACKET_IN_PAYLOAD_0 = 1370,     /* common QUIC payload size upperbound */
     PACKET_IN_PAYLOAD_1 = 4096,     /* payload size middleground guess */
@@ -181,7 +363,13 @@ packet_in_index (unsigned size)
                  + (size > PACKET_IN_PAYLOAD_1);
     return idx;
 }
-#endif
+
+
+/* Packet buffers are accounted for by their size class.  This way, the
+ * same amount is subtracted when the buffer is returned, even if the put
+ * function is passed a smaller size (for example, of decrypted data).
+ */
+#define PACKET_IN_BUF_SZ(size) packet_in_sizes[ packet_in_index(size) ]
 
 
 void
@@ -193,17 +381,41 @@ lsquic_mm_put_packet_in (struct lsquic_mm *mm,
     struct packet_in_buf *pib;
 
     assert(0 == packet_in->pi_refcnt);
+    LSQ_MT_LOCK(mm->lock);
     if (packet_in->pi_flags & PI_OWN_DATA)
     {
-        pib = (struct packet_in_buf *) packet_in->pi_data;
-        idx = packet_in_index(packet_in->pi_data_sz);
-        SLIST_INSERT_HEAD(&mm->packet_in_bufs[idx], pib, next_pib);
+        if (mm->arena)
+        {
+            mm->mem_out -= lsquic_arena_size(packet_in->pi_data);
+            lsquic_arena_free(mm->arena, packet_in->pi_data);
+        }
+        else
+        {
+            pib = (struct packet_in_buf *) packet_in->pi_data;
+            idx = packet_in_index(packet_in->pi_data_sz);
+            SLIST_INSERT_HEAD(&mm->packet_in_bufs[idx], pib, next_pib);
+            mm->mem_out -= packet_in_sizes[idx];
+        }
     }
-    TAILQ_INSERT_HEAD(&mm->free_packets_in, packet_in, pi_next);
+    else if (packet_in->pi_flags & PI_BUF_REF)
+        lsquic_mm_unref_packet_in_buf(mm, packet_in);
+    /* Shared pool has its own per-thread caches */
+    if (mm->shared_malo)
+        lsquic_malo_put(packet_in);
+    else
+        TAILQ_INSERT_HEAD(&mm->free_packets_in, packet_in, pi_next);
+    LSQ_MT_UNLOCK(mm->lock);
 #else
+    LSQ_MT_LOCK(mm->lock);
     if (packet_in->pi_flags & PI_OWN_DATA)
+    {
+        mm->mem_out -= PACKET_IN_BUF_SZ(packet_in->pi_data_sz);
         free(packet_in->pi_data);
+    }
+    else if (packet_in->pi_flags & PI_BUF_REF)
+        lsquic_mm_unref_packet_in_buf(mm, packet_in);
     lsquic_malo_put(packet_in);
+    LSQ_MT_UNLOCK(mm->lock);
 #endif
 }
 
@@ -215,6 +427,7 @@ lsquic_mm_get_packet_in (struct lsquic_mm *mm)
 
     fiu_do_on("mm/packet_in", FAIL_NOMEM);
 
+    LSQ_MT_LOCK(mm->lock);
 #if LSQUIC_USE_POOLS
     packet_in = TAILQ_FIRST(&mm->free_packets_in);
     if (packet_in)
@@ -225,6 +438,7 @@ lsquic_mm_get_packet_in (struct lsquic_mm *mm)
     else
 #endif
         packet_in = lsquic_malo_get(mm->malo.packet_in);
+    LSQ_MT_UNLOCK(mm->lock);
 
     if (packet_in)
         memset(packet_in, 0, sizeof(*packet_in));
@@ -233,7 +447,6 @@ lsquic_mm_get_packet_in (struct lsquic_mm *mm)
 }
 
 
-#if LSQUIC_USE_POOLS
 /* Based on commonly used MTUs, ordered from small to large: */
 enum {
     PACKET_OUT_PAYLOAD_0 = 1280                    - GQUIC_MIN_PACKET_OVERHEAD,
@@ -262,7 +475,9 @@ packet_out_index (unsigned size)
                  + (size > PACKET_OUT_PAYLOAD_3);
     return idx;
 }
-#endif
+
+
+#define PACKET_OUT_BUF_SZ(size) packet_out_sizes[ packet_out_index(size) ]
 
 #if LSQUIC_USE_POOLS
 #define POOL_SAMPLE_PERIOD 1024
@@ -375,23 +590,36 @@ lsquic_mm_put_packet_out (struct lsquic_mm *mm,
     unsigned idx;
 
     assert(packet_out->po_data);
-    pob = (struct packet_out_buf *) packet_out->po_data;
-    idx = packet_out_index(packet_out->po_n_alloc);
-    SLIST_INSERT_HEAD(&mm->packet_out_bufs[idx], pob, next_pob);
-    poolst_freed(&mm->packet_out_bstats[idx]);
-    if (poolst_has_new_sample(&mm->packet_out_bstats[idx]))
-        maybe_shrink_packet_out_bufs(mm, idx);
+    LSQ_MT_LOCK(mm->lock);
+    if (mm->arena)
+    {
+        mm->mem_out -= lsquic_arena_size(packet_out->po_data);
+        lsquic_arena_free(mm->arena, packet_out->po_data);
+    }
+    else
+    {
+        pob = (struct packet_out_buf *) packet_out->po_data;
+        idx = packet_out_index(packet_out->po_n_alloc);
+        SLIST_INSERT_HEAD(&mm->packet_out_bufs[idx], pob, next_pob);
+        mm->mem_out -= packet_out_sizes[idx];
+        poolst_freed(&mm->packet_out_bstats[idx]);
+        if (poolst_has_new_sample(&mm->packet_out_bstats[idx]))
+            maybe_shrink_packet_out_bufs(mm, idx);
+    }
     if (packet_out->po_bwp_state)
         lsquic_malo_put(packet_out->po_bwp_state);
 #else
+    LSQ_MT_LOCK(mm->lock);
+    mm->mem_out -= PACKET_OUT_BUF_SZ(packet_out->po_n_alloc);
     free(packet_out->po_data);
 #endif
     lsquic_malo_put(packet_out);
+    LSQ_MT_UNLOCK(mm->lock);
 }
 
 
-struct lsquic_packet_out *
-lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
+static struct lsquic_packet_out *
+mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
                           unsigned short size)
 {
     struct lsquic_packet_out *packet_out;
@@ -400,32 +628,44 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
     unsigned idx;
 #endif
 
-    fiu_do_on("mm/packet_out", FAIL_NOMEM);
-
     packet_out = lsquic_malo_get(malo ? malo : mm->malo.packet_out);
     if (!packet_out)
         return NULL;
 
 #if LSQUIC_USE_POOLS
-    idx = packet_out_index(size);
-    pob = SLIST_FIRST(&mm->packet_out_bufs[idx]);
-    if (pob)
-    {
-        SLIST_REMOVE_HEAD(&mm->packet_out_bufs[idx], next_pob);
-        poolst_allocated(&mm->packet_out_bstats[idx], 0);
-    }
-    else
+    if (mm->arena)
     {
-        pob = malloc(packet_out_sizes[idx]);
+        pob = lsquic_arena_alloc(mm->arena, size);
         if (!pob)
         {
             lsquic_malo_put(packet_out);
             return NULL;
         }
-        poolst_allocated(&mm->packet_out_bstats[idx], 1);
+        mm->mem_out += lsquic_arena_size(pob);
+    }
+    else
+    {
+        idx = packet_out_index(size);
+        pob = SLIST_FIRST(&mm->packet_out_bufs[idx]);
+        if (pob)
+        {
+            SLIST_REMOVE_HEAD(&mm->packet_out_bufs[idx], next_pob);
+            poolst_allocated(&mm->packet_out_bstats[idx], 0);
+        }
+        else
+        {
+            pob = malloc(packet_out_sizes[idx]);
+            if (!pob)
+            {
+                lsquic_malo_put(packet_out);
+                return NULL;
+            }
+            poolst_allocated(&mm->packet_out_bstats[idx], 1);
+        }
+        mm->mem_out += packet_out_sizes[idx];
+        if (poolst_has_new_sample(&mm->packet_out_bstats[idx]))
+            maybe_shrink_packet_out_bufs(mm, idx);
     }
-    if (poolst_has_new_sample(&mm->packet_out_bstats[idx]))
-        maybe_shrink_packet_out_bufs(mm, idx);
 #else
     pob = malloc(size);
     if (!pob)
@@ -433,6 +673,7 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
         lsquic_malo_put(packet_out);
         return NULL;
     }
+    mm->mem_out += PACKET_OUT_BUF_SZ(size);
 #endif
 
     memset(packet_out, 0, sizeof(*packet_out));
@@ -443,6 +684,48 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
 }
 
 
+struct lsquic_packet_out *
+lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
+                          unsigned short size)
+{
+    struct lsquic_packet_out *packet_out;
+
+    fiu_do_on("mm/packet_out", FAIL_NOMEM);
+
+    LSQ_MT_LOCK(mm->lock);
+    packet_out = mm_get_packet_out(mm, malo, size);
+    LSQ_MT_UNLOCK(mm->lock);
+    return packet_out;
+}
+
+
+void
+lsquic_mm_ref_packet_in_buf (struct lsquic_mm *mm,
+                                        struct lsquic_packet_in *packet_in)
+{
+    assert(mm->rbi);
+    assert(packet_in->pi_buf_ctx);
+    assert(!(packet_in->pi_flags & (PI_OWN_DATA|PI_BUF_REF)));
+    LSQ_MT_LOCK(mm->lock);
+    mm->rbi->rbi_incref(mm->rbi_ctx, packet_in->pi_buf_ctx);
+    LSQ_MT_UNLOCK(mm->lock);
+    packet_in->pi_flags |= PI_BUF_REF;
+}
+
+
+void
+lsquic_mm_unref_packet_in_buf (struct lsquic_mm *mm,
+                                        struct lsquic_packet_in *packet_in)
+{
+    assert(packet_in->pi_flags & PI_BUF_REF);
+    LSQ_MT_LOCK(mm->lock);
+    mm->rbi->rbi_release(mm->rbi_ctx, packet_in->pi_buf_ctx);
+    LSQ_MT_UNLOCK(mm->lock);
+    packet_in->pi_flags &= ~PI_BUF_REF;
+    packet_in->pi_buf_ctx = NULL;
+}
+
+
 void *
 lsquic_mm_get_packet_in_buf (struct lsquic_mm *mm, size_t size)
 {
@@ -450,16 +733,33 @@ lsquic_mm_get_packet_in_buf (struct lsquic_mm *mm, size_t size)
 #if LSQUIC_USE_POOLS
     unsigned idx;
 
+    fiu_do_on("mm/packet_in_buf", FAIL_NOMEM);
+    if (mm->arena)
+    {
+        LSQ_MT_LOCK(mm->lock);
+        pib = lsquic_arena_alloc(mm->arena, size);
+        if (pib)
+            mm->mem_out += lsquic_arena_size(pib);
+        LSQ_MT_UNLOCK(mm->lock);
+        return pib;
+    }
     idx = packet_in_index(size);
+    LSQ_MT_LOCK(mm->lock);
     pib = SLIST_FIRST(&mm->packet_in_bufs[idx]);
-    fiu_do_on("mm/packet_in_buf", FAIL_NOMEM);
     if (pib)
         SLIST_REMOVE_HEAD(&mm->packet_in_bufs[idx], next_pib);
-    else
+    LSQ_MT_UNLOCK(mm->lock);
+    if (!pib)
         pib = malloc(packet_in_sizes[idx]);
 #else
     pib = malloc(size);
 #endif
+    if (pib)
+    {
+        LSQ_MT_LOCK(mm->lock);
+        mm->mem_out += PACKET_IN_BUF_SZ(size);
+        LSQ_MT_UNLOCK(mm->lock);
+    }
     return pib;
 }
 
@@ -471,10 +771,24 @@ lsquic_mm_put_packet_in_buf (struct lsquic_mm *mm, void *mem, size_t size)
     unsigned idx;
     struct packet_in_buf *pib;
 
-    pib = (struct packet_in_buf *) mem;
-    idx = packet_in_index(size);
-    SLIST_INSERT_HEAD(&mm->packet_in_bufs[idx], pib, next_pib);
+    LSQ_MT_LOCK(mm->lock);
+    if (mm->arena)
+    {
+        mm->mem_out -= lsquic_arena_size(mem);
+        lsquic_arena_free(mm->arena, mem);
+    }
+    else
+    {
+        pib = (struct packet_in_buf *) mem;
+        idx = packet_in_index(size);
+        SLIST_INSERT_HEAD(&mm->packet_in_bufs[idx], pib, next_pib);
+        mm->mem_out -= packet_in_sizes[idx];
+    }
+    LSQ_MT_UNLOCK(mm->lock);
 #else
+    LSQ_MT_LOCK(mm->lock);
+    mm->mem_out -= PACKET_IN_BUF_SZ(size);
+    LSQ_MT_UNLOCK(mm->lock);
     free(mem);
 #endif
 }
@@ -483,17 +797,30 @@ lsquic_mm_put_packet_in_buf (struct lsquic_mm *mm, void *mem, size_t size)
 void *
 lsquic_mm_get_4k (struct lsquic_mm *mm)
 {
+    void *mem;
 #if LSQUIC_USE_POOLS
-    struct four_k_page *fkp = SLIST_FIRST(&mm->four_k_pages);
+    struct four_k_page *fkp;
     fiu_do_on("mm/4k", FAIL_NOMEM);
-    if (fkp)
-        SLIST_REMOVE_HEAD(&mm->four_k_pages, next_fkp);
+    LSQ_MT_LOCK(mm->lock);
+    if (mm->arena)
+        mem = lsquic_arena_alloc(mm->arena, 0x1000);
     else
-        fkp = malloc(0x1000);
-    return fkp;
+    {
+        fkp = SLIST_FIRST(&mm->four_k_pages);
+        if (fkp)
+            SLIST_REMOVE_HEAD(&mm->four_k_pages, next_fkp);
+        else
+            fkp = malloc(0x1000);
+        mem = fkp;
+    }
 #else
-    return malloc(0x1000);
+    LSQ_MT_LOCK(mm->lock);
+    mem = malloc(0x1000);
 #endif
+    if (mem)
+        mm->mem_out += 0x1000;
+    LSQ_MT_UNLOCK(mm->lock);
+    return mem;
 }
 
 
@@ -502,8 +829,17 @@ lsquic_mm_put_4k (struct lsquic_mm *mm, void *mem)
 {
 #if LSQUIC_USE_POOLS
     struct four_k_page *fkp = mem;
-    SLIST_INSERT_HEAD(&mm->four_k_pages, fkp, next_fkp);
+    LSQ_MT_LOCK(mm->lock);
+    mm->mem_out -= 0x1000;
+    if (mm->arena)
+        lsquic_arena_free(mm->arena, mem);
+    else
+        SLIST_INSERT_HEAD(&mm->four_k_pages, fkp, next_fkp);
+    LSQ_MT_UNLOCK(mm->lock);
 #else
+    LSQ_MT_LOCK(mm->lock);
+    mm->mem_out -= 0x1000;
+    LSQ_MT_UNLOCK(mm->lock);
     free(mem);
 #endif
 }
@@ -512,17 +848,30 @@ lsquic_mm_put_4k (struct lsquic_mm *mm, void *mem)
 void *
 lsquic_mm_get_16k (struct lsquic_mm *mm)
 {
+    void *mem;
 #if LSQUIC_USE_POOLS
-    struct sixteen_k_page *skp = SLIST_FIRST(&mm->sixteen_k_pages);
+    struct sixteen_k_page *skp;
     fiu_do_on("mm/16k", FAIL_NOMEM);
-    if (skp)
-        SLIST_REMOVE_HEAD(&mm->sixteen_k_pages, next_skp);
+    LSQ_MT_LOCK(mm->lock);
+    if (mm->arena)
+        mem = lsquic_arena_alloc(mm->arena, 16 * 1024);
     else
-        skp = malloc(16 * 1024);
-    return skp;
+    {
+        skp = SLIST_FIRST(&mm->sixteen_k_pages);
+        if (skp)
+            SLIST_REMOVE_HEAD(&mm->sixteen_k_pages, next_skp);
+        else
+            skp = malloc(16 * 1024);
+        mem = skp;
+    }
 #else
-    return malloc(16 * 1024);
+    LSQ_MT_LOCK(mm->lock);
+    mem = malloc(16 * 1024);
 #endif
+    if (mem)
+        mm->mem_out += 16 * 1024;
+    LSQ_MT_UNLOCK(mm->lock);
+    return mem;
 }
 
 
@@ -531,8 +880,17 @@ lsquic_mm_put_16k (struct lsquic_mm *mm, void *mem)
 {
 #if LSQUIC_USE_POOLS
     struct sixteen_k_page *skp = mem;
-    SLIST_INSERT_HEAD(&mm->sixteen_k_pages, skp, next_skp);
+    LSQ_MT_LOCK(mm->lock);
+    mm->mem_out -= 16 * 1024;
+    if (mm->arena)
+        lsquic_arena_free(mm->arena, mem);
+    else
+        SLIST_INSERT_HEAD(&mm->sixteen_k_pages, skp, next_skp);
+    LSQ_MT_UNLOCK(mm->lock);
 #else
+    LSQ_MT_LOCK(mm->lock);
+    mm->mem_out -= 16 * 1024;
+    LSQ_MT_UNLOCK(mm->lock);
     free(mem);
 #endif
 }
@@ -546,17 +904,22 @@ lsquic_mm_mem_used (const struct lsquic_mm *mm)
     const struct packet_in_buf *pib;
     const struct four_k_page *fkp;
     const struct sixteen_k_page *skp;
+    struct arena_stats arena_stats;
     unsigned i;
     size_t size;
 
     size = sizeof(*mm);
     size += sizeof(*mm->acki);
-    size += lsquic_malo_mem_used(mm->malo.stream_frame);
-    size += lsquic_malo_mem_used(mm->malo.stream_rec_arr);
-    size += lsquic_malo_mem_used(mm->malo.mini_conn);
-    size += lsquic_malo_mem_used(mm->malo.mini_conn_ietf);
-    size += lsquic_malo_mem_used(mm->malo.packet_in);
-    size += lsquic_malo_mem_used(mm->malo.packet_out);
+    /* Shared pools do not belong to any one memory manager */
+    if (!mm->shared_malo)
+    {
+        size += lsquic_malo_mem_used(mm->malo.stream_frame);
+        size += lsquic_malo_mem_used(mm->malo.stream_rec_arr);
+        size += lsquic_malo_mem_used(mm->malo.mini_conn);
+        size += lsquic_malo_mem_used(mm->malo.mini_conn_ietf);
+        size += lsquic_malo_mem_used(mm->malo.packet_in);
+        size += lsquic_malo_mem_used(mm->malo.packet_out);
+    }
 
     for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
         SLIST_FOREACH(pob, &mm->packet_out_bufs[i], next_pob)
@@ -572,8 +935,20 @@ lsquic_mm_mem_used (const struct lsquic_mm *mm)
     SLIST_FOREACH(skp, &mm->sixteen_k_pages, next_skp)
         size += 0x4000;
 
+    size += mm->n_mini_conn_pages * 0x1000;
+
+    /* Like the lists above, count only the part of the arena that is not
+     * in use: buffers in use are counted by their owners.
+     */
+    if (mm->arena)
+    {
+        lsquic_arena_get_stats(mm->arena, &arena_stats);
+        size += (size_t) arena_stats.as_slabs * ARENA_SLAB_SZ
+                                                    - arena_stats.as_bytes_out;
+    }
+
     return size;
 #else
-    return sizeof(*mm);
+    return sizeof(*mm) + mm->n_mini_conn_pages * 0x1000;
 #endif
 }
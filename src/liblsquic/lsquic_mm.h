@@ -9,12 +9,16 @@
 #ifndef LSQUIC_MM_H
 #define LSQUIC_MM_H 1
 
+#include "lsquic_mt.h"
+
 struct lsquic_engine_public;
 struct lsquic_packet_in;
 struct lsquic_packet_out;
 struct ack_info;
+struct arena;
 struct malo;
 struct mini_conn;
+struct lsquic_recv_buf_if;
 
 struct pool_stats
 {
@@ -31,7 +35,7 @@ struct pool_stats
 
 struct lsquic_mm {
     struct ack_info     *acki;
-    struct {
+    struct mm_malo {
         struct malo     *stream_frame;  /* For struct stream_frame */
         struct malo     *stream_rec_arr;/* For struct stream_rec_arr */
         struct malo     *mini_conn;     /* For struct mini_conn */
@@ -48,14 +52,93 @@ struct lsquic_mm {
     SLIST_HEAD(, packet_in_buf)     packet_in_bufs[MM_N_IN_BUCKETS];
     SLIST_HEAD(, four_k_page)       four_k_pages;
     SLIST_HEAD(, sixteen_k_page)    sixteen_k_pages;
+    /* 4K pages held by mini connections.  Unlike other users of the
+     * pools, mini connections do not report their memory use, so these
+     * pages are counted by lsquic_mm_mem_used().
+     */
+    unsigned                        n_mini_conn_pages;
+    /* Bytes in packet buffers and pages that have been handed out and not
+     * yet returned.  Memory kept in the free lists is not counted.
+     */
+    size_t                          mem_out;
+    /* If set, packet buffers and pages come from the arena instead of
+     * the lists above.  See lsquic_mm_use_arena().
+     */
+    struct arena                   *arena;
+    /* True if `malo' points to pools shared by engines that use them.
+     * See lsquic_mm_use_shared_pools().
+     */
+    int                             shared_malo;
+    /* Used to release application's receive buffers, see PI_BUF_REF */
+    const struct lsquic_recv_buf_if *rbi;
+    void                           *rbi_ctx;
+#if LSQUIC_TICK_THREADS
+    /* Set while connections are ticked on several threads */
+    pthread_mutex_t                *lock;
+#endif
 };
 
+#if LSQUIC_TICK_THREADS
+/* Worker threads that tick connections have their own ACK info scratch
+ * space.  This is NULL in all other threads.
+ */
+extern __thread struct ack_info *lsquic_mm_thread_acki;
+
+#define lsquic_mm_acki(mm) (lsquic_mm_thread_acki ? lsquic_mm_thread_acki \
+                                                            : (mm)->acki)
+
+/* Set up and release per-thread state of a worker thread.  Returns 0 on
+ * success and -1 on failure.
+ */
+int
+lsquic_mm_thread_init (void);
+
+void
+lsquic_mm_thread_cleanup (void);
+
+/* Set the lock (or NULL) on the memory manager and all its malo pools. */
+void
+lsquic_mm_set_lock (struct lsquic_mm *, pthread_mutex_t *);
+#else
+#define lsquic_mm_acki(mm) ((mm)->acki)
+#endif
+
 int
 lsquic_mm_init (struct lsquic_mm *);
 
 void
 lsquic_mm_cleanup (struct lsquic_mm *);
 
+/* Switch to arena mode.  Must be called before any buffers are allocated.
+ * If `numa_node' is not negative, the arena is bound to that node.
+ * Returns 0 on success and -1 on failure.
+ */
+int
+lsquic_mm_use_arena (struct lsquic_mm *, int numa_node);
+
+/* Replace the malo pools with thread-caching pools shared by all memory
+ * managers that call this function.  Must be called before any objects
+ * are allocated.  Returns 0 on success and -1 on failure, including when
+ * this mode is not supported.
+ */
+int
+lsquic_mm_use_shared_pools (struct lsquic_mm *);
+
+/* Returns NULL if the memory manager is not in arena mode or if the
+ * arena cannot satisfy the request.
+ */
+void *
+lsquic_mm_arena_alloc (struct lsquic_mm *, size_t size);
+
+/* `buf' must have been returned by lsquic_mm_arena_alloc() */
+void
+lsquic_mm_arena_free (struct lsquic_mm *, void *buf);
+
+/* Packet out memory interface backed by the arena.  Its context is the
+ * memory manager, which must be in arena mode.
+ */
+extern const struct lsquic_packout_mem_if lsquic_mm_arena_pmi;
+
 struct lsquic_packet_in *
 lsquic_mm_get_packet_in (struct lsquic_mm *);
 
@@ -75,6 +158,14 @@ lsquic_mm_get_packet_out (struct lsquic_mm *, struct malo *,
 void
 lsquic_mm_put_packet_out (struct lsquic_mm *, struct lsquic_packet_out *);
 
+/* Take reference to application's receive buffer that `pi_data' points to */
+void
+lsquic_mm_ref_packet_in_buf (struct lsquic_mm *, struct lsquic_packet_in *);
+
+/* Drop reference taken by lsquic_mm_ref_packet_in_buf() */
+void
+lsquic_mm_unref_packet_in_buf (struct lsquic_mm *, struct lsquic_packet_in *);
+
 void *
 lsquic_mm_get_packet_in_buf (struct lsquic_mm *, size_t);
 
@@ -93,7 +184,13 @@ lsquic_mm_get_16k (struct lsquic_mm *);
 void
 lsquic_mm_put_16k (struct lsquic_mm *, void *);
 
+/* Walks the free lists: not for use on the fast path */
 size_t
 lsquic_mm_mem_used (const struct lsquic_mm *mm);
 
+/* Amount of memory in use by packet buffers and pages.  Unlike
+ * lsquic_mm_mem_used(), this goes down when buffers are returned.
+ */
+#define lsquic_mm_mem_out(mm) ((mm)->mem_out)
+
 #endif
@@ -0,0 +1,46 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_mt.h -- Locking used when connections are ticked on several threads
+ *
+ * The engine is single-threaded except for one phase: when threaded ticking
+ * is enabled (see es_tick_threads), connections are ticked in parallel by
+ * a pool of worker threads.  During that phase, the engine sets the lock
+ * pointers of shared objects and code that touches them takes the lock.
+ * At all other times the lock pointers are NULL and locking is a no-op.
+ */
+
+#ifndef LSQUIC_MT_H
+#define LSQUIC_MT_H 1
+
+#ifndef LSQUIC_TICK_THREADS
+#ifdef WIN32
+#define LSQUIC_TICK_THREADS 0
+#else
+#define LSQUIC_TICK_THREADS 1
+#endif
+#endif
+
+#if LSQUIC_TICK_THREADS
+#include <pthread.h>
+
+/* The lock is recursive: for example, lsquic_mm functions use malo, both
+ * of which take the same lock.
+ */
+#define LSQ_MT_LOCK(lock) do {                                          \
+    if (lock)                                                           \
+        pthread_mutex_lock(lock);                                       \
+} while (0)
+
+#define LSQ_MT_UNLOCK(lock) do {                                        \
+    if (lock)                                                           \
+        pthread_mutex_unlock(lock);                                     \
+} while (0)
+
+#else
+
+#define LSQ_MT_LOCK(lock) do { } while (0)
+#define LSQ_MT_UNLOCK(lock) do { } while (0)
+
+#endif
+
+#endif
@@ -74,7 +74,7 @@ typedef struct lsquic_packet_in
         PI_ENC_LEV_BIT_0= (1 << 5),                /* Encodes encryption level */
         PI_ENC_LEV_BIT_1= (1 << 6),                /*  (see enum enc_level). */
         PI_GQUIC        = (1 << 7),
-        PI_UNUSED_8     = (1 << 8),                /* <-- hole, reuse me! */
+        PI_BUF_REF      = (1 << 8),                /* Holding ref to pi_buf_ctx */
 #define PIBIT_ECN_SHIFT 9
         PI_ECN_BIT_0    = (1 << 9),
         PI_ECN_BIT_1    = (1 <<10),
@@ -101,9 +101,16 @@ typedef struct lsquic_packet_in
     enum header_type                pi_header_type:8;
     unsigned char                   pi_path_id;
     /* If PI_OWN_DATA flag is not set, `pi_data' points to user-supplied
-     * packet data, which is NOT TO BE MODIFIED.
+     * packet data, which is NOT TO BE MODIFIED -- unless `pi_buf_ctx' is
+     * set.
      */
     unsigned char                  *pi_data;
+    /* Application's refcounted receive buffer that `pi_data' points to.
+     * Only set if engine uses lsquic_recv_buf_if.  If PI_BUF_REF is not
+     * set, the reference has not been taken and the buffer is only valid
+     * until the packet-in function returns.
+     */
+    void                           *pi_buf_ctx;
 } lsquic_packet_in_t;
 
 
@@ -193,6 +193,26 @@ lsquic_cid_from_packet (const unsigned char *buf, size_t bufsz,
 }
 
 
+/* See lsquic_generate_scid() for how the shard ID is encoded */
+int
+lsquic_packet_shard (const unsigned char *buf, size_t bufsz,
+                                                        unsigned n_shards)
+{
+    lsquic_cid_t cid;
+
+    if (n_shards < 1 || n_shards > LSQUIC_MAX_SHARDS)
+        return -1;
+
+    if (0 != lsquic_cid_from_packet(buf, bufsz, &cid))
+        return -1;
+
+    if (cid.len > 0)
+        return cid.idbuf[0] % n_shards;
+    else
+        return 0;
+}
+
+
 /* See [draft-ietf-quic-tls-19], Section 4 */
 const enum quic_ft_bit lsquic_legal_frames_by_level[N_ENC_LEVS] =
 {
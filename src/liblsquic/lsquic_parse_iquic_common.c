@@ -25,9 +25,13 @@
 #include "lsquic_varint.h"
 #include "lsquic_enc_sess.h"
 #include "lsquic_tokgen.h"
+#include "lsquic_util.h"
 #include "lsquic.h"
 #include "lsquic_mm.h"
 #include "lsquic_engine_public.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_packet_ietf.h"
 
 
 /* [draft-ietf-quic-transport-17] Section-17.2 */
@@ -223,6 +227,64 @@ lsquic_generate_iquic_reset (const lsquic_cid_t *cidp, unsigned char *buf,
 }
 
 
+/* `scid' and `dcid' are the CIDs from the client's Initial packet: the
+ * client's SCID becomes the DCID of the Retry packet and the client's DCID
+ * is the ODCID.  A new SCID is generated; the client will use it as the
+ * DCID of its next Initial packet.
+ */
+int
+lsquic_iquic_gen_retry_pkt (unsigned char *buf, size_t bufsz,
+        const struct lsquic_engine_public *enpub, const lsquic_cid_t *scid,
+        const lsquic_cid_t *dcid, enum lsquic_version version,
+        const struct sockaddr *sockaddr, uint8_t random_nybble)
+{
+    unsigned char *p, *const end = buf + bufsz;
+    lsquic_cid_t new_scid;
+    lsquic_ver_tag_t tag;
+    ssize_t token_sz;
+    size_t need;
+
+    lsquic_generate_scid(&new_scid, &enpub->enp_settings);
+    /* Initial DCID chosen by the client must be at least 8 bytes long;
+     * the one we give it should be, too.
+     */
+    if (new_scid.len < MIN_INITIAL_DCID_LEN)
+    {
+        RAND_bytes(new_scid.idbuf + new_scid.len,
+                                        MIN_INITIAL_DCID_LEN - new_scid.len);
+        new_scid.len = MIN_INITIAL_DCID_LEN;
+    }
+
+    need = 1 /* Type */ + 4 /* Version */ + 1 /* DCIL */ + scid->len
+            + 1 /* SCIL */ + new_scid.len + 1 /* ODCIL */ + dcid->len;
+    if (need > bufsz)
+        return -1;
+
+    p = buf;
+    *p++ = 0x80 | 0x40 | (0x3 /* Retry */ << 4) | (random_nybble & 0xF);
+    tag = lsquic_ver2tag(version);
+    memcpy(p, &tag, sizeof(tag));
+    p += sizeof(tag);
+    *p++ = scid->len;
+    memcpy(p, scid->idbuf, scid->len);
+    p += scid->len;
+    *p++ = new_scid.len;
+    memcpy(p, new_scid.idbuf, new_scid.len);
+    p += new_scid.len;
+    *p++ = dcid->len;
+    memcpy(p, dcid->idbuf, dcid->len);
+    p += dcid->len;
+
+    token_sz = lsquic_tg_generate_retry(enpub->enp_tokgen, p, end - p, dcid,
+                                            sockaddr, lsquic_enpub_now(enpub));
+    if (token_sz < 0)
+        return -1;
+    p += token_sz;
+
+    return p - buf;
+}
+
+
 /* This is a bare-bones version of lsquic_Q046_parse_packet_in_long_begin()
  */
 int
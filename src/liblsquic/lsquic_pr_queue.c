@@ -24,6 +24,7 @@
 #include "lsquic_packet_in.h"
 #include "lsquic_hash.h"
 #include "lsquic_conn.h"
+#include "lsquic_packet_ietf.h"
 #include "lsquic_parse.h"
 #include "lsquic_malo.h"
 #include "lsquic_pr_queue.h"
@@ -34,7 +35,6 @@
 #include "lsquic_engine_public.h"
 #include "lsquic_sizes.h"
 #include "lsquic_handshake.h"
-#include "lsquic_xxhash.h"
 
 #define LSQUIC_LOGGER_MODULE LSQLM_PRQ
 #include "lsquic_logger.h"
@@ -80,6 +80,27 @@ struct evanescent_conn
                 + 1 /* DCIL */ + MAX_CID_LEN + 1 /* SCIL */ + MAX_CID_LEN + \
                 4 * N_LSQVER)
 
+/* Replies to each source prefix -- /24 for IPv4 and /48 for IPv6 -- are
+ * limited using a token bucket.  The buckets are kept in a fixed-size
+ * table indexed by keyed hash of the prefix.  Prefixes that collide share
+ * a bucket, which only makes the limit stricter.
+ */
+#define PRQ_N_BUCKETS       1024u
+#define PRQ_BUCKET_RATE     50u     /* Replies per second */
+#define PRQ_BUCKET_BURST    100u
+
+struct prq_bucket
+{
+    lsquic_time_t               pb_refilled;
+    unsigned                    pb_tokens;
+};
+
+
+/* [draft-ietf-quic-transport-24], Section 17.2.5 */
+#define IQUIC_RETRY_SIZE (1 /* Type */ + 4 /* Version */ \
+                + 1 /* DCIL */ + MAX_CID_LEN + 1 /* SCIL */ + MAX_CID_LEN \
+                + 1 /* ODCIL */ + MAX_CID_LEN + MAX_RETRY_TOKEN_SZ)
+
 
 struct pr_queue
 {
@@ -95,17 +116,21 @@ struct pr_queue
     unsigned                    prq_nconns;
     unsigned                    prq_verneg_g_sz;  /* Size of prq_verneg_g_buf */
     unsigned                    prq_pubres_g_sz;  /* Size of prq_pubres_g_buf */
+    unsigned                    prq_ver_tags_sz;  /* Size of prq_ver_tags */
 
     /* GQUIC version negotiation and stateless reset packets are generated
      * once, when the Packet Request Queue is created.  For each request,
      * these buffers are simply copied and the connection ID is replaced.
      *
      * Since IETF QUIC uses variable-length connections IDs, we have to
-     * generate packets every time.
+     * generate packets every time.  The list of supported versions at
+     * the end of version negotiation packets is generated once, though.
      */
     unsigned char               prq_pubres_g_buf[GQUIC_RESET_SZ];
     unsigned char               prq_verneg_g_buf[1 + GQUIC_CID_LEN
                                                                 + N_LSQVER * 4];
+    unsigned char               prq_ver_tags[N_LSQVER * 4];
+    struct prq_bucket           prq_buckets[PRQ_N_BUCKETS];
     /* We generate random nybbles in batches */
 #define NYBBLE_COUNT_BITS 4
 #define NYBBLE_COUNT (1 << NYBBLE_COUNT_BITS)
@@ -134,12 +159,12 @@ comp_reqs (const void *s1, const void *s2, size_t n)
 
 
 static unsigned
-hash_req (const void *p, size_t len, unsigned seed)
+hash_req (const void *p, size_t len, const unsigned char *key)
 {
     const struct packet_req *req;
 
     req = p;
-    return XXH32(req->pr_dcid.idbuf, req->pr_dcid.len, seed);
+    return lsquic_hash_keyed(req->pr_dcid.idbuf, req->pr_dcid.len, key);
 }
 
 
@@ -163,7 +188,7 @@ prq_create (unsigned max_elems, unsigned max_conns,
     }
 
 
-    hash = lsquic_hash_create_ext(comp_reqs, hash_req);
+    hash = lsquic_hash_create_ext(comp_reqs, hash_req, enpub->enp_hash_key);
     if (!hash)
     {
         LSQ_WARN("cannot create hash");
@@ -190,6 +215,15 @@ prq_create (unsigned max_elems, unsigned max_conns,
     }
     verneg_g_sz = (unsigned) len;
 
+    len = lsquic_gen_ver_tags(prq->prq_ver_tags, sizeof(prq->prq_ver_tags),
+                                    enpub->enp_settings.es_versions);
+    if (len < 0)
+    {
+        LSQ_ERROR("cannot generate version tags");
+        goto err3;
+    }
+    prq->prq_ver_tags_sz = (unsigned) len;
+
     prst_g_sz = pf->pf_generate_simple_prst(0 /* This is just placeholder */,
                                 prq->prq_pubres_g_buf, sizeof(prq->prq_pubres_g_buf));
     if (prst_g_sz < 0)
@@ -210,6 +244,7 @@ prq_create (unsigned max_elems, unsigned max_conns,
     prq->prq_pubres_g_sz = (unsigned) prst_g_sz;
     prq->prq_enpub       = enpub;
     prq->prq_rand_nybble_off = 0;
+    memset(prq->prq_buckets, 0, sizeof(prq->prq_buckets));
 
     LSQ_INFO("initialized queue of size %d", max_elems);
 
@@ -269,15 +304,107 @@ put_req (struct pr_queue *prq, struct packet_req *req)
 }
 
 
+/* Returns true if a reply to `peer_addr' may be sent now */
+static int
+prq_take_token (struct pr_queue *prq, const struct sockaddr *peer_addr,
+                                                            lsquic_time_t now)
+{
+    struct prq_bucket *bucket;
+    const void *prefix;
+    size_t prefix_sz;
+    uint64_t n;
+
+    if (peer_addr->sa_family == AF_INET)
+    {
+        prefix = &((const struct sockaddr_in *) peer_addr)->sin_addr;
+        prefix_sz = 3;
+    }
+    else if (peer_addr->sa_family == AF_INET6)
+    {
+        prefix = &((const struct sockaddr_in6 *) peer_addr)->sin6_addr;
+        prefix_sz = 6;
+    }
+    else
+    {
+        LSQ_DEBUG("unexpected address family %d", peer_addr->sa_family);
+        return 0;
+    }
+    bucket = &prq->prq_buckets[ lsquic_hash_keyed(prefix, prefix_sz,
+                    prq->prq_enpub->enp_hash_key) & (PRQ_N_BUCKETS - 1) ];
+
+    /* Whole tokens accrued since last refill; the remainder carries over */
+    if (now > bucket->pb_refilled)
+    {
+        n = (now - bucket->pb_refilled) * PRQ_BUCKET_RATE / 1000000;
+        if (n + bucket->pb_tokens >= PRQ_BUCKET_BURST)
+        {
+            bucket->pb_tokens = PRQ_BUCKET_BURST;
+            bucket->pb_refilled = now;
+        }
+        else if (n > 0)
+        {
+            bucket->pb_tokens += n;
+            bucket->pb_refilled += n * 1000000 / PRQ_BUCKET_RATE;
+        }
+    }
+
+    if (bucket->pb_tokens > 0)
+    {
+        --bucket->pb_tokens;
+        return 1;
+    }
+    else
+        return 0;
+}
+
+
+/* Largest size of reply to a request.  Retry size depends on the token
+ * size and is approximated from above.
+ */
+static unsigned
+reply_size (const struct pr_queue *prq, enum packet_req_type type,
+            unsigned flags, const lsquic_cid_t *dcid, const lsquic_cid_t *scid)
+{
+    unsigned new_scid_len;
+
+    switch ((type << 29) | flags)
+    {
+    case (PACKET_REQ_VERNEG << 29) | PR_GQUIC:
+        return prq->prq_verneg_g_sz;
+    case (PACKET_REQ_PUBRES << 29) | PR_GQUIC:
+        return prq->prq_pubres_g_sz;
+    case (PACKET_REQ_VERNEG << 29) | 0:
+        return 1 + 4 + 1 + dcid->len + 1 + scid->len + prq->prq_ver_tags_sz;
+    case (PACKET_REQ_RETRY << 29) | 0:
+        new_scid_len = MAX(prq->prq_enpub->enp_settings.es_scid_len,
+                                                        MIN_INITIAL_DCID_LEN);
+        return 1 + 4 + 1 + scid->len + 1 + new_scid_len + 1 + dcid->len
+                                                        + MAX_RETRY_TOKEN_SZ;
+    default:
+        return IQUIC_MIN_SRST_SIZE;
+    }
+}
+
+
 int
 lsquic_prq_new_req (struct pr_queue *prq, enum packet_req_type type,
     unsigned flags, enum lsquic_version version, unsigned short data_sz,
     const lsquic_cid_t *dcid, const lsquic_cid_t *scid, void *peer_ctx,
-    const struct sockaddr *local_addr, const struct sockaddr *peer_addr)
+    const struct sockaddr *local_addr, const struct sockaddr *peer_addr,
+    lsquic_time_t now)
 {
     struct packet_req *req;
     unsigned max, size, rand;
 
+    /* Replies must never be larger than the packets that elicited them */
+    if (reply_size(prq, type, flags, dcid, scid) > data_sz)
+    {
+        LSQ_DEBUGC("not scheduling %s packet: incoming packet for CID "
+            "%"CID_FMT" too small: %hu bytes", lsquic_preqt2str[type],
+            CID_BITS(dcid), data_sz);
+        return -1;
+    }
+
     if (type == PACKET_REQ_PUBRES && !(flags & PR_GQUIC))
     {
         if (data_sz <= IQUIC_MIN_SRST_SIZE)
@@ -318,6 +445,16 @@ lsquic_prq_new_req (struct pr_queue *prq, enum packet_req_type type,
         return -1;
     }
 
+    /* Only requests that would otherwise be scheduled use up tokens */
+    if (!prq_take_token(prq, peer_addr, now))
+    {
+        LSQ_DEBUGC("not scheduling %s packet for CID %"CID_FMT": reply "
+            "rate limit for this peer prefix reached", lsquic_preqt2str[type],
+            CID_BITS(dcid));
+        put_req(prq, req);
+        return -1;
+    }
+
     req->pr_hash_el.qhe_flags = 0;
     if (!lsquic_hash_insert(prq->prq_reqs_hash, req, sizeof(req),
                                                     req, &req->pr_hash_el))
@@ -369,14 +506,16 @@ prq_new_req (struct pr_queue *prq, enum packet_req_type type,
 
     lsquic_scid_from_packet_in(packet_in, &scid);
     return lsquic_prq_new_req(prq, type, flags, version, packet_in->pi_data_sz,
-                &packet_in->pi_dcid, &scid, peer_ctx, local_addr, peer_addr);
+                &packet_in->pi_dcid, &scid, peer_ctx, local_addr, peer_addr,
+                packet_in->pi_received);
 }
 
 
 static size_t
 max_bufsz (const struct pr_queue *prq)
 {
-    return  MAX(MAX(MAX(IQUIC_VERNEG_SIZE,
+    return  MAX(MAX(MAX(MAX(IQUIC_VERNEG_SIZE,
+                        IQUIC_RETRY_SIZE),
                         IQUIC_MIN_SRST_SIZE),
                         sizeof(prq->prq_verneg_g_buf)),
                         sizeof(prq->prq_pubres_g_buf));
@@ -506,10 +645,26 @@ prq_next_conn (struct pr_queue *prq)
             gen_verneg = lsquic_Q046_gen_ver_nego_pkt;
         else
             gen_verneg = lsquic_ietf_v1_gen_ver_nego_pkt;
-        len = gen_verneg(packet_out->po_data, max_bufsz(prq),
+        /* Generate the header only and append the prebuilt version list */
+        len = gen_verneg(packet_out->po_data,
+                    max_bufsz(prq) - prq->prq_ver_tags_sz,
                     /* Flip SCID/DCID here: */ &req->pr_dcid, &req->pr_scid,
-                    prq->prq_enpub->enp_settings.es_versions,
-                    get_rand_byte(prq));
+                    0, get_rand_byte(prq));
+        if (len > 0)
+        {
+            memcpy(packet_out->po_data + len, prq->prq_ver_tags,
+                                                    prq->prq_ver_tags_sz);
+            packet_out->po_data_sz = len + prq->prq_ver_tags_sz;
+        }
+        else
+            packet_out->po_data_sz = 0;
+        break;
+    case (PACKET_REQ_RETRY << 29) | 0:
+        packet_out->po_flags &= ~PO_VERNEG;
+        len = lsquic_iquic_gen_retry_pkt(packet_out->po_data, max_bufsz(prq),
+                    prq->prq_enpub, &req->pr_scid, &req->pr_dcid,
+                    req->pr_version, NP_PEER_SA(&req->pr_path),
+                    get_rand_nybble(prq));
         if (len > 0)
             packet_out->po_data_sz = len;
         else
@@ -690,6 +845,7 @@ const char *const lsquic_preqt2str[] =
 {
     [PACKET_REQ_VERNEG] = "version negotiation",
     [PACKET_REQ_PUBRES] = "stateless reset",
+    [PACKET_REQ_RETRY]  = "retry",
 };
 
 
@@ -9,6 +9,9 @@
  *     arrives that specifies QUIC version that we do not support.
  *  2. A public reset packet needs to be sent when we receive a
  *     packet that does not belong to a known QUIC connection.
+ *  3. A Retry packet is sent in reply to an IETF QUIC Initial packet
+ *     when the server is validating client addresses before creating
+ *     mini connections.
  *
  * The replies cannot be sent immediately.  They share outgoing
  * socket with existing connections and must be scheduled according
@@ -23,7 +26,7 @@
  * evanescent connection object that disappears as soon as the reply
  * packet is successfully sent out.
  *
- * There are two limits associated with Packet Request Queue:
+ * There are four limits associated with Packet Request Queue:
  *  1. Maximum number of packet requests that are allowed to be
  *     pending at any one time.  This is simply to prevent memory
  *     blowout.
@@ -32,6 +35,11 @@
  *     the engine, because the packet (and, therefore, the connection)
  *     is returned to the Packet Request Queue when it could not be
  *     sent.
+ *  3. A reply is never larger than the packet it replies to, so that
+ *     the server cannot be used to amplify traffic.
+ *  4. The rate of replies to each source address prefix is limited,
+ *     so that scanning or spoofed packets cannot make us send replies
+ *     without bound.
  *
  * We call this a "request" queue because it describes what we do with
  * QUIC packets whose version we do not support or those packets that
@@ -51,6 +59,7 @@ struct sockaddr;
 enum packet_req_type {
     PACKET_REQ_VERNEG,
     PACKET_REQ_PUBRES,
+    PACKET_REQ_RETRY,
     N_PREQ_TYPES,
 };
 
@@ -63,6 +72,13 @@ prq_create (unsigned max_elems, unsigned max_conns,
 void
 prq_destroy (struct pr_queue *);
 
+int
+lsquic_prq_new_req (struct pr_queue *, enum packet_req_type,
+    unsigned flags, enum lsquic_version, unsigned short data_sz,
+    const lsquic_cid_t *dcid, const lsquic_cid_t *scid, void *peer_ctx,
+    const struct sockaddr *local_addr, const struct sockaddr *peer_addr,
+    lsquic_time_t now);
+
 int
 prq_new_req (struct pr_queue *, enum packet_req_type,
              const struct lsquic_packet_in *, void *conn_ctx,
@@ -1,4 +1,5 @@
 /* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <stddef.h>
@@ -7,59 +8,38 @@
 #include <string.h>
 #include <sys/queue.h>
 
+#include <openssl/rand.h>
+
 #include "lsquic.h"
 #include "lsquic_types.h"
 #include "lsquic_int_types.h"
-#include "lsquic_xxhash.h"
+#include "lsquic_hash.h"
 #include "lsquic_purga.h"
 
 #define LSQUIC_LOGGER_MODULE LSQLM_PURGA
 #include "lsquic_logger.h"
 
 
-/* To avoid scannig the whole list of CIDs, we use a Bloom filter.
- *
- * The Bloom filter is constructed using a 8192-bit bit field and 6 hash
- * functions.  With 273 elements per page, this gives us 0.004% possibility
- * of a false positive.  In other words, when we do have to search a page
- * for a particular CID, the chance of finding the CID is 99.99%.
- *
- * Quick calc:
- *   perl -E '$k=6;$m=1<<13;$n=273;printf("%f\n", (1-exp(1)**-($k*$n/$m))**$k)'
+/* CIDs are kept in pages, in the order they were added.  Pages are the
+ * unit of expiry: when the oldest page is full and older than the minimum
+ * life, all its CIDs are dropped at once.
  *
- * To extract 6 13-bit values from a 64-bit integer, they are overlapped:
- *  0         10        20        30        40        50        60
- * +----------------------------------------------------------------+
- * |                                                                |
- * +----------------------------------------------------------------+
- *  1111111111111
- *            2222222222222
- *                      3333333333333
- *                                4444444444444
- *                                          5555555555555
- *                                                    6666666666666
- *
- * This is not 100% kosher, but having 6 functions gives a better guarantee
- * and it happens to work in practice.
+ * To find a CID without scanning the pages, all CIDs are indexed by a
+ * single open-addressing hash with linear probing.  A slot points to the
+ * page and the index of the CID in it.  Slots are removed using backward
+ * shift, so that there are no tombstones and lookups of missing CIDs stop
+ * at the first empty slot.  The load factor is kept at or below one half.
  */
 
-#define BLOOM_N_FUNCS 6
-#define BLOOM_SHIFT 10
-#define BLOOM_N_BITS (1 << 13)
-typedef uint64_t bloom_mask_el_t;
-#define BLOOM_SET_SHIFT 6   /* log2(sizeof(bloom_mask_el_t)) */
-#define BLOOM_BITS_PER_EL (1 << BLOOM_SET_SHIFT)
-#define BLOOM_N_MASK_ELS (BLOOM_N_BITS / BLOOM_BITS_PER_EL)
-#define BLOOM_ONE 1ull
-
 #define PURGA_ELS_PER_PAGE 273
 
+#define PURGA_MIN_SLOTS 512
+
 struct purga_page
 {
     TAILQ_ENTRY(purga_page)     pupa_next;
     lsquic_time_t               pupa_last;
     unsigned                    pupa_count;
-    bloom_mask_el_t             pupa_mask[BLOOM_N_MASK_ELS];
     lsquic_cid_t                pupa_cids[PURGA_ELS_PER_PAGE];
     void *                      pupa_peer_ctx[PURGA_ELS_PER_PAGE];
     struct purga_el             pupa_els[PURGA_ELS_PER_PAGE];
@@ -69,18 +49,103 @@ struct purga_page
 
 TAILQ_HEAD(purga_pages, purga_page);
 
+struct purga_slot
+{
+    struct purga_page          *pus_page;   /* NULL if slot is empty */
+    unsigned                    pus_hash;
+    unsigned                    pus_idx;    /* Index into pus_page arrays */
+};
+
 struct lsquic_purga
 {
     lsquic_time_t              pur_min_life;
     lsquic_cids_update_f       pur_remove_cids;
     void                      *pur_remove_ctx;
     struct purga_pages         pur_pages;
+    struct purga_slot         *pur_slots;
+    unsigned                   pur_n_slots;    /* Zero or a power of two */
+    unsigned                   pur_count;      /* Number of used slots */
+    unsigned char              pur_hash_key[LSQUIC_HASH_KEY_SZ];
 #ifndef NDEBUG
-    struct purga_bloom_stats   pur_stats;
+    struct purga_stats         pur_stats;
 #endif
 };
 
 
+static unsigned
+purga_hash (const struct lsquic_purga *purga, const lsquic_cid_t *cid)
+{
+    return lsquic_hash_keyed(cid->idbuf, cid->len, purga->pur_hash_key);
+}
+
+
+static void
+purga_slot_insert (struct purga_slot *slots, unsigned n_slots,
+                                            const struct purga_slot *new_slot)
+{
+    unsigned i;
+
+    for (i = new_slot->pus_hash & (n_slots - 1); slots[i].pus_page;
+                                                i = (i + 1) & (n_slots - 1))
+        ;
+    slots[i] = *new_slot;
+}
+
+
+static int
+purga_resize (struct lsquic_purga *purga, unsigned n_slots)
+{
+    struct purga_slot *slots;
+    unsigned i;
+
+    slots = calloc(n_slots, sizeof(slots[0]));
+    if (!slots)
+    {
+        LSQ_INFO("cannot allocate %u slots: %s", n_slots, strerror(errno));
+        return -1;
+    }
+
+    for (i = 0; i < purga->pur_n_slots; ++i)
+        if (purga->pur_slots[i].pus_page)
+            purga_slot_insert(slots, n_slots, &purga->pur_slots[i]);
+
+    LSQ_DEBUG("resized index from %u to %u slots", purga->pur_n_slots,
+                                                                    n_slots);
+    free(purga->pur_slots);
+    purga->pur_slots = slots;
+    purga->pur_n_slots = n_slots;
+    return 0;
+}
+
+
+static void
+purga_index_remove (struct lsquic_purga *purga, struct purga_page *page,
+                                                                unsigned idx)
+{
+    struct purga_slot *const slots = purga->pur_slots;
+    const unsigned mask = purga->pur_n_slots - 1;
+    unsigned i, j, home;
+
+    for (i = purga_hash(purga, &page->pupa_cids[idx]) & mask;
+            !(slots[i].pus_page == page && slots[i].pus_idx == idx);
+                i = (i + 1) & mask)
+        assert(slots[i].pus_page);
+
+    /* Move back later slots whose home is not between the hole and them */
+    for (j = (i + 1) & mask; slots[j].pus_page; j = (j + 1) & mask)
+    {
+        home = slots[j].pus_hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].pus_page = NULL;
+    --purga->pur_count;
+}
+
+
 struct lsquic_purga *
 lsquic_purga_new (lsquic_time_t min_life, lsquic_cids_update_f remove_cids,
                                                                 void *remove_ctx)
@@ -98,6 +163,7 @@ lsquic_purga_new (lsquic_time_t min_life, lsquic_cids_update_f remove_cids,
     purga->pur_remove_cids = remove_cids;
     purga->pur_remove_ctx = remove_ctx;
     TAILQ_INIT(&purga->pur_pages);
+    RAND_bytes(purga->pur_hash_key, sizeof(purga->pur_hash_key));
     LSQ_INFO("create purgatory, min life %"PRIu64" usec", min_life);
 
     return purga;
@@ -122,16 +188,30 @@ purga_get_page (struct lsquic_purga *purga)
 
     page->pupa_count = 0;
     page->pupa_last  = 0;
-    memset(page->pupa_mask, 0, sizeof(page->pupa_mask));
     TAILQ_INSERT_TAIL(&purga->pur_pages, page, pupa_next);
     LSQ_DEBUG("allocated new page");
     return page;
 }
 
 
+/* Called right before the page is freed */
 static void
 purga_remove_cids (struct lsquic_purga *purga, struct purga_page *page)
 {
+    unsigned i, n;
+
+    /* Squeeze out CIDs that are still in use elsewhere */
+    for (i = 0, n = 0; i < page->pupa_count; ++i)
+        if (page->pupa_els[i].puel_type != PUTY_CID_MOVED)
+        {
+            page->pupa_cids[n] = page->pupa_cids[i];
+            page->pupa_peer_ctx[n] = page->pupa_peer_ctx[i];
+            ++n;
+        }
+    page->pupa_count = n;
+    if (n == 0)
+        return;
+
     LSQ_DEBUG("calling remove_cids with %u CID%.*s", page->pupa_count,
                                                 page->pupa_count != 1, "s");
     /* XXX It is interesting that pur_remove_ctx is called with peer_ctx
@@ -143,17 +223,36 @@ purga_remove_cids (struct lsquic_purga *purga, struct purga_page *page)
 }
 
 
+static void
+purga_free_page (struct lsquic_purga *purga, struct purga_page *page)
+{
+    unsigned i;
+
+    TAILQ_REMOVE(&purga->pur_pages, page, pupa_next);
+    for (i = 0; i < page->pupa_count; ++i)
+        purga_index_remove(purga, page, i);
+    if (purga->pur_remove_cids && page->pupa_count)
+        purga_remove_cids(purga, page);
+    free(page);
+}
+
+
 struct purga_el *
 lsquic_purga_add (struct lsquic_purga *purga, const lsquic_cid_t *cid,
                     void *peer_ctx, enum purga_type putype, lsquic_time_t now)
 {
     struct purga_page *last_page, *page;
-    uint64_t hash;
-    unsigned i, idx, set, bit;
+    struct purga_slot slot;
+    unsigned idx;
+
+    if ((purga->pur_count + 1) * 2 > purga->pur_n_slots
+            && 0 != purga_resize(purga, purga->pur_n_slots
+                                ? purga->pur_n_slots * 2 : PURGA_MIN_SLOTS))
+        return NULL;     /* We do best effort, nothing to do if malloc fails */
 
     last_page = purga_get_page(purga);
     if (!last_page)
-        return NULL;     /* We do best effort, nothing to do if malloc fails */
+        return NULL;
 
     idx = last_page->pupa_count++;
     last_page->pupa_cids    [idx] = *cid;
@@ -162,14 +261,11 @@ lsquic_purga_add (struct lsquic_purga *purga, const lsquic_cid_t *cid,
         .puel_type      = putype,
     };
 
-    hash = XXH64(cid->idbuf, cid->len, 0);
-    for (i = 0; i < BLOOM_N_FUNCS; ++i)
-    {
-        bit = (unsigned) hash & (BLOOM_BITS_PER_EL - 1);
-        set = ((unsigned) hash >> BLOOM_SET_SHIFT) & (BLOOM_N_MASK_ELS - 1);
-        last_page->pupa_mask[set] |= BLOOM_ONE << bit;
-        hash >>= BLOOM_SHIFT;
-    }
+    slot.pus_page = last_page;
+    slot.pus_hash = purga_hash(purga, cid);
+    slot.pus_idx  = idx;
+    purga_slot_insert(purga->pur_slots, purga->pur_n_slots, &slot);
+    ++purga->pur_count;
 
     LSQ_DEBUGC("added %"CID_FMT" to the set", CID_BITS(cid));
     if (PAGE_IS_FULL(last_page))
@@ -185,12 +281,14 @@ lsquic_purga_add (struct lsquic_purga *purga, const lsquic_cid_t *cid,
     {
         LSQ_DEBUG("page at timestamp %"PRIu64" expired; now is %"PRIu64,
             page->pupa_last, now);
-        TAILQ_REMOVE(&purga->pur_pages, page, pupa_next);
-        if (purga->pur_remove_cids && page->pupa_count)
-            purga_remove_cids(purga, page);
-        free(page);
+        purga_free_page(purga, page);
     }
 
+    /* Give memory back after a wave of closed connections has expired */
+    if (purga->pur_n_slots >= PURGA_MIN_SLOTS * 4
+                                && purga->pur_count * 8 < purga->pur_n_slots)
+        (void) purga_resize(purga, purga->pur_n_slots / 4);
+
     return &last_page->pupa_els[idx];
 }
 
@@ -198,44 +296,31 @@ lsquic_purga_add (struct lsquic_purga *purga, const lsquic_cid_t *cid,
 struct purga_el *
 lsquic_purga_contains (struct lsquic_purga *purga, const lsquic_cid_t *cid)
 {
-    struct purga_page *page;
-    unsigned i, bit, set, hits;
-    uint64_t cid_hash, hash;
+    const struct purga_slot *slot;
+    unsigned i, hash, mask;
 
-    page = TAILQ_FIRST(&purga->pur_pages);
-    if (!page)
+    if (purga->pur_count == 0)
         goto end;
 
-    cid_hash = XXH64(cid->idbuf, cid->len, 0);
-    do
+#ifndef NDEBUG
+    ++purga->pur_stats.searches;
+#endif
+    hash = purga_hash(purga, cid);
+    mask = purga->pur_n_slots - 1;
+    for (i = hash & mask; slot = &purga->pur_slots[i], slot->pus_page;
+                                                        i = (i + 1) & mask)
     {
 #ifndef NDEBUG
-        ++purga->pur_stats.searches;
+        ++purga->pur_stats.probes;
 #endif
-        hash = cid_hash;
-        hits = 0;
-        for (i = 0; i < BLOOM_N_FUNCS; ++i)
+        if (slot->pus_hash == hash
+                && LSQUIC_CIDS_EQ(&slot->pus_page->pupa_cids[slot->pus_idx],
+                                                                        cid))
         {
-            bit = (unsigned) hash & (BLOOM_BITS_PER_EL - 1);
-            set = ((unsigned) hash >> BLOOM_SET_SHIFT) & (BLOOM_N_MASK_ELS - 1);
-            hits += (page->pupa_mask[set] & (BLOOM_ONE << bit)) != 0;
-            hash >>= BLOOM_SHIFT;
+            LSQ_DEBUGC("found %"CID_FMT, CID_BITS(cid));
+            return &slot->pus_page->pupa_els[slot->pus_idx];
         }
-        if (hits < BLOOM_N_FUNCS)
-            goto next_page;
-        for (i = 0; i < page->pupa_count; ++i)
-            if (LSQUIC_CIDS_EQ(&page->pupa_cids[i], cid))
-            {
-                LSQ_DEBUGC("found %"CID_FMT, CID_BITS(cid));
-                return &page->pupa_els[i];
-            }
-#ifndef NDEBUG
-        ++purga->pur_stats.false_hits;
-#endif
-  next_page:
-        page = TAILQ_NEXT(page, pupa_next);
     }
-    while (page);
 
   end:
     LSQ_DEBUGC("%"CID_FMT" not found", CID_BITS(cid));
@@ -255,6 +340,7 @@ lsquic_purga_destroy (struct lsquic_purga *purga)
             purga_remove_cids(purga, page);
         free(page);
     }
+    free(purga->pur_slots);
     free(purga);
     LSQ_INFO("destroyed");
 }
@@ -269,8 +355,8 @@ lsquic_purga_cids_per_page (void)
 
 
 #ifndef NDEBUG
-struct purga_bloom_stats *
-lsquic_purga_get_bloom_stats (struct lsquic_purga *purga)
+struct purga_stats *
+lsquic_purga_get_stats (struct lsquic_purga *purga)
 {
     return &purga->pur_stats;
 }
@@ -5,6 +5,10 @@
  * This module keeps a set of CIDs that should be ignored for a period
  * of time.  It is used when a connection is closed: this way, late
  * packets will not create a new connection.
+ *
+ * Lookups take constant time regardless of how many CIDs are in the
+ * purgatory, so that a flood of packets for dead connections -- the
+ * usual sight after a restart -- is cheap to drop.
  */
 
 #ifndef LSQUIC_PURGA_H
@@ -20,6 +24,10 @@ enum purga_type
     PUTY_CONN_DELETED,  /* Connection was deleted */
     PUTY_CONN_DRAIN,    /* Connection is in the "Drain" state */
     PUTY_CID_RETIRED,   /* CID was retired */
+    PUTY_CID_MOVED,     /* Connection was moved to another engine.  Such
+                         * CIDs are not passed to `remove_cids' callback
+                         * when they expire: they are still in use.
+                         */
 };
 
 /* User can set these values freely */
@@ -55,14 +63,14 @@ unsigned
 lsquic_purga_cids_per_page (void);
 
 #ifndef NDEBUG
-struct purga_bloom_stats
+struct purga_stats
 {
     unsigned long   searches;
-    unsigned long   false_hits;
+    unsigned long   probes;     /* Occupied slots looked at */
 };
 
-struct purga_bloom_stats *
-lsquic_purga_get_bloom_stats (struct lsquic_purga *);
+struct purga_stats *
+lsquic_purga_get_stats (struct lsquic_purga *);
 #endif
 
 #endif
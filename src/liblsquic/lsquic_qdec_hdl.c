@@ -167,6 +167,18 @@ lsquic_qdh_cleanup (struct qpack_dec_hdl *qdh)
     }
 }
 
+
+size_t
+lsquic_qdh_mem_used (const struct qpack_dec_hdl *qdh)
+{
+    if (!(qdh->qdh_flags & QDH_INITIALIZED))
+        return 0;
+
+    /* The dynamic table is counted at its maximum capacity */
+    return lsquic_frab_list_mem_used(&qdh->qdh_fral)
+                        + qdh->qdh_enpub->enp_settings.es_qpack_dec_max_size;
+}
+
 static lsquic_stream_ctx_t *
 qdh_out_on_new (void *stream_if_ctx, struct lsquic_stream *stream)
 {
@@ -147,6 +147,22 @@ lsquic_qeh_cleanup (struct qpack_enc_hdl *qeh)
     }
 }
 
+
+size_t
+lsquic_qeh_mem_used (const struct qpack_enc_hdl *qeh)
+{
+    size_t size;
+
+    if (!(qeh->qeh_flags & QEH_INITIALIZED))
+        return 0;
+
+    /* The dynamic table is counted at its maximum capacity */
+    size = lsquic_frab_list_mem_used(&qeh->qeh_fral);
+    if (qeh->qeh_flags & QEH_HAVE_SETTINGS)
+        size += qeh->qeh_encoder.qpe_cur_max_capacity;
+    return size;
+}
+
 static lsquic_stream_ctx_t *
 qeh_out_on_new (void *stream_if_ctx, struct lsquic_stream *stream)
 {
@@ -40,6 +40,9 @@ lsquic_qeh_settings (struct qpack_enc_hdl *, unsigned max_table_size,
 void
 lsquic_qeh_cleanup (struct qpack_enc_hdl *);
 
+size_t
+lsquic_qeh_mem_used (const struct qpack_enc_hdl *);
+
 #define lsquic_qeh_has_dec_stream(qeh) ((qeh)->qeh_dec_sm_in != NULL)
 
 enum qwh_status {
@@ -34,7 +34,7 @@
 
 
 void
-lsquic_qlog_create_connection (const lsquic_cid_t* cid,
+lsquic_qlog_create_connection (const lsquic_cid_t* cid, lsquic_time_t now,
                                 const struct sockaddr *local_sa,
                                 const struct sockaddr *peer_sa)
 {
@@ -77,7 +77,7 @@ lsquic_qlog_create_connection (const lsquic_cid_t* cid,
                 "\"srcport\":\"%u\","
                 "\"dstport\":\"%u\""
             "}]",
-            lsquic_time_now(), ip_version, srcip, dstip, srcport, dstport);
+            now, ip_version, srcip, dstip, srcport, dstport);
 }
 
 #define QLOG_FRAME_DICT_PREFIX_COMMA ",{\"frame_type\":\""
@@ -159,24 +159,24 @@ lsquic_qlog_packet_rx (const lsquic_cid_t* cid,
 
 
 void
-lsquic_qlog_hsk_completed (const lsquic_cid_t* cid)
+lsquic_qlog_hsk_completed (const lsquic_cid_t* cid, lsquic_time_t now)
 {
     LCID("[%" PRIu64 ",\"CONNECTIVITY\",\"HANDSHAKE\",\"PACKET_RX\","
-            "{\"status\":\"complete\"}]", lsquic_time_now());
+            "{\"status\":\"complete\"}]", now);
 }
 
 
 void
-lsquic_qlog_zero_rtt (const lsquic_cid_t* cid)
+lsquic_qlog_zero_rtt (const lsquic_cid_t* cid, lsquic_time_t now)
 {
     LCID("[%" PRIu64 ",\"RECOVERY\",\"RTT_UPDATE\",\"PACKET_RX\","
-            "{\"zero_rtt\":\"successful\"}]", lsquic_time_now());
+            "{\"zero_rtt\":\"successful\"}]", now);
 }
 
 
 void
-lsquic_qlog_check_certs (const lsquic_cid_t* cid, const lsquic_str_t **certs,
-                                                                size_t count)
+lsquic_qlog_check_certs (const lsquic_cid_t* cid, lsquic_time_t now,
+                                    const lsquic_str_t **certs, size_t count)
 {
     size_t i;
     size_t buf_sz = 0;
@@ -196,7 +196,7 @@ lsquic_qlog_check_certs (const lsquic_cid_t* cid, const lsquic_str_t **certs,
         lsquic_hex_encode(lsquic_str_cstr(certs[i]), lsquic_str_len(certs[i]),
                                                                 buf, buf_sz);
         LCID("[%" PRIu64 ",\"SECURITY\",\"CHECK_CERT\",\"CERTLOG\","
-                "{\"certificate\":\"%s\"}]", lsquic_time_now(), buf);
+                "{\"certificate\":\"%s\"}]", now, buf);
     }
     if (buf)
         free(buf);
@@ -204,7 +204,7 @@ lsquic_qlog_check_certs (const lsquic_cid_t* cid, const lsquic_str_t **certs,
 
 
 void
-lsquic_qlog_version_negotiation (const lsquic_cid_t* cid,
+lsquic_qlog_version_negotiation (const lsquic_cid_t* cid, lsquic_time_t now,
                                         const char *action, const char *ver)
 {
     char *trig;
@@ -218,5 +218,5 @@ lsquic_qlog_version_negotiation (const lsquic_cid_t* cid,
     else
         return;
     LCID("[%" PRIu64 ",\"CONNECTIVITY\",\"VERNEG\",\"%s\","
-            "{\"%s_version\":\"%s\"}]", lsquic_time_now(), trig, action, ver);
+            "{\"%s_version\":\"%s\"}]", now, trig, action, ver);
 }
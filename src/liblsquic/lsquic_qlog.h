@@ -61,9 +61,12 @@ EventData
   EventPacketRX
 */
 
+/* Events other than PACKET_RX are stamped with `now', which callers take
+ * from the engine's clock.
+ */
 void
-lsquic_qlog_create_connection (const lsquic_cid_t *, const struct sockaddr *,
-                                                    const struct sockaddr *);
+lsquic_qlog_create_connection (const lsquic_cid_t *, lsquic_time_t now,
+                        const struct sockaddr *, const struct sockaddr *);
 
 void
 lsquic_qlog_packet_rx (const lsquic_cid_t * cid, const struct lsquic_packet_in *,
@@ -75,15 +78,17 @@ lsquic_qlog_packet_rx (const lsquic_cid_t * cid, const struct lsquic_packet_in *
 } while (0)
 
 void
-lsquic_qlog_hsk_completed (const lsquic_cid_t *);
+lsquic_qlog_hsk_completed (const lsquic_cid_t *, lsquic_time_t now);
 
 void
-lsquic_qlog_zero_rtt (const lsquic_cid_t *);
+lsquic_qlog_zero_rtt (const lsquic_cid_t *, lsquic_time_t now);
 
 void
-lsquic_qlog_check_certs (const lsquic_cid_t *, const lsquic_str_t **, size_t);
+lsquic_qlog_check_certs (const lsquic_cid_t *, lsquic_time_t now,
+                                            const lsquic_str_t **, size_t);
 
 void
-lsquic_qlog_version_negotiation (const lsquic_cid_t *, const char *, const char *);
+lsquic_qlog_version_negotiation (const lsquic_cid_t *, lsquic_time_t now,
+                                                const char *, const char *);
 
 #endif
@@ -1419,7 +1419,7 @@ lsquic_send_ctl_sanity_check (const lsquic_send_ctl_t *ctl)
     if (lsquic_alarmset_is_set(ctl->sc_alset, AL_RETX_APP))
     {
         assert(send_ctl_first_unacked_retx_packet(ctl, PNS_APP));
-        assert(lsquic_time_now()
+        assert(lsquic_enpub_tick_time(ctl->sc_enpub)
                     < ctl->sc_alset->as_expiry[AL_RETX_APP] + MAX_RTO_DELAY);
     }
 
@@ -2814,3 +2814,18 @@ lsquic_send_ctl_return_enc_data (struct lsquic_send_ctl *ctl)
         if (packet_out->po_flags & PO_ENCRYPTED)
             send_ctl_return_enc_data(ctl, packet_out);
 }
+
+
+int
+lsquic_send_ctl_is_empty (const struct lsquic_send_ctl *ctl)
+{
+    enum packnum_space pns;
+
+    for (pns = 0; pns < N_PNS; ++pns)
+        if (!TAILQ_EMPTY(&ctl->sc_unacked_packets[pns]))
+            return 0;
+
+    return TAILQ_EMPTY(&ctl->sc_scheduled_packets)
+        && TAILQ_EMPTY(&ctl->sc_lost_packets)
+        && !lsquic_send_ctl_has_buffered(ctl);
+}
@@ -287,6 +287,12 @@ lsquic_send_ctl_schedule_buffered (lsquic_send_ctl_t *, enum buf_packet_type);
 #define lsquic_send_ctl_has_buffered_high(ctl) (                            \
     !TAILQ_EMPTY(&(ctl)->sc_buffered_packets[BPT_HIGHEST_PRIO].bpq_packets))
 
+/* Returns true if there are no packets in any queue: nothing is scheduled,
+ * buffered, lost, or waiting to be acknowledged.
+ */
+int
+lsquic_send_ctl_is_empty (const struct lsquic_send_ctl *);
+
 #define lsquic_send_ctl_invalidate_bpt_cache(ctl) do {      \
     (ctl)->sc_cached_bpt.stream_id = UINT64_MAX;            \
 } while (0)
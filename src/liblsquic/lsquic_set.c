@@ -369,3 +369,36 @@ lsquic_set64_has (const struct lsquic_set64 *set, uint64_t value)
 }
 
 
+int
+lsquic_set64_n_ranges (const struct lsquic_set64 *set)
+{
+    return set->n_elems;
+}
+
+
+void
+lsquic_set64_get_range (const struct lsquic_set64 *set, int idx,
+                                        uint64_t *low, uint64_t *high)
+{
+    assert(idx >= 0 && idx < set->n_elems);
+    *low = set->elems[idx].low;
+    *high = set->elems[idx].high;
+}
+
+
+int
+lsquic_set64_append_range (struct lsquic_set64 *set, uint64_t low,
+                                                            uint64_t high)
+{
+    if (low < 64 || low > high
+        || (set->n_elems > 0 && set->elems[set->n_elems - 1].high + 1 >= low))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (0 != lsquic_set64_insert_set_elem(set, set->n_elems, low))
+        return -1;
+    set->elems[set->n_elems - 1].high = high;
+    return 0;
+}
@@ -53,4 +53,19 @@ lsquic_set64_add (struct lsquic_set64 *, uint64_t value);
 int
 lsquic_set64_has (const struct lsquic_set64 *, uint64_t value);
 
+/* Values 64 and larger are stored as ranges.  The following three functions
+ * are used to save and restore the set: copy `lowset' and the ranges.
+ */
+int
+lsquic_set64_n_ranges (const struct lsquic_set64 *);
+
+void
+lsquic_set64_get_range (const struct lsquic_set64 *, int idx,
+                                        uint64_t *low, uint64_t *high);
+
+/* Ranges must be appended in order and must not touch */
+int
+lsquic_set64_append_range (struct lsquic_set64 *, uint64_t low,
+                                                            uint64_t high);
+
 #endif
@@ -38,7 +38,11 @@ lsquic_sfcw_init (struct lsquic_sfcw *fc, unsigned max_recv_window,
     fc->sf_cfcw = cfcw;
     fc->sf_conn_pub = cpub;
     fc->sf_stream_id = stream_id;
-    (void) lsquic_sfcw_fc_offsets_changed(fc);
+    /* The initial window has been advertised already: it is not subject
+     * to the memory budget.
+     */
+    fc->sf_recv_off = max_recv_window;
+    fc->sf_last_updated = lsquic_enpub_tick_time(cpub->enpub);
 }
 
 
@@ -90,6 +94,41 @@ sfcw_maybe_increase_max_window (struct lsquic_sfcw *fc)
 }
 
 
+/* See cfcw_offsets_changed_tight() */
+static int
+sfcw_offsets_changed_tight (struct lsquic_sfcw *fc)
+{
+    uint64_t recv_off;
+
+    if (fc->sf_max_recv_off > fc->sf_read_off)
+    {
+        LSQ_DEBUG("memory is tight, hold off update while %"PRIu64" bytes "
+            "are unread", fc->sf_max_recv_off - fc->sf_read_off);
+        return 0;
+    }
+
+    if (fc->sf_max_recv_win / 2 >= LSQUIC_MIN_FCW)
+    {
+        LSQ_DEBUG("memory is tight, max window decrease %u -> %u",
+                                fc->sf_max_recv_win, fc->sf_max_recv_win / 2);
+        EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID,
+            "max SFCW decrease %u -> %u", fc->sf_max_recv_win,
+                                                    fc->sf_max_recv_win / 2);
+        fc->sf_max_recv_win /= 2;
+    }
+
+    recv_off = fc->sf_read_off + fc->sf_max_recv_win;
+    if (recv_off <= fc->sf_recv_off)
+        return 0;
+
+    fc->sf_last_updated = lsquic_enpub_tick_time(fc->sf_conn_pub->enpub);
+    fc->sf_recv_off = recv_off;
+    LSQ_DEBUG("recv_off changed: read_off: %"PRIu64"; "
+        "recv_off: %"PRIu64, fc->sf_read_off, fc->sf_recv_off);
+    return 1;
+}
+
+
 int
 lsquic_sfcw_fc_offsets_changed (struct lsquic_sfcw *fc)
 {
@@ -102,7 +141,11 @@ lsquic_sfcw_fc_offsets_changed (struct lsquic_sfcw *fc)
         return 0;
     }
 
-    now = lsquic_time_now();
+    /* Streams outside of connection flow control carry handshake data */
+    if (fc->sf_cfcw && lsquic_enpub_mem_tight(fc->sf_conn_pub->enpub))
+        return sfcw_offsets_changed_tight(fc);
+
+    now = lsquic_enpub_tick_time(fc->sf_conn_pub->enpub);
     since_last_update = now - fc->sf_last_updated;
     fc->sf_last_updated = now;
 
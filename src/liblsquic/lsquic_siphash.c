@@ -0,0 +1,88 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_siphash.c -- SipHash-1-3
+ *
+ * See "SipHash: a fast short-input PRF" by Aumasson and Bernstein.  We use
+ * one compression round and three finalization rounds; this is the variant
+ * used for hash tables by CPython and Rust.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lsquic_siphash.h"
+
+#ifndef SIPHASH_C_ROUNDS
+#define SIPHASH_C_ROUNDS 1
+#endif
+#ifndef SIPHASH_D_ROUNDS
+#define SIPHASH_D_ROUNDS 3
+#endif
+
+#define ROTL(x, b) (uint64_t) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND do {                                                       \
+    v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32);               \
+    v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;                                  \
+    v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;                                  \
+    v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32);               \
+} while (0)
+
+
+static uint64_t
+read_le64 (const unsigned char *p)
+{
+    return (uint64_t) p[0]       | (uint64_t) p[1] <<  8
+         | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24
+         | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40
+         | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+}
+
+
+uint64_t
+lsquic_siphash13 (const unsigned char *key, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    const unsigned char *const end = p + (len & ~(size_t) 7);
+    uint64_t k0, k1, v0, v1, v2, v3, m, b;
+    unsigned i;
+
+    k0 = read_le64(key);
+    k1 = read_le64(key + 8);
+    v0 = 0x736f6d6570736575ULL ^ k0;
+    v1 = 0x646f72616e646f6dULL ^ k1;
+    v2 = 0x6c7967656e657261ULL ^ k0;
+    v3 = 0x7465646279746573ULL ^ k1;
+
+    for ( ; p < end; p += 8)
+    {
+        m = read_le64(p);
+        v3 ^= m;
+        for (i = 0; i < SIPHASH_C_ROUNDS; ++i)
+            SIPROUND;
+        v0 ^= m;
+    }
+
+    b = (uint64_t) len << 56;
+    switch (len & 7)
+    {
+    case 7: b |= (uint64_t) p[6] << 48;     /* fall through */
+    case 6: b |= (uint64_t) p[5] << 40;     /* fall through */
+    case 5: b |= (uint64_t) p[4] << 32;     /* fall through */
+    case 4: b |= (uint64_t) p[3] << 24;     /* fall through */
+    case 3: b |= (uint64_t) p[2] << 16;     /* fall through */
+    case 2: b |= (uint64_t) p[1] <<  8;     /* fall through */
+    case 1: b |= (uint64_t) p[0];
+    }
+
+    v3 ^= b;
+    for (i = 0; i < SIPHASH_C_ROUNDS; ++i)
+        SIPROUND;
+    v0 ^= b;
+
+    v2 ^= 0xFF;
+    for (i = 0; i < SIPHASH_D_ROUNDS; ++i)
+        SIPROUND;
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
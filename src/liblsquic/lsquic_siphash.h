@@ -0,0 +1,17 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_siphash.h -- SipHash-1-3
+ *
+ * Keyed hash used for hash tables whose keys are chosen by the peer.  As
+ * long as the key is secret, the peer cannot pick keys that collide.
+ */
+
+#ifndef LSQUIC_SIPHASH_H
+#define LSQUIC_SIPHASH_H 1
+
+#define LSQUIC_SIPHASH_KEY_SZ 16
+
+uint64_t
+lsquic_siphash13 (const unsigned char *key, const void *data, size_t len);
+
+#endif
@@ -365,6 +365,7 @@ stream_new_common (lsquic_stream_id_t id, struct lsquic_conn_public *conn_pub,
     stream->sm_write_avail = stream_write_avail_no_frames;
 
     STAILQ_INIT(&stream->sm_hq_frames);
+    STAILQ_INIT(&stream->sm_refs);
 
     stream->sm_bflags |= ctor_flags & ((1 << (N_SMBF_FLAGS - 1)) - 1);
     if (conn_pub->lconn->cn_flags & LSCONN_SERVER)
@@ -519,12 +520,43 @@ maybe_resize_stream_buffer (struct lsquic_stream *stream)
 }
 
 
+/* Data written using lsquic_stream_write_ref() */
+struct stream_ref
+{
+    STAILQ_ENTRY(stream_ref)    sr_next;
+    struct iovec               *sr_iov,     /* Current iovec */
+                               *sr_end;
+    size_t                      sr_iov_off; /* Offset into current iovec */
+    void                      (*sr_release)(void *);
+    void                       *sr_ctx;
+    /* The iovec array follows the struct */
+};
+
+
+static void
+release_stream_ref (struct lsquic_stream *stream, struct stream_ref *ref)
+{
+    LSQ_DEBUG("release data written by reference");
+    if (ref->sr_release)
+        ref->sr_release(ref->sr_ctx);
+    free(ref);
+}
+
+
 static void
 drop_buffered_data (struct lsquic_stream *stream)
 {
+    struct stream_ref *ref;
+
     decr_conn_cap(stream, stream->sm_n_buffered);
     stream->sm_n_buffered = 0;
     maybe_resize_stream_buffer(stream);
+    while ((ref = STAILQ_FIRST(&stream->sm_refs)))
+    {
+        STAILQ_REMOVE_HEAD(&stream->sm_refs, sr_next);
+        release_stream_ref(stream, ref);
+    }
+    stream->sm_n_ref_bytes = 0;
     if (stream->sm_qflags & SMQF_WRITE_Q_FLAGS)
         maybe_remove_from_write_q(stream, SMQF_WRITE_Q_FLAGS);
 }
@@ -1562,7 +1594,7 @@ stream_shutdown_write (lsquic_stream_t *stream)
             LSQ_DEBUG("headers not sent, send a reset");
             lsquic_stream_reset(stream, 0);
         }
-        else if (stream->sm_n_buffered == 0)
+        else if (!lsquic_stream_has_data_to_flush(stream))
         {
             if (0 == lsquic_send_ctl_turn_on_fin(stream->conn_pub->send_ctl,
                                                  stream))
@@ -2143,7 +2175,7 @@ stream_flush (lsquic_stream_t *stream)
     ssize_t nw;
 
     assert(stream->sm_qflags & SMQF_WANT_FLUSH);
-    assert(stream->sm_n_buffered > 0 ||
+    assert(lsquic_stream_has_data_to_flush(stream) ||
         /* Flushing is also used to packetize standalone FIN: */
         ((stream->stream_flags & (STREAM_U_WRITE_DONE|STREAM_FIN_SENT))
                                                     == STREAM_U_WRITE_DONE));
@@ -2188,7 +2220,7 @@ lsquic_stream_flush (lsquic_stream_t *stream)
         return -1;
     }
 
-    if (0 == stream->sm_n_buffered)
+    if (!lsquic_stream_has_data_to_flush(stream))
     {
         LSQ_DEBUG("flushing 0 bytes: noop");
         return 0;
@@ -2296,7 +2328,8 @@ frame_std_gen_size (void *ctx)
     size_t available, remaining;
 
     /* Make sure we are not writing past available size: */
-    remaining = fg_ctx->fgc_reader->lsqr_size(fg_ctx->fgc_reader->lsqr_ctx);
+    remaining = fg_ctx->fgc_stream->sm_n_ref_bytes
+              + fg_ctx->fgc_reader->lsqr_size(fg_ctx->fgc_reader->lsqr_ctx);
     available = lsquic_stream_write_avail(fg_ctx->fgc_stream);
     if (available < remaining)
         remaining = available;
@@ -2409,7 +2442,8 @@ frame_hq_gen_size (void *ctx)
             frames += stream_hq_frame_size(shf);
 
     /* Make sure we are not writing past available size: */
-    remaining = fg_ctx->fgc_reader->lsqr_size(fg_ctx->fgc_reader->lsqr_ctx);
+    remaining = stream->sm_n_ref_bytes
+              + fg_ctx->fgc_reader->lsqr_size(fg_ctx->fgc_reader->lsqr_ctx);
     available = lsquic_stream_write_avail(stream);
     if (available < remaining)
         remaining = available;
@@ -2425,6 +2459,7 @@ frame_std_gen_fin (void *ctx)
     return !(fg_ctx->fgc_stream->sm_bflags & SMBF_CRYPTO)
         && (fg_ctx->fgc_stream->stream_flags & STREAM_U_WRITE_DONE)
         && 0 == fg_ctx->fgc_stream->sm_n_buffered
+        && 0 == fg_ctx->fgc_stream->sm_n_ref_bytes
         /* Do not use frame_std_gen_size() as it may chop the real size: */
         && 0 == fg_ctx->fgc_reader->lsqr_size(fg_ctx->fgc_reader->lsqr_ctx);
 }
@@ -2451,6 +2486,48 @@ incr_sm_payload (struct lsquic_stream *stream, size_t incr)
 }
 
 
+/* Copy data written by reference into the packet, releasing references
+ * that have been used up.
+ */
+static size_t
+read_from_stream_refs (struct lsquic_stream *stream, unsigned char *buf,
+                                                                size_t count)
+{
+    struct stream_ref *ref;
+    unsigned char *p = buf;
+    unsigned char *const end = p + count;
+    size_t n_tocopy;
+
+    while (p < end && (ref = STAILQ_FIRST(&stream->sm_refs)))
+    {
+        while (ref->sr_iov < ref->sr_end && p < end)
+        {
+            n_tocopy = ref->sr_iov->iov_len - ref->sr_iov_off;
+            if (n_tocopy > (size_t) (end - p))
+                n_tocopy = end - p;
+            memcpy(p, (unsigned char *) ref->sr_iov->iov_base
+                                                + ref->sr_iov_off, n_tocopy);
+            p += n_tocopy;
+            ref->sr_iov_off += n_tocopy;
+            if (ref->sr_iov->iov_len == ref->sr_iov_off)
+            {
+                ++ref->sr_iov;
+                ref->sr_iov_off = 0;
+            }
+        }
+        if (ref->sr_iov == ref->sr_end)
+        {
+            STAILQ_REMOVE_HEAD(&stream->sm_refs, sr_next);
+            release_stream_ref(stream, ref);
+        }
+    }
+
+    assert(stream->sm_n_ref_bytes >= (size_t) (p - buf));
+    stream->sm_n_ref_bytes -= p - buf;
+    return p - buf;
+}
+
+
 static size_t
 frame_std_gen_read (void *ctx, void *begin_buf, size_t len, int *fin)
 {
@@ -2458,7 +2535,7 @@ frame_std_gen_read (void *ctx, void *begin_buf, size_t len, int *fin)
     unsigned char *p = begin_buf;
     unsigned char *const end = p + len;
     lsquic_stream_t *const stream = fg_ctx->fgc_stream;
-    size_t n_written, available, n_to_write;
+    size_t n_written, available, n_to_write, n_refs;
 
     if (stream->sm_n_buffered > 0)
     {
@@ -2485,13 +2562,17 @@ frame_std_gen_read (void *ctx, void *begin_buf, size_t len, int *fin)
     n_to_write = end - p;
     if (n_to_write > available)
         n_to_write = available;
+    /* Data written by reference precedes data in the reader: */
+    n_refs = read_from_stream_refs(stream, p, n_to_write);
+    p += n_refs;
+    n_to_write -= n_refs;
     n_written = fg_ctx->fgc_reader->lsqr_read(fg_ctx->fgc_reader->lsqr_ctx, p,
                                               n_to_write);
     p += n_written;
     fg_ctx->fgc_nread_from_reader += n_written;
     *fin = fg_ctx->fgc_fin(fg_ctx);
     incr_sm_payload(stream, p - (const unsigned char *) begin_buf);
-    incr_conn_cap(stream, n_written);
+    incr_conn_cap(stream, n_refs + n_written);
     return p - (const unsigned char *) begin_buf;
 }
 
@@ -2655,7 +2736,8 @@ frame_hq_gen_read (void *ctx, void *begin_buf, size_t len, int *fin)
         }
         else
         {
-            avail = stream->sm_n_buffered + stream->sm_write_avail(stream);
+            avail = stream->sm_n_buffered + stream->sm_n_ref_bytes
+                                        + stream->sm_write_avail(stream);
             len = stream_hq_frame_end(shf) - stream->sm_payload;
             assert(len);
             if (len > (unsigned) (end - p))
@@ -2690,7 +2772,8 @@ static void
 check_flush_threshold (lsquic_stream_t *stream)
 {
     if ((stream->sm_qflags & SMQF_WANT_FLUSH) &&
-                            stream->tosend_off >= stream->sm_flush_to)
+                            stream->tosend_off >= stream->sm_flush_to
+                                        && STAILQ_EMPTY(&stream->sm_refs))
     {
         LSQ_DEBUG("flushed to or past required offset %"PRIu64,
                                                     stream->sm_flush_to);
@@ -3236,6 +3319,10 @@ stream_write (lsquic_stream_t *stream, struct lsquic_reader *reader)
     if (len == 0)
         return 0;
 
+    /* Buffering would place new data ahead of data written by reference */
+    if (!STAILQ_EMPTY(&stream->sm_refs))
+        return stream_write_to_packets(stream, reader, 0);
+
     frames = 0;
     if ((stream->sm_bflags & (SMBF_IETF|SMBF_USE_HEADERS))
                                         == (SMBF_IETF|SMBF_USE_HEADERS))
@@ -3356,6 +3443,76 @@ lsquic_stream_writef (lsquic_stream_t *stream, struct lsquic_reader *reader)
 }
 
 
+/* Returns 1 if the stream can be written to */
+static ssize_t
+stream_write_ref_check (struct lsquic_stream *stream)
+{
+    COMMON_WRITE_CHECKS();
+    return 1;
+}
+
+
+ssize_t
+lsquic_stream_write_ref (lsquic_stream_t *stream, const struct iovec *iov,
+                int iovcnt, void (*release)(void *), void *release_ctx)
+{
+    struct stream_ref *ref;
+    struct iovec *dst;
+    ssize_t nw;
+    size_t len;
+    int i;
+
+    nw = stream_write_ref_check(stream);
+    if (nw <= 0)
+    {
+        if (release)
+            release(release_ctx);
+        return nw;
+    }
+    SM_HISTORY_APPEND(stream, SHE_USER_WRITE_DATA);
+
+    ref = malloc(sizeof(*ref) + (iovcnt > 0 ? iovcnt : 0) * sizeof(iov[0]));
+    if (!ref)
+    {
+        if (release)
+            release(release_ctx);
+        return -1;
+    }
+
+    /* Skip empty iovecs so that the reference is released as soon as its
+     * last byte is packetized.
+     */
+    len = 0;
+    dst = (struct iovec *) (ref + 1);
+    for (i = 0; i < iovcnt; ++i)
+        if (iov[i].iov_len)
+        {
+            *dst++ = iov[i];
+            len += iov[i].iov_len;
+        }
+
+    ref->sr_iov = (struct iovec *) (ref + 1);
+    ref->sr_end = dst;
+    ref->sr_iov_off = 0;
+    ref->sr_release = release;
+    ref->sr_ctx = release_ctx;
+
+    if (len == 0)
+    {
+        release_stream_ref(stream, ref);
+        return 0;
+    }
+
+    STAILQ_INSERT_TAIL(&stream->sm_refs, ref, sr_next);
+    stream->sm_n_ref_bytes += len;
+    LSQ_DEBUG("wrote %zu bytes by reference", len);
+
+    if (0 != stream_flush_nocheck(stream))
+        return -1;
+    return len;
+}
+
+
 /* This bypasses COMMON_WRITE_CHECKS */
 static ssize_t
 stream_write_buf (struct lsquic_stream *stream, const void *buf, size_t sz)
@@ -3922,16 +4079,25 @@ lsquic_stream_mem_used (const struct lsquic_stream *stream)
 {
     size_t size;
 
-    size = sizeof(stream);
+    size = sizeof(*stream);
     if (stream->sm_buf)
         size += stream->sm_n_allocated;
-    if (stream->data_in)
-        size += stream->data_in->di_if->di_mem_used(stream->data_in);
+    size += lsquic_stream_data_in_mem_used(stream);
 
     return size;
 }
 
 
+size_t
+lsquic_stream_data_in_mem_used (const struct lsquic_stream *stream)
+{
+    if (stream->data_in)
+        return stream->data_in->di_if->di_mem_used(stream->data_in);
+    else
+        return 0;
+}
+
+
 const lsquic_cid_t *
 lsquic_stream_cid (const struct lsquic_stream *stream)
 {
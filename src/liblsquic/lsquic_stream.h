@@ -19,6 +19,7 @@ struct frame_gen_ctx;
 struct data_frame;
 enum quic_frame_type;
 struct push_promise;
+struct stream_ref;
 
 TAILQ_HEAD(lsquic_streams_tailq, lsquic_stream);
 
@@ -259,6 +260,12 @@ struct lsquic_stream
     /* List of active HQ frames */
     STAILQ_HEAD(, stream_hq_frame)  sm_hq_frames;
 
+    /* Data written by reference that has not been packetized yet.  It
+     * follows data in sm_buf.
+     */
+    STAILQ_HEAD(, stream_ref)       sm_refs;
+    size_t                          sm_n_ref_bytes;
+
     /* For efficiency, several frames are allocated as part of the stream
      * itself.  If more frames are needed, they are allocated.
      */
@@ -510,10 +517,15 @@ lsquic_stream_is_critical (const struct lsquic_stream *);
 size_t
 lsquic_stream_mem_used (const struct lsquic_stream *);
 
+/* Part of the above used by incoming data */
+size_t
+lsquic_stream_data_in_mem_used (const struct lsquic_stream *);
+
 const lsquic_cid_t *
 lsquic_stream_cid (const struct lsquic_stream *);
 
-#define lsquic_stream_has_data_to_flush(stream) ((stream)->sm_n_buffered > 0)
+#define lsquic_stream_has_data_to_flush(stream) ((stream)->sm_n_buffered > 0 \
+                                        || !STAILQ_EMPTY(&(stream)->sm_refs))
 
 int
 lsquic_stream_readable (struct lsquic_stream *);
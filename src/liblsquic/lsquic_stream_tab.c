@@ -0,0 +1,130 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_stream_tab.c -- Index of streams by stream ID
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic.h"
+#include "lsquic_stream_tab.h"
+
+
+static int
+stw_resize (struct stream_tab_window *win, unsigned cap)
+{
+    struct lsquic_stream **slots;
+    uint64_t idx;
+
+    slots = calloc(cap, sizeof(slots[0]));
+    if (!slots)
+        return -1;
+
+    for (idx = win->stw_base; idx < win->stw_base + win->stw_cap; ++idx)
+        slots[idx & (cap - 1)] = win->stw_slots[idx & (win->stw_cap - 1)];
+    free(win->stw_slots);
+    win->stw_slots = slots;
+    win->stw_cap = cap;
+    return 0;
+}
+
+
+/* Returns true if streams with indexes below `new_base' are in window */
+static int
+stw_has_streams_below (const struct stream_tab_window *win, uint64_t new_base)
+{
+    uint64_t idx, end;
+
+    end = win->stw_base + win->stw_cap;
+    if (new_base < end)
+        end = new_base;
+    for (idx = win->stw_base; idx < end; ++idx)
+        if (win->stw_slots[idx & (win->stw_cap - 1)])
+            return 1;
+    return 0;
+}
+
+
+static void
+stw_slide (struct stream_tab_window *win, uint64_t new_base)
+{
+    uint64_t idx, end;
+
+    end = win->stw_base + win->stw_cap;
+    if (new_base < end)
+        end = new_base;
+    for (idx = win->stw_base; idx < end; ++idx)
+        win->stw_slots[idx & (win->stw_cap - 1)] = NULL;
+    win->stw_base = new_base;
+}
+
+
+void
+lsquic_stab_insert (struct stream_tab *tab, lsquic_stream_id_t id,
+                                                struct lsquic_stream *stream)
+{
+    struct stream_tab_window *const win = STAB_WINDOW(tab, id);
+    const uint64_t idx = STAB_INDEX(id);
+
+    if (idx < win->stw_base)
+        return;
+
+    if (win->stw_cap == 0)
+    {
+        if (0 != stw_resize(win, STAB_MIN_WINDOW))
+        {
+            /* Keep all streams of this type in the hash from now on: a
+             * window created later could cover streams added meanwhile.
+             */
+            win->stw_base = UINT64_MAX;
+            return;
+        }
+        win->stw_base = idx & ~(uint64_t) (STAB_MIN_WINDOW - 1);
+    }
+
+    while (idx - win->stw_base >= win->stw_cap)
+        if (!(win->stw_cap < STAB_MAX_WINDOW
+                && stw_has_streams_below(win, idx - win->stw_cap + 1)
+                && 0 == stw_resize(win, win->stw_cap * 2)))
+            stw_slide(win, idx - win->stw_cap + 1);
+
+    assert(!win->stw_slots[idx & (win->stw_cap - 1)]);
+    win->stw_slots[idx & (win->stw_cap - 1)] = stream;
+}
+
+
+void
+lsquic_stab_remove (struct stream_tab *tab, lsquic_stream_id_t id)
+{
+    struct stream_tab_window *const win = STAB_WINDOW(tab, id);
+
+    if (STAB_INDEX(id) - win->stw_base < win->stw_cap)
+        win->stw_slots[STAB_INDEX(id) & (win->stw_cap - 1)] = NULL;
+}
+
+
+void
+lsquic_stab_cleanup (struct stream_tab *tab)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(tab->st_windows) / sizeof(tab->st_windows[0]); ++i)
+        free(tab->st_windows[i].stw_slots);
+    memset(tab, 0, sizeof(*tab));
+}
+
+
+size_t
+lsquic_stab_mem_used (const struct stream_tab *tab)
+{
+    size_t size;
+    unsigned i;
+
+    size = 0;
+    for (i = 0; i < sizeof(tab->st_windows) / sizeof(tab->st_windows[0]); ++i)
+        size += tab->st_windows[i].stw_cap
+                                * sizeof(tab->st_windows[i].stw_slots[0]);
+    return size;
+}
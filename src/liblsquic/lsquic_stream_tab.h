@@ -0,0 +1,81 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_stream_tab.h -- Index of streams by stream ID
+ *
+ * Stream IDs of each type -- the two low bits of the ID -- are allocated
+ * in order, so streams open at the same time tend to have IDs that are
+ * close together.  The stream table keeps a window of stream pointers for
+ * each type.  Within the window, looking up a stream is a single array
+ * access.
+ *
+ * The window slides forward as streams with higher IDs are added.  If
+ * sliding would push out streams that are still open, the window doubles
+ * instead, up to STAB_MAX_WINDOW.  Streams below the window are not in
+ * the table.
+ *
+ * The table is an index and not a container: the connection's all_streams
+ * hash still contains all streams.  Lookups that fall outside the window
+ * use the hash.
+ *
+ * A zeroed struct stream_tab is a valid empty table.
+ */
+
+#ifndef LSQUIC_STREAM_TAB_H
+#define LSQUIC_STREAM_TAB_H 1
+
+struct lsquic_stream;
+
+#define STAB_MIN_WINDOW 16
+#define STAB_MAX_WINDOW 4096
+
+struct stream_tab_window
+{
+    struct lsquic_stream  **stw_slots;  /* Ring of stw_cap elements */
+    uint64_t                stw_base;   /* Lowest index in the window */
+    unsigned                stw_cap;    /* Zero or a power of two */
+};
+
+struct stream_tab
+{
+    struct stream_tab_window    st_windows[4];  /* One per stream type */
+};
+
+#define STAB_WINDOW(tab, id) (&(tab)->st_windows[(id) & 3])
+#define STAB_INDEX(id) ((id) >> 2)
+
+/* Returns true if `id' falls within the window.  Then, `*stream' is set
+ * to the stream or to NULL if there is no such stream.  If false is
+ * returned, the all_streams hash has to be searched.
+ */
+static inline int
+lsquic_stab_find (const struct stream_tab *tab, lsquic_stream_id_t id,
+                                                struct lsquic_stream **stream)
+{
+    const struct stream_tab_window *const win = STAB_WINDOW(tab, id);
+
+    if (STAB_INDEX(id) - win->stw_base < win->stw_cap)
+    {
+        *stream = win->stw_slots[STAB_INDEX(id) & (win->stw_cap - 1)];
+        return 1;
+    }
+    else
+        return 0;
+}
+
+/* Never fails: if memory cannot be allocated, the stream ends up outside
+ * of the window.
+ */
+void
+lsquic_stab_insert (struct stream_tab *, lsquic_stream_id_t,
+                                                    struct lsquic_stream *);
+
+void
+lsquic_stab_remove (struct stream_tab *, lsquic_stream_id_t);
+
+void
+lsquic_stab_cleanup (struct stream_tab *);
+
+size_t
+lsquic_stab_mem_used (const struct stream_tab *);
+
+#endif
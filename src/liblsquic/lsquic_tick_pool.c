@@ -0,0 +1,322 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_tick_pool.c -- Pool of worker threads that tick connections
+ *
+ * Each thread -- the caller is thread zero -- owns a range of job indexes.
+ * It takes jobs from the front of its range.  When its range is empty, it
+ * steals the back half of another thread's range.  A thread is done when
+ * all ranges are empty.
+ */
+
+#include "lsquic_mt.h"
+
+#if LSQUIC_TICK_THREADS
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_mm.h"
+#include "lsquic_tick_pool.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_ENGINE
+#include "lsquic_logger.h"
+
+
+struct tp_range
+{
+    pthread_mutex_t     tr_lock;
+    unsigned            tr_lo, tr_hi;
+};
+
+
+struct tp_worker
+{
+    struct tick_pool   *tw_pool;
+    unsigned            tw_idx;
+    pthread_t           tw_thread;
+};
+
+
+struct tick_pool
+{
+    pthread_mutex_t     tp_lock;
+    pthread_cond_t      tp_start_cond;  /* Workers wait for a job here */
+    pthread_cond_t      tp_done_cond;   /* Caller waits for workers here */
+    unsigned            tp_n_threads;   /* Including the caller */
+    unsigned            tp_n_started;   /* Workers that have initialized */
+    unsigned            tp_n_failed;    /* Workers that failed to init */
+    unsigned            tp_n_busy;      /* Workers running current batch */
+    unsigned            tp_generation;  /* Incremented for every batch */
+    int                 tp_stop;
+    tick_pool_job_f     tp_job;
+    void               *tp_job_ctx;
+    struct tp_range    *tp_ranges;
+    struct tp_worker   *tp_workers;
+};
+
+
+static int
+tp_take (struct tp_range *range, unsigned *idx)
+{
+    int taken;
+
+    pthread_mutex_lock(&range->tr_lock);
+    taken = range->tr_lo < range->tr_hi;
+    if (taken)
+        *idx = range->tr_lo++;
+    pthread_mutex_unlock(&range->tr_lock);
+    return taken;
+}
+
+
+/* Steal half of the jobs of the first non-empty range, looking at threads
+ * following ours.  The first stolen job is returned in `idx', the rest go
+ * into our own range.
+ */
+static int
+tp_steal (struct tick_pool *pool, unsigned self, unsigned *idx)
+{
+    struct tp_range *victim, *const own = &pool->tp_ranges[self];
+    unsigned i, lo, hi, mid;
+
+    for (i = 1; i < pool->tp_n_threads; ++i)
+    {
+        victim = &pool->tp_ranges[(self + i) % pool->tp_n_threads];
+        pthread_mutex_lock(&victim->tr_lock);
+        lo = victim->tr_lo;
+        hi = victim->tr_hi;
+        if (lo < hi)
+        {
+            mid = lo + (hi - lo) / 2;
+            victim->tr_hi = mid;
+            pthread_mutex_unlock(&victim->tr_lock);
+            if (mid + 1 < hi)
+            {
+                pthread_mutex_lock(&own->tr_lock);
+                own->tr_lo = mid + 1;
+                own->tr_hi = hi;
+                pthread_mutex_unlock(&own->tr_lock);
+            }
+            *idx = mid;
+            return 1;
+        }
+        pthread_mutex_unlock(&victim->tr_lock);
+    }
+
+    return 0;
+}
+
+
+static void
+tp_work (struct tick_pool *pool, unsigned self)
+{
+    unsigned idx;
+
+    while (tp_take(&pool->tp_ranges[self], &idx)
+                                        || tp_steal(pool, self, &idx))
+        pool->tp_job(pool->tp_job_ctx, idx);
+}
+
+
+static void *
+tp_worker_main (void *arg)
+{
+    struct tp_worker *const worker = arg;
+    struct tick_pool *const pool = worker->tw_pool;
+    unsigned generation;
+    int s, stop;
+
+    s = lsquic_mm_thread_init();
+
+    pthread_mutex_lock(&pool->tp_lock);
+    ++pool->tp_n_started;
+    if (s != 0)
+        ++pool->tp_n_failed;
+    generation = pool->tp_generation;
+    pthread_cond_broadcast(&pool->tp_done_cond);
+    pthread_mutex_unlock(&pool->tp_lock);
+    if (s != 0)
+        return NULL;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->tp_lock);
+        while (!pool->tp_stop && generation == pool->tp_generation)
+            pthread_cond_wait(&pool->tp_start_cond, &pool->tp_lock);
+        generation = pool->tp_generation;
+        stop = pool->tp_stop;
+        pthread_mutex_unlock(&pool->tp_lock);
+        if (stop)
+            break;
+
+        tp_work(pool, worker->tw_idx);
+
+        pthread_mutex_lock(&pool->tp_lock);
+        if (0 == --pool->tp_n_busy)
+            pthread_cond_signal(&pool->tp_done_cond);
+        pthread_mutex_unlock(&pool->tp_lock);
+    }
+
+    lsquic_mm_thread_cleanup();
+    return NULL;
+}
+
+
+static void
+tp_stop_workers (struct tick_pool *pool, unsigned n_workers)
+{
+    unsigned i;
+
+    pthread_mutex_lock(&pool->tp_lock);
+    pool->tp_stop = 1;
+    pthread_cond_broadcast(&pool->tp_start_cond);
+    pthread_mutex_unlock(&pool->tp_lock);
+
+    for (i = 0; i < n_workers; ++i)
+        pthread_join(pool->tp_workers[i].tw_thread, NULL);
+}
+
+
+struct tick_pool *
+lsquic_tp_new (unsigned n_threads)
+{
+    struct tick_pool *pool;
+    unsigned i, n_workers;
+    int s;
+
+    if (n_threads < 2)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pool->tp_n_threads = n_threads;
+    pool->tp_ranges = calloc(n_threads, sizeof(pool->tp_ranges[0]));
+    pool->tp_workers = calloc(n_threads - 1, sizeof(pool->tp_workers[0]));
+    if (!(pool->tp_ranges && pool->tp_workers))
+        goto err0;
+
+    for (i = 0; i < n_threads; ++i)
+        pthread_mutex_init(&pool->tp_ranges[i].tr_lock, NULL);
+    pthread_mutex_init(&pool->tp_lock, NULL);
+    pthread_cond_init(&pool->tp_start_cond, NULL);
+    pthread_cond_init(&pool->tp_done_cond, NULL);
+
+    for (n_workers = 0; n_workers < n_threads - 1; ++n_workers)
+    {
+        pool->tp_workers[n_workers].tw_pool = pool;
+        pool->tp_workers[n_workers].tw_idx = n_workers + 1;
+        s = pthread_create(&pool->tp_workers[n_workers].tw_thread, NULL,
+                                tp_worker_main, &pool->tp_workers[n_workers]);
+        if (s != 0)
+        {
+            LSQ_WARN("cannot create worker thread: %s", strerror(s));
+            goto err1;
+        }
+    }
+
+    pthread_mutex_lock(&pool->tp_lock);
+    while (pool->tp_n_started < n_workers)
+        pthread_cond_wait(&pool->tp_done_cond, &pool->tp_lock);
+    s = pool->tp_n_failed;
+    pthread_mutex_unlock(&pool->tp_lock);
+    if (s)
+    {
+        LSQ_WARN("%d worker thread%.*s failed to initialize", s, s != 1, "s");
+        goto err1;
+    }
+
+    LSQ_INFO("created tick pool with %u threads", n_threads);
+    return pool;
+
+  err1:
+    tp_stop_workers(pool, n_workers);
+    for (i = 0; i < n_threads; ++i)
+        pthread_mutex_destroy(&pool->tp_ranges[i].tr_lock);
+    pthread_mutex_destroy(&pool->tp_lock);
+    pthread_cond_destroy(&pool->tp_start_cond);
+    pthread_cond_destroy(&pool->tp_done_cond);
+  err0:
+    free(pool->tp_ranges);
+    free(pool->tp_workers);
+    free(pool);
+    return NULL;
+}
+
+
+unsigned
+lsquic_tp_n_threads (const struct tick_pool *pool)
+{
+    return pool->tp_n_threads;
+}
+
+
+void
+lsquic_tp_run (struct tick_pool *pool, tick_pool_job_f job, void *ctx,
+                                                            unsigned n_jobs)
+{
+    unsigned i, per_thread, extra, lo;
+
+    if (n_jobs == 0)
+        return;
+
+    /* Ranges are not locked: workers are idle and will not look at them
+     * until the generation changes below.
+     */
+    per_thread = n_jobs / pool->tp_n_threads;
+    extra = n_jobs % pool->tp_n_threads;
+    lo = 0;
+    for (i = 0; i < pool->tp_n_threads; ++i)
+    {
+        pool->tp_ranges[i].tr_lo = lo;
+        lo += per_thread + (i < extra);
+        pool->tp_ranges[i].tr_hi = lo;
+    }
+    assert(lo == n_jobs);
+
+    pthread_mutex_lock(&pool->tp_lock);
+    pool->tp_job = job;
+    pool->tp_job_ctx = ctx;
+    pool->tp_n_busy = pool->tp_n_threads - 1;
+    ++pool->tp_generation;
+    pthread_cond_broadcast(&pool->tp_start_cond);
+    pthread_mutex_unlock(&pool->tp_lock);
+
+    tp_work(pool, 0);
+
+    pthread_mutex_lock(&pool->tp_lock);
+    while (pool->tp_n_busy > 0)
+        pthread_cond_wait(&pool->tp_done_cond, &pool->tp_lock);
+    pthread_mutex_unlock(&pool->tp_lock);
+}
+
+
+void
+lsquic_tp_destroy (struct tick_pool *pool)
+{
+    unsigned i;
+
+    tp_stop_workers(pool, pool->tp_n_threads - 1);
+    for (i = 0; i < pool->tp_n_threads; ++i)
+        pthread_mutex_destroy(&pool->tp_ranges[i].tr_lock);
+    pthread_mutex_destroy(&pool->tp_lock);
+    pthread_cond_destroy(&pool->tp_start_cond);
+    pthread_cond_destroy(&pool->tp_done_cond);
+    free(pool->tp_ranges);
+    free(pool->tp_workers);
+    free(pool);
+}
+
+
+#endif
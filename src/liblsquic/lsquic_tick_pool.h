@@ -0,0 +1,35 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_tick_pool.h -- Pool of worker threads that tick connections
+ *
+ * The caller hands the pool a number of jobs, identified by index, and a
+ * function to run on each of them.  The jobs are split evenly between the
+ * threads; a thread that runs out of jobs steals half of the remaining
+ * jobs of another thread.  The calling thread participates in the work.
+ */
+
+#ifndef LSQUIC_TICK_POOL_H
+#define LSQUIC_TICK_POOL_H 1
+
+struct tick_pool;
+
+typedef void (*tick_pool_job_f) (void *ctx, unsigned idx);
+
+/* `n_threads' includes the calling thread.  Returns NULL on failure. */
+struct tick_pool *
+lsquic_tp_new (unsigned n_threads);
+
+unsigned
+lsquic_tp_n_threads (const struct tick_pool *);
+
+/* Run `job' for every index in [0, n_jobs) and return when all jobs are
+ * done.  Jobs may run in any order.
+ */
+void
+lsquic_tp_run (struct tick_pool *, tick_pool_job_f job, void *ctx,
+                                                            unsigned n_jobs);
+
+void
+lsquic_tp_destroy (struct tick_pool *);
+
+#endif
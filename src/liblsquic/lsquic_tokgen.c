@@ -1,5 +1,6 @@
 /* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
 #include <assert.h>
+#include <inttypes.h>
 #include <netinet/in.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -31,7 +32,7 @@
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
 
-#define TOKGEN_VERSION 1
+#define TOKGEN_VERSION 2
 
 #define CRYPTER_KEY_SIZE        16
 #define SRST_MAX_PRK_SIZE       EVP_MAX_MD_SIZE
@@ -56,12 +57,28 @@ struct tokgen_shm_state
 
 static const uint8_t srst_salt[8] = "\x28\x6e\x81\x02\x40\x5b\x2c\x2b";
 
+/* Retry token layout:
+ *
+ *  Nonce (12 bytes): random per-process prefix and a counter
+ *  Encrypted:
+ *      Timestamp (8 bytes, engine time in seconds)
+ *      ODCID length (1 byte)
+ *      ODCID
+ *  AEAD tag (16 bytes)
+ *
+ * The token type and the peer's IP address are authenticated as the
+ * additional data: a token is only good for the address it was sent to.
+ */
+#define RETRY_NONCE_SZ          12
+#define RETRY_NONCE_PREFIX_SZ   (RETRY_NONCE_SZ - sizeof(uint64_t))
+#define RETRY_TAG_SZ            16
+#define RETRY_PLAIN_MIN_SZ      (sizeof(uint64_t) + 1)
+
 struct crypter
 {
     EVP_AEAD_CTX    ctx;
-    unsigned long   nonce_counter;
-    size_t          nonce_prk_sz;
-    uint8_t         nonce_prk_buf[EVP_MAX_MD_SIZE];
+    uint64_t        nonce_counter;
+    uint8_t         nonce_prefix[RETRY_NONCE_PREFIX_SZ];
 };
 
 
@@ -69,6 +86,7 @@ struct token_generator
 {
     /* We encrypt different token types using different keys. */
     struct crypter  tg_crypters[N_TOKEN_TYPES];
+    unsigned        tg_n_crypters;  /* Number of initialized crypters */
 
     /* Stateless reset token is generated using HKDF with CID as the
      * `info' parameter to HKDF-Expand.
@@ -144,6 +162,8 @@ get_or_generate_state (struct lsquic_engine_public *enpub, time_t now,
     {
         srst_ikm.now = now;
         RAND_bytes(srst_ikm.buf, sizeof(srst_ikm.buf));
+        RAND_bytes((uint8_t *) shm_state->tgss_crypter_key,
+                                    sizeof(shm_state->tgss_crypter_key));
     }
     if (!HKDF_extract(shm_state->tgss_srst_prk, &bufsz,
                      EVP_sha256(), (uint8_t *) &srst_ikm, sizeof(srst_ikm),
@@ -199,6 +219,7 @@ lsquic_tg_new (struct lsquic_engine_public *enpub)
 {
     struct token_generator *tokgen;
     time_t now;
+    unsigned i;
     struct tokgen_shm_state shm_state;
 
     tokgen = calloc(1, sizeof(*tokgen));
@@ -219,12 +240,28 @@ lsquic_tg_new (struct lsquic_engine_public *enpub)
     memcpy(tokgen->tg_srst_prk_buf, shm_state.tgss_srst_prk,
                                                     tokgen->tg_srst_prk_sz);
 
+    for (i = 0; i < N_TOKEN_TYPES; ++i)
+    {
+        if (!EVP_AEAD_CTX_init(&tokgen->tg_crypters[i].ctx,
+                    EVP_aead_aes_128_gcm(), shm_state.tgss_crypter_key[i],
+                    CRYPTER_KEY_SIZE, RETRY_TAG_SZ, NULL))
+        {
+            LSQ_WARN("cannot initialize AEAD context");
+            goto err;
+        }
+        /* Processes sharing the key use different nonce prefixes */
+        RAND_bytes(tokgen->tg_crypters[i].nonce_prefix,
+                            sizeof(tokgen->tg_crypters[i].nonce_prefix));
+        ++tokgen->tg_n_crypters;
+    }
+
     LSQ_DEBUG("initialized");
     return tokgen;
 
   err:
     LSQ_ERROR("error initializing");
-    free(tokgen);
+    if (tokgen)
+        lsquic_tg_destroy(tokgen);
     return NULL;
 }
 
@@ -232,6 +269,10 @@ lsquic_tg_new (struct lsquic_engine_public *enpub)
 void
 lsquic_tg_destroy (struct token_generator *tokgen)
 {
+    unsigned i;
+
+    for (i = 0; i < tokgen->tg_n_crypters; ++i)
+        EVP_AEAD_CTX_cleanup(&tokgen->tg_crypters[i].ctx);
     free(tokgen);
     LSQ_DEBUG("destroyed");
 }
@@ -248,3 +289,114 @@ lsquic_tg_generate_sreset (struct token_generator *tokgen,
     LSQ_DEBUGC("generated stateless reset token %s for CID %"CID_FMT,
         HEXSTR(reset_token, IQUIC_SRESET_TOKEN_SZ, str), CID_BITS(cid));
 }
+
+
+/* Additional data: token type followed by the peer IP address */
+static size_t
+retry_ad (unsigned char *buf, enum token_type type,
+                                                const struct sockaddr *sa_peer)
+{
+    buf[0] = type;
+    if (sa_peer->sa_family == AF_INET)
+    {
+        memcpy(buf + 1, &((struct sockaddr_in *) sa_peer)->sin_addr,
+                                                    sizeof(struct in_addr));
+        return 1 + sizeof(struct in_addr);
+    }
+    else
+    {
+        memcpy(buf + 1, &((struct sockaddr_in6 *) sa_peer)->sin6_addr,
+                                                    sizeof(struct in6_addr));
+        return 1 + sizeof(struct in6_addr);
+    }
+}
+
+
+ssize_t
+lsquic_tg_generate_retry (struct token_generator *tokgen,
+        unsigned char *buf, size_t bufsz, const struct lsquic_cid *odcid,
+        const struct sockaddr *sa_peer, lsquic_time_t now)
+{
+    struct crypter *const crypter = &tokgen->tg_crypters[TOKEN_RETRY];
+    unsigned char ad[1 + sizeof(struct in6_addr)];
+    unsigned char plain[RETRY_PLAIN_MIN_SZ + MAX_CID_LEN];
+    uint64_t timestamp;
+    size_t ad_len, out_len;
+
+    if (bufsz < RETRY_NONCE_SZ)
+        return -1;
+
+    memcpy(buf, crypter->nonce_prefix, RETRY_NONCE_PREFIX_SZ);
+    memcpy(buf + RETRY_NONCE_PREFIX_SZ, &crypter->nonce_counter,
+                                            sizeof(crypter->nonce_counter));
+    ++crypter->nonce_counter;
+
+    timestamp = now / 1000000;
+    memcpy(plain, &timestamp, sizeof(timestamp));
+    plain[sizeof(timestamp)] = odcid->len;
+    memcpy(plain + RETRY_PLAIN_MIN_SZ, odcid->idbuf, odcid->len);
+
+    ad_len = retry_ad(ad, TOKEN_RETRY, sa_peer);
+    if (!EVP_AEAD_CTX_seal(&crypter->ctx, buf + RETRY_NONCE_SZ, &out_len,
+            bufsz - RETRY_NONCE_SZ, buf, RETRY_NONCE_SZ, plain,
+            RETRY_PLAIN_MIN_SZ + odcid->len, ad, ad_len))
+    {
+        LSQ_WARN("cannot seal retry token");
+        return -1;
+    }
+
+    LSQ_DEBUGC("generated %zu-byte retry token for ODCID %"CID_FMT,
+                        RETRY_NONCE_SZ + out_len, CID_BITS(odcid));
+    return RETRY_NONCE_SZ + out_len;
+}
+
+
+int
+lsquic_tg_validate_retry (struct token_generator *tokgen,
+        const unsigned char *token, size_t token_sz,
+        const struct sockaddr *sa_peer, struct lsquic_cid *odcid,
+        lsquic_time_t now_usec)
+{
+    struct crypter *const crypter = &tokgen->tg_crypters[TOKEN_RETRY];
+    unsigned char ad[1 + sizeof(struct in6_addr)];
+    unsigned char plain[RETRY_PLAIN_MIN_SZ + MAX_CID_LEN];
+    uint64_t timestamp, now;
+    size_t ad_len, plain_len;
+
+    if (token_sz < RETRY_NONCE_SZ + RETRY_PLAIN_MIN_SZ + RETRY_TAG_SZ
+                                        || token_sz > MAX_RETRY_TOKEN_SZ)
+    {
+        LSQ_DEBUG("retry token has invalid size %zu", token_sz);
+        return -1;
+    }
+
+    ad_len = retry_ad(ad, TOKEN_RETRY, sa_peer);
+    if (!EVP_AEAD_CTX_open(&crypter->ctx, plain, &plain_len, sizeof(plain),
+            token, RETRY_NONCE_SZ, token + RETRY_NONCE_SZ,
+            token_sz - RETRY_NONCE_SZ, ad, ad_len))
+    {
+        LSQ_DEBUG("cannot open retry token");
+        return -1;
+    }
+
+    if (plain_len < RETRY_PLAIN_MIN_SZ
+            || plain[sizeof(timestamp)] != plain_len - RETRY_PLAIN_MIN_SZ)
+    {
+        LSQ_INFO("retry token has invalid contents");
+        return -1;
+    }
+
+    memcpy(&timestamp, plain, sizeof(timestamp));
+    now = now_usec / 1000000;
+    if (timestamp > now || now - timestamp > RETRY_TOKEN_TTL)
+    {
+        LSQ_DEBUG("retry token has expired: issued %"PRIu64"; now %"PRIu64,
+                                                            timestamp, now);
+        return -1;
+    }
+
+    odcid->len = plain[sizeof(timestamp)];
+    memcpy(odcid->idbuf, plain + RETRY_PLAIN_MIN_SZ, odcid->len);
+    LSQ_DEBUGC("validated retry token for ODCID %"CID_FMT, CID_BITS(odcid));
+    return 0;
+}
@@ -9,6 +9,12 @@ struct lsquic_cid;
 
 enum token_type { TOKEN_RETRY, TOKEN_RESUME, N_TOKEN_TYPES, };
 
+/* Nonce, timestamp, ODCID length, ODCID, and AEAD tag */
+#define MAX_RETRY_TOKEN_SZ (12 + 8 + 1 + MAX_CID_LEN + 16)
+
+/* Retry tokens are valid for this many seconds */
+#define RETRY_TOKEN_TTL 10
+
 struct token_generator;
 
 struct token_generator *
@@ -22,4 +28,21 @@ void
 lsquic_tg_generate_sreset (struct token_generator *,
         const struct lsquic_cid *cid, unsigned char *reset_token);
 
+/* Returns size of the token or -1 on error.  The token is timestamped
+ * using `now', the engine time.
+ */
+ssize_t
+lsquic_tg_generate_retry (struct token_generator *,
+        unsigned char *buf, size_t bufsz, const struct lsquic_cid *odcid,
+        const struct sockaddr *sa_peer, lsquic_time_t now);
+
+/* Returns 0 if the token is valid, in which case `odcid' is set to the
+ * original DCID.  Otherwise, -1 is returned.
+ */
+int
+lsquic_tg_validate_retry (struct token_generator *,
+        const unsigned char *token, size_t token_sz,
+        const struct sockaddr *sa_peer, struct lsquic_cid *odcid,
+        lsquic_time_t now);
+
 #endif
@@ -96,6 +96,22 @@ lsquic_time_now (void)
 }
 
 
+lsquic_time_t
+lsquic_time_now_coarse (void)
+{
+#if defined(CLOCK_MONOTONIC_COARSE)
+    struct timespec ts;
+#if LSQUIC_COUNT_TIME_CALLS
+    ++n_time_now_calls;
+#endif
+    (void) clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (lsquic_time_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return lsquic_time_now();
+#endif
+}
+
+
 int
 lsquic_is_zero (const void *pbuf, size_t bufsz)
 {
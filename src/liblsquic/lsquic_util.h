@@ -13,6 +13,13 @@ extern "C" {
 lsquic_time_t
 lsquic_time_now (void);
 
+/* Same as lsquic_time_now(), but cheaper and with resolution of a few
+ * milliseconds.  Falls back to lsquic_time_now() if coarse clock is not
+ * available.
+ */
+lsquic_time_t
+lsquic_time_now_coarse (void);
+
 void
 lsquic_init_timers (void);
 
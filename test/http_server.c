@@ -1160,6 +1160,8 @@ usage (const char *prog)
 "   -w SIZE     Write immediately (LSWS mode).  Argument specifies maximum\n"
 "                 size of the immediate write.\n"
 "   -y DELAY    Delay response for this many seconds -- use for debugging\n"
+"   -E SHARDS   Run this many engines in sharded mode.  Incoming packets\n"
+"                 are steered to engines by connection ID.\n"
             , prog);
 }
 
@@ -1269,7 +1271,7 @@ main (int argc, char **argv)
     prog_init(&prog, LSENG_SERVER|LSENG_HTTP, &server_ctx.sports,
                                             &http_server_if, &server_ctx);
 
-    while (-1 != (opt = getopt(argc, argv, PROG_OPTS "y:Y:n:p:r:w:h")))
+    while (-1 != (opt = getopt(argc, argv, PROG_OPTS "y:Y:n:p:r:w:E:h")))
     {
         switch (opt) {
         case 'n':
@@ -1294,6 +1296,9 @@ main (int argc, char **argv)
         case 'w':
             s_immediate_write = atoi(optarg);
             break;
+        case 'E':
+            prog.prog_n_shards = atoi(optarg);
+            break;
         case 'y':
             server_ctx.delay_resp_sec = atoi(optarg);
             break;
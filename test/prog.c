@@ -168,6 +168,16 @@ prog_print_common_options (const struct prog *prog, FILE *out)
 "   -j          Use recvmmsg() to receive packets.\n"
     );
 #endif
+#if __linux__
+    fprintf(out,
+"   -J          Use UDP GRO to receive packets.\n"
+    );
+#endif
+#if HAVE_LIBURING
+    fprintf(out,
+"   -U          Use io_uring to send and receive packets.\n"
+    );
+#endif
 
     if (prog->prog_engine_flags & LSENG_SERVER)
         fprintf(out,
@@ -239,6 +249,16 @@ prog_set_opt (struct prog *prog, int opt, const char *arg)
     case 'j':
         prog->prog_use_recvmmsg = 1;
         return 0;
+#endif
+#if __linux__
+    case 'J':
+        prog->prog_use_gro = 1;
+        return 0;
+#endif
+#if HAVE_LIBURING
+    case 'U':
+        prog->prog_use_uring = 1;
+        return 0;
 #endif
     case 'm':
         prog->prog_packout_max = atoi(arg);
@@ -438,13 +458,26 @@ prog_init_server (struct prog *prog)
 void
 prog_process_conns (struct prog *prog)
 {
-    int diff;
+    int diff, min_diff, have_diff;
+    unsigned n;
     struct timeval timeout;
 
-    lsquic_engine_process_conns(prog->prog_engine);
+    have_diff = 0;
+    min_diff = 0;
+    for (n = 0; n < prog->prog_n_shards; ++n)
+    {
+        lsquic_engine_process_conns(prog->prog_shards[n]);
+        if (lsquic_engine_earliest_adv_tick(prog->prog_shards[n], &diff)
+                                        && (!have_diff || diff < min_diff))
+        {
+            min_diff = diff;
+            have_diff = 1;
+        }
+    }
 
-    if (lsquic_engine_earliest_adv_tick(prog->prog_engine, &diff))
+    if (have_diff)
     {
+        diff = min_diff;
         if (diff < 0
                 || (unsigned) diff < prog->prog_settings.es_clock_granularity)
         {
@@ -458,7 +491,14 @@ prog_process_conns (struct prog *prog)
         }
 
         if (!prog_is_stopped())
-            event_add(prog->prog_timer, &timeout);
+        {
+#if HAVE_LIBURING
+            if (prog->prog_uring)
+                uring_set_timer(prog->prog_uring, &timeout);
+            else
+#endif
+                event_add(prog->prog_timer, &timeout);
+        }
     }
 }
 
@@ -484,10 +524,12 @@ static void
 prog_usr2_handler (int fd, short what, void *arg)
 {
     struct prog *const prog = arg;
+    unsigned n;
 
     LSQ_NOTICE("Got SIGUSR2, cool down engine");
     prog->prog_flags |= PROG_FLAG_COOLDOWN;
-    lsquic_engine_cooldown(prog->prog_engine);
+    for (n = 0; n < prog->prog_n_shards; ++n)
+        lsquic_engine_cooldown(prog->prog_shards[n]);
 }
 
 
@@ -512,7 +554,20 @@ prog_run (struct prog *prog)
 void
 prog_cleanup (struct prog *prog)
 {
-    lsquic_engine_destroy(prog->prog_engine);
+    unsigned n;
+
+    if (prog->prog_shards)
+    {
+        for (n = 0; n < prog->prog_n_shards; ++n)
+            if (prog->prog_shards[n])
+                lsquic_engine_destroy(prog->prog_shards[n]);
+        if (prog->prog_shards != &prog->prog_engine)
+            free(prog->prog_shards);
+    }
+#if HAVE_LIBURING
+    if (prog->prog_uring)
+        uring_destroy(prog->prog_uring);
+#endif
     event_base_free(prog->prog_eb);
     if (!prog->prog_use_stock_pmi)
         pba_cleanup(&prog->prog_pba);
@@ -543,6 +598,13 @@ prog_stop (struct prog *prog)
         event_free(prog->prog_timer);
         prog->prog_timer = NULL;
     }
+#if HAVE_LIBURING
+    /* The ring itself is freed in prog_cleanup(), as we may be called from
+     * the ring's event handler.
+     */
+    if (prog->prog_uring)
+        uring_stop(prog->prog_uring);
+#endif
     if (prog->prog_usr1)
     {
         event_del(prog->prog_usr1);
@@ -624,6 +686,7 @@ int
 prog_prep (struct prog *prog)
 {
     int s;
+    unsigned n;
     char err_buf[100];
 
     if (prog->prog_keylog_dir)
@@ -632,6 +695,16 @@ prog_prep (struct prog *prog)
         prog->prog_api.ea_keylog_ctx = prog;
     }
 
+    if (prog->prog_n_shards > 1)
+    {
+        if (!(prog->prog_engine_flags & LSENG_SERVER))
+        {
+            LSQ_ERROR("sharded mode is only supported by the server");
+            return -1;
+        }
+        prog->prog_settings.es_n_shards = prog->prog_n_shards;
+    }
+
     if (0 != lsquic_engine_check_settings(prog->prog_api.ea_settings,
                         prog->prog_engine_flags, err_buf, sizeof(err_buf)))
     {
@@ -670,14 +743,51 @@ prog_prep (struct prog *prog)
     }
 
     prog->prog_eb = event_base_new();
-    prog->prog_engine = lsquic_engine_new(prog->prog_engine_flags,
+    if (prog->prog_n_shards > 1)
+    {
+        prog->prog_shards = calloc(prog->prog_n_shards,
+                                            sizeof(prog->prog_shards[0]));
+        if (!prog->prog_shards)
+            return -1;
+        /* Each engine makes a copy of the settings */
+        for (n = 0; n < prog->prog_n_shards; ++n)
+        {
+            prog->prog_settings.es_shard_id = n;
+            prog->prog_shards[n] = lsquic_engine_new(prog->prog_engine_flags,
                                                             &prog->prog_api);
-    if (!prog->prog_engine)
-        return -1;
+            if (!prog->prog_shards[n])
+                return -1;
+        }
+        prog->prog_engine = prog->prog_shards[0];
+        LSQ_NOTICE("running %u engines in sharded mode", prog->prog_n_shards);
+    }
+    else
+    {
+        prog->prog_n_shards = 1;
+        prog->prog_shards = &prog->prog_engine;
+        prog->prog_engine = lsquic_engine_new(prog->prog_engine_flags,
+                                                            &prog->prog_api);
+        if (!prog->prog_engine)
+            return -1;
+    }
 
     prog->prog_timer = event_new(prog->prog_eb, -1, 0,
                                         prog_timer_handler, prog);
 
+#if HAVE_LIBURING
+    if (prog->prog_use_uring)
+    {
+        if (prog->prog_use_gro)
+        {
+            LSQ_ERROR("GRO is not supported by the io_uring driver");
+            return -1;
+        }
+        prog->prog_uring = uring_new(prog);
+        if (!prog->prog_uring)
+            return -1;
+    }
+#endif
+
     if (prog->prog_engine_flags & LSENG_SERVER)
         s = prog_init_server(prog);
     else
@@ -701,12 +811,15 @@ static void
 send_unsent (evutil_socket_t fd, short what, void *arg)
 {
     struct prog *const prog = arg;
+    unsigned n;
+
     assert(prog->prog_send);
     event_del(prog->prog_send);
     event_free(prog->prog_send);
     prog->prog_send = NULL;
     LSQ_DEBUG("on_write event fires");
-    lsquic_engine_send_unsent_packets(prog->prog_engine);
+    for (n = 0; n < prog->prog_n_shards; ++n)
+        lsquic_engine_send_unsent_packets(prog->prog_shards[n]);
 }
 
 
@@ -13,6 +13,7 @@ struct event_base;
 struct lsquic_hash;
 struct sport_head;
 struct ssl_ctx_st;
+struct uring;
 
 struct prog
 {
@@ -30,6 +31,13 @@ struct prog
 #endif
 #if HAVE_RECVMMSG
     int                             prog_use_recvmmsg;
+#endif
+#if __linux__
+    int                             prog_use_gro;
+#endif
+#if HAVE_LIBURING
+    int                             prog_use_uring;
+    struct uring                   *prog_uring;
 #endif
     int                             prog_use_stock_pmi;
     struct event_base              *prog_eb;
@@ -43,6 +51,11 @@ struct prog
     char                           *prog_susp_sni;
     struct sport_head              *prog_sports;
     struct lsquic_engine           *prog_engine;
+    /* In sharded server mode, there is one engine per shard; otherwise,
+     * this points to prog_engine.
+     */
+    struct lsquic_engine          **prog_shards;
+    unsigned                        prog_n_shards;
     const char                     *prog_hostname;
     int                             prog_ipver;     /* 0, 4, or 6 */
     const char                     *prog_keylog_dir;
@@ -69,6 +82,18 @@ prog_init (struct prog *, unsigned lsquic_engine_flags, struct sport_head *,
 #   define RECVMMSG_FLAG ""
 #endif
 
+#if __linux__
+#   define GRO_FLAG "J"
+#else
+#   define GRO_FLAG ""
+#endif
+
+#if HAVE_LIBURING
+#   define URING_FLAG "U"
+#else
+#   define URING_FLAG ""
+#endif
+
 #if LSQUIC_DONTFRAG_SUPPORTED
 #   define IP_DONTFRAG_FLAG "D"
 #else
@@ -76,7 +101,7 @@ prog_init (struct prog *, unsigned lsquic_engine_flags, struct sport_head *,
 #endif
 
 #define PROG_OPTS "i:km:c:y:L:l:o:H:s:S:Y:z:G:W" RECVMMSG_FLAG SENDMMSG_FLAG \
-                                                            IP_DONTFRAG_FLAG
+                                        GRO_FLAG URING_FLAG IP_DONTFRAG_FLAG
 
 /* Returns:
  *  0   Applied
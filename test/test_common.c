@@ -15,6 +15,9 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <arpa/inet.h>
+#if __linux__
+#include <netinet/udp.h>
+#endif
 #include <sys/socket.h>
 #include <unistd.h>
 #else
@@ -36,6 +39,10 @@
 
 #include <event2/event.h>
 
+#if HAVE_LIBURING
+#include <liburing.h>
+#endif
+
 #include "test_common.h"
 #include "lsquic.h"
 #include "prog.h"
@@ -81,10 +88,33 @@
 #define ECN_SZ 0
 #endif
 
+#if __linux__
+#   ifndef UDP_SEGMENT
+#       define UDP_SEGMENT 103
+#   endif
+#   define GSO_SUPPORTED 1
+#   define GSO_SZ CMSG_SPACE(sizeof(uint16_t))
+#else
+#   define GSO_SUPPORTED 0
+#   define GSO_SZ 0
+#endif
+
+#if __linux__
+#   ifndef UDP_GRO
+#       define UDP_GRO 104
+#   endif
+#   define GRO_SUPPORTED 1
+#   define GRO_SZ CMSG_SPACE(sizeof(int))
+#else
+#   define GRO_SUPPORTED 0
+#   define GRO_SZ 0
+#endif
+
 #define MAX_PACKET_SZ 0xffff
 
 #define CTL_SZ (CMSG_SPACE(MAX(DST_MSG_SZ, \
-                        sizeof(struct in6_pktinfo))) + NDROPPED_SZ + ECN_SZ)
+                        sizeof(struct in6_pktinfo))) + NDROPPED_SZ + ECN_SZ \
+                        + GRO_SZ)
 
 /* There are `n_alloc' elements in `vecs', `local_addresses', and
  * `peer_addresses' arrays.  `ctlmsg_data' is n_alloc * CTL_SZ.  Each packets
@@ -104,9 +134,13 @@ struct packets_in
 #endif
 #if ECN_SUPPORTED
     int                     *ecn;
+#endif
+#if GRO_SUPPORTED
+    int                     *gro_size;
 #endif
     struct sockaddr_storage *local_addresses,
                             *peer_addresses;
+    struct lsquic_in_spec   *specs;
     unsigned                 n_alloc;
     unsigned                 data_sz;
 };
@@ -189,9 +223,13 @@ allocate_packets_in (SOCKET_TYPE fd)
     packs_in->vecs = malloc(n_alloc * sizeof(packs_in->vecs[0]));
     packs_in->local_addresses = malloc(n_alloc * sizeof(packs_in->local_addresses[0]));
     packs_in->peer_addresses = malloc(n_alloc * sizeof(packs_in->peer_addresses[0]));
+    packs_in->specs = malloc(n_alloc * sizeof(packs_in->specs[0]));
 #if ECN_SUPPORTED
     packs_in->ecn = malloc(n_alloc * sizeof(packs_in->ecn[0]));
 #endif
+#if GRO_SUPPORTED
+    packs_in->gro_size = malloc(n_alloc * sizeof(packs_in->gro_size[0]));
+#endif
 
     return packs_in;
 }
@@ -203,6 +241,10 @@ free_packets_in (struct packets_in *packs_in)
 #if ECN_SUPPORTED
     free(packs_in->ecn);
 #endif
+#if GRO_SUPPORTED
+    free(packs_in->gro_size);
+#endif
+    free(packs_in->specs);
     free(packs_in->peer_addresses);
     free(packs_in->local_addresses);
     free(packs_in->ctlmsg_data);
@@ -403,6 +445,9 @@ proc_ancillary (
 #endif
 #if ECN_SUPPORTED
                 , int *ecn
+#endif
+#if GRO_SUPPORTED
+                , int *gro_size
 #endif
                 )
 {
@@ -453,6 +498,11 @@ proc_ancillary (
                  cmsg->cmsg_type  == SO_RXQ_OVFL)
             memcpy(n_dropped, CMSG_DATA(cmsg), sizeof(*n_dropped));
 #endif
+#if GRO_SUPPORTED
+        else if (cmsg->cmsg_level == SOL_UDP &&
+                 cmsg->cmsg_type  == UDP_GRO)
+            memcpy(gro_size, CMSG_DATA(cmsg), sizeof(*gro_size));
+#endif
 #if ECN_SUPPORTED
         else if ((cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS)
                  || (cmsg->cmsg_level == IPPROTO_IPV6
@@ -569,6 +619,9 @@ read_one_packet (struct read_iter *iter)
 #endif
 #if ECN_SUPPORTED
     packs_in->ecn[iter->ri_idx] = 0;
+#endif
+#if GRO_SUPPORTED
+    packs_in->gro_size[iter->ri_idx] = 0;
 #endif
     proc_ancillary(&msg, local_addr
 #if __linux__
@@ -576,6 +629,9 @@ read_one_packet (struct read_iter *iter)
 #endif
 #if ECN_SUPPORTED
         , &packs_in->ecn[iter->ri_idx]
+#endif
+#if GRO_SUPPORTED
+        , &packs_in->gro_size[iter->ri_idx]
 #endif
     );
 #if LSQUIC_ECN_BLACK_HOLE && ECN_SUPPORTED
@@ -669,6 +725,9 @@ read_using_recvmmsg (struct read_iter *iter)
 #endif
 #if ECN_SUPPORTED
         packs_in->ecn[n] = 0;
+#endif
+#if GRO_SUPPORTED
+        packs_in->gro_size[n] = 0;
 #endif
         proc_ancillary(&mmsghdrs[n].msg_hdr, local_addr
 #if __linux__
@@ -676,6 +735,9 @@ read_using_recvmmsg (struct read_iter *iter)
 #endif
 #if ECN_SUPPORTED
             , &packs_in->ecn[n]
+#endif
+#if GRO_SUPPORTED
+            , &packs_in->gro_size[n]
 #endif
         );
 #if __linux__
@@ -707,12 +769,61 @@ read_using_recvmmsg (struct read_iter *iter)
 #endif
 
 
+/* In sharded mode, steer the packet to the engine that owns the connection
+ * based on its destination CID.
+ */
+static lsquic_engine_t *
+packet_engine (const struct lsquic_in_spec *spec)
+{
+    const struct service_port *const sport = spec->peer_ctx;
+    const struct prog *const prog = sport->sp_prog;
+    int shard;
+
+    if (prog->prog_n_shards > 1)
+    {
+        shard = lsquic_packet_shard(spec->buf, spec->bufsz,
+                                                        prog->prog_n_shards);
+        if (shard >= 0)
+            return prog->prog_shards[shard];
+    }
+
+    return sport->engine;
+}
+
+
+/* Pass runs of packets destined to the same engine in one call.  Returns
+ * number of specs consumed.
+ */
+static unsigned
+packets_in_to_engines (const struct lsquic_in_spec *specs, unsigned n_specs)
+{
+    lsquic_engine_t *engine;
+    unsigned n, end;
+    int n_in;
+
+    n = 0;
+    while (n < n_specs)
+    {
+        engine = packet_engine(&specs[n]);
+        for (end = n + 1; end < n_specs; ++end)
+            if (engine != packet_engine(&specs[end]))
+                break;
+        n_in = lsquic_engine_packets_in(engine, &specs[n], end - n);
+        if ((unsigned) n_in < end - n)
+            return n + n_in;
+        n = end;
+    }
+
+    return n;
+}
+
+
 static void
 read_handler (evutil_socket_t fd, short flags, void *ctx)
 {
     struct service_port *sport = ctx;
-    lsquic_engine_t *const engine = sport->engine;
     struct packets_in *packs_in = sport->packs_in;
+    struct lsquic_in_spec *spec;
     struct read_iter iter;
     unsigned n, n_batches;
     /* Save the value in case program is stopped packs_in is freed: */
@@ -748,25 +859,31 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
         n_batches += iter.ri_idx > 0;
 
         for (n = 0; n < iter.ri_idx; ++n)
-            if (0 > lsquic_engine_packet_in(engine,
+        {
+            spec = &packs_in->specs[n];
 #ifndef WIN32
-                        packs_in->vecs[n].iov_base,
-                        packs_in->vecs[n].iov_len,
+            spec->buf = packs_in->vecs[n].iov_base;
+            spec->bufsz = packs_in->vecs[n].iov_len;
 #else
-                        (const unsigned char *) packs_in->vecs[n].buf,
-                        packs_in->vecs[n].len,
+            spec->buf = (const unsigned char *) packs_in->vecs[n].buf;
+            spec->bufsz = packs_in->vecs[n].len;
 #endif
-                        (struct sockaddr *) &packs_in->local_addresses[n],
-                        (struct sockaddr *) &packs_in->peer_addresses[n],
-                        sport,
+            spec->local_sa = (struct sockaddr *) &packs_in->local_addresses[n];
+            spec->peer_sa = (struct sockaddr *) &packs_in->peer_addresses[n];
+            spec->peer_ctx = sport;
 #if ECN_SUPPORTED
-                        packs_in->ecn[n]
+            spec->ecn = packs_in->ecn[n];
 #else
-                        0
+            spec->ecn = 0;
 #endif
-                        ))
-                break;
+#if GRO_SUPPORTED
+            spec->gro_size = packs_in->gro_size[n];
+#else
+            spec->gro_size = 0;
+#endif
+        }
 
+        n = packets_in_to_engines(packs_in->specs, iter.ri_idx);
         if (n > 0)
             prog_process_conns(sport->sp_prog);
     }
@@ -779,9 +896,19 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
 }
 
 
+#if HAVE_LIBURING
+static int
+uring_add_sport (struct uring *, struct service_port *);
+#endif
+
+
 static int
 add_to_event_loop (struct service_port *sport, struct event_base *eb)
 {
+#if HAVE_LIBURING
+    if (sport->sp_prog->prog_uring)
+        return uring_add_sport(sport->sp_prog->prog_uring, sport);
+#endif
     sport->ev = event_new(eb, sport->fd, EV_READ|EV_PERSIST, read_handler,
                                                                     sport);
     if (sport->ev)
@@ -960,6 +1087,21 @@ sport_init_server (struct service_port *sport, struct lsquic_engine *engine,
     }
 #endif
 
+#if GRO_SUPPORTED
+    if (sport->sp_prog->prog_use_gro)
+    {
+        on = 1;
+        s = setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+        if (0 != s)
+        {
+            saved_errno = errno;
+            close(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
     if (sport->sp_flags & SPORT_SET_SNDBUF)
     {
         s = setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &sport->sp_sndbuf,
@@ -1155,6 +1297,21 @@ sport_init_client (struct service_port *sport, struct lsquic_engine *engine,
     }
 #endif
 
+#if GRO_SUPPORTED
+    if (sport->sp_prog->prog_use_gro)
+    {
+        int on = 1;
+        s = setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+        if (0 != s)
+        {
+            saved_errno = errno;
+            close(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
     if (sport->sp_flags & SPORT_SET_SNDBUF)
     {
         s = setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF,
@@ -1234,6 +1391,9 @@ enum ctl_what
 #if ECN_SUPPORTED
     CW_ECN          = 1 << 1,
 #endif
+#if GSO_SUPPORTED
+    CW_GSO          = 1 << 2,
+#endif
 };
 
 static void
@@ -1347,6 +1507,18 @@ setup_control_msg (
             }
             cw &= ~CW_ECN;
         }
+#endif
+#if GSO_SUPPORTED
+        else if (cw & CW_GSO)
+        {
+            const uint16_t gso_size = spec->gso_size;
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type  = UDP_SEGMENT;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(gso_size));
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+            ctl_len += CMSG_SPACE(sizeof(gso_size));
+            cw &= ~CW_GSO;
+        }
 #endif
         else
             assert(0);
@@ -1400,6 +1572,7 @@ send_packets_using_sendmmsg (const struct lsquic_out_spec *specs,
 #if ECN_SUPPORTED
             + CMSG_SPACE(sizeof(int))
 #endif
+            + GSO_SZ
                                                                     ];
         struct cmsghdr cmsg;
     } ancil [ sizeof(mmsgs) / sizeof(mmsgs[0]) ];
@@ -1420,6 +1593,10 @@ send_packets_using_sendmmsg (const struct lsquic_out_spec *specs,
 #if ECN_SUPPORTED
         if (sport->sp_prog->prog_api.ea_settings->es_ecn && specs[i].ecn)
             cw |= CW_ECN;
+#endif
+#if GSO_SUPPORTED
+        if (specs[i].gso_size)
+            cw |= CW_GSO;
 #endif
         if (cw)
             setup_control_msg(&mmsgs[i].msg_hdr, cw, &specs[i], ancil[i].buf,
@@ -1507,6 +1684,7 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 #if ECN_SUPPORTED
             + CMSG_SPACE(sizeof(int))
 #endif
+            + GSO_SZ
         ];
         struct cmsghdr cmsg;
     } ancil;
@@ -1569,6 +1747,10 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 #if ECN_SUPPORTED
         if (sport->sp_prog->prog_api.ea_settings->es_ecn && specs[n].ecn)
             cw |= CW_ECN;
+#endif
+#if GSO_SUPPORTED
+        if (specs[n].gso_size)
+            cw |= CW_GSO;
 #endif
         if (cw)
             setup_control_msg(&msg, cw, &specs[n], ancil.buf, sizeof(ancil.buf));
@@ -1616,12 +1798,606 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 }
 
 
+#if HAVE_LIBURING
+/* io_uring I/O driver.  The ring's file descriptor is registered with the
+ * libevent loop, which still handles signals and the rest of the program's
+ * events.  Each service port has a multishot recvmsg outstanding that picks
+ * its buffers from a provided buffer ring; completions are gathered into
+ * batches and passed to lsquic_engine_packets_in().  Outgoing packets are
+ * submitted as a chain of linked sendmsg operations and the engine's tick
+ * timer is an IORING_OP_TIMEOUT.
+ */
+
+#define URING_ENTRIES       256
+#define URING_N_BUFS        512     /* Must be a power of two */
+#define URING_BUF_SZ        4096
+#define URING_BGID          0
+#define URING_MAX_SENDS     64
+#define URING_BATCH         64
+#define URING_N_STASHED     256
+
+/* The two lower bits of user_data identify operation type.  The rest is
+ * a pointer to service port (receive), the send index, or the timer
+ * generation.
+ */
+enum uring_ud
+{
+    UD_RECV     = 0,
+    UD_TIMER    = 1,
+    UD_SEND     = 2,
+    UD_IGNORE   = 3,
+};
+
+#define UD_TYPE(ud) ((enum uring_ud) ((ud) & 3))
+
+struct uring_cqe
+{
+    uint64_t    user_data;
+    int32_t     res;
+    uint32_t    flags;
+};
+
+#define SEND_CTL_SZ (CMSG_SPACE(MAX(sizeof(struct in_pktinfo),      \
+            sizeof(struct in6_pktinfo))) + CMSG_SPACE(sizeof(int)) + GSO_SZ)
+
+struct uring
+{
+    struct io_uring             ur_ring;
+    struct io_uring_buf_ring   *ur_buf_ring;
+    unsigned char              *ur_bufs;
+    struct prog                *ur_prog;
+    struct event               *ur_ev;
+    /* Template used by multishot recvmsg: only name and control lengths
+     * matter.
+     */
+    struct msghdr               ur_recv_msg;
+    struct __kernel_timespec    ur_ts;
+    uint64_t                    ur_timer_gen;
+    int                         ur_timer_armed;
+    int                         ur_tick;
+    unsigned                    ur_n_recycle;
+    /* Completions reaped while waiting for sends to complete are processed
+     * after ea_packets_out() returns, as the engine is not reentrant.
+     */
+    unsigned                    ur_n_stashed;
+    struct uring_cqe            ur_stashed[URING_N_STASHED];
+    /* Current receive batch */
+    unsigned                    ur_n_specs;
+    struct lsquic_in_spec       ur_specs[URING_BATCH];
+    struct sockaddr_storage     ur_local_addrs[URING_BATCH];
+    unsigned short              ur_bids[URING_BATCH];
+    /* Send state must stay valid until the sends complete */
+    struct msghdr               ur_send_msgs[URING_MAX_SENDS];
+    int                         ur_send_res[URING_MAX_SENDS];
+    union {
+        unsigned char   buf[SEND_CTL_SZ];
+        struct cmsghdr  cmsg;
+    }                           ur_send_ctl[URING_MAX_SENDS];
+};
+
+
+static void
+uring_recycle_buf (struct uring *ur, unsigned short bid)
+{
+    io_uring_buf_ring_add(ur->ur_buf_ring, ur->ur_bufs + bid * URING_BUF_SZ,
+        URING_BUF_SZ, bid, io_uring_buf_ring_mask(URING_N_BUFS),
+        ur->ur_n_recycle++);
+}
+
+
+static void
+uring_recycle_flush (struct uring *ur)
+{
+    if (ur->ur_n_recycle)
+    {
+        io_uring_buf_ring_advance(ur->ur_buf_ring, ur->ur_n_recycle);
+        ur->ur_n_recycle = 0;
+    }
+}
+
+
+static int
+uring_arm_recv (struct uring *ur, struct service_port *sport)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = io_uring_get_sqe(&ur->ur_ring);
+    if (!sqe)
+    {
+        (void) io_uring_submit(&ur->ur_ring);
+        sqe = io_uring_get_sqe(&ur->ur_ring);
+        if (!sqe)
+        {
+            LSQ_ERROR("cannot get SQE to arm receive");
+            return -1;
+        }
+    }
+    io_uring_prep_recvmsg_multishot(sqe, sport->fd, &ur->ur_recv_msg, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    io_uring_sqe_set_data64(sqe, (uintptr_t) sport | UD_RECV);
+    return 0;
+}
+
+
+static void
+uring_flush_batch (struct uring *ur)
+{
+    unsigned n;
+
+    if (ur->ur_n_specs)
+    {
+        n = packets_in_to_engines(ur->ur_specs, ur->ur_n_specs);
+        if (n < ur->ur_n_specs)
+            LSQ_WARN("engine did not take %u packet%.*s", ur->ur_n_specs - n,
+                                        ur->ur_n_specs - n != 1, "s");
+        /* The engine copies what it keeps: buffers can be reused now */
+        for (n = 0; n < ur->ur_n_specs; ++n)
+            uring_recycle_buf(ur, ur->ur_bids[n]);
+        uring_recycle_flush(ur);
+        LSQ_DEBUG("read %u packet%.*s using io_uring", ur->ur_n_specs,
+                                                ur->ur_n_specs != 1, "s");
+        ur->ur_n_specs = 0;
+        ur->ur_tick = 1;
+    }
+
+    if (ur->ur_tick)
+    {
+        ur->ur_tick = 0;
+        prog_process_conns(ur->ur_prog);
+    }
+}
+
+
+static void
+uring_proc_recv (struct uring *ur, struct service_port *sport,
+                                                const struct uring_cqe *cqe)
+{
+    struct io_uring_recvmsg_out *out;
+    struct lsquic_in_spec *spec;
+    struct sockaddr_storage *local_addr;
+    struct msghdr msg;
+    unsigned short bid;
+#if __linux__
+    uint32_t n_dropped;
+#endif
+#if ECN_SUPPORTED
+    int ecn;
+#endif
+#if GRO_SUPPORTED
+    int gro_size;
+#endif
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && !prog_is_stopped())
+        (void) uring_arm_recv(ur, sport);
+
+    if (cqe->res < 0)
+    {
+        if (cqe->res == -ECONNREFUSED && (sport->sp_flags & SPORT_CONNECT))
+        {
+            LSQ_ERROR("connection refused: exit program");
+            prog_cleanup(sport->sp_prog);
+            exit(1);
+        }
+        if (cqe->res == -ENOBUFS)
+            LSQ_INFO("out of receive buffers");
+        else
+            LSQ_ERROR("recvmsg: %s", strerror(-cqe->res));
+        return;
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_BUFFER))
+        return;
+    bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+    out = io_uring_recvmsg_validate(ur->ur_bufs + bid * URING_BUF_SZ,
+                                                cqe->res, &ur->ur_recv_msg);
+    if (!out || (out->flags & (MSG_TRUNC|MSG_CTRUNC)))
+    {
+        LSQ_INFO("packet or its auxiliary data truncated - drop it");
+        uring_recycle_buf(ur, bid);
+        uring_recycle_flush(ur);
+        return;
+    }
+
+    if (ur->ur_n_specs >= URING_BATCH)
+        uring_flush_batch(ur);
+
+    spec = &ur->ur_specs[ur->ur_n_specs];
+    local_addr = &ur->ur_local_addrs[ur->ur_n_specs];
+    memcpy(local_addr, &sport->sp_local_addr, sizeof(*local_addr));
+    memset(&msg, 0, sizeof(msg));
+    if (out->controllen)
+    {
+        msg.msg_control = (unsigned char *) io_uring_recvmsg_name(out)
+                                            + ur->ur_recv_msg.msg_namelen;
+        msg.msg_controllen = out->controllen;
+    }
+#if __linux__
+    n_dropped = 0;
+#endif
+#if ECN_SUPPORTED
+    ecn = 0;
+#endif
+#if GRO_SUPPORTED
+    gro_size = 0;
+#endif
+    proc_ancillary(&msg, local_addr
+#if __linux__
+        , &n_dropped
+#endif
+#if ECN_SUPPORTED
+        , &ecn
+#endif
+#if GRO_SUPPORTED
+        , &gro_size
+#endif
+    );
+#if __linux__
+    if (sport->drop_init)
+    {
+        if (sport->n_dropped < n_dropped)
+            LSQ_INFO("dropped %u packets", n_dropped - sport->n_dropped);
+    }
+    else
+        sport->drop_init = 1;
+    sport->n_dropped = n_dropped;
+#endif
+
+    spec->buf = io_uring_recvmsg_payload(out, &ur->ur_recv_msg);
+    spec->bufsz = io_uring_recvmsg_payload_length(out, cqe->res,
+                                                        &ur->ur_recv_msg);
+    spec->local_sa = (struct sockaddr *) local_addr;
+    spec->peer_sa = io_uring_recvmsg_name(out);
+    spec->peer_ctx = sport;
+#if ECN_SUPPORTED
+    spec->ecn = ecn;
+#else
+    spec->ecn = 0;
+#endif
+#if GRO_SUPPORTED
+    spec->gro_size = gro_size;
+#else
+    spec->gro_size = 0;
+#endif
+    spec->buf_ctx = NULL;
+    ur->ur_bids[ur->ur_n_specs++] = bid;
+}
+
+
+static void
+uring_proc_cqe (struct uring *ur, const struct uring_cqe *cqe)
+{
+    switch (UD_TYPE(cqe->user_data))
+    {
+    case UD_RECV:
+        uring_proc_recv(ur, (struct service_port *) (uintptr_t)
+                                                    cqe->user_data, cqe);
+        break;
+    case UD_TIMER:
+        if ((cqe->user_data >> 2) == ur->ur_timer_gen && cqe->res == -ETIME)
+        {
+            ur->ur_timer_armed = 0;
+            ur->ur_tick = 1;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+
+static void
+uring_handler (evutil_socket_t fd, short what, void *arg)
+{
+    struct uring *const ur = arg;
+    struct io_uring_cqe *cqe;
+    struct uring_cqe copy;
+    unsigned n;
+
+    do
+    {
+        for (n = 0; n < ur->ur_n_stashed && !prog_is_stopped(); ++n)
+            uring_proc_cqe(ur, &ur->ur_stashed[n]);
+        ur->ur_n_stashed = 0;
+
+        while (!prog_is_stopped()
+                            && 0 == io_uring_peek_cqe(&ur->ur_ring, &cqe))
+        {
+            copy.user_data = io_uring_cqe_get_data64(cqe);
+            copy.res       = cqe->res;
+            copy.flags     = cqe->flags;
+            io_uring_cqe_seen(&ur->ur_ring, cqe);
+            uring_proc_cqe(ur, &copy);
+        }
+
+        if (!prog_is_stopped())
+            uring_flush_batch(ur);
+    }
+    while (ur->ur_n_stashed && !prog_is_stopped());
+
+    if (!prog_is_stopped())
+        (void) io_uring_submit(&ur->ur_ring);
+}
+
+
+struct uring *
+uring_new (struct prog *prog)
+{
+    struct uring *ur;
+    unsigned n;
+    int s;
+
+    ur = calloc(1, sizeof(*ur));
+    if (!ur)
+        return NULL;
+
+    s = io_uring_queue_init(URING_ENTRIES, &ur->ur_ring, 0);
+    if (s < 0)
+    {
+        LSQ_ERROR("io_uring_queue_init: %s", strerror(-s));
+        free(ur);
+        return NULL;
+    }
+
+    ur->ur_bufs = malloc(URING_N_BUFS * URING_BUF_SZ);
+    if (!ur->ur_bufs)
+        goto err;
+    ur->ur_buf_ring = io_uring_setup_buf_ring(&ur->ur_ring, URING_N_BUFS,
+                                                        URING_BGID, 0, &s);
+    if (!ur->ur_buf_ring)
+    {
+        LSQ_ERROR("io_uring_setup_buf_ring: %s", strerror(-s));
+        goto err;
+    }
+    for (n = 0; n < URING_N_BUFS; ++n)
+        uring_recycle_buf(ur, n);
+    uring_recycle_flush(ur);
+
+    ur->ur_recv_msg.msg_namelen = sizeof(struct sockaddr_storage);
+    ur->ur_recv_msg.msg_controllen = CTL_SZ;
+
+    ur->ur_ev = event_new(prog->prog_eb, ur->ur_ring.ring_fd,
+                                    EV_READ|EV_PERSIST, uring_handler, ur);
+    if (!ur->ur_ev)
+        goto err;
+    event_add(ur->ur_ev, NULL);
+
+    ur->ur_prog = prog;
+    LSQ_NOTICE("using io_uring for I/O");
+    return ur;
+
+  err:
+    if (ur->ur_buf_ring)
+        io_uring_free_buf_ring(&ur->ur_ring, ur->ur_buf_ring, URING_N_BUFS,
+                                                                URING_BGID);
+    free(ur->ur_bufs);
+    io_uring_queue_exit(&ur->ur_ring);
+    free(ur);
+    return NULL;
+}
+
+
+static int
+uring_add_sport (struct uring *ur, struct service_port *sport)
+{
+    if (0 != uring_arm_recv(ur, sport))
+        return -1;
+    (void) io_uring_submit(&ur->ur_ring);
+    return 0;
+}
+
+
+void
+uring_stop (struct uring *ur)
+{
+    if (ur->ur_ev)
+    {
+        event_del(ur->ur_ev);
+        event_free(ur->ur_ev);
+        ur->ur_ev = NULL;
+    }
+}
+
+
+void
+uring_destroy (struct uring *ur)
+{
+    uring_stop(ur);
+    io_uring_free_buf_ring(&ur->ur_ring, ur->ur_buf_ring, URING_N_BUFS,
+                                                                URING_BGID);
+    io_uring_queue_exit(&ur->ur_ring);
+    free(ur->ur_bufs);
+    free(ur);
+}
+
+
+void
+uring_set_timer (struct uring *ur, const struct timeval *timeout)
+{
+    struct io_uring_sqe *sqe;
+
+    if (io_uring_sq_space_left(&ur->ur_ring) < 2)
+        (void) io_uring_submit(&ur->ur_ring);
+
+    if (ur->ur_timer_armed)
+    {
+        sqe = io_uring_get_sqe(&ur->ur_ring);
+        io_uring_prep_timeout_remove(sqe,
+                                (ur->ur_timer_gen << 2) | UD_TIMER, 0);
+        io_uring_sqe_set_data64(sqe, UD_IGNORE);
+    }
+
+    ur->ur_ts.tv_sec  = timeout->tv_sec;
+    ur->ur_ts.tv_nsec = timeout->tv_usec * 1000;
+    ++ur->ur_timer_gen;
+    sqe = io_uring_get_sqe(&ur->ur_ring);
+    io_uring_prep_timeout(sqe, &ur->ur_ts, 0, 0);
+    io_uring_sqe_set_data64(sqe, (ur->ur_timer_gen << 2) | UD_TIMER);
+    ur->ur_timer_armed = 1;
+
+    (void) io_uring_submit(&ur->ur_ring);
+}
+
+
+/* Sends are linked so that a failure cancels the rest of the chain and the
+ * number of packets sent can be reported to the engine.  We wait for all
+ * of them to complete, as the engine may reuse packet buffers as soon as
+ * this function returns.
+ */
+static int
+uring_packets_out (struct uring *ur, const struct lsquic_out_spec *specs,
+                                                            unsigned count)
+{
+    const struct service_port *sport;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    struct msghdr *msg;
+    struct uring_cqe copy;
+    enum ctl_what cw;
+    unsigned n, n_pending;
+    int s;
+
+    if (0 == count)
+        return 0;
+
+    /* Leave room for receive and timer SQEs: */
+    (void) io_uring_submit(&ur->ur_ring);
+    if (count > URING_MAX_SENDS)
+        count = URING_MAX_SENDS;
+
+    for (n = 0; n < count; ++n)
+    {
+        sport = specs[n].peer_ctx;
+        msg = &ur->ur_send_msgs[n];
+        msg->msg_name       = (void *) specs[n].dest_sa;
+        msg->msg_namelen    = (AF_INET == specs[n].dest_sa->sa_family ?
+                                            sizeof(struct sockaddr_in) :
+                                            sizeof(struct sockaddr_in6)),
+        msg->msg_iov        = specs[n].iov;
+        msg->msg_iovlen     = specs[n].iovlen;
+        msg->msg_flags      = 0;
+        if ((sport->sp_flags & SPORT_SERVER) && specs[n].local_sa->sa_family)
+            cw = CW_SENDADDR;
+        else
+            cw = 0;
+#if ECN_SUPPORTED
+        if (sport->sp_prog->prog_api.ea_settings->es_ecn && specs[n].ecn)
+            cw |= CW_ECN;
+#endif
+#if GSO_SUPPORTED
+        if (specs[n].gso_size)
+            cw |= CW_GSO;
+#endif
+        if (cw)
+            setup_control_msg(msg, cw, &specs[n], ur->ur_send_ctl[n].buf,
+                                            sizeof(ur->ur_send_ctl[n].buf));
+        else
+        {
+            msg->msg_control = NULL;
+            msg->msg_controllen = 0;
+        }
+        sqe = io_uring_get_sqe(&ur->ur_ring);
+        io_uring_prep_sendmsg(sqe, sport->fd, msg, 0);
+        if (n + 1 < count)
+            sqe->flags |= IOSQE_IO_LINK;
+        io_uring_sqe_set_data64(sqe, ((uint64_t) n << 2) | UD_SEND);
+    }
+
+    s = io_uring_submit(&ur->ur_ring);
+    if (s < 0)
+    {
+        LSQ_WARN("io_uring_submit: %s", strerror(-s));
+        prog_sport_cant_send(ur->ur_prog, ((struct service_port *)
+                                                    specs[0].peer_ctx)->fd);
+        errno = -s;
+        return -1;
+    }
+
+    n_pending = count;
+    while (n_pending > 0)
+    {
+        s = io_uring_wait_cqe(&ur->ur_ring, &cqe);
+        if (s < 0)
+        {
+            if (s == -EINTR)
+                continue;
+            /* Should not happen: bail */
+            LSQ_ERROR("io_uring_wait_cqe: %s", strerror(-s));
+            abort();
+        }
+        copy.user_data = io_uring_cqe_get_data64(cqe);
+        copy.res       = cqe->res;
+        copy.flags     = cqe->flags;
+        io_uring_cqe_seen(&ur->ur_ring, cqe);
+        switch (UD_TYPE(copy.user_data))
+        {
+        case UD_SEND:
+            ur->ur_send_res[copy.user_data >> 2] = copy.res;
+            --n_pending;
+            break;
+        case UD_RECV:
+            if (ur->ur_n_stashed < URING_N_STASHED)
+                ur->ur_stashed[ur->ur_n_stashed++] = copy;
+            else
+            {
+                LSQ_INFO("completion stash is full: drop packet");
+                if (copy.flags & IORING_CQE_F_BUFFER)
+                {
+                    uring_recycle_buf(ur,
+                                    copy.flags >> IORING_CQE_BUFFER_SHIFT);
+                    uring_recycle_flush(ur);
+                }
+                if (!(copy.flags & IORING_CQE_F_MORE))
+                    (void) uring_arm_recv(ur, (struct service_port *)
+                                                (uintptr_t) copy.user_data);
+            }
+            break;
+        default:
+            /* Timer completions only set flags */
+            uring_proc_cqe(ur, &copy);
+            break;
+        }
+    }
+
+    /* The completions have been reaped: make sure the handler runs */
+    if ((ur->ur_n_stashed || ur->ur_tick) && ur->ur_ev)
+        event_active(ur->ur_ev, EV_READ, 0);
+
+    for (n = 0; n < count; ++n)
+        if (ur->ur_send_res[n] < 0)
+            break;
+
+    if (n < count)
+    {
+        sport = specs[n].peer_ctx;
+        LSQ_INFO("sendmsg failed: %s", strerror(-ur->ur_send_res[n]));
+        prog_sport_cant_send(sport->sp_prog, sport->fd);
+        errno = -ur->ur_send_res[n];
+    }
+
+    if (n > 0)
+        return n;
+    else
+        return -1;
+}
+
+
+#endif
+
+
 int
 sport_packets_out (void *ctx, const struct lsquic_out_spec *specs,
                    unsigned count)
 {
-#if HAVE_SENDMMSG
+#if HAVE_LIBURING || HAVE_SENDMMSG
     const struct prog *prog = ctx;
+#endif
+#if HAVE_LIBURING
+    if (prog->prog_uring)
+        return uring_packets_out(prog->prog_uring, specs, count);
+#endif
+#if HAVE_SENDMMSG
     if (prog->prog_use_sendmmsg)
         return send_packets_using_sendmmsg(specs, count);
     else
@@ -1660,6 +2436,18 @@ set_engine_option (struct lsquic_engine_settings *settings,
                 LSQ_ERROR("ECN is not supported on this platform");
                 break;
             }
+#endif
+            return 0;
+        }
+        if (0 == strncmp(name, "gso", 3))
+        {
+            settings->es_gso = atoi(val);
+#if !GSO_SUPPORTED
+            if (settings->es_gso)
+            {
+                LSQ_ERROR("GSO is not supported on this platform");
+                break;
+            }
 #endif
             return 0;
         }
@@ -1782,6 +2570,11 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_handshake_to = atoi(val);
             return 0;
         }
+        if (0 == strncmp(name, "tick_threads", 12))
+        {
+            settings->es_tick_threads = atoi(val);
+            return 0;
+        }
         break;
     case 13:
         if (0 == strncmp(name, "support_tcid0", 13))
@@ -19,6 +19,7 @@ struct packets_in;
 struct lsquic_conn;
 struct prog;
 struct reader_ctx;
+struct timeval;
 
 enum sport_flags
 {
@@ -80,6 +81,21 @@ sport_packets_out (void *ctx, const struct lsquic_out_spec *, unsigned count);
 int
 sport_set_token (struct service_port *, const char *);
 
+struct uring;
+
+/* io_uring I/O driver.  These are only available if HAVE_LIBURING is set. */
+struct uring *
+uring_new (struct prog *);
+
+void
+uring_set_timer (struct uring *, const struct timeval *);
+
+void
+uring_stop (struct uring *);
+
+void
+uring_destroy (struct uring *);
+
 int
 set_engine_option (struct lsquic_engine_settings *,
                    int *version_cleared, const char *name_value);
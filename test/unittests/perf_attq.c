@@ -0,0 +1,142 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * This is not really a test: this program measures how long it takes to
+ * run a simulated server workload through the Advisory Tick Time Queue.
+ * It is built twice: perf_attq_heap and perf_attq_wheel.
+ *
+ * Each connection is scheduled some time into the future; mostly idle
+ * connections are scheduled far ahead.  Every simulated tick, the due
+ * connections are popped and rescheduled and some connections that are
+ * not due are rescheduled as well, as happens when packets arrive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_attq.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_util.h"
+
+
+#define MS(n) ((n) * 1000)  /* MS: Milliseconds */
+
+static lsquic_time_t
+next_time (lsquic_time_t now, unsigned active_pct)
+{
+    if ((unsigned) rand() % 100 < active_pct)
+        return now + 1 + rand() % MS(25);           /* Pacer or ACK timer */
+    else
+        return now + MS(1000) + rand() % MS(30000); /* Idle or PING timer */
+}
+
+
+int
+main (int argc, char **argv)
+{
+    unsigned n_conns = 1000000, n_ticks = 10000, n_resched = 100,
+             active_pct = 10;
+    unsigned i, n, n_popped;
+    int opt;
+    struct attq *q;
+    struct lsquic_conn *conns, *conn;
+    lsquic_time_t now, start, elapsed;
+
+    while (-1 != (opt = getopt(argc, argv, "n:t:r:a:s:h")))
+    {
+        switch (opt)
+        {
+        case 'n':
+            n_conns = atoi(optarg);
+            break;
+        case 't':
+            n_ticks = atoi(optarg);
+            break;
+        case 'r':
+            n_resched = atoi(optarg);
+            break;
+        case 'a':
+            active_pct = atoi(optarg);
+            break;
+        case 's':
+            srand(atoi(optarg));
+            break;
+        case 'h':
+            printf(
+"Usage: %s [-n conns] [-t ticks] [-r reschedules] [-a active%%] [-s seed]\n"
+"\n"
+"   -n N    Number of connections.  Defaults to 1000000.\n"
+"   -t N    Number of 1-millisecond ticks to simulate.  Defaults to 10000.\n"
+"   -r N    Number of connections rescheduled every tick.  Defaults to 100.\n"
+"   -a N    Percentage of connections scheduled soon.  Defaults to 10.\n"
+"   -s N    Random seed.\n"
+            , argv[0]);
+            return 0;
+        default:
+            exit(1);
+        }
+    }
+
+    if (n_conns == 0)
+    {
+        fprintf(stderr, "number of connections must be positive\n");
+        exit(1);
+    }
+
+    conns = calloc(n_conns, sizeof(conns[0]));
+    q = attq_create();
+    if (!conns || !q)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    start = lsquic_time_now();
+    now = MS(1000);
+    for (i = 0; i < n_conns; ++i)
+        if (0 != attq_add(q, &conns[i], next_time(now, active_pct), 0))
+        {
+            perror("attq_add");
+            exit(1);
+        }
+    elapsed = lsquic_time_now() - start;
+    printf("%s: added %u connections in %llu usec\n",
+        LSQUIC_ATTQ_WHEEL ? "wheel" : "heap", n_conns,
+        (unsigned long long) elapsed);
+
+    start = lsquic_time_now();
+    n_popped = 0;
+    for (n = 0; n < n_ticks; ++n)
+    {
+        now += MS(1);
+        while ((conn = attq_pop(q, now)))
+        {
+            (void) attq_add(q, conn, next_time(now, active_pct), 0);
+            ++n_popped;
+        }
+        for (i = 0; i < n_resched; ++i)
+        {
+            conn = &conns[ rand() % n_conns ];
+            attq_remove(q, conn);
+            (void) attq_add(q, conn, next_time(now, active_pct), 0);
+        }
+        (void) attq_next(q);
+    }
+    elapsed = lsquic_time_now() - start;
+    printf("%s: ran %u ticks (%u pops, %u reschedules) in %llu usec\n",
+        LSQUIC_ATTQ_WHEEL ? "wheel" : "heap", n_ticks, n_popped,
+        n_ticks * n_resched, (unsigned long long) elapsed);
+
+    attq_destroy(q);
+    free(conns);
+    return 0;
+}
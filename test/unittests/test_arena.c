@@ -0,0 +1,179 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic.h"
+#include "lsquic_arena.h"
+
+
+/* Buffers are at least as large as requested, do not overlap, and are
+ * reused once freed.
+ */
+static void
+test_alloc_free (void)
+{
+    struct arena *arena;
+    struct arena_stats stats;
+    static const size_t sizes[] = {
+        1, 1232, 1280, 1350, 1370, 1500, 4096, 9000, 16 * 1024, 0xFFFF,
+        ARENA_MAX_SIZE,
+    };
+    unsigned char *bufs[sizeof(sizes) / sizeof(sizes[0])][50];
+    void *buf;
+    unsigned i, j;
+
+    arena = lsquic_arena_new(-1);
+    assert(arena);
+
+    for (j = 0; j < 50; ++j)
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+        {
+            bufs[i][j] = lsquic_arena_alloc(arena, sizes[i]);
+            assert(bufs[i][j]);
+            assert(lsquic_arena_size(bufs[i][j]) >= sizes[i]);
+            memset(bufs[i][j], i * 50 + j, sizes[i]);
+        }
+
+    for (j = 0; j < 50; ++j)
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+        {
+            assert(bufs[i][j][0] == (unsigned char) (i * 50 + j));
+            assert(bufs[i][j][sizes[i] - 1] == (unsigned char) (i * 50 + j));
+        }
+
+    lsquic_arena_get_stats(arena, &stats);
+    assert(stats.as_slabs > 0);
+    assert(stats.as_bytes_out >= 50 * 0xFFFF);
+
+    /* Last freed, first reused */
+    lsquic_arena_free(arena, bufs[3][7]);
+    buf = lsquic_arena_alloc(arena, 1300);
+    assert(buf == bufs[3][7]);
+
+    for (j = 0; j < 50; ++j)
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+            lsquic_arena_free(arena, bufs[i][j]);
+
+    lsquic_arena_get_stats(arena, &stats);
+    assert(stats.as_bytes_out == 0);
+
+    assert(!lsquic_arena_alloc(arena, ARENA_MAX_SIZE + 1));
+    lsquic_arena_destroy(arena);
+}
+
+
+/* Freed buffers are reused: churn does not add slabs */
+static void
+test_churn (void)
+{
+    struct arena *arena;
+    struct arena_stats stats;
+    void *bufs[100];
+    unsigned i, n_slabs;
+
+    arena = lsquic_arena_new(-1);
+    assert(arena);
+
+    for (i = 0; i < 100; ++i)
+        bufs[i] = lsquic_arena_alloc(arena, 1200);
+    lsquic_arena_get_stats(arena, &stats);
+    n_slabs = stats.as_slabs;
+    assert(n_slabs == 1);
+
+    for (i = 0; i < 100000; ++i)
+    {
+        lsquic_arena_free(arena, bufs[i % 100]);
+        bufs[i % 100] = lsquic_arena_alloc(arena, 1000 + i % 280);
+        assert(bufs[i % 100]);
+    }
+    lsquic_arena_get_stats(arena, &stats);
+    assert(stats.as_slabs == n_slabs);
+
+    for (i = 0; i < 100; ++i)
+        lsquic_arena_free(arena, bufs[i]);
+    lsquic_arena_destroy(arena);
+}
+
+
+/* Binding may fail -- for example, if there is no such node -- but the
+ * memory is still usable.
+ */
+static void
+test_numa (void)
+{
+    struct arena *arena;
+    struct arena_stats stats;
+    void *buf;
+
+    assert(!lsquic_arena_new(ARENA_MAX_NODE + 1));
+
+    arena = lsquic_arena_new(0);
+    assert(arena);
+    buf = lsquic_arena_alloc(arena, 4096);
+    assert(buf);
+    memset(buf, 0, 4096);
+    lsquic_arena_get_stats(arena, &stats);
+    assert(stats.as_bind_fail <= stats.as_slabs);
+    lsquic_arena_free(arena, buf);
+    lsquic_arena_destroy(arena);
+}
+
+
+static lsquic_engine_t *
+new_engine (int arena)
+{
+    struct lsquic_engine_settings settings;
+    struct lsquic_engine_api api;
+
+    lsquic_engine_init_settings(&settings, LSENG_SERVER);
+    settings.es_arena = arena;
+    memset(&api, 0, sizeof(api));
+    api.ea_settings = &settings;
+    api.ea_packets_out = (void *) (uintptr_t) 1;
+    return lsquic_engine_new(LSENG_SERVER, &api);
+}
+
+
+/* Application's packet out memory interface can use the engine's arena */
+static void
+test_engine_arena (void)
+{
+    lsquic_engine_t *engine;
+    unsigned char *buf, *buf2;
+
+    engine = new_engine(1);
+    assert(engine);
+    buf = lsquic_engine_arena_alloc(engine, 1370);
+    assert(buf);
+    assert(lsquic_arena_size(buf) >= 1370);
+    memset(buf, 0xAB, 1370);
+    lsquic_engine_arena_free(engine, buf);
+    buf2 = lsquic_engine_arena_alloc(engine, 1370);
+    assert(buf2 == buf);
+    lsquic_engine_arena_free(engine, buf2);
+    assert(!lsquic_engine_arena_alloc(engine, ARENA_MAX_SIZE + 1));
+    lsquic_engine_destroy(engine);
+
+    engine = new_engine(0);
+    assert(engine);
+    assert(!lsquic_engine_arena_alloc(engine, 1370));
+    lsquic_engine_destroy(engine);
+}
+
+
+int
+main (void)
+{
+    test_alloc_free();
+    test_churn();
+    test_numa();
+
+    if (0 != lsquic_global_init(LSQUIC_GLOBAL_SERVER))
+        return 1;
+    test_engine_arena();
+    lsquic_global_cleanup();
+    return 0;
+}
@@ -215,6 +215,71 @@ test_attq_removal_3 (void)
 }
 
 
+/* Times far apart and in the past: exercises cascading of timer wheel */
+static void
+test_attq_cascade (void)
+{
+    static const lsquic_time_t times[] = {
+        1000000, 5, 1000001, 70, 64, 1ULL << 40, 4095, 4096, 123456789,
+        (1ULL << 40) + 1, 63, 262144, ~0ULL - 1, 1000000, 9999, 0,
+    };
+    const unsigned n_conns = sizeof(times) / sizeof(times[0]);
+    struct attq *q;
+    struct lsquic_conn *conns, *conn;
+    const struct attq_elem *next_attq;
+    lsquic_time_t prev, cutoff;
+    unsigned i, n_popped;
+    int s;
+
+    q = attq_create();
+    conns = calloc(n_conns, sizeof(conns[0]));
+
+    /* Advance the queue first, so that some times are in the past */
+    conn = attq_pop(q, 1000);
+    assert(!conn);
+
+    for (i = 0; i < n_conns; ++i)
+    {
+        s = attq_add(q, &conns[i], times[i], 0);
+        assert(s == 0);
+    }
+
+    attq_remove(q, &conns[8]);    /* 123456789 */
+    assert(!conns[8].cn_attq_elem);
+
+    n_popped = 0;
+    prev = 0;
+    for (cutoff = 1; n_popped < n_conns - 1; cutoff *= 3)
+    {
+        while ((conn = attq_pop(q, cutoff)))
+        {
+            assert(conn->cn_attq_elem == NULL);
+            i = conn - conns;
+            assert(times[i] < cutoff);
+            assert(times[i] >= prev);
+            prev = times[i];
+            ++n_popped;
+        }
+        next_attq = attq_next(q);
+        if (next_attq)
+            assert(next_attq->ae_adv_time >= cutoff);
+        if (cutoff > ~0ULL / 3)
+        {
+            conn = attq_pop(q, ~0ULL);
+            if (conn)
+                ++n_popped;
+            break;
+        }
+    }
+
+    assert(n_popped == n_conns - 1);
+    assert(!attq_next(q));
+
+    free(conns);
+    attq_destroy(q);
+}
+
+
 int
 main (void)
 {
@@ -224,5 +289,6 @@ main (void)
     test_attq_removal_1();
     test_attq_removal_2();
     test_attq_removal_3();
+    test_attq_cascade();
     return 0;
 }
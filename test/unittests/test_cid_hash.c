@@ -0,0 +1,232 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include "lsquic_hash.h"
+#include "lsquic_cid_hash.h"
+
+
+static const unsigned char s_hash_key[LSQUIC_HASH_KEY_SZ] = "0123456789ABCDEF";
+
+
+struct widget
+{
+    struct lsquic_hash_elem hash_el;
+    unsigned char   key[20];
+    unsigned        key_len;
+    int             in_hash;
+};
+
+
+static void
+make_key (struct widget *widget, unsigned n, unsigned key_len)
+{
+    unsigned i;
+
+    memset(widget->key, 0, sizeof(widget->key));
+    for (i = 0; i < key_len; ++i)
+        widget->key[i] = (unsigned char) (n >> (i % 4 * 8)) ^ i;
+    widget->key_len = key_len;
+}
+
+
+static void
+check_all (struct cid_hash *hash, struct widget *widgets, unsigned nelems)
+{
+    struct lsquic_hash_elem *el;
+    unsigned n, count;
+
+    for (n = 0, count = 0; n < nelems; ++n)
+    {
+        el = lsquic_cidh_find(hash, widgets[n].key, widgets[n].key_len);
+        if (widgets[n].in_hash)
+        {
+            assert(el == &widgets[n].hash_el);
+            assert(lsquic_hashelem_getdata(el) == &widgets[n]);
+            ++count;
+        }
+        else
+            assert(!el);
+    }
+    assert(count == lsquic_cidh_count(hash));
+
+    for (n = 0, el = lsquic_cidh_first(hash); el;
+                                            ++n, el = lsquic_cidh_next(hash))
+        assert(((struct widget *) lsquic_hashelem_getdata(el))->in_hash);
+    assert(n == count);
+}
+
+
+static void
+insert (struct cid_hash *hash, struct widget *widget)
+{
+    struct lsquic_hash_elem *el;
+
+    el = lsquic_cidh_insert(hash, widget->key, widget->key_len, widget,
+                                                            &widget->hash_el);
+    assert(el == &widget->hash_el);
+    widget->in_hash = 1;
+}
+
+
+static void
+erase (struct cid_hash *hash, struct widget *widget)
+{
+    lsquic_cidh_erase(hash, &widget->hash_el);
+    widget->in_hash = 0;
+}
+
+
+/* Grow the hash, verifying contents while old table is being drained */
+static void
+test_grow (unsigned key_len, unsigned nelems)
+{
+    struct lsquic_hash_stats stats;
+    struct cid_hash *hash;
+    struct widget *widgets;
+    unsigned n;
+
+    hash = lsquic_cidh_create(key_len, s_hash_key);
+    widgets = calloc(nelems, sizeof(widgets[0]));
+
+    for (n = 0; n < nelems; ++n)
+    {
+        make_key(&widgets[n], n, key_len);
+        assert(!lsquic_cidh_find(hash, widgets[n].key, key_len));
+        insert(hash, &widgets[n]);
+        /* Inserting the same element again fails */
+        assert(!lsquic_cidh_insert(hash, widgets[n].key, key_len,
+                                        &widgets[n], &widgets[n].hash_el));
+        if (n % 97 == 0)
+            check_all(hash, widgets, nelems);
+    }
+    check_all(hash, widgets, nelems);
+
+    for (n = 0; n < nelems; n += 2)
+        erase(hash, &widgets[n]);
+    check_all(hash, widgets, nelems);
+
+    for (n = 0; n < nelems; n += 2)
+        insert(hash, &widgets[n]);
+    check_all(hash, widgets, nelems);
+
+    /* Lookups stay short: most finish in the first group */
+    lsquic_cidh_get_stats(hash, &stats);
+    assert(stats.hs_lookups > 0);
+    assert(stats.hs_probes < stats.hs_lookups * 2);
+
+    lsquic_cidh_destroy(hash);
+    free(widgets);
+}
+
+
+/* Keys of different lengths -- CIDs and ports -- live in the same hash */
+static void
+test_mixed_lengths (void)
+{
+    struct cid_hash *hash;
+    struct widget widgets[60];
+    unsigned n;
+
+    memset(widgets, 0, sizeof(widgets));
+    hash = lsquic_cidh_create(8, s_hash_key);
+    for (n = 0; n < 60; ++n)
+    {
+        /* Same leading bytes, different lengths */
+        make_key(&widgets[n], n / 3, (unsigned []) { 2, 8, 20, }[n % 3]);
+        insert(hash, &widgets[n]);
+    }
+    check_all(hash, widgets, 60);
+    lsquic_cidh_destroy(hash);
+}
+
+
+/* Erasing while iterating, the way the engine closes all connections */
+static void
+test_erase_while_iterating (void)
+{
+    struct cid_hash *hash;
+    struct lsquic_hash_elem *el;
+    struct widget widgets[100];
+    unsigned n;
+
+    memset(widgets, 0, sizeof(widgets));
+    hash = lsquic_cidh_create(8, s_hash_key);
+    for (n = 0; n < 100; ++n)
+    {
+        make_key(&widgets[n], n, 8);
+        insert(hash, &widgets[n]);
+    }
+    for (n = 0, el = lsquic_cidh_first(hash); el;
+                                            ++n, el = lsquic_cidh_next(hash))
+        erase(hash, lsquic_hashelem_getdata(el));
+    assert(n == 100);
+    assert(0 == lsquic_cidh_count(hash));
+    check_all(hash, widgets, 100);
+    lsquic_cidh_destroy(hash);
+}
+
+
+/* Long churn with a steady population leaves deleted slots behind; the
+ * hash must keep working and not grow without bound.
+ */
+static void
+test_churn (void)
+{
+    struct cid_hash *hash;
+    struct widget *widgets;
+    size_t max_mem;
+    unsigned n, i;
+    const unsigned nelems = 1000, live = 100;
+
+    hash = lsquic_cidh_create(8, s_hash_key);
+    widgets = calloc(nelems, sizeof(widgets[0]));
+    for (n = 0; n < nelems; ++n)
+        make_key(&widgets[n], n, 8);
+
+    max_mem = 0;
+    for (i = 0; i < 20000; ++i)
+    {
+        if (i >= live)
+            erase(hash, &widgets[(i - live) % nelems]);
+        insert(hash, &widgets[i % nelems]);
+        if (lsquic_cidh_mem_used(hash) > max_mem)
+            max_mem = lsquic_cidh_mem_used(hash);
+        if (i % 1001 == 0)
+            check_all(hash, widgets, nelems);
+    }
+    check_all(hash, widgets, nelems);
+    assert(live + 1 >= lsquic_cidh_count(hash));
+    assert(max_mem < 16 * 1024);
+
+    lsquic_cidh_destroy(hash);
+    free(widgets);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    unsigned nelems;
+
+    if (argc > 1)
+        nelems = atoi(argv[1]);
+    else
+        nelems = 10000;
+
+    test_grow(8, nelems);
+    test_grow(20, nelems);
+    test_grow(5, 100);
+    test_mixed_lengths();
+    test_erase_while_iterating();
+    test_churn();
+
+    exit(0);
+}
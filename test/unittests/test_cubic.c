@@ -24,6 +24,8 @@
 #include "lsquic_stream.h"
 #include "lsquic_rtt.h"
 #include "lsquic_conn_public.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
 #include "lsquic_packet_common.h"
 #include "lsquic_packet_out.h"
 
@@ -36,10 +38,12 @@ test_post_quiescence_explosion (void)
     lsquic_time_t const rtt = 10000;
     lsquic_time_t t = 12345600;
     struct lsquic_conn lconn = LSCONN_INITIALIZER_CIDLEN(lconn, 8);
-    struct lsquic_conn_public conn_pub = { .lconn = &lconn, };
+    struct lsquic_engine_public enpub;
+    struct lsquic_conn_public conn_pub = { .lconn = &lconn, .enpub = &enpub, };
     int i;
     struct lsquic_packet_out packet_out = {};
 
+    memset(&enpub, 0, sizeof(enpub));
     cci->cci_init(&cubic, &conn_pub, 0);
     cubic.cu_ssthresh = cubic.cu_cwnd = 32 * 1370;
 
@@ -70,10 +74,12 @@ test_post_quiescence_explosion2 (void)
     lsquic_time_t const rtt = 10000;
     lsquic_time_t t = 12345600;
     struct lsquic_conn lconn = LSCONN_INITIALIZER_CIDLEN(lconn, 8);
-    struct lsquic_conn_public conn_pub = { .lconn = &lconn, };
+    struct lsquic_engine_public enpub;
+    struct lsquic_conn_public conn_pub = { .lconn = &lconn, .enpub = &enpub, };
     int i;
     struct lsquic_packet_out packet_out = {};
 
+    memset(&enpub, 0, sizeof(enpub));
     cci->cci_init(&cubic, &conn_pub, 0);
     cubic.cu_ssthresh = cubic.cu_cwnd = 32 * 1370;
 
@@ -0,0 +1,1166 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * test_engine_conns.c -- Client and server engines connected in memory.
+ *
+ * Packets are passed between the engines without going through sockets
+ * and time is virtual: when no packets are in flight, the clock jumps to
+ * the earliest advisory tick time.  This way, tests that depend on timers
+ * run quickly and deterministically.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#else
+#include "vc_compat.h"
+#endif
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_sizes.h"
+#include "lsquic_hash.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_export.h"
+
+
+#define SERVER_PORT 443
+#define CLIENT_PORT 12345
+
+/* Advance the clock in steps no larger than this */
+#define MAX_STEP 10000
+
+
+struct test_packet
+{
+    TAILQ_ENTRY(test_packet)    next;
+    struct sockaddr_in          local, peer;
+    int                         ecn;
+    size_t                      sz;
+    unsigned char               buf[];
+};
+
+TAILQ_HEAD(packets_head, test_packet);
+
+
+/* One side of the connection: an engine and its incoming packets */
+struct endpoint
+{
+    lsquic_engine_t            *ep_engine;
+    struct network             *ep_net;
+    struct sockaddr_in          ep_addr;
+    struct packets_head         ep_inbox;
+    lsquic_conn_t              *ep_conn;        /* Latest connection */
+    unsigned                    ep_n_new_conns;
+    unsigned                    ep_n_closed_conns;
+    unsigned                    ep_n_packets_in;
+    unsigned                    ep_n_packets_out;
+    int                         ep_hsk_ok;      /* Client only */
+    unsigned char               ep_data[0x100]; /* Data read from streams */
+    size_t                      ep_data_sz;
+    /* If set, packets are passed to the engine in refcounted buffers */
+    int                         ep_zero_copy;
+    unsigned                    ep_n_bufs_live;
+    unsigned                    ep_n_buf_increfs;
+};
+
+
+struct network
+{
+    uint64_t                    now;
+    SSL_CTX                    *ssl_ctx;
+    struct endpoint             client;
+    /* There may be several servers.  They share the same address: packets
+     * addressed to it go to `route'.
+     */
+    struct endpoint            *route;
+};
+
+
+static uint64_t
+get_time (void *ctx)
+{
+    struct network *const net = ctx;
+    return net->now;
+}
+
+
+static struct endpoint *
+find_dest (struct network *net, const struct sockaddr *sa)
+{
+    const struct sockaddr_in *const sin = (void *) sa;
+
+    if (sin->sin_port == net->client.ep_addr.sin_port)
+        return &net->client;
+    else
+        return net->route;
+}
+
+
+static void
+enqueue_packet (struct endpoint *src, struct endpoint *dst,
+                                    const unsigned char *buf, size_t sz, int ecn)
+{
+    struct test_packet *packet;
+
+    packet = malloc(sizeof(*packet) + sz);
+    assert(packet);
+    memcpy(packet->buf, buf, sz);
+    packet->sz = sz;
+    packet->ecn = ecn;
+    packet->local = dst->ep_addr;
+    packet->peer = src->ep_addr;
+    TAILQ_INSERT_TAIL(&dst->ep_inbox, packet, next);
+}
+
+
+static int
+packets_out (void *ctx, const struct lsquic_out_spec *specs, unsigned count)
+{
+    struct endpoint *const src = ctx;
+    struct endpoint *dst;
+    unsigned char buf[0x10000];
+    size_t sz, off, len;
+    unsigned n, i;
+
+    for (n = 0; n < count; ++n)
+    {
+        sz = 0;
+        for (i = 0; i < specs[n].iovlen; ++i)
+        {
+            assert(sz + specs[n].iov[i].iov_len <= sizeof(buf));
+            memcpy(buf + sz, specs[n].iov[i].iov_base, specs[n].iov[i].iov_len);
+            sz += specs[n].iov[i].iov_len;
+        }
+        dst = find_dest(src->ep_net, specs[n].dest_sa);
+        if (specs[n].gso_size)
+            for (off = 0; off < sz; off += len)
+            {
+                len = sz - off;
+                if (len > specs[n].gso_size)
+                    len = specs[n].gso_size;
+                enqueue_packet(src, dst, buf + off, len, specs[n].ecn);
+                ++src->ep_n_packets_out;
+            }
+        else
+        {
+            enqueue_packet(src, dst, buf, sz, specs[n].ecn);
+            ++src->ep_n_packets_out;
+        }
+    }
+
+    return (int) count;
+}
+
+
+static lsquic_conn_ctx_t *
+on_new_conn (void *stream_if_ctx, lsquic_conn_t *conn)
+{
+    struct endpoint *const ep = stream_if_ctx;
+
+    ep->ep_conn = conn;
+    ++ep->ep_n_new_conns;
+    return (void *) ep;
+}
+
+
+static void
+on_conn_closed (lsquic_conn_t *conn)
+{
+    struct endpoint *const ep = (void *) lsquic_conn_get_ctx(conn);
+
+    if (ep->ep_conn == conn)
+        ep->ep_conn = NULL;
+    ++ep->ep_n_closed_conns;
+}
+
+
+static void
+on_hsk_done (lsquic_conn_t *conn, enum lsquic_hsk_status status)
+{
+    struct endpoint *const ep = (void *) lsquic_conn_get_ctx(conn);
+
+    ep->ep_hsk_ok = status == LSQ_HSK_OK || status == LSQ_HSK_0RTT_OK;
+}
+
+
+static lsquic_stream_ctx_t *
+on_new_stream (void *stream_if_ctx, lsquic_stream_t *stream)
+{
+    struct endpoint *const ep = stream_if_ctx;
+
+    if (!stream)
+        return NULL;
+    if (ep == &ep->ep_net->client)
+        lsquic_stream_wantwrite(stream, 1);
+    else
+        lsquic_stream_wantread(stream, 1);
+    return (void *) ep;
+}
+
+
+static void
+on_read (lsquic_stream_t *stream, lsquic_stream_ctx_t *h)
+{
+    struct endpoint *const ep = (void *) h;
+    ssize_t nread;
+
+    nread = lsquic_stream_read(stream, ep->ep_data + ep->ep_data_sz,
+                                        sizeof(ep->ep_data) - ep->ep_data_sz);
+    if (nread > 0)
+        ep->ep_data_sz += (size_t) nread;
+    else
+        lsquic_stream_close(stream);
+}
+
+
+/* The client writes the message once and closes the stream */
+static void
+on_write (lsquic_stream_t *stream, lsquic_stream_ctx_t *h)
+{
+    static const char msg[] = "hello";
+    ssize_t nw;
+
+    nw = lsquic_stream_write(stream, msg, sizeof(msg) - 1);
+    assert(nw == (ssize_t) sizeof(msg) - 1);
+    lsquic_stream_shutdown(stream, 1);
+    lsquic_stream_wantwrite(stream, 0);
+    lsquic_stream_wantread(stream, 1);
+}
+
+
+static void
+on_close (lsquic_stream_t *stream, lsquic_stream_ctx_t *h)
+{
+}
+
+
+static const struct lsquic_stream_if stream_if =
+{
+    .on_new_conn    = on_new_conn,
+    .on_conn_closed = on_conn_closed,
+    .on_new_stream  = on_new_stream,
+    .on_read        = on_read,
+    .on_write       = on_write,
+    .on_close       = on_close,
+    .on_hsk_done    = on_hsk_done,
+};
+
+
+/* Refcounted receive buffer, see struct lsquic_recv_buf_if */
+struct recv_buf
+{
+    struct endpoint            *rb_ep;
+    unsigned                    rb_refcnt;
+    unsigned char               rb_data[];
+};
+
+
+static void
+rbi_incref (void *rbi_ctx, void *buf_ctx)
+{
+    struct recv_buf *const rb = buf_ctx;
+
+    assert(rb->rb_ep == rbi_ctx);
+    assert(rb->rb_refcnt > 0);
+    ++rb->rb_refcnt;
+    ++rb->rb_ep->ep_n_buf_increfs;
+}
+
+
+static void
+rbi_release (void *rbi_ctx, void *buf_ctx)
+{
+    struct recv_buf *const rb = buf_ctx;
+
+    assert(rb->rb_ep == rbi_ctx);
+    assert(("buffer is not released twice", rb->rb_refcnt > 0));
+    if (0 == --rb->rb_refcnt)
+    {
+        --rb->rb_ep->ep_n_bufs_live;
+        free(rb);
+    }
+}
+
+
+static const struct lsquic_recv_buf_if recv_buf_if =
+{
+    .rbi_incref     = rbi_incref,
+    .rbi_release    = rbi_release,
+};
+
+
+static int
+select_alpn (SSL *ssl, const unsigned char **out, unsigned char *outlen,
+                    const unsigned char *in, unsigned int inlen, void *arg)
+{
+    const unsigned char alpn[] = "\x5h3-23\x5h3-24";
+    int r;
+
+    r = SSL_select_next_proto((unsigned char **) out, outlen, in, inlen,
+                                                            alpn, sizeof(alpn));
+    if (r == OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_OK;
+    else
+        return SSL_TLSEXT_ERR_ALERT_FATAL;
+}
+
+
+/* Server SSL context with a freshly generated self-signed certificate */
+static SSL_CTX *
+new_ssl_ctx (void)
+{
+    SSL_CTX *ssl_ctx;
+    EC_KEY *ec_key;
+    EVP_PKEY *pkey;
+    X509 *x509;
+    X509_NAME *name;
+    int s;
+
+    ec_key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    assert(ec_key);
+    s = EC_KEY_generate_key(ec_key);
+    assert(s);
+    pkey = EVP_PKEY_new();
+    assert(pkey);
+    s = EVP_PKEY_assign_EC_KEY(pkey, ec_key);
+    assert(s);
+
+    x509 = X509_new();
+    assert(x509);
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 24 * 3600);
+    X509_set_pubkey(x509, pkey);
+    name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                (const unsigned char *) "localhost", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    s = X509_sign(x509, pkey, EVP_sha256());
+    assert(s);
+
+    ssl_ctx = SSL_CTX_new(TLS_method());
+    assert(ssl_ctx);
+    SSL_CTX_set_min_proto_version(ssl_ctx, TLS1_3_VERSION);
+    SSL_CTX_set_max_proto_version(ssl_ctx, TLS1_3_VERSION);
+    SSL_CTX_set_alpn_select_cb(ssl_ctx, select_alpn, NULL);
+    s = SSL_CTX_use_certificate(ssl_ctx, x509);
+    assert(s);
+    s = SSL_CTX_use_PrivateKey(ssl_ctx, pkey);
+    assert(s);
+
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+    return ssl_ctx;
+}
+
+
+static struct network *s_net;
+
+
+static SSL_CTX *
+get_ssl_ctx (void *peer_ctx)
+{
+    return s_net->ssl_ctx;
+}
+
+
+static SSL_CTX *
+lookup_cert (void *ctx, const struct sockaddr *local, const char *sni)
+{
+    return s_net->ssl_ctx;
+}
+
+
+static void
+init_endpoint (struct network *net, struct endpoint *ep, unsigned flags,
+                    const struct lsquic_engine_settings *custom_settings)
+{
+    struct lsquic_engine_settings settings;
+    struct lsquic_engine_api api;
+    char errbuf[100];
+
+    memset(ep, 0, sizeof(*ep));
+    ep->ep_net = net;
+    TAILQ_INIT(&ep->ep_inbox);
+    ep->ep_addr.sin_family = AF_INET;
+    ep->ep_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ep->ep_addr.sin_port = htons(flags & LSENG_SERVER
+                                                ? SERVER_PORT : CLIENT_PORT);
+
+    if (custom_settings)
+        settings = *custom_settings;
+    else
+        lsquic_engine_init_settings(&settings, flags);
+    settings.es_versions = 1 << LSQVER_ID24;
+    if (0 != lsquic_engine_check_settings(&settings, flags, errbuf,
+                                                            sizeof(errbuf)))
+    {
+        fprintf(stderr, "invalid settings: %s\n", errbuf);
+        abort();
+    }
+
+    memset(&api, 0, sizeof(api));
+    api.ea_settings = &settings;
+    api.ea_stream_if = &stream_if;
+    api.ea_stream_if_ctx = ep;
+    api.ea_packets_out = packets_out;
+    api.ea_packets_out_ctx = ep;
+    api.ea_get_time = get_time;
+    api.ea_get_time_ctx = net;
+    /* Only used by endpoints that set ep_zero_copy */
+    api.ea_rbi = &recv_buf_if;
+    api.ea_rbi_ctx = ep;
+    if (flags & LSENG_SERVER)
+    {
+        api.ea_get_ssl_ctx = get_ssl_ctx;
+        api.ea_lookup_cert = lookup_cert;
+    }
+
+    ep->ep_engine = lsquic_engine_new(flags, &api);
+    assert(ep->ep_engine);
+}
+
+
+static void
+cleanup_endpoint (struct endpoint *ep)
+{
+    struct test_packet *packet;
+
+    lsquic_engine_destroy(ep->ep_engine);
+    while ((packet = TAILQ_FIRST(&ep->ep_inbox)))
+    {
+        TAILQ_REMOVE(&ep->ep_inbox, packet, next);
+        free(packet);
+    }
+}
+
+
+static void
+init_network (struct network *net, struct endpoint *server,
+                    const struct lsquic_engine_settings *server_settings)
+{
+    memset(net, 0, sizeof(*net));
+    s_net = net;
+    net->now = 1000000;
+    net->ssl_ctx = new_ssl_ctx();
+    init_endpoint(net, &net->client, 0, NULL);
+    init_endpoint(net, server, LSENG_SERVER, server_settings);
+    net->route = server;
+}
+
+
+static void
+cleanup_network (struct network *net)
+{
+    cleanup_endpoint(&net->client);
+    SSL_CTX_free(net->ssl_ctx);
+    s_net = NULL;
+}
+
+
+/* Pass packet to the engine in a refcounted buffer.  The engine may
+ * decrypt it in place and hold on to it after this function returns.
+ */
+static void
+deliver_zero_copy (struct endpoint *ep, const struct test_packet *packet)
+{
+    struct lsquic_in_spec spec;
+    struct recv_buf *rb;
+    int n;
+
+    rb = malloc(sizeof(*rb) + packet->sz);
+    assert(rb);
+    rb->rb_ep = ep;
+    rb->rb_refcnt = 1;
+    memcpy(rb->rb_data, packet->buf, packet->sz);
+    ++ep->ep_n_bufs_live;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.buf = rb->rb_data;
+    spec.bufsz = packet->sz;
+    spec.local_sa = (struct sockaddr *) &packet->local;
+    spec.peer_sa = (struct sockaddr *) &packet->peer;
+    spec.peer_ctx = ep;
+    spec.ecn = packet->ecn;
+    spec.buf_ctx = rb;
+    n = lsquic_engine_packets_in(ep->ep_engine, &spec, 1);
+    assert(1 == n);
+
+    rbi_release(ep, rb);
+}
+
+
+/* Returns true if there were packets to deliver */
+static int
+deliver_packets (struct endpoint *ep)
+{
+    struct test_packet *packet;
+    int delivered;
+
+    delivered = 0;
+    while ((packet = TAILQ_FIRST(&ep->ep_inbox)))
+    {
+        TAILQ_REMOVE(&ep->ep_inbox, packet, next);
+        if (ep->ep_zero_copy)
+            deliver_zero_copy(ep, packet);
+        else
+            (void) lsquic_engine_packet_in(ep->ep_engine, packet->buf,
+                    packet->sz, (struct sockaddr *) &packet->local,
+                    (struct sockaddr *) &packet->peer, ep, packet->ecn);
+        ++ep->ep_n_packets_in;
+        free(packet);
+        delivered = 1;
+    }
+    if (delivered)
+        lsquic_engine_process_conns(ep->ep_engine);
+    return delivered;
+}
+
+
+static void
+advance_time (struct network *net, struct endpoint **eps, unsigned n_eps)
+{
+    int diff, min_diff;
+    unsigned n;
+
+    min_diff = MAX_STEP;
+    for (n = 0; n < n_eps; ++n)
+        if (lsquic_engine_earliest_adv_tick(eps[n]->ep_engine, &diff)
+                                                        && diff < min_diff)
+            min_diff = diff;
+    if (min_diff > 0)
+        net->now += (unsigned) min_diff;
+    for (n = 0; n < n_eps; ++n)
+        lsquic_engine_process_conns(eps[n]->ep_engine);
+}
+
+
+/* Run the network until `done' returns true.  Returns false if this does
+ * not happen within `max_usec' microseconds of virtual time.  The servers
+ * that are not the current route are processed as well.
+ */
+static int
+run_network (struct network *net, struct endpoint **servers,
+             unsigned n_servers, int (*done)(struct network *),
+             uint64_t max_usec)
+{
+    struct endpoint *eps[4];
+    const uint64_t deadline = net->now + max_usec;
+    unsigned n, n_eps;
+    int delivered;
+
+    assert(n_servers < sizeof(eps) / sizeof(eps[0]));
+    eps[0] = &net->client;
+    for (n = 0; n < n_servers; ++n)
+        eps[n + 1] = servers[n];
+    n_eps = n_servers + 1;
+
+    while (!done(net))
+    {
+        if (net->now > deadline)
+            return 0;
+        delivered = 0;
+        for (n = 0; n < n_eps; ++n)
+            delivered |= deliver_packets(eps[n]);
+        if (!delivered)
+            advance_time(net, eps, n_eps);
+    }
+
+    return 1;
+}
+
+
+/* Create client connection without ticking it */
+static lsquic_conn_t *
+start_client (struct network *net)
+{
+    struct sockaddr_in server_addr;
+    lsquic_conn_t *conn;
+
+    server_addr = net->route->ep_addr;
+    conn = lsquic_engine_connect(net->client.ep_engine, LSQVER_ID24,
+                (struct sockaddr *) &net->client.ep_addr,
+                (struct sockaddr *) &server_addr, &net->client, NULL,
+                "localhost", 0, NULL, 0, NULL, 0);
+    assert(conn);
+    return conn;
+}
+
+
+static lsquic_conn_t *
+connect_client (struct network *net)
+{
+    lsquic_conn_t *conn;
+
+    conn = start_client(net);
+    lsquic_engine_process_conns(net->client.ep_engine);
+    return conn;
+}
+
+
+static int
+server_can_export (struct network *net)
+{
+    return net->client.ep_hsk_ok && net->route->ep_conn
+        && lsquic_conn_export(net->route->ep_conn, NULL, 0) > 0;
+}
+
+
+static int
+server_got_hello (struct network *net)
+{
+    return net->route->ep_data_sz == 5
+        && 0 == memcmp(net->route->ep_data, "hello", 5);
+}
+
+
+/* Move an idle server connection to another engine.  The client continues
+ * talking to the new engine.  Packets that still reach the old engine are
+ * dropped: a stateless reset would kill the connection.
+ */
+static void
+test_export_import (void)
+{
+    struct network net;
+    struct endpoint server_a, server_b;
+    struct endpoint *servers[2] = { &server_a, &server_b, };
+    struct lsquic_engine_settings settings;
+    unsigned char buf[0x1000];
+    ssize_t len, len2;
+    unsigned n_out;
+    lsquic_conn_t *conn;
+    int s;
+
+    lsquic_engine_init_settings(&settings, LSENG_SERVER);
+    settings.es_send_prst = 1;
+    init_network(&net, &server_a, &settings);
+    init_endpoint(&net, &server_b, LSENG_SERVER, &settings);
+
+    connect_client(&net);
+    s = run_network(&net, servers, 1, server_can_export, 5000000);
+    assert(s);
+    assert(1 == server_a.ep_n_new_conns);
+
+    /* Asking for the size does not affect the connection */
+    len = lsquic_conn_export(server_a.ep_conn, NULL, 0);
+    assert(len > 0 && (size_t) len <= sizeof(buf));
+    len2 = lsquic_conn_export(server_a.ep_conn, buf, (size_t) len - 1);
+    assert(len2 == len);
+    len2 = lsquic_conn_export(server_a.ep_conn, buf, sizeof(buf));
+    assert(len2 == len);
+
+    /* The exported connection closes without sending anything */
+    n_out = server_a.ep_n_packets_out;
+    lsquic_engine_process_conns(server_a.ep_engine);
+    assert(n_out == server_a.ep_n_packets_out);
+    assert(1 == server_a.ep_n_closed_conns);
+
+    conn = lsquic_engine_import_conn(server_b.ep_engine, buf, (size_t) len,
+                                                                &server_b);
+    assert(conn);
+    assert(conn == server_b.ep_conn);
+    assert(1 == server_b.ep_n_new_conns);
+
+    /* Garbage is rejected */
+    buf[len / 2] ^= 0xFF;
+    conn = lsquic_engine_import_conn(server_b.ep_engine, buf,
+                                                    (size_t) len / 2, &server_b);
+    assert(!conn);
+    assert(1 == server_b.ep_n_new_conns);
+
+    /* The client's first packets still go to the old engine */
+    lsquic_conn_make_stream(net.client.ep_conn);
+    lsquic_engine_process_conns(net.client.ep_engine);
+    assert(!TAILQ_EMPTY(&server_a.ep_inbox));
+    s = deliver_packets(&server_a);
+    assert(s);
+    assert(("no stateless reset", n_out == server_a.ep_n_packets_out));
+    assert(TAILQ_EMPTY(&net.client.ep_inbox));
+
+    /* Once the route is switched, the client retransmits to the new engine */
+    net.route = &server_b;
+    s = run_network(&net, servers + 1, 1, server_got_hello, 5000000);
+    assert(s);
+    assert(net.client.ep_conn);
+    assert(0 == net.client.ep_n_closed_conns);
+    assert(0 == server_b.ep_n_closed_conns);
+
+    cleanup_endpoint(&server_b);
+    cleanup_endpoint(&server_a);
+    cleanup_network(&net);
+}
+
+
+/* Offsets of fields in exported connection that the importer must check.
+ * This follows write_export() in lsquic_full_conn_ietf.c.
+ */
+struct export_offsets
+{
+    size_t      eo_pack_size;
+    size_t      eo_cce_idx;
+    size_t      eo_max_recv_off;
+    size_t      eo_recv_off;
+    size_t      eo_read_off;
+    uint64_t    eo_cces_mask;
+};
+
+
+static void
+skip_u64s (struct export_reader *er, unsigned count)
+{
+    while (count-- > 0)
+        (void) lsquic_er_u64(er);
+}
+
+
+static void
+find_export_offsets (const unsigned char *buf, size_t len,
+                                                struct export_offsets *eo)
+{
+    struct export_reader er;
+    unsigned char cid[MAX_CID_LEN];
+    uint64_t n;
+    unsigned i;
+
+    lsquic_er_init(&er, buf, len);
+    skip_u64s(&er, 3);      /* Export version, QUIC version, ECN */
+    eo->eo_cces_mask = lsquic_er_u64(&er);
+    for (i = 0; i < 64; ++i)
+        if (eo->eo_cces_mask & (1ull << i))
+        {
+            (void) lsquic_er_bytes(&er, cid, sizeof(cid));
+            skip_u64s(&er, 3);
+        }
+    skip_u64s(&er, 5);      /* Current CCE index and SCID bookkeeping */
+    for (n = lsquic_er_u64(&er); n > 0 && !er.er_error; --n)
+    {
+        (void) lsquic_er_bytes(&er, cid, sizeof(cid));
+        skip_u64s(&er, 2);
+        er.er_p += IQUIC_SRESET_TOKEN_SZ;
+    }
+    skip_u64s(&er, 1);
+    er.er_p += 2 * sizeof(struct sockaddr_in6);     /* Local and peer */
+    (void) lsquic_er_bytes(&er, cid, sizeof(cid));
+    eo->eo_pack_size = er.er_p - buf;
+    eo->eo_cce_idx = eo->eo_pack_size + 8;
+    er.er_p += 16;
+    skip_u64s(&er, 7 + 5 + 8);  /* Send controller, ACK and ECN state */
+    eo->eo_max_recv_off = er.er_p - buf;
+    eo->eo_recv_off = eo->eo_max_recv_off + 8;
+    eo->eo_read_off = eo->eo_max_recv_off + 16;
+    assert(!er.er_error && eo->eo_read_off + 8 <= len);
+}
+
+
+static uint64_t
+get_u64 (const unsigned char *p)
+{
+    uint64_t val;
+    unsigned i;
+
+    for (val = 0, i = 0; i < 8; ++i)
+        val = (val << 8) | p[i];
+    return val;
+}
+
+
+static void
+put_u64 (unsigned char *p, uint64_t val)
+{
+    unsigned i;
+
+    for (i = 8; i > 0; --i, val >>= 8)
+        p[i - 1] = (unsigned char) val;
+}
+
+
+/* Exported connection comes from outside the engine.  Truncated input and
+ * out-of-range values are rejected and leave no trace in the engine.
+ */
+static void
+test_import_bad_input (void)
+{
+    struct network net;
+    struct endpoint server_a, server_b;
+    struct endpoint *servers[1] = { &server_a, };
+    struct lsquic_engine_settings settings;
+    const struct lsquic_engine_public *enpub;
+    struct export_offsets eo;
+    unsigned char buf[0x1000], copy[0x1000];
+    uint64_t max_recv_off, recv_off, read_off, unused_idx;
+    ssize_t len;
+    size_t sz;
+    unsigned i;
+    lsquic_conn_t *conn;
+    int s;
+
+    lsquic_engine_init_settings(&settings, LSENG_SERVER);
+    init_network(&net, &server_a, &settings);
+    /* With memory budget on, unread data is counted on import */
+    settings.es_mem_budget = 10 * 1024 * 1024;
+    init_endpoint(&net, &server_b, LSENG_SERVER, &settings);
+    enpub = (struct lsquic_engine_public *) server_b.ep_engine;
+
+    connect_client(&net);
+    s = run_network(&net, servers, 1, server_can_export, 5000000);
+    assert(s);
+    len = lsquic_conn_export(server_a.ep_conn, buf, sizeof(buf));
+    assert(len > 0 && (size_t) len <= sizeof(buf));
+
+    find_export_offsets(buf, (size_t) len, &eo);
+    assert(get_u64(buf + eo.eo_pack_size) >= 1200);
+    assert(eo.eo_cces_mask & (1ull << get_u64(buf + eo.eo_cce_idx)));
+    max_recv_off = get_u64(buf + eo.eo_max_recv_off);
+    recv_off = get_u64(buf + eo.eo_recv_off);
+    read_off = get_u64(buf + eo.eo_read_off);
+    assert(read_off <= max_recv_off && max_recv_off <= recv_off);
+    for (unused_idx = 0; eo.eo_cces_mask & (1ull << unused_idx); ++unused_idx)
+        ;
+
+    for (sz = 0; sz < (size_t) len; ++sz)
+    {
+        conn = lsquic_engine_import_conn(server_b.ep_engine, buf, sz,
+                                                                &server_b);
+        assert(!conn);
+    }
+
+    {
+        const struct {
+            size_t      off;
+            uint64_t    val;
+        } bad[] = {
+            { eo.eo_pack_size,      0, },
+            { eo.eo_pack_size,      1000, },
+            { eo.eo_pack_size,      0x10000, },
+            { eo.eo_cce_idx,        unused_idx, },
+            { eo.eo_cce_idx,        64, },
+            { eo.eo_cce_idx,        1ull << 40, },
+            { eo.eo_read_off,       max_recv_off + 1, },
+            { eo.eo_max_recv_off,   recv_off + 1, },
+        };
+        for (i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i)
+        {
+            memcpy(copy, buf, (size_t) len);
+            put_u64(copy + bad[i].off, bad[i].val);
+            errno = 0;
+            conn = lsquic_engine_import_conn(server_b.ep_engine, copy,
+                                                    (size_t) len, &server_b);
+            assert(!conn);
+            assert(EINVAL == errno);
+        }
+    }
+
+    assert(0 == server_b.ep_n_new_conns);
+    assert(0 == enpub->enp_stream_bytes);
+
+    /* The original is still good */
+    conn = lsquic_engine_import_conn(server_b.ep_engine, buf, (size_t) len,
+                                                                &server_b);
+    assert(conn);
+    assert(1 == server_b.ep_n_new_conns);
+    assert(enpub->enp_stream_bytes == max_recv_off - read_off);
+
+    cleanup_endpoint(&server_b);
+    cleanup_endpoint(&server_a);
+    cleanup_network(&net);
+}
+
+
+static int
+server_hibernated (struct network *net)
+{
+    return net->client.ep_hsk_ok && net->route->ep_n_closed_conns > 0;
+}
+
+
+static int
+server_has_no_conns (struct network *net)
+{
+    int diff;
+
+    return !lsquic_engine_earliest_adv_tick(net->route->ep_engine, &diff);
+}
+
+
+/* Pass the first packet in the inbox to the engine and return the result
+ * of lsquic_engine_packet_in().  If `bad_dcid' is set, a copy of the packet
+ * with corrupted DCID is passed instead and the packet stays in the inbox.
+ */
+static int
+deliver_one (struct endpoint *ep, int bad_dcid)
+{
+    struct test_packet *packet;
+    unsigned char buf[0x10000];
+    int s;
+
+    packet = TAILQ_FIRST(&ep->ep_inbox);
+    assert(packet);
+    assert(!(packet->buf[0] & 0x80));   /* Short header */
+    assert(packet->sz <= sizeof(buf));
+    memcpy(buf, packet->buf, packet->sz);
+    if (bad_dcid)
+        buf[1] ^= 0xFF;
+    else
+        TAILQ_REMOVE(&ep->ep_inbox, packet, next);
+    s = lsquic_engine_packet_in(ep->ep_engine, buf, packet->sz,
+                    (struct sockaddr *) &packet->local,
+                    (struct sockaddr *) &packet->peer, ep, packet->ecn);
+    ++ep->ep_n_packets_in;
+    if (!bad_dcid)
+        free(packet);
+    lsquic_engine_process_conns(ep->ep_engine);
+    return s;
+}
+
+
+static void
+init_hibernate_settings (struct lsquic_engine_settings *settings)
+{
+    lsquic_engine_init_settings(settings, LSENG_SERVER);
+    settings->es_hibernate_idle = 2;
+    settings->es_idle_timeout = 5;
+}
+
+
+/* An idle server connection hibernates; the next packet from the client
+ * is found by its DCID and wakes the connection up.
+ */
+static void
+test_hibernate_wake (void)
+{
+    struct network net;
+    struct endpoint server;
+    struct endpoint *servers[1] = { &server, };
+    struct lsquic_engine_settings settings;
+    int s;
+
+    /* HTTP mode is not supported */
+    lsquic_engine_init_settings(&settings, LSENG_HTTP_SERVER);
+    settings.es_hibernate_idle = 2;
+    s = lsquic_engine_check_settings(&settings, LSENG_HTTP_SERVER, NULL, 0);
+    assert(-1 == s);
+
+    init_hibernate_settings(&settings);
+    init_network(&net, &server, &settings);
+
+    connect_client(&net);
+    s = run_network(&net, servers, 1, server_hibernated, 5000000);
+    assert(s);
+    assert(1 == server.ep_n_new_conns);
+    assert(1 == server.ep_n_closed_conns);
+    assert(!server.ep_conn);
+    assert(net.client.ep_conn);
+    assert(0 == net.client.ep_n_closed_conns);
+    /* The hibernated connection is still waiting for its idle timeout */
+    assert(!server_has_no_conns(&net));
+
+    lsquic_conn_make_stream(net.client.ep_conn);
+    lsquic_engine_process_conns(net.client.ep_engine);
+    assert(!TAILQ_EMPTY(&server.ep_inbox));
+
+    /* A packet with unknown DCID does not wake the connection */
+    s = deliver_one(&server, 1);
+    assert(1 == s);
+    assert(1 == server.ep_n_new_conns);
+
+    /* The real one does */
+    s = deliver_one(&server, 0);
+    assert(0 == s);
+    assert(2 == server.ep_n_new_conns);
+    assert(server.ep_conn);
+
+    s = run_network(&net, servers, 1, server_got_hello, 5000000);
+    assert(s);
+    assert(1 == server.ep_n_closed_conns);
+    assert(0 == net.client.ep_n_closed_conns);
+
+    cleanup_endpoint(&server);
+    cleanup_network(&net);
+}
+
+
+/* A hibernated connection that is not woken up is dropped at idle timeout */
+static void
+test_hibernate_expire (void)
+{
+    struct network net;
+    struct endpoint server;
+    struct endpoint *servers[1] = { &server, };
+    struct lsquic_engine_settings settings;
+    uint64_t hibernated_at;
+    int s;
+
+    init_hibernate_settings(&settings);
+    init_network(&net, &server, &settings);
+
+    connect_client(&net);
+    s = run_network(&net, servers, 1, server_hibernated, 5000000);
+    assert(s);
+    hibernated_at = net.now;
+
+    s = run_network(&net, servers, 1, server_has_no_conns, 10000000);
+    assert(s);
+    assert(net.now - hibernated_at
+                        <= (uint64_t) settings.es_idle_timeout * 1000000);
+    assert(1 == server.ep_n_new_conns);
+    assert(1 == server.ep_n_closed_conns);
+
+    /* The connection is gone: packets for it are not processed */
+    lsquic_conn_make_stream(net.client.ep_conn);
+    lsquic_engine_process_conns(net.client.ep_engine);
+    s = deliver_one(&server, 0);
+    assert(1 == s);
+    assert(1 == server.ep_n_new_conns);
+
+    cleanup_endpoint(&server);
+    cleanup_network(&net);
+}
+
+
+/* Returns true if `dst' has a long-header packet from client connection
+ * `conn' waiting in its inbox.  Client connection is identified by SCID.
+ */
+static int
+has_packet_from (const struct endpoint *dst, const lsquic_conn_t *conn)
+{
+    const lsquic_cid_t *const scid = lsquic_conn_id(conn);
+    const struct test_packet *packet;
+    const unsigned char *p, *end;
+
+    TAILQ_FOREACH(packet, &dst->ep_inbox, next)
+    {
+        p = packet->buf;
+        end = p + packet->sz;
+        if (packet->sz < 6 || !(p[0] & 0x80))
+            continue;
+        p += 5;                 /* Flags and version */
+        p += 1 + p[0];          /* DCID */
+        if (p < end && p[0] == scid->len && p + 1 + scid->len <= end
+                                && 0 == memcmp(p + 1, scid->idbuf, scid->len))
+            return 1;
+    }
+
+    return 0;
+}
+
+
+static unsigned
+count_conns_sent (const struct endpoint *dst, lsquic_conn_t *const *conns,
+                                                            unsigned n_conns)
+{
+    unsigned n, count;
+
+    count = 0;
+    for (n = 0; n < n_conns; ++n)
+        count += has_packet_from(dst, conns[n]);
+    return count;
+}
+
+
+/* Connections are ticked no more than the budget allows.  Those that are
+ * left over are ticked by the next call, before the ones already ticked.
+ */
+static void
+test_process_conns_budget (void)
+{
+    struct network net;
+    struct endpoint server;
+    lsquic_conn_t *conns[5];
+    unsigned left, n;
+    int diff;
+
+    init_network(&net, &server, NULL);
+    for (n = 0; n < sizeof(conns) / sizeof(conns[0]); ++n)
+        conns[n] = start_client(&net);
+    assert(0 == count_conns_sent(&server, conns, 5));
+
+    left = lsquic_engine_process_conns_budget(net.client.ep_engine, 1, 0);
+    assert(1 == count_conns_sent(&server, conns, 5));
+    assert(left >= 4);
+    /* Connections left over make the engine ready to tick again */
+    assert(lsquic_engine_earliest_adv_tick(net.client.ep_engine, &diff));
+    assert(diff <= 0);
+
+    left = lsquic_engine_process_conns_budget(net.client.ep_engine, 2, 0);
+    assert(3 == count_conns_sent(&server, conns, 5));
+    assert(left >= 2);
+
+    /* No limit on the number of connections: the rest are ticked */
+    left = lsquic_engine_process_conns_budget(net.client.ep_engine, 0,
+                                                                    1000000);
+    assert(5 == count_conns_sent(&server, conns, 5));
+
+    /* Connections that are still tickable are worked off one by one */
+    for (n = 0; left > 0 && n < 10; ++n)
+        left = lsquic_engine_process_conns_budget(net.client.ep_engine, 1, 0);
+    assert(0 == left);
+
+    cleanup_endpoint(&server);
+    cleanup_network(&net);
+}
+
+
+/* The server receives packets in refcounted buffers, which it decrypts in
+ * place.  The data is read correctly and each buffer is released exactly
+ * once.
+ */
+static void
+test_zero_copy_recv (void)
+{
+    struct network net;
+    struct endpoint server;
+    struct endpoint *servers[1] = { &server, };
+    int s;
+
+    init_network(&net, &server, NULL);
+    server.ep_zero_copy = 1;
+
+    connect_client(&net);
+    lsquic_conn_make_stream(net.client.ep_conn);
+    s = run_network(&net, servers, 1, server_got_hello, 5000000);
+    assert(s);
+    assert(server.ep_n_packets_in > 0);
+    /* Packets were decrypted in place, not copied */
+    assert(server.ep_n_buf_increfs > 0);
+
+    /* Buffers still referenced by the connection are released when the
+     * engine is destroyed.
+     */
+    cleanup_endpoint(&server);
+    assert(0 == server.ep_n_bufs_live);
+    cleanup_network(&net);
+}
+
+
+int
+main (void)
+{
+    if (0 != lsquic_global_init(LSQUIC_GLOBAL_CLIENT|LSQUIC_GLOBAL_SERVER))
+        return 1;
+
+    test_export_import();
+    test_import_bad_input();
+    test_hibernate_wake();
+    test_hibernate_expire();
+    test_process_conns_budget();
+    test_zero_copy_recv();
+
+    lsquic_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,245 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test lsquic_engine_mem_stats() using fake connections inserted directly
+ * into the engine's connection hash.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#else
+#include "vc_compat.h"
+#endif
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+
+
+struct test_conn
+{
+    struct lsquic_conn      tc_conn;
+    struct conn_cid_elem    tc_cces[3];
+    struct network_path     tc_path;
+    /* Each category is a multiple of this; the total is 21 times this */
+    size_t                  tc_unit;
+};
+
+
+static struct network_path *
+test_ci_get_path (struct lsquic_conn *lconn, const struct sockaddr *sa)
+{
+    struct test_conn *const tc = (struct test_conn *) lconn;
+    return &tc->tc_path;
+}
+
+
+static void
+test_ci_mem_stats (struct lsquic_conn *lconn, struct lsquic_mem_stats *stats)
+{
+    struct test_conn *const tc = (struct test_conn *) lconn;
+    stats->ms_packets_in  += 1 * tc->tc_unit;
+    stats->ms_packets_out += 2 * tc->tc_unit;
+    stats->ms_pools       += 3 * tc->tc_unit;
+    stats->ms_conns       += 4 * tc->tc_unit;
+    stats->ms_streams     += 5 * tc->tc_unit;
+    stats->ms_hdr_tables  += 6 * tc->tc_unit;
+}
+
+
+static const struct conn_iface test_conn_iface = {
+    .ci_get_path    = test_ci_get_path,
+    .ci_mem_stats   = test_ci_mem_stats,
+};
+
+
+/* Mini connections are allocated from the pools and do not report */
+static const struct conn_iface test_mini_conn_iface = {
+    .ci_get_path    = test_ci_get_path,
+};
+
+
+#define CONN_BYTES(unit) (21 * (unit))
+
+
+static void
+add_conn (lsquic_engine_t *engine, struct test_conn *tc, unsigned id,
+            size_t unit, unsigned n_cids, enum lsquic_conn_flags flags)
+{
+    struct lsquic_engine_public *const enpub
+                                    = (struct lsquic_engine_public *) engine;
+    unsigned i;
+    int s;
+
+    assert(n_cids <= sizeof(tc->tc_cces) / sizeof(tc->tc_cces[0]));
+    memset(tc, 0, sizeof(*tc));
+    tc->tc_unit = unit;
+    tc->tc_conn.cn_if = &test_conn_iface;
+    tc->tc_conn.cn_cces = tc->tc_cces;
+    tc->tc_conn.cn_n_cces = sizeof(tc->tc_cces) / sizeof(tc->tc_cces[0]);
+    tc->tc_conn.cn_flags = LSCONN_SERVER | flags;
+    for (i = 0; i < n_cids; ++i)
+    {
+        tc->tc_conn.cn_cces[i].cce_cid.len = 8;
+        tc->tc_conn.cn_cces[i].cce_cid.idbuf[0] = id;
+        tc->tc_conn.cn_cces[i].cce_cid.idbuf[1] = i;
+        tc->tc_conn.cn_cces_mask |= 1 << i;
+        s = lsquic_engine_add_cid(enpub, &tc->tc_conn, i);
+        assert(0 == s);
+    }
+}
+
+
+static void
+remove_conn (lsquic_engine_t *engine, struct test_conn *tc)
+{
+    struct lsquic_engine_public *const enpub
+                                    = (struct lsquic_engine_public *) engine;
+    unsigned i;
+
+    for (i = 0; i < tc->tc_conn.cn_n_cces; ++i)
+        if (tc->tc_conn.cn_cces_mask & (1 << i))
+            lsquic_engine_retire_cid(enpub, &tc->tc_conn, i, 0);
+}
+
+
+static lsquic_engine_t *
+new_engine (void)
+{
+    struct lsquic_engine_settings settings;
+    struct lsquic_engine_api api;
+    lsquic_engine_t *engine;
+
+    lsquic_engine_init_settings(&settings, LSENG_SERVER);
+    memset(&api, 0, sizeof(api));
+    api.ea_settings = &settings;
+    api.ea_packets_out = (void *) (uintptr_t) 1;
+    engine = lsquic_engine_new(LSENG_SERVER, &api);
+    assert(engine);
+    return engine;
+}
+
+
+static int
+is_one_of (const struct lsquic_conn *conn, const struct test_conn *a,
+                                                    const struct test_conn *b)
+{
+    return conn == &a->tc_conn || conn == &b->tc_conn;
+}
+
+
+static void
+test_mem_stats (void)
+{
+    lsquic_engine_t *engine;
+    struct lsquic_mem_stats base, stats;
+    struct lsquic_conn_mem top[10];
+    struct test_conn small, big, twin1, twin2, hib, mini;
+    unsigned n;
+    const size_t sum_units = 10 + 30 + 20 + 20 + 50;
+
+    engine = new_engine();
+
+    n = lsquic_engine_mem_stats(engine, &base, top, 10);
+    assert(0 == n);
+    assert(0 == base.ms_n_conns);
+    assert(base.ms_total == lsquic_mem_stats_sum(&base));
+
+    add_conn(engine, &small, 1, 10, 1, 0);
+    add_conn(engine, &big,   2, 30, 1, 0);
+    add_conn(engine, &twin1, 3, 20, 3, 0);  /* Counted once */
+    add_conn(engine, &twin2, 4, 20, 1, 0);
+    add_conn(engine, &hib,   5, 50, 1, LSCONN_HIBERNATED);
+    add_conn(engine, &mini,  6, 99, 1, LSCONN_MINI);
+    mini.tc_conn.cn_if = &test_mini_conn_iface;
+
+    /* Totals include all connections that report memory, hibernated
+     * included.
+     */
+    n = lsquic_engine_mem_stats(engine, &stats, NULL, 0);
+    assert(0 == n);
+    assert(5 == stats.ms_n_conns);
+    assert(stats.ms_packets_in  == base.ms_packets_in  + 1 * sum_units);
+    assert(stats.ms_packets_out == base.ms_packets_out + 2 * sum_units);
+    assert(stats.ms_pools       == base.ms_pools       + 3 * sum_units);
+    /* Connection hash may have grown */
+    assert(stats.ms_conns       >= base.ms_conns       + 4 * sum_units);
+    assert(stats.ms_streams     == base.ms_streams     + 5 * sum_units);
+    assert(stats.ms_hdr_tables  == base.ms_hdr_tables  + 6 * sum_units);
+    assert(stats.ms_total == lsquic_mem_stats_sum(&stats));
+
+    /* Fewer connections than N: all of them, largest first.  Hibernated
+     * connection is not reported, as the user does not know about it.
+     */
+    memset(top, 0, sizeof(top));
+    n = lsquic_engine_mem_stats(engine, &stats, top, 10);
+    assert(4 == n);
+    assert(5 == stats.ms_n_conns);
+    assert(top[0].cm_conn == &big.tc_conn);
+    assert(top[0].cm_bytes == CONN_BYTES(30));
+    assert(is_one_of(top[1].cm_conn, &twin1, &twin2));
+    assert(top[1].cm_bytes == CONN_BYTES(20));
+    assert(is_one_of(top[2].cm_conn, &twin1, &twin2));
+    assert(top[2].cm_bytes == CONN_BYTES(20));
+    assert(top[1].cm_conn != top[2].cm_conn);
+    assert(top[3].cm_conn == &small.tc_conn);
+    assert(top[3].cm_bytes == CONN_BYTES(10));
+    assert(NULL == top[4].cm_conn);
+
+    /* Top N: the tie at the cut-off is broken either way, but only one of
+     * the tied connections makes it.
+     */
+    memset(top, 0, sizeof(top));
+    n = lsquic_engine_mem_stats(engine, &stats, top, 2);
+    assert(2 == n);
+    assert(top[0].cm_conn == &big.tc_conn);
+    assert(is_one_of(top[1].cm_conn, &twin1, &twin2));
+    assert(top[1].cm_bytes == CONN_BYTES(20));
+    assert(NULL == top[2].cm_conn);
+
+    memset(top, 0, sizeof(top));
+    n = lsquic_engine_mem_stats(engine, &stats, top, 1);
+    assert(1 == n);
+    assert(top[0].cm_conn == &big.tc_conn);
+    assert(NULL == top[1].cm_conn);
+
+    /* Top N does not affect the totals */
+    assert(5 == stats.ms_n_conns);
+    assert(stats.ms_total == lsquic_mem_stats_sum(&stats));
+
+    remove_conn(engine, &small);
+    remove_conn(engine, &big);
+    remove_conn(engine, &twin1);
+    remove_conn(engine, &twin2);
+    remove_conn(engine, &hib);
+    remove_conn(engine, &mini);
+    n = lsquic_engine_mem_stats(engine, &stats, top, 10);
+    assert(0 == n);
+    assert(0 == stats.ms_n_conns);
+
+    lsquic_engine_destroy(engine);
+}
+
+
+int
+main (void)
+{
+    if (0 != lsquic_global_init(LSQUIC_GLOBAL_SERVER))
+        return 1;
+
+    test_mem_stats();
+
+    lsquic_global_cleanup();
+    return 0;
+}
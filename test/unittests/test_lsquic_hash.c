@@ -27,6 +27,7 @@ main (int argc, char **argv)
     struct lsquic_hash_elem *el;
     unsigned n, nelems;
     struct widget *widgets, *widget;
+    struct lsquic_hash_stats stats;
 
     hash = lsquic_hash_create();
 
@@ -72,6 +73,10 @@ main (int argc, char **argv)
 
     assert(0 == lsquic_hash_count(hash));
 
+    lsquic_hash_get_stats(hash, &stats);
+    assert(stats.hs_lookups == nelems * 3);
+    assert(stats.hs_max_probes < 20);
+
     lsquic_hash_destroy(hash);
     free(widgets);
 
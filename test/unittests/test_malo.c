@@ -11,6 +11,10 @@
 
 #include "lsquic_malo.h"
 
+#if LSQUIC_MALO_MT
+#include <pthread.h>
+#endif
+
 struct elem {
     unsigned        id;
 };
@@ -108,6 +112,101 @@ alloc_using_malo (int n)
 }
 
 
+#if LSQUIC_MALO_MT
+struct put_ctx
+{
+    struct elem   **elems;
+    unsigned        n_elems;
+};
+
+
+static void *
+put_elems (void *arg)
+{
+    struct put_ctx *const ctx = arg;
+    unsigned i;
+
+    for (i = 0; i < ctx->n_elems; ++i)
+        lsquic_malo_put(ctx->elems[i]);
+    return NULL;
+}
+
+
+static void
+get_elems (struct malo *malo, struct elem **els, unsigned n_elems)
+{
+    unsigned i, j;
+
+    for (i = 0; i < n_elems; ++i)
+    {
+        els[i] = lsquic_malo_get(malo);
+        assert(els[i]);
+        els[i]->id = i;
+    }
+    for (i = 0; i < n_elems; ++i)
+        for (j = i + 1; j < n_elems && j < i + 100; ++j)
+            assert(els[i] != els[j]);
+    for (i = 0; i < n_elems; ++i)
+        assert(els[i]->id == i);
+}
+
+
+/* Objects put by another thread -- while it runs and when it exits --
+ * are reused: the pool does not grow.
+ */
+static void
+test_mt (size_t el_size)
+{
+    struct malo *malo;
+    struct malo_stats stats;
+    struct put_ctx ctx;
+    pthread_t thread;
+    size_t mem_used;
+    unsigned i, round;
+
+    malo = lsquic_malo_create_mt(el_size);
+    assert(malo);
+
+    /* Same thread: after warm-up, nearly all gets are served from cache */
+    for (i = 0; i < 1000; ++i)
+        lsquic_malo_put(lsquic_malo_get(malo));
+    lsquic_malo_get_stats(malo, &stats);
+    assert(stats.ms_misses <= 2);
+
+    get_elems(malo, elems, N_ELEMS);
+    mem_used = lsquic_malo_mem_used(malo);
+
+    for (round = 0; round < 5; ++round)
+    {
+        ctx.elems = elems;
+        ctx.n_elems = N_ELEMS;
+        assert(0 == pthread_create(&thread, NULL, put_elems, &ctx));
+        assert(0 == pthread_join(thread, NULL));
+        get_elems(malo, elems, N_ELEMS);
+        assert(lsquic_malo_mem_used(malo) == mem_used);
+    }
+
+    for (i = 0; i < N_ELEMS; ++i)
+        lsquic_malo_put(elems[i]);
+    lsquic_malo_get_stats(malo, &stats);
+    assert(stats.ms_hits > 0);
+    assert(stats.ms_misses > 0);
+    lsquic_malo_destroy(malo);
+
+    /* This thread's cache still has objects of the destroyed malo.  A
+     * new malo may get the same registry slot; the stale objects must
+     * not be handed out.
+     */
+    malo = lsquic_malo_create_mt(el_size);
+    assert(malo);
+    get_elems(malo, elems, 100);
+    for (i = 0; i < 100; ++i)
+        lsquic_malo_put(elems[i]);
+    lsquic_malo_destroy(malo);
+}
+#endif
+
+
 int
 main (int argc, char **argv)
 {
@@ -140,6 +239,10 @@ main (int argc, char **argv)
             run_tests(sz + 1);
             run_tests(sz + 3);
         }
+#if LSQUIC_MALO_MT
+        test_mt(sizeof(struct elem));
+        test_mt(200);
+#endif
         break;
     }
     case 0:
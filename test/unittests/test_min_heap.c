@@ -0,0 +1,95 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic_min_heap.h"
+
+
+#define N_CONNS 1000
+
+/* The heap does not look inside connection objects: use fake pointers */
+#define VAL2CONN(val) ((struct lsquic_conn *) (uintptr_t) ((val) + 1))
+#define CONN2VAL(conn) ((uint64_t) (uintptr_t) (conn) - 1)
+
+
+static void
+verify_pops (struct min_heap *heap, unsigned count)
+{
+    struct lsquic_conn *conn;
+    uint64_t prev, val;
+    unsigned n;
+
+    assert(lsquic_mh_count(heap) == count);
+    prev = 0;
+    for (n = 0; n < count; ++n)
+    {
+        conn = lsquic_mh_pop(heap);
+        assert(conn);
+        val = CONN2VAL(conn);
+        assert(val >= prev);
+        prev = val;
+    }
+    assert(NULL == lsquic_mh_pop(heap));
+    assert(lsquic_mh_count(heap) == 0);
+}
+
+
+/* Add `n_insert' elements one by one, then `n_append' in bulk */
+static void
+test_heap (unsigned n_insert, unsigned n_append)
+{
+    struct min_heap heap;
+    uint64_t val;
+    unsigned n;
+
+    memset(&heap, 0, sizeof(heap));
+    heap.mh_nalloc = n_insert + n_append;
+    heap.mh_elems = malloc(heap.mh_nalloc * sizeof(heap.mh_elems[0]));
+
+    for (n = 0; n < n_insert; ++n)
+    {
+        val = rand() % 10000;
+        lsquic_mh_insert(&heap, VAL2CONN(val), val);
+        assert(CONN2VAL(lsquic_mh_peek(&heap)) <= val);
+    }
+
+    for (n = 0; n < n_append; ++n)
+    {
+        val = rand() % 10000;
+        lsquic_mh_append(&heap, VAL2CONN(val), val);
+    }
+    lsquic_mh_build(&heap);
+
+    verify_pops(&heap, n_insert + n_append);
+
+    /* Heap can be reused after it is emptied */
+    for (n = 0; n < n_append; ++n)
+    {
+        val = n_append - n;     /* Descending order */
+        lsquic_mh_append(&heap, VAL2CONN(val), val);
+    }
+    lsquic_mh_build(&heap);
+    if (n_append)
+        assert(CONN2VAL(lsquic_mh_peek(&heap)) == 1);
+    verify_pops(&heap, n_append);
+
+    free(heap.mh_elems);
+}
+
+
+int
+main (void)
+{
+    test_heap(0, 0);
+    test_heap(1, 0);
+    test_heap(0, 1);
+    test_heap(N_CONNS, 0);
+    test_heap(0, N_CONNS);
+    test_heap(N_CONNS, 10);         /* Appended elements are sifted up */
+    test_heap(10, N_CONNS);         /* Heap is rebuilt */
+    test_heap(N_CONNS, N_CONNS);
+    test_heap(5, 4);
+    return 0;
+}
@@ -0,0 +1,219 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test that stashing out-of-order CRYPTO frames in IETF mini connection
+ * and releasing them keeps memory manager accounting balanced.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/types.h>
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_sizes.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_mm.h"
+#include "lsquic_malo.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_in.h"
+#include "lsquic_parse.h"
+#include "lsquic_rtt.h"
+#include "lsquic_enc_sess.h"
+#include "lsquic_mini_conn_ietf.h"
+#include "lsquic_logger.h"
+
+
+/* Packets are created in plaintext: decryption is a no-op */
+static struct enc_session_funcs_common test_esf_c;
+
+
+static enum dec_packin
+noop_decrypt_packet (enc_session_t *enc_session,
+        struct lsquic_engine_public *enpub, const struct lsquic_conn *lconn,
+        struct lsquic_packet_in *packet_in)
+{
+    return DECPI_OK;
+}
+
+
+struct test_ctx
+{
+    struct lsquic_engine_public     enpub;
+    /* Packet payloads live here, as a packet referenced by a stashed
+     * frame must outlive the packet_in_put() in the test.
+     */
+    unsigned char                   bufs[4][0x1400];
+    unsigned                        n_bufs;
+    lsquic_packno_t                 packno;
+};
+
+
+static void
+init_test_ctx (struct test_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    lsquic_mm_init(&ctx->enpub.enp_mm);
+    lsquic_engine_init_settings(&ctx->enpub.enp_settings, LSENG_SERVER);
+}
+
+
+static void
+cleanup_test_ctx (struct test_ctx *ctx)
+{
+    lsquic_mm_cleanup(&ctx->enpub.enp_mm);
+}
+
+
+/* Returns Initial packet with a single CRYPTO frame */
+static struct lsquic_packet_in *
+new_crypto_packet (struct test_ctx *ctx, unsigned offset, unsigned size)
+{
+    struct lsquic_packet_in *packet_in;
+    unsigned char *p;
+
+    assert(ctx->n_bufs < sizeof(ctx->bufs) / sizeof(ctx->bufs[0]));
+    assert(offset < 0x4000 && size < 0x4000);
+    assert(5 + size <= sizeof(ctx->bufs[0]));
+    p = ctx->bufs[ctx->n_bufs++];
+    p[0] = 0x06;    /* CRYPTO */
+    p[1] = 0x40 | (offset >> 8);
+    p[2] = offset;
+    p[3] = 0x40 | (size >> 8);
+    p[4] = size;
+    memset(p + 5, 'A' + ctx->n_bufs, size);
+
+    packet_in = lsquic_mm_get_packet_in(&ctx->enpub.enp_mm);
+    assert(packet_in);
+    memset(packet_in, 0, sizeof(*packet_in));
+    packet_in->pi_data = p;
+    packet_in->pi_data_sz = 5 + size;
+    packet_in->pi_header_type = HETY_INITIAL;
+    packet_in->pi_packno = ctx->packno++;
+    packet_in->pi_dcid.len = 8;
+    memset(packet_in->pi_dcid.idbuf, 0xDC, 8);
+    packet_in->pi_refcnt = 1;   /* Reference held by the test */
+    return packet_in;
+}
+
+
+/* The unit tests are compiled with LSQUIC_TEST, which changes the size of
+ * struct lsquic_conn, so the test cannot look inside struct ietf_mini_conn:
+ * only the connection interface and memory manager are used.
+ */
+static struct lsquic_conn *
+new_mini_conn (struct test_ctx *ctx)
+{
+    struct lsquic_packet_in *packet_in;
+    struct lsquic_conn *lconn;
+
+    packet_in = new_crypto_packet(ctx, 0, 0);
+    lconn = lsquic_mini_conn_ietf_new(&ctx->enpub, packet_in, LSQVER_ID24, 1,
+                                                                        NULL);
+    assert(lconn);
+    lsquic_packet_in_put(&ctx->enpub.enp_mm, packet_in);
+    ctx->n_bufs = 0;
+
+    test_esf_c = *lconn->cn_esf_c;
+    test_esf_c.esf_decrypt_packet = noop_decrypt_packet;
+    lconn->cn_esf_c = &test_esf_c;
+    return lconn;
+}
+
+
+/* Feeds packet to the connection; returns its reference count afterwards,
+ * not counting the test's reference.
+ */
+static unsigned
+feed_packet (struct test_ctx *ctx, struct lsquic_conn *lconn,
+                                        struct lsquic_packet_in *packet_in)
+{
+    unsigned refcnt;
+
+    lconn->cn_if->ci_packet_in(lconn, packet_in);
+    refcnt = packet_in->pi_refcnt - 1;
+    lsquic_packet_in_put(&ctx->enpub.enp_mm, packet_in);
+    return refcnt;
+}
+
+
+static void
+test_stash_and_release (void)
+{
+    struct test_ctx ctx;
+    struct lsquic_mm *const mm = &ctx.enpub.enp_mm;
+    struct lsquic_conn *lconn;
+    unsigned refcnt;
+    size_t mem_out, mem_used, peak_used;
+
+    init_test_ctx(&ctx);
+
+    lconn = new_mini_conn(&ctx);
+    mem_out = lsquic_mm_mem_out(mm);
+    mem_used = lsquic_mm_mem_used(mm);
+    assert(0 == mm->n_mini_conn_pages);
+
+    /* Out-of-order frame is copied into the stash page and the packet is
+     * released.
+     */
+    refcnt = feed_packet(&ctx, lconn, new_crypto_packet(&ctx, 1000, 100));
+    assert(0 == refcnt);
+    assert(1 == mm->n_mini_conn_pages);
+    assert(lsquic_mm_mem_out(mm) == mem_out + 0x1000);
+    assert(lsquic_mm_mem_used(mm) >= mem_used + 0x1000);
+
+    /* Another frame shares the page */
+    refcnt = feed_packet(&ctx, lconn, new_crypto_packet(&ctx, 2000, 200));
+    assert(0 == refcnt);
+    assert(1 == mm->n_mini_conn_pages);
+    assert(lsquic_mm_mem_out(mm) == mem_out + 0x1000);
+
+    /* Frame that does not fit into the page keeps its packet */
+    refcnt = feed_packet(&ctx, lconn,
+                new_crypto_packet(&ctx, 3000, IMICO_STASH_BUF_SZ - 200));
+    assert(1 == refcnt);
+    assert(1 == mm->n_mini_conn_pages);
+    assert(lsquic_mm_mem_out(mm) == mem_out + 0x1000);
+    peak_used = lsquic_mm_mem_used(mm);
+
+    /* Destroying the connection returns the page and the packet */
+    lconn->cn_if->ci_destroy(lconn);
+    assert(0 == mm->n_mini_conn_pages);
+    assert(lsquic_mm_mem_out(mm) == mem_out);
+    /* The page is either freed or back in the pool: it is not counted
+     * twice.
+     */
+    assert(lsquic_mm_mem_used(mm) <= peak_used);
+
+    /* The next connection reuses the memory: the peak does not grow */
+    lconn = new_mini_conn(&ctx);
+    refcnt = feed_packet(&ctx, lconn, new_crypto_packet(&ctx, 1000, 100));
+    assert(0 == refcnt);
+    assert(1 == mm->n_mini_conn_pages);
+    assert(lsquic_mm_mem_out(mm) == mem_out + 0x1000);
+    assert(lsquic_mm_mem_used(mm) <= peak_used);
+    lconn->cn_if->ci_destroy(lconn);
+    assert(0 == mm->n_mini_conn_pages);
+    assert(lsquic_mm_mem_out(mm) == mem_out);
+    assert(lsquic_mm_mem_used(mm) <= peak_used);
+
+    cleanup_test_ctx(&ctx);
+}
+
+
+int
+main (void)
+{
+    if (0 != lsquic_global_init(LSQUIC_GLOBAL_SERVER))
+        return 1;
+
+    test_stash_and_release();
+
+    lsquic_global_cleanup();
+    return 0;
+}
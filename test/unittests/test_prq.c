@@ -0,0 +1,334 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test Packet Request Queue: reply size limits and per-prefix rate limit.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#else
+#include "vc_compat.h"
+#endif
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_packet_ietf.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_malo.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_pr_queue.h"
+#include "lsquic_sizes.h"
+#include "lsquic_tokgen.h"
+#include "lsquic_version.h"
+
+
+/* These match lsquic_pr_queue.c */
+#define BUCKET_RATE     50u
+#define BUCKET_BURST    100u
+
+/* Buckets start out empty: by this time, they are full */
+#define START_TIME      (1000000ull * BUCKET_BURST / BUCKET_RATE + 1)
+
+
+static struct lsquic_engine_public s_enpub;
+static unsigned s_cid_seqno;
+
+
+static void
+init_enpub (void)
+{
+    unsigned i;
+
+    memset(&s_enpub, 0, sizeof(s_enpub));
+    lsquic_engine_init_settings(&s_enpub.enp_settings, LSENG_SERVER);
+    for (i = 0; i < sizeof(s_enpub.enp_hash_key); ++i)
+        s_enpub.enp_hash_key[i] = (unsigned char) (i * 37 + 11);
+}
+
+
+/* The queue copies sizeof(struct sockaddr_in6) bytes of any address */
+static void
+set_addr (struct sockaddr_storage *storage, unsigned a, unsigned b,
+                                                    unsigned c, unsigned d)
+{
+    struct sockaddr_in *const sin = (struct sockaddr_in *) storage;
+
+    memset(storage, 0, sizeof(*storage));
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(443);
+    sin->sin_addr.s_addr = htonl((a << 24) | (b << 16) | (c << 8) | d);
+}
+
+
+/* Each request gets a new DCID so that it is not rejected as a duplicate */
+static int
+new_req (struct pr_queue *prq, enum packet_req_type type,
+         unsigned short data_sz, const struct sockaddr *peer_addr,
+         lsquic_time_t now)
+{
+    struct sockaddr_storage local;
+    lsquic_cid_t dcid, scid;
+
+    ++s_cid_seqno;
+    memset(&dcid, 0, sizeof(dcid));
+    dcid.len = 8;
+    memcpy(dcid.idbuf, &s_cid_seqno, sizeof(s_cid_seqno));
+    memset(&scid, 0, sizeof(scid));
+    scid.len = 8;
+    set_addr(&local, 127, 0, 0, 1);
+    return lsquic_prq_new_req(prq, type, 0, LSQVER_ID24, data_sz, &dcid,
+                &scid, NULL, (struct sockaddr *) &local, peer_addr, now);
+}
+
+
+/* Send out all queued replies, freeing the requests */
+static unsigned
+drain_queue (struct pr_queue *prq)
+{
+    struct lsquic_conn *conn;
+    struct lsquic_packet_out *packet_out;
+    unsigned count;
+
+    count = 0;
+    while ((conn = prq_next_conn(prq)))
+    {
+        packet_out = conn->cn_if->ci_next_packet_to_send(conn, 0);
+        assert(packet_out);
+        conn->cn_if->ci_packet_sent(conn, packet_out);
+        ++count;
+    }
+    assert(!prq_have_pending(prq));
+    return count;
+}
+
+
+/* Replies are never larger than the packets that elicit them */
+static void
+test_reply_size (void)
+{
+    struct pr_queue *prq;
+    struct sockaddr_storage peer;
+    unsigned char ver_tags[N_LSQVER * 4];
+    unsigned verneg_sz, retry_sz, scid_len;
+    int s, ver_tags_sz;
+    const lsquic_time_t now = START_TIME;
+
+    init_enpub();
+    prq = prq_create(100, 10, &s_enpub);
+    assert(prq);
+    set_addr(&peer, 10, 0, 0, 1);
+
+    /* Stateless reset: strictly smaller than the incoming packet */
+    s = new_req(prq, PACKET_REQ_PUBRES, IQUIC_MIN_SRST_SIZE - 1,
+                                            (struct sockaddr *) &peer, now);
+    assert(-1 == s);
+    s = new_req(prq, PACKET_REQ_PUBRES, IQUIC_MIN_SRST_SIZE,
+                                            (struct sockaddr *) &peer, now);
+    assert(-1 == s);
+    s = new_req(prq, PACKET_REQ_PUBRES, IQUIC_MIN_SRST_SIZE + 1,
+                                            (struct sockaddr *) &peer, now);
+    assert(0 == s);
+
+    /* Version negotiation: header with both CIDs and the list of versions */
+    ver_tags_sz = lsquic_gen_ver_tags(ver_tags, sizeof(ver_tags),
+                                        s_enpub.enp_settings.es_versions);
+    assert(ver_tags_sz > 0);
+    verneg_sz = 1 + 4 + 1 + 8 + 1 + 8 + (unsigned) ver_tags_sz;
+    s = new_req(prq, PACKET_REQ_VERNEG, verneg_sz - 1,
+                                            (struct sockaddr *) &peer, now);
+    assert(-1 == s);
+    s = new_req(prq, PACKET_REQ_VERNEG, verneg_sz,
+                                            (struct sockaddr *) &peer, now);
+    assert(0 == s);
+
+    /* Retry: header, new SCID, original DCID, and the largest token */
+    scid_len = s_enpub.enp_settings.es_scid_len;
+    if (scid_len < MIN_INITIAL_DCID_LEN)
+        scid_len = MIN_INITIAL_DCID_LEN;
+    retry_sz = 1 + 4 + 1 + 8 + 1 + scid_len + 1 + 8 + MAX_RETRY_TOKEN_SZ;
+    s = new_req(prq, PACKET_REQ_RETRY, retry_sz - 1,
+                                            (struct sockaddr *) &peer, now);
+    assert(-1 == s);
+    s = new_req(prq, PACKET_REQ_RETRY, retry_sz,
+                                            (struct sockaddr *) &peer, now);
+    assert(0 == s);
+
+    prq_destroy(prq);
+}
+
+
+static unsigned
+count_accepted (struct pr_queue *prq, unsigned n_tries,
+                    const struct sockaddr *peer_addr, lsquic_time_t now)
+{
+    unsigned n, count;
+
+    count = 0;
+    for (n = 0; n < n_tries; ++n)
+        count += 0 == new_req(prq, PACKET_REQ_VERNEG, 1200, peer_addr, now);
+    return count;
+}
+
+
+static void
+test_token_bucket (void)
+{
+    struct pr_queue *prq;
+    struct sockaddr_storage peer4;
+    struct sockaddr_in6 peer6;
+    struct sockaddr_un peer_un;
+    lsquic_time_t now;
+    unsigned count;
+    int s;
+
+    init_enpub();
+    prq = prq_create(BUCKET_BURST * 4, 10, &s_enpub);
+    assert(prq);
+    now = START_TIME;
+
+    /* The burst is shared by the whole /24 */
+    set_addr(&peer4, 10, 0, 0, 1);
+    count = count_accepted(prq, BUCKET_BURST / 2,
+                                            (struct sockaddr *) &peer4, now);
+    assert(BUCKET_BURST / 2 == count);
+    set_addr(&peer4, 10, 0, 0, 200);
+    count = count_accepted(prq, BUCKET_BURST,
+                                            (struct sockaddr *) &peer4, now);
+    assert(BUCKET_BURST / 2 == count);
+
+    /* Another prefix has its own bucket */
+    set_addr(&peer4, 10, 0, 1, 1);
+    count = count_accepted(prq, 1, (struct sockaddr *) &peer4, now);
+    assert(1 == count);
+    set_addr(&peer4, 10, 0, 0, 1);
+
+    /* Tokens are refilled at a fixed rate: the fraction carries over */
+    now += 1000000 / BUCKET_RATE / 2;
+    count = count_accepted(prq, 1, (struct sockaddr *) &peer4, now);
+    assert(0 == count);
+    now += 1000000 / BUCKET_RATE / 2;
+    count = count_accepted(prq, 2, (struct sockaddr *) &peer4, now);
+    assert(1 == count);
+
+    /* ...and up to the burst size */
+    now += 1000000 * 60;
+    drain_queue(prq);
+    count = count_accepted(prq, BUCKET_BURST * 2,
+                                            (struct sockaddr *) &peer4, now);
+    assert(BUCKET_BURST == count);
+    drain_queue(prq);
+
+    /* IPv6: the prefix is /48 */
+    memset(&peer6, 0, sizeof(peer6));
+    peer6.sin6_family = AF_INET6;
+    peer6.sin6_addr.s6_addr[0] = 0x20;
+    peer6.sin6_addr.s6_addr[1] = 0x01;
+    peer6.sin6_addr.s6_addr[15] = 1;
+    count = count_accepted(prq, BUCKET_BURST / 2,
+                                            (struct sockaddr *) &peer6, now);
+    assert(BUCKET_BURST / 2 == count);
+    peer6.sin6_addr.s6_addr[5] = 0xFF;  /* Outside of the /48 */
+    peer6.sin6_addr.s6_addr[15] = 2;
+    count = count_accepted(prq, BUCKET_BURST / 2,
+                                            (struct sockaddr *) &peer6, now);
+    assert(BUCKET_BURST / 2 == count);
+    peer6.sin6_addr.s6_addr[5] = 0;     /* Same /48 as the first address */
+    count = count_accepted(prq, BUCKET_BURST,
+                                            (struct sockaddr *) &peer6, now);
+    assert(BUCKET_BURST / 2 == count);
+    drain_queue(prq);
+
+    /* Other address families are rejected */
+    memset(&peer_un, 0, sizeof(peer_un));
+    peer_un.sun_family = AF_UNIX;
+    s = new_req(prq, PACKET_REQ_PUBRES, 1200, (struct sockaddr *) &peer_un,
+                                                                        now);
+    assert(-1 == s);
+
+    prq_destroy(prq);
+}
+
+
+/* Requests rejected for other reasons do not use up tokens */
+static void
+test_rejected_keep_tokens (void)
+{
+    struct pr_queue *prq;
+    struct sockaddr_storage peer;
+    struct sockaddr_storage local;
+    lsquic_cid_t dcid, scid;
+    unsigned count, n;
+    int s;
+    const lsquic_time_t now = START_TIME;
+
+    init_enpub();
+    set_addr(&peer, 10, 0, 2, 1);
+
+    /* Queue full */
+    prq = prq_create(1, 10, &s_enpub);
+    assert(prq);
+    count = count_accepted(prq, BUCKET_BURST * 2,
+                                            (struct sockaddr *) &peer, now);
+    assert(1 == count);
+    for (n = 0; n < BUCKET_BURST - 1; ++n)
+    {
+        assert(1 == drain_queue(prq));
+        count = count_accepted(prq, 1, (struct sockaddr *) &peer, now);
+        assert(1 == count);
+    }
+    assert(1 == drain_queue(prq));
+    count = count_accepted(prq, 1, (struct sockaddr *) &peer, now);
+    assert(0 == count);
+    prq_destroy(prq);
+
+    /* Stateless reset would be too large */
+    prq = prq_create(BUCKET_BURST * 2, 10, &s_enpub);
+    assert(prq);
+    for (n = 0; n < BUCKET_BURST * 2; ++n)
+    {
+        s = new_req(prq, PACKET_REQ_PUBRES, IQUIC_MIN_SRST_SIZE,
+                                            (struct sockaddr *) &peer, now);
+        assert(-1 == s);
+    }
+
+    /* Duplicate request */
+    memset(&dcid, 0, sizeof(dcid));
+    dcid.len = 8;
+    memset(&scid, 0, sizeof(scid));
+    scid.len = 8;
+    set_addr(&local, 127, 0, 0, 1);
+    for (n = 0; n < BUCKET_BURST * 2; ++n)
+    {
+        s = lsquic_prq_new_req(prq, PACKET_REQ_PUBRES, 0, LSQVER_ID24, 1200,
+                &dcid, &scid, NULL, (struct sockaddr *) &local,
+                (struct sockaddr *) &peer, now);
+        assert(n > 0 ? -1 == s : 0 == s);
+    }
+
+    count = count_accepted(prq, BUCKET_BURST * 2,
+                                            (struct sockaddr *) &peer, now);
+    assert(BUCKET_BURST - 1 == count);
+    prq_destroy(prq);
+}
+
+
+int
+main (void)
+{
+    test_reply_size();
+    test_token_bucket();
+    test_rejected_keep_tokens();
+    return 0;
+}
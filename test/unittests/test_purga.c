@@ -16,10 +16,10 @@
 static int s_eight;
 
 static void
-bloom_test (unsigned count, unsigned miss_searches, unsigned hit_searches)
+search_test (unsigned count, unsigned miss_searches, unsigned hit_searches)
 {
     struct lsquic_purga *purga;
-    struct purga_bloom_stats *stats;
+    struct purga_stats *stats;
     struct purga_el *puel;
     lsquic_cid_t *cids, cid;
     unsigned i, j;
@@ -69,16 +69,118 @@ bloom_test (unsigned count, unsigned miss_searches, unsigned hit_searches)
         }
     }
 
-    stats = lsquic_purga_get_bloom_stats(purga);
-    LSQ_NOTICE("searches: %lu, false hits: %lu, false hit ratio: %lf",
-        stats->searches, stats->false_hits,
-        (double) stats->false_hits / (double) stats->searches);
+    stats = lsquic_purga_get_stats(purga);
+    LSQ_NOTICE("searches: %lu, probes: %lu, probes per search: %lf",
+        stats->searches, stats->probes,
+        (double) stats->probes / (double) stats->searches);
+    /* Load factor is at most one half: probe sequences are short */
+    assert(stats->probes < stats->searches * 3);
 
     lsquic_purga_destroy(purga);
     free(cids);
 }
 
 
+/* Pages expire one by one while CIDs from later pages must still be found:
+ * removing entries from the index must not break other probe sequences.
+ */
+static void
+expiry_test (void)
+{
+    struct lsquic_purga *purga;
+    struct purga_el *puel;
+    lsquic_cid_t cid;
+    unsigned i, n, per_page;
+    const unsigned n_pages = 20;
+
+    per_page = lsquic_purga_cids_per_page();
+    purga = lsquic_purga_new(250, NULL, NULL);
+    assert(purga);
+
+    cid.len = 4;
+    for (n = 0; n < n_pages * per_page; ++n)
+    {
+        memcpy(cid.idbuf, &n, sizeof(n));
+        /* Each page is full at time equal to its number times 100 */
+        puel = lsquic_purga_add(purga, &cid, NULL, PUTY_CID_RETIRED,
+                                                        n / per_page * 100);
+        assert(puel);
+        puel->puel_time = n;
+
+        /* With 250 usec minimum life, the current page and the two
+         * before it are kept; older pages have expired.
+         */
+        for (i = 0; i <= n; i += 7)
+        {
+            memcpy(cid.idbuf, &i, sizeof(i));
+            puel = lsquic_purga_contains(purga, &cid);
+            if (i / per_page + 2 < n / per_page)
+                assert(!puel);
+            else
+                assert(puel && puel->puel_time == i);
+        }
+    }
+
+    lsquic_purga_destroy(purga);
+}
+
+
+static unsigned s_n_removed;
+
+static void
+count_removed (void *ctx, void **peer_ctx, const lsquic_cid_t *cids,
+                                                                unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i)
+        /* Only even CIDs were retired; odd ones were moved */
+        assert(0 == (cids[i].idbuf[0] & 1));
+    s_n_removed += n;
+}
+
+
+/* CIDs of connections moved to another engine are dropped silently */
+static void
+moved_test (void)
+{
+    struct lsquic_purga *purga;
+    struct purga_el *puel;
+    lsquic_cid_t cid;
+    unsigned i, per_page;
+
+    per_page = lsquic_purga_cids_per_page();
+    purga = lsquic_purga_new(10, count_removed, NULL);
+    assert(purga);
+
+    s_n_removed = 0;
+    cid.len = 2;
+    for (i = 0; i < per_page; ++i)
+    {
+        cid.idbuf[0] = i;
+        cid.idbuf[1] = i >> 8;
+        puel = lsquic_purga_add(purga, &cid, NULL,
+                                i & 1 ? PUTY_CID_MOVED : PUTY_CID_RETIRED, 20);
+        assert(puel);
+    }
+
+    cid.idbuf[0] = 1;
+    cid.idbuf[1] = 0;
+    puel = lsquic_purga_contains(purga, &cid);
+    assert(puel && PUTY_CID_MOVED == puel->puel_type);
+
+    /* Expire the first page */
+    cid.len = 3;
+    cid.idbuf[0] = 0;
+    lsquic_purga_add(purga, &cid, NULL, PUTY_CONN_DELETED, 31);
+    assert(s_n_removed == (per_page + 1) / 2);
+
+    /* On destruction, the CID in the second page is reported */
+    lsquic_purga_destroy(purga);
+    assert(s_n_removed == (per_page + 1) / 2 + 1);
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -121,7 +223,7 @@ main (int argc, char **argv)
     {
         LSQ_NOTICE("bloom test: will insert %u and search for %u missing "
             "and %u extant CIDs", bloom_ins, bloom_miss_sea, bloom_hit_sea);
-        bloom_test(bloom_ins, bloom_miss_sea, bloom_hit_sea);
+        search_test(bloom_ins, bloom_miss_sea, bloom_hit_sea);
         exit(EXIT_SUCCESS);
     }
 
@@ -168,7 +270,9 @@ main (int argc, char **argv)
 
     lsquic_purga_destroy(purga);
 
-    bloom_test(20000, 200000, 2000);
+    search_test(20000, 200000, 2000);
+    expiry_test();
+    moved_test();
 
     exit(EXIT_SUCCESS);
 }
@@ -23,7 +23,7 @@ main (void)
     lsquic_log_to_fstream(stderr, LLTS_HHMMSSMS);
     lsquic_set_log_level("debug");
 
-    lsquic_qlog_create_connection(0, NULL, NULL);
+    lsquic_qlog_create_connection(0, 0, NULL, NULL);
     struct in_addr local_addr = {.s_addr = htonl(0x0a000001),};
     struct sockaddr_in local =
     {
@@ -39,20 +39,20 @@ main (void)
         .sin_addr = peer_addr,
     };
     lsquic_cid_t cid = {};
-    lsquic_qlog_create_connection(&cid, (const struct sockaddr *)&local,
+    lsquic_qlog_create_connection(&cid, 123456, (const struct sockaddr *)&local,
                                         (const struct sockaddr *)&peer);
 
     lsquic_qlog_packet_rx(&cid, NULL, NULL, 0);
-    lsquic_qlog_hsk_completed(&cid);
-    lsquic_qlog_zero_rtt(&cid);
-    lsquic_qlog_check_certs(&cid, NULL, 0);
-
-    lsquic_qlog_version_negotiation(&cid, NULL, NULL);
-    lsquic_qlog_version_negotiation(&cid, "proposed", NULL);
-    lsquic_qlog_version_negotiation(&cid, "proposed", "Q035");
-    lsquic_qlog_version_negotiation(&cid, "proposed", "Q046");
-    lsquic_qlog_version_negotiation(&cid, "agreed", "Q044");
-    lsquic_qlog_version_negotiation(&cid, "agreed", "Q098");
-    lsquic_qlog_version_negotiation(&cid, "something else", "Q098");
+    lsquic_qlog_hsk_completed(&cid, 123456);
+    lsquic_qlog_zero_rtt(&cid, 123456);
+    lsquic_qlog_check_certs(&cid, 123456, NULL, 0);
+
+    lsquic_qlog_version_negotiation(&cid, 123456, NULL, NULL);
+    lsquic_qlog_version_negotiation(&cid, 123456, "proposed", NULL);
+    lsquic_qlog_version_negotiation(&cid, 123456, "proposed", "Q035");
+    lsquic_qlog_version_negotiation(&cid, 123456, "proposed", "Q046");
+    lsquic_qlog_version_negotiation(&cid, 123456, "agreed", "Q044");
+    lsquic_qlog_version_negotiation(&cid, 123456, "agreed", "Q098");
+    lsquic_qlog_version_negotiation(&cid, 123456, "something else", "Q098");
     return 0;
 }
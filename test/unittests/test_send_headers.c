@@ -168,13 +168,13 @@ init_test_objs (struct test_objs *tobjs, unsigned initial_conn_window,
     TAILQ_INIT(&tobjs->conn_pub.read_streams);
     TAILQ_INIT(&tobjs->conn_pub.write_streams);
     TAILQ_INIT(&tobjs->conn_pub.service_streams);
+    tobjs->conn_pub.enpub = &tobjs->eng_pub;
     lsquic_cfcw_init(&tobjs->conn_pub.cfcw, &tobjs->conn_pub,
                                                     initial_conn_window);
     lsquic_conn_cap_init(&tobjs->conn_pub.conn_cap, initial_conn_window);
     lsquic_alarmset_init(&tobjs->alset, 0);
     tobjs->conn_pub.mm = &tobjs->eng_pub.enp_mm;
     tobjs->conn_pub.lconn = &tobjs->lconn;
-    tobjs->conn_pub.enpub = &tobjs->eng_pub;
     tobjs->conn_pub.send_ctl = &tobjs->send_ctl;
     tobjs->conn_pub.packet_out_malo =
                         lsquic_malo_create(sizeof(struct lsquic_packet_out));
@@ -142,10 +142,54 @@ test_lsquic_set64 (void)
 }
 
 
+/* Copy a set by ranges, the way connection export does it */
+static void
+test_set64_ranges (void)
+{
+    lsquic_set64_t set, copy;
+    uint64_t i, low, high;
+    int n, s;
+
+    lsquic_set64_init(&set);
+    for (i = 0; i < 5000; ++i)
+        if (i % 1000 < 300 || i % 7 == 0)
+            (void) lsquic_set64_add(&set, i);
+
+    lsquic_set64_init(&copy);
+    copy.lowset = set.lowset;
+    for (n = 0; n < lsquic_set64_n_ranges(&set); ++n)
+    {
+        lsquic_set64_get_range(&set, n, &low, &high);
+        s = lsquic_set64_append_range(&copy, low, high);
+        assert(0 == s);
+    }
+
+    for (i = 0; i < 6000; ++i)
+        assert(lsquic_set64_has(&set, i) == lsquic_set64_has(&copy, i));
+
+    /* Out of order, overlapping, touching, and small ranges are rejected */
+    assert(-1 == lsquic_set64_append_range(&copy, 100, 200));
+    assert(-1 == lsquic_set64_append_range(&copy, high, high + 10));
+    assert(-1 == lsquic_set64_append_range(&copy, high + 1, high + 10));
+    assert(-1 == lsquic_set64_append_range(&copy, high + 10, high + 2));
+    lsquic_set64_cleanup(&copy);
+    lsquic_set64_init(&copy);
+    assert(-1 == lsquic_set64_append_range(&copy, 10, 100));
+    assert(0 == lsquic_set64_append_range(&copy, 64, 100));
+    assert(lsquic_set64_has(&copy, 64));
+    assert(lsquic_set64_has(&copy, 100));
+    assert(!lsquic_set64_has(&copy, 101));
+
+    lsquic_set64_cleanup(&copy);
+    lsquic_set64_cleanup(&set);
+}
+
+
 int
 main (void)
 {
     test_lsquic_set32();
     test_lsquic_set64();
+    test_set64_ranges();
     return 0;
 }
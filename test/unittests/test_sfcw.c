@@ -17,6 +17,126 @@
 #include "lsquic_stream.h"
 #include "lsquic_conn_public.h"
 #include "lsquic_conn.h"
+#include "lsquic_malo.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+
+
+/* When the engine is near its memory budget, updates are held back while
+ * there is unread data and the windows shrink.
+ */
+static void
+test_mem_tight (void)
+{
+    struct lsquic_sfcw fc;
+    struct lsquic_cfcw cfcw;
+    struct lsquic_conn lconn;
+    struct lsquic_conn_public conn_pub;
+    struct lsquic_engine_public enpub;
+    int s;
+
+    memset(&lconn, 0, sizeof(lconn));
+    LSCONN_INITIALIZE(&lconn);
+    memset(&conn_pub, 0, sizeof(conn_pub));
+    conn_pub.lconn = &lconn;
+    memset(&enpub, 0, sizeof(enpub));
+    enpub.enp_settings.es_max_cfcw = 1024 * 1024;
+    enpub.enp_settings.es_max_sfcw = 1024 * 1024;
+    enpub.enp_mem_high = 1000 * 1000;
+    conn_pub.enpub = &enpub;
+    lsquic_cfcw_init(&cfcw, &conn_pub, 64 * 1024);
+    lsquic_sfcw_init(&fc, 64 * 1024, &cfcw, &conn_pub, 0);
+
+    s = lsquic_sfcw_set_max_recv_off(&fc, 40000);
+    assert(s);
+    assert(40000 == enpub.enp_stream_bytes);
+
+    enpub.enp_mm.mem_out = enpub.enp_mem_high;
+    assert(lsquic_enpub_mem_tight(&enpub));
+
+    lsquic_sfcw_set_read_off(&fc, 20000);
+    assert(20000 == enpub.enp_stream_bytes);
+    s = lsquic_sfcw_fc_offsets_changed(&fc);
+    assert(("No update while there is unread data", !s));
+    s = lsquic_cfcw_fc_offsets_changed(&cfcw);
+    assert(!s);
+
+    lsquic_sfcw_set_read_off(&fc, 40000);
+    assert(0 == enpub.enp_stream_bytes);
+    s = lsquic_sfcw_fc_offsets_changed(&fc);
+    assert(("Update with a smaller window once data is read", s));
+    assert(32 * 1024 == fc.sf_max_recv_win);
+    assert(40000 + 32 * 1024 == lsquic_sfcw_get_fc_recv_off(&fc));
+    s = lsquic_cfcw_fc_offsets_changed(&cfcw);
+    assert(s);
+    assert(32 * 1024 == lsquic_cfcw_get_max_recv_window(&cfcw));
+
+    s = lsquic_sfcw_set_max_recv_off(&fc, 50000);
+    assert(s);
+    assert(10000 == enpub.enp_stream_bytes);
+    lsquic_cfcw_cleanup(&cfcw);
+    assert(0 == enpub.enp_stream_bytes);
+}
+
+
+/* Buffers returned to the memory manager's free lists no longer count
+ * against the budget: once they are returned, the engine is no longer
+ * tight, even though the memory is still cached.
+ */
+static void
+test_mem_tight_clears (void)
+{
+    struct lsquic_engine_public enpub;
+    struct lsquic_packet_out *packet_out;
+    void *pages[4], *in_buf;
+    size_t pools_before;
+    unsigned i;
+    int s;
+
+    memset(&enpub, 0, sizeof(enpub));
+    s = lsquic_mm_init(&enpub.enp_mm);
+    assert(0 == s);
+    enpub.enp_mem_high = 64 * 1024;
+    assert(!lsquic_enpub_mem_tight(&enpub));
+    assert(0 == lsquic_mm_mem_out(&enpub.enp_mm));
+
+    for (i = 0; i < sizeof(pages) / sizeof(pages[0]); ++i)
+    {
+        pages[i] = lsquic_mm_get_16k(&enpub.enp_mm);
+        assert(pages[i]);
+    }
+    assert(64 * 1024 == lsquic_mm_mem_out(&enpub.enp_mm));
+    assert(lsquic_enpub_mem_tight(&enpub));
+
+    pools_before = lsquic_mm_mem_used(&enpub.enp_mm);
+    for (i = 0; i < sizeof(pages) / sizeof(pages[0]); ++i)
+        lsquic_mm_put_16k(&enpub.enp_mm, pages[i]);
+    assert(0 == lsquic_mm_mem_out(&enpub.enp_mm));
+    assert(("Engine leaves tight state once buffers are returned",
+                                        !lsquic_enpub_mem_tight(&enpub)));
+    assert(("Returned pages are still cached",
+                    lsquic_mm_mem_used(&enpub.enp_mm) >= pools_before));
+
+    /* Unread stream data counts as well */
+    enpub.enp_stream_bytes = enpub.enp_mem_high;
+    assert(lsquic_enpub_mem_tight(&enpub));
+    enpub.enp_stream_bytes = 0;
+    assert(!lsquic_enpub_mem_tight(&enpub));
+
+    /* Packet buffers are returned in the same size class they were taken
+     * from, even if the size passed to put is smaller.
+     */
+    in_buf = lsquic_mm_get_packet_in_buf(&enpub.enp_mm, 1300);
+    assert(in_buf);
+    packet_out = lsquic_mm_get_packet_out(&enpub.enp_mm, NULL, 1200);
+    assert(packet_out);
+    assert(lsquic_mm_mem_out(&enpub.enp_mm) > 0);
+    lsquic_mm_put_packet_in_buf(&enpub.enp_mm, in_buf, 1200);
+    lsquic_mm_put_packet_out(&enpub.enp_mm, packet_out);
+    assert(0 == lsquic_mm_mem_out(&enpub.enp_mm));
+
+    lsquic_mm_cleanup(&enpub.enp_mm);
+}
 
 
 int
@@ -27,6 +147,7 @@ main (void)
     struct lsquic_sfcw fc;
     struct lsquic_conn lconn;
     struct lsquic_conn_public conn_pub;
+    struct lsquic_engine_public enpub;
     uint64_t recv_off;
     int s;
 
@@ -34,6 +155,8 @@ main (void)
     LSCONN_INITIALIZE(&lconn);
     memset(&conn_pub, 0, sizeof(conn_pub));
     conn_pub.lconn = &lconn;
+    memset(&enpub, 0, sizeof(enpub));
+    conn_pub.enpub = &enpub;
     lsquic_sfcw_init(&fc, INIT_WINDOW_SIZE, NULL, &conn_pub, 123);
 
     recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
@@ -60,5 +183,8 @@ main (void)
     assert(("Updated flow control receive window checks out",
         INIT_WINDOW_SIZE * 5 / 3 == recv_off));
 
+    test_mem_tight();
+    test_mem_tight_clears();
+
     return 0;
 }
@@ -0,0 +1,50 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lsquic_siphash.h"
+
+
+/* Expected values are those of CPython's bytes hash with PYTHONHASHSEED=0,
+ * which is SipHash-1-3 with all-zero key.  Input is bytes 0, 1, 2, ...
+ */
+static const struct {
+    size_t      len;
+    uint64_t    hash;
+} tests[] = {
+    {  1, 0x68a914128e01e473ULL, },
+    {  7, 0x2f098ab0c751325aULL, },
+    {  8, 0xead411e67ebe2eeaULL, },
+    {  9, 0x75927f9d95124362ULL, },
+    { 15, 0xf30eb725bb91c9eaULL, },
+    { 16, 0x8972188433a5c5b7ULL, },
+    { 20, 0x639e355ae68c0100ULL, },
+};
+
+
+int
+main (void)
+{
+    unsigned char key[LSQUIC_SIPHASH_KEY_SZ], data[32];
+    uint64_t hash;
+    unsigned i;
+
+    memset(key, 0, sizeof(key));
+    for (i = 0; i < sizeof(data); ++i)
+        data[i] = i;
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+        assert(tests[i].hash == lsquic_siphash13(key, data, tests[i].len));
+
+    assert(0xb1b1f2e707e4ac8aULL
+                                == lsquic_siphash13(key, "hello world", 11));
+
+    /* Different key, different hash */
+    hash = lsquic_siphash13(key, data, 8);
+    key[15] = 1;
+    assert(hash != lsquic_siphash13(key, data, 8));
+
+    return 0;
+}
@@ -334,13 +334,13 @@ init_test_objs (struct test_objs *tobjs, unsigned initial_conn_window,
     TAILQ_INIT(&tobjs->conn_pub.read_streams);
     TAILQ_INIT(&tobjs->conn_pub.write_streams);
     TAILQ_INIT(&tobjs->conn_pub.service_streams);
+    tobjs->conn_pub.enpub = &tobjs->eng_pub;
     lsquic_cfcw_init(&tobjs->conn_pub.cfcw, &tobjs->conn_pub,
                                                     initial_conn_window);
     lsquic_conn_cap_init(&tobjs->conn_pub.conn_cap, initial_conn_window);
     lsquic_alarmset_init(&tobjs->alset, 0);
     tobjs->conn_pub.mm = &tobjs->eng_pub.enp_mm;
     tobjs->conn_pub.lconn = &tobjs->lconn;
-    tobjs->conn_pub.enpub = &tobjs->eng_pub;
     tobjs->conn_pub.send_ctl = &tobjs->send_ctl;
     tobjs->conn_pub.packet_out_malo =
                         lsquic_malo_create(sizeof(struct lsquic_packet_out));
@@ -1441,6 +1441,128 @@ test_writev (void)
 }
 
 
+static void
+count_release (void *ctx)
+{
+    ++*(unsigned *) ctx;
+}
+
+
+/* Data written by reference is sent in order with other data and is
+ * released once packetized or when the stream is destroyed.
+ */
+static void
+test_write_ref (void)
+{
+    struct test_objs tobjs;
+    lsquic_stream_t *stream;
+    ssize_t n;
+    unsigned n_released;
+    unsigned char buf_in[0x4000];
+    unsigned char buf_out[0x4000 + 10];
+    int fin;
+    const struct iovec iov[] = {
+        { .iov_base = buf_in,          .iov_len = 0x1000, },
+        { .iov_base = buf_in + 0x1000, .iov_len = 0,      },
+        { .iov_base = buf_in + 0x1000, .iov_len = 0x3000, },
+    };
+
+    memset(buf_in,          'A', 0x2000);
+    memset(buf_in + 0x2000, 'B', 0x2000);
+
+    init_test_objs(&tobjs, UINT_MAX, UINT_MAX, NULL);
+    stream = new_stream_ext(&tobjs, 12345, 0x8000);
+    n_released = 0;
+    n = lsquic_stream_write(stream, "head", 4);
+    assert(4 == n);
+    n = lsquic_stream_write_ref(stream, iov, 3, count_release, &n_released);
+    assert(0x4000 == n);
+    assert(1 == n_released);
+    n = lsquic_stream_write(stream, "tail!!", 6);
+    assert(6 == n);
+    lsquic_stream_flush(stream);
+    n = read_from_scheduled_packets(&tobjs.send_ctl, stream->id, buf_out,
+                                                sizeof(buf_out), 0, &fin, 0);
+    assert(0x4000 + 10 == n);
+    assert(0 == memcmp(buf_out, "head", 4));
+    assert(0 == memcmp(buf_out + 4, buf_in, 0x4000));
+    assert(0 == memcmp(buf_out + 4 + 0x4000, "tail!!", 6));
+    assert(!fin);
+    lsquic_stream_destroy(stream);
+    deinit_test_objs(&tobjs);
+
+    /* Flow control keeps part of the data unsent: */
+    init_test_objs(&tobjs, UINT_MAX, UINT_MAX, NULL);
+    stream = new_stream_ext(&tobjs, 12345, 0x1000);
+    n_released = 0;
+    n = lsquic_stream_write_ref(stream, iov, 3, count_release, &n_released);
+    assert(0x4000 == n);
+    assert(0 == n_released);
+    assert(0 == lsquic_stream_write_avail(stream));
+    n = lsquic_stream_write(stream, "tail!!", 6);
+    assert(0 == n);
+    lsquic_stream_destroy(stream);
+    assert(1 == n_released);
+    deinit_test_objs(&tobjs);
+
+    /* HTTP/3 stream: referenced data is wrapped in DATA frames */
+    {
+        struct lsquic_http_header header = {
+            .name = { ":method", 7, },
+            .value = { "GET", 3, },
+        };
+        struct lsquic_http_headers headers = { 1, &header, };
+        const unsigned char *src;
+        unsigned char *dst;
+        unsigned frame_type;
+        uint64_t sz;
+        int s;
+
+        init_test_objs(&tobjs, UINT_MAX, UINT_MAX,
+                                                &lsquic_parse_funcs_ietf_v1);
+        tobjs.ctor_flags |= SCF_HTTP|SCF_IETF;
+        tobjs.lconn.cn_flags |= LSCONN_IETF;
+        stream = new_stream_ext(&tobjs, 0, 0x8000);
+        s = lsquic_stream_send_headers(stream, &headers, 0);
+        assert(0 == s);
+        n_released = 0;
+        n = lsquic_stream_write_ref(stream, iov, 3, count_release, &n_released);
+        assert(0x4000 == n);
+        n = lsquic_stream_write(stream, "tail!!", 6);
+        assert(6 == n);
+        lsquic_stream_flush(stream);
+        assert(1 == n_released);
+        n = read_from_scheduled_packets(&tobjs.send_ctl, stream->id, buf_out,
+                                                sizeof(buf_out), 0, &fin, 0);
+        assert(n > 0x4000 + 6);
+        src = buf_out;
+        dst = buf_out;
+        frame_type = *src++;
+        assert(HQFT_HEADERS == frame_type);
+        s = vint_read(src, buf_out + n, &sz);
+        assert(s > 0);
+        src += s + sz;
+        while (src < buf_out + n)
+        {
+            frame_type = *src++;
+            assert(HQFT_DATA == frame_type);
+            s = vint_read(src, buf_out + n, &sz);
+            assert(s > 0);
+            src += s;
+            assert(src + sz <= buf_out + n);
+            memmove(dst, src, sz);
+            dst += sz;
+            src += sz;
+        }
+        assert(0x4000 + 6 == dst - buf_out);
+        assert(0 == memcmp(buf_out, buf_in, 0x4000));
+        assert(0 == memcmp(buf_out + 0x4000, "tail!!", 6));
+        lsquic_stream_destroy(stream);
+        deinit_test_objs(&tobjs);
+    }
+}
+
+
 static void
 test_prio_conversion (void)
 {
@@ -3098,6 +3220,8 @@ main (int argc, char **argv)
 
     test_writev();
 
+    test_write_ref();
+
     test_prio_conversion();
 
     test_read_in_middle();
@@ -0,0 +1,160 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic.h"
+#include "lsquic_stream_tab.h"
+
+#define MAX_ID 40000
+
+/* We never dereference stream pointers, so use fake ones */
+static struct lsquic_stream *
+fake_stream (lsquic_stream_id_t id)
+{
+    return (struct lsquic_stream *) (uintptr_t) ((id + 1) * 8);
+}
+
+
+/* The set of streams the connection has: the all_streams hash */
+static unsigned char s_present[MAX_ID];
+
+
+/* Lookup the way the connection does it: table first, then the hash */
+static struct lsquic_stream *
+find (const struct stream_tab *tab, lsquic_stream_id_t id, int *in_window)
+{
+    struct lsquic_stream *stream;
+
+    *in_window = lsquic_stab_find(tab, id, &stream);
+    if (*in_window)
+        return stream;
+    return id < MAX_ID && s_present[id] ? fake_stream(id) : NULL;
+}
+
+
+static void
+add (struct stream_tab *tab, lsquic_stream_id_t id)
+{
+    assert(!s_present[id]);
+    s_present[id] = 1;
+    lsquic_stab_insert(tab, id, fake_stream(id));
+}
+
+
+static void
+del (struct stream_tab *tab, lsquic_stream_id_t id)
+{
+    assert(s_present[id]);
+    s_present[id] = 0;
+    lsquic_stab_remove(tab, id);
+}
+
+
+static void
+verify (const struct stream_tab *tab, lsquic_stream_id_t max_id)
+{
+    lsquic_stream_id_t id;
+    int in_window;
+
+    for (id = 0; id < max_id; ++id)
+        assert(find(tab, id, &in_window)
+                                == (s_present[id] ? fake_stream(id) : NULL));
+}
+
+
+/* Typical request streams: each lives for a while, then goes away */
+static void
+test_sequential (void)
+{
+    struct stream_tab tab;
+    lsquic_stream_id_t id;
+    int in_window;
+    const unsigned n_concurrent = 100;
+
+    memset(&tab, 0, sizeof(tab));
+    memset(s_present, 0, sizeof(s_present));
+
+    for (id = 0; id < 20000; id += 4)
+    {
+        add(&tab, id);
+        if (id >= n_concurrent * 4)
+            del(&tab, id - n_concurrent * 4);
+        /* Recent streams are always in the window */
+        (void) find(&tab, id, &in_window);
+        assert(in_window);
+    }
+    verify(&tab, 20000);
+    /* Window did not grow past what is needed */
+    assert(lsquic_stab_mem_used(&tab) <= 256 * sizeof(void *));
+
+    lsquic_stab_cleanup(&tab);
+}
+
+
+/* A long-lived stream makes the window grow, and when the window is as
+ * large as it gets, the stream falls out of it and is found in the hash.
+ */
+static void
+test_long_lived (void)
+{
+    struct stream_tab tab;
+    lsquic_stream_id_t id;
+    int in_window;
+
+    memset(&tab, 0, sizeof(tab));
+    memset(s_present, 0, sizeof(s_present));
+
+    add(&tab, 0);
+    for (id = 4; id < 4 * (STAB_MAX_WINDOW + 100); id += 4)
+    {
+        add(&tab, id);
+        del(&tab, id);
+    }
+    assert(find(&tab, 0, &in_window) == fake_stream(0));
+    assert(!in_window);
+    verify(&tab, 4 * (STAB_MAX_WINDOW + 100));
+
+    lsquic_stab_cleanup(&tab);
+}
+
+
+/* All four types at once, out of order, with big jumps */
+static void
+test_random (void)
+{
+    struct stream_tab tab;
+    lsquic_stream_id_t id;
+    unsigned i;
+
+    memset(&tab, 0, sizeof(tab));
+    memset(s_present, 0, sizeof(s_present));
+    srand(1);
+
+    for (i = 0; i < 100000; ++i)
+    {
+        id = rand() % 100 < 99 ? (i / 4) * 4 + rand() % 400 : rand();
+        id %= MAX_ID;
+        if (s_present[id])
+            del(&tab, id);
+        else
+            add(&tab, id);
+        if (i % 10007 == 0)
+            verify(&tab, MAX_ID);
+    }
+    verify(&tab, MAX_ID);
+
+    lsquic_stab_cleanup(&tab);
+    assert(0 == lsquic_stab_mem_used(&tab));
+}
+
+
+int
+main (void)
+{
+    test_sequential();
+    test_long_lived();
+    test_random();
+    return 0;
+}
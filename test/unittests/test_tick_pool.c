@@ -0,0 +1,88 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic_mt.h"
+#include "lsquic_tick_pool.h"
+
+
+#if LSQUIC_TICK_THREADS
+
+#define MAX_JOBS 10000
+
+struct job_ctx
+{
+    unsigned        counts[MAX_JOBS];
+};
+
+
+static void
+job (void *ctx, unsigned idx)
+{
+    struct job_ctx *const jc = ctx;
+    volatile unsigned n;
+
+    /* Uneven work makes stealing more likely */
+    for (n = 0; n < (idx % 7) * 1000; ++n)
+        ;
+    ++jc->counts[idx];
+}
+
+
+/* Each job is run exactly once, no matter how many jobs there are */
+static void
+test_run (unsigned n_threads, unsigned n_jobs)
+{
+    struct tick_pool *pool;
+    struct job_ctx *jc;
+    unsigned i, round;
+
+    assert(n_jobs <= MAX_JOBS);
+    pool = lsquic_tp_new(n_threads);
+    assert(pool);
+    assert(lsquic_tp_n_threads(pool) == n_threads);
+    jc = malloc(sizeof(*jc));
+    assert(jc);
+
+    for (round = 0; round < 3; ++round)
+    {
+        memset(jc->counts, 0, sizeof(jc->counts));
+        lsquic_tp_run(pool, job, jc, n_jobs);
+        for (i = 0; i < n_jobs; ++i)
+            assert(jc->counts[i] == 1);
+        for ( ; i < MAX_JOBS; ++i)
+            assert(jc->counts[i] == 0);
+    }
+
+    free(jc);
+    lsquic_tp_destroy(pool);
+}
+
+
+int
+main (void)
+{
+    assert(NULL == lsquic_tp_new(1));
+    test_run(2, 0);
+    test_run(2, 1);
+    test_run(2, 2);
+    test_run(4, 3);
+    test_run(4, 1000);
+    test_run(8, MAX_JOBS);
+    test_run(3, 7);
+    return 0;
+}
+
+
+#else
+
+
+int
+main (void)
+{
+    return 0;
+}
+
+
+#endif
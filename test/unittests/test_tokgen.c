@@ -0,0 +1,314 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test retry tokens: round trip, expiry, tampering, and peer address.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#else
+#include "vc_compat.h"
+#endif
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_stock_shi.h"
+#include "lsquic_tokgen.h"
+
+
+#define NOW (1600000000ull * 1000000)
+#define SEC 1000000ull
+
+
+static void
+init_enpub (struct lsquic_engine_public *enpub, struct stock_shared_hash *hash)
+{
+    memset(enpub, 0, sizeof(*enpub));
+    enpub->enp_shi = &stock_shi;
+    enpub->enp_shi_ctx = hash;
+}
+
+
+static void
+set_addr4 (struct sockaddr_in *sin, uint32_t addr, unsigned short port)
+{
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(addr);
+    sin->sin_port = htons(port);
+}
+
+
+static void
+set_addr6 (struct sockaddr_in6 *sin6, unsigned char last_byte)
+{
+    memset(sin6, 0, sizeof(*sin6));
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_addr.s6_addr[0] = 0x20;
+    sin6->sin6_addr.s6_addr[1] = 0x01;
+    sin6->sin6_addr.s6_addr[15] = last_byte;
+    sin6->sin6_port = htons(443);
+}
+
+
+static void
+init_cid (lsquic_cid_t *cid, unsigned len)
+{
+    unsigned i;
+
+    memset(cid, 0, sizeof(*cid));
+    cid->len = len;
+    for (i = 0; i < len; ++i)
+        cid->idbuf[i] = (uint8_t) (0xA0 + i);
+}
+
+
+static int
+validate (struct token_generator *tokgen, const unsigned char *token,
+            size_t token_sz, const void *sa, lsquic_time_t now,
+            const lsquic_cid_t *expected_odcid)
+{
+    lsquic_cid_t odcid;
+    int s;
+
+    memset(&odcid, 0xFF, sizeof(odcid));
+    s = lsquic_tg_validate_retry(tokgen, token, token_sz, sa, &odcid, now);
+    if (0 == s && expected_odcid)
+        assert(LSQUIC_CIDS_EQ(&odcid, expected_odcid));
+    return s;
+}
+
+
+static void
+test_round_trip (struct token_generator *tokgen)
+{
+    unsigned char token[MAX_RETRY_TOKEN_SZ];
+    struct sockaddr_in sin;
+    struct sockaddr_in6 sin6;
+    lsquic_cid_t odcid;
+    ssize_t sz;
+    unsigned len;
+    int s;
+
+    set_addr4(&sin, 0x0A000001, 443);
+    for (len = 0; len <= MAX_CID_LEN; ++len)
+    {
+        init_cid(&odcid, len);
+        sz = lsquic_tg_generate_retry(tokgen, token, sizeof(token), &odcid,
+                                                (struct sockaddr *) &sin, NOW);
+        assert(sz > 0 && (size_t) sz <= sizeof(token));
+        s = validate(tokgen, token, (size_t) sz, &sin, NOW, &odcid);
+        assert(0 == s);
+    }
+
+    init_cid(&odcid, 8);
+    set_addr6(&sin6, 1);
+    sz = lsquic_tg_generate_retry(tokgen, token, sizeof(token), &odcid,
+                                                (struct sockaddr *) &sin6, NOW);
+    assert(sz > 0);
+    s = validate(tokgen, token, (size_t) sz, &sin6, NOW + SEC, &odcid);
+    assert(0 == s);
+
+    /* Each token is unique */
+    {
+        unsigned char token2[MAX_RETRY_TOKEN_SZ];
+        ssize_t sz2;
+
+        sz2 = lsquic_tg_generate_retry(tokgen, token2, sizeof(token2), &odcid,
+                                                (struct sockaddr *) &sin6, NOW);
+        assert(sz2 == sz);
+        assert(0 != memcmp(token, token2, (size_t) sz));
+    }
+
+    /* Buffer too small */
+    sz = lsquic_tg_generate_retry(tokgen, token, 4, &odcid,
+                                                (struct sockaddr *) &sin, NOW);
+    assert(-1 == sz);
+}
+
+
+static void
+test_expiry (struct token_generator *tokgen)
+{
+    unsigned char token[MAX_RETRY_TOKEN_SZ];
+    struct sockaddr_in sin;
+    lsquic_cid_t odcid;
+    ssize_t sz;
+    int s;
+
+    set_addr4(&sin, 0x0A000001, 443);
+    init_cid(&odcid, 8);
+    sz = lsquic_tg_generate_retry(tokgen, token, sizeof(token), &odcid,
+                                                (struct sockaddr *) &sin, NOW);
+    assert(sz > 0);
+
+    s = validate(tokgen, token, (size_t) sz, &sin,
+                                        NOW + RETRY_TOKEN_TTL * SEC, &odcid);
+    assert(0 == s);
+    s = validate(tokgen, token, (size_t) sz, &sin,
+                                NOW + (RETRY_TOKEN_TTL + 1) * SEC, NULL);
+    assert(-1 == s);
+
+    /* Tokens from the future are not accepted, either */
+    s = validate(tokgen, token, (size_t) sz, &sin, NOW - SEC, NULL);
+    assert(-1 == s);
+}
+
+
+static void
+test_tampered (struct token_generator *tokgen)
+{
+    unsigned char token[MAX_RETRY_TOKEN_SZ + 1];
+    struct sockaddr_in sin;
+    lsquic_cid_t odcid;
+    ssize_t sz;
+    size_t i;
+    int s;
+
+    set_addr4(&sin, 0x0A000001, 443);
+    init_cid(&odcid, 8);
+    sz = lsquic_tg_generate_retry(tokgen, token, sizeof(token), &odcid,
+                                                (struct sockaddr *) &sin, NOW);
+    assert(sz > 0);
+
+    /* Any flipped bit -- in the nonce, ciphertext, or tag -- is detected */
+    for (i = 0; i < (size_t) sz; ++i)
+    {
+        token[i] ^= 0x01;
+        s = validate(tokgen, token, (size_t) sz, &sin, NOW, NULL);
+        assert(-1 == s);
+        token[i] ^= 0x01;
+    }
+
+    /* Truncated and extended tokens */
+    s = validate(tokgen, token, (size_t) sz - 1, &sin, NOW, NULL);
+    assert(-1 == s);
+    s = validate(tokgen, token, 0, &sin, NOW, NULL);
+    assert(-1 == s);
+    token[sz] = 0;
+    s = validate(tokgen, token, (size_t) sz + 1, &sin, NOW, NULL);
+    assert(-1 == s);
+
+    /* Untouched token is still good */
+    s = validate(tokgen, token, (size_t) sz, &sin, NOW, &odcid);
+    assert(0 == s);
+}
+
+
+static void
+test_address_mismatch (struct token_generator *tokgen)
+{
+    unsigned char token[MAX_RETRY_TOKEN_SZ];
+    struct sockaddr_in sin, other_sin;
+    struct sockaddr_in6 sin6, other_sin6;
+    lsquic_cid_t odcid;
+    ssize_t sz;
+    int s;
+
+    init_cid(&odcid, 8);
+
+    set_addr4(&sin, 0x0A000001, 443);
+    sz = lsquic_tg_generate_retry(tokgen, token, sizeof(token), &odcid,
+                                                (struct sockaddr *) &sin, NOW);
+    assert(sz > 0);
+    /* Only the IP address is bound to the token, not the port */
+    set_addr4(&other_sin, 0x0A000001, 8443);
+    s = validate(tokgen, token, (size_t) sz, &other_sin, NOW, &odcid);
+    assert(0 == s);
+    set_addr4(&other_sin, 0x0A000002, 443);
+    s = validate(tokgen, token, (size_t) sz, &other_sin, NOW, NULL);
+    assert(-1 == s);
+    set_addr6(&other_sin6, 1);
+    s = validate(tokgen, token, (size_t) sz, &other_sin6, NOW, NULL);
+    assert(-1 == s);
+
+    set_addr6(&sin6, 1);
+    sz = lsquic_tg_generate_retry(tokgen, token, sizeof(token), &odcid,
+                                                (struct sockaddr *) &sin6, NOW);
+    assert(sz > 0);
+    set_addr6(&other_sin6, 2);
+    s = validate(tokgen, token, (size_t) sz, &other_sin6, NOW, NULL);
+    assert(-1 == s);
+    s = validate(tokgen, token, (size_t) sz, &sin, NOW, NULL);
+    assert(-1 == s);
+}
+
+
+/* Token generators that share state via the shared hash accept each
+ * other's tokens; those that do not, don't.
+ */
+static void
+test_shared_key (struct stock_shared_hash *hash,
+                                            struct token_generator *tokgen)
+{
+    struct lsquic_engine_public enpub2, enpub3;
+    struct stock_shared_hash *hash3;
+    struct token_generator *tokgen2, *tokgen3;
+    unsigned char token[MAX_RETRY_TOKEN_SZ];
+    struct sockaddr_in sin;
+    lsquic_cid_t odcid;
+    ssize_t sz;
+    int s;
+
+    init_enpub(&enpub2, hash);
+    tokgen2 = lsquic_tg_new(&enpub2);
+    assert(tokgen2);
+    hash3 = stock_shared_hash_new();
+    assert(hash3);
+    init_enpub(&enpub3, hash3);
+    tokgen3 = lsquic_tg_new(&enpub3);
+    assert(tokgen3);
+
+    set_addr4(&sin, 0x0A000001, 443);
+    init_cid(&odcid, 8);
+    sz = lsquic_tg_generate_retry(tokgen, token, sizeof(token), &odcid,
+                                                (struct sockaddr *) &sin, NOW);
+    assert(sz > 0);
+    s = validate(tokgen2, token, (size_t) sz, &sin, NOW, &odcid);
+    assert(0 == s);
+    s = validate(tokgen3, token, (size_t) sz, &sin, NOW, NULL);
+    assert(-1 == s);
+
+    lsquic_tg_destroy(tokgen3);
+    stock_shared_hash_destroy(hash3);
+    lsquic_tg_destroy(tokgen2);
+}
+
+
+int
+main (void)
+{
+    struct lsquic_engine_public enpub;
+    struct stock_shared_hash *hash;
+    struct token_generator *tokgen;
+
+    if (0 != lsquic_global_init(LSQUIC_GLOBAL_SERVER))
+        return 1;
+
+    hash = stock_shared_hash_new();
+    assert(hash);
+    init_enpub(&enpub, hash);
+    tokgen = lsquic_tg_new(&enpub);
+    assert(tokgen);
+
+    test_round_trip(tokgen);
+    test_expiry(tokgen);
+    test_tampered(tokgen);
+    test_address_mismatch(tokgen);
+    test_shared_key(hash, tokgen);
+
+    lsquic_tg_destroy(tokgen);
+    stock_shared_hash_destroy(hash);
+    lsquic_global_cleanup();
+    return 0;
+}